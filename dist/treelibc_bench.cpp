@@ -0,0 +1,708 @@
+/*
+ =============================================================================
+ Name        : treelibc_bench.cpp
+ Author      : David T. Silvers Sr.
+ Contact     : davidtsilvers@aol.com
+ Created     : 2026-10-16
+ Updated     : 2026-10-16
+ Version     : 4.00
+ License     : GNU LGPL
+ Description : Benchmark of treelibc against tsearch() and std::map
+               Times insert, lookup hit and miss, batched lookup, update, treeArray(),
+               treeArraySorted(), delete and treeFree() for each size, key
+               distribution, key type and copy or address storage. Prints
+               one CSV row, or JSON object, per operation with throughput
+               and latency percentiles. Data comes from a seeded generator,
+               runs with the same arguments use the same keys in the same
+               order. Lookup counts are checked, a wrong result exits 1.
+               make bench BENCH_ARGS="--sizes=1e3,1e6 --format=json"
+               SEE: treelibc.c AND treelibc.h
+
+ Copyright   : Copyright 2014 by David T. Silvers Sr.
+
+	This file is part of treelibc.
+
+    treelibc is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    treelibc is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with treelibc. If not, see <http://www.gnu.org/licenses/>.
+  =============================================================================
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+#include <search.h>
+#include "treelibc.h"
+
+#define BENCH_STRIDE_MIN 8 /* at most 1 op in 8 pays for clock reads */
+#define BENCH_KEY_TEXT 17 /* 16 hex digits and NUL, fixed width so string order equals number order */
+#define BENCH_BATCH 64 /* keys per lookup_batch call */
+#define BENCH_SNAPSHOT 1024 /* writes between snapshots of engine snapshot, each one held until the next */
+#define BENCH_PAGES "treelibc_bench.pages" /* file of engine paged in working directory, removed when run ends */
+#define BENCH_PAGES_MEMORY (4 << 20) /* buffer pool of engine paged, runs of 1e5 keys and up spill to the file */
+
+/* ------------------------------ workload ------------------------------ */
+
+struct Options {
+	std::vector<unsigned long> sizes;
+	std::vector<std::string> engines, dists, keys, storages;
+	uint64_t ui64Seed;
+	unsigned long ulSamples; /* latency samples per operation at most */
+	double dZipf; /* skew, below 1 */
+	bool bJson;
+};
+
+static uint64_t mix(uint64_t ui64) { /* splitmix64 finalizer, one to one so distinct inputs stay distinct */
+	ui64 = (ui64 ^ (ui64 >> 30)) * 0xBF58476D1CE4E5B9ull;
+	ui64 = (ui64 ^ (ui64 >> 27)) * 0x94D049BB133111EBull;
+return(ui64 ^ (ui64 >> 31));
+}
+
+struct Random { /* same sequence on every platform, unlike <random> distributions */
+	uint64_t ui64State;
+	explicit Random(uint64_t ui64Seed) : ui64State(ui64Seed) {}
+	uint64_t next() { return(mix(ui64State += 0x9E3779B97F4A7C15ull)); }
+	double unit() { return((next() >> 11) * (1.0 / 9007199254740992.0)); } /* [0, 1) */
+	unsigned long below(unsigned long ul) { return((unsigned long)(unit() * ul)); }
+};
+
+static void shuffle(std::vector<unsigned long> &v, Random &random) { /* Fisher-Yates */
+	for(unsigned long ul = v.size(); ul > 1; ul--)
+		std::swap(v[ul - 1], v[random.below(ul)]);
+}
+
+struct Zipf { /* YCSB generator (Gray et al.), rank 0 most frequent, no table of n entries */
+	double dTheta, dZetan, dAlpha, dEta, dHalf;
+	unsigned long ulN;
+	Zipf(unsigned long ulN_, double dTheta_) : dTheta(dTheta_), ulN(ulN_) {
+		double dZeta2 = 1.0 + std::pow(0.5, dTheta);
+		dZetan = 0.0;
+		for(unsigned long ul = 1; ul <= ulN; ul++)
+			dZetan += 1.0 / std::pow((double)ul, dTheta);
+		dAlpha = 1.0 / (1.0 - dTheta);
+		dEta = (1.0 - std::pow(2.0 / ulN, 1.0 - dTheta)) / (1.0 - (dZeta2 / dZetan));
+		dHalf = std::pow(0.5, dTheta);
+	}
+	unsigned long next(Random &random) {
+		double dU = random.unit(), dUz = dU * dZetan;
+		if((dUz < 1.0) || (ulN < 2))
+			return(0);
+		if(dUz < 1.0 + dHalf)
+			return(1);
+		return(std::min(ulN - 1, (unsigned long)(ulN * std::pow((dEta * dU) - dEta + 1.0, dAlpha))));
+	}
+};
+
+struct Workload { /* keys in insertion order, absent keys, and the index streams operations follow */
+	unsigned long ulN;
+	bool bString;
+	std::vector<uint64_t> vKeys, vMiss, vValues, vUpdates;
+	std::vector<char> vText, vMissText; /* string keys, BENCH_KEY_TEXT bytes each */
+	std::vector<unsigned long> vAccess; /* lookups and updates */
+	std::vector<unsigned long> vDelete; /* distinct, first half deleted */
+
+	const void *key(unsigned long ul) const { return(bString ? (const void*)&vText[ul * BENCH_KEY_TEXT] : (const void*)&vKeys[ul]); }
+	const void *miss(unsigned long ul) const { return(bString ? (const void*)&vMissText[ul * BENCH_KEY_TEXT] : (const void*)&vMiss[ul]); }
+	size_t keySize() const { return(bString ? BENCH_KEY_TEXT - 1 : sizeof(uint64_t)); }
+
+	Workload(unsigned long ulN_, const std::string &sDist, bool bString_, const Options &opt) : ulN(ulN_), bString(bString_) {
+		Random random(opt.ui64Seed ^ mix(ulN) ^ std::hash<std::string>()(sDist));
+		unsigned long ul;
+		vKeys.resize(ulN);
+		vMiss.resize(ulN);
+		vValues.resize(ulN);
+		vUpdates.resize(ulN);
+		for(ul = 0; ul < ulN; ul++) { /* even numbers present, odd ones absent */
+			vKeys[ul] = (sDist == "seq") ? 2 * (uint64_t)ul : mix((2 * (uint64_t)ul) ^ opt.ui64Seed);
+			vMiss[ul] = (sDist == "seq") ? (2 * (uint64_t)ul) + 1 : mix(((2 * (uint64_t)ul) + 1) ^ opt.ui64Seed);
+			vValues[ul] = vKeys[ul] ^ 0x5555;
+			vUpdates[ul] = vKeys[ul] ^ 0xAAAA;
+		}
+		if(bString) {
+			vText.resize(ulN * BENCH_KEY_TEXT);
+			vMissText.resize(ulN * BENCH_KEY_TEXT);
+			for(ul = 0; ul < ulN; ul++) {
+				snprintf(&vText[ul * BENCH_KEY_TEXT], BENCH_KEY_TEXT, "%016llx", (unsigned long long)vKeys[ul]);
+				snprintf(&vMissText[ul * BENCH_KEY_TEXT], BENCH_KEY_TEXT, "%016llx", (unsigned long long)vMiss[ul]);
+			}
+		}
+		vDelete.resize(ulN);
+		for(ul = 0; ul < ulN; ul++)
+			vDelete[ul] = ul;
+		if(sDist != "seq")
+			shuffle(vDelete, random);
+		vAccess = vDelete;
+		if(sDist == "random")
+			shuffle(vAccess, random);
+		else if(sDist == "zipf") { /* hot ranks land on scattered keys through the shuffled order */
+			Zipf zipf(ulN, opt.dZipf);
+			for(ul = 0; ul < ulN; ul++)
+				vAccess[ul] = vDelete[zipf.next(random)];
+		}
+	}
+};
+
+/* ------------------------------- engines ------------------------------- */
+
+struct Engine { /* one container under test, keys and values passed by address */
+	virtual ~Engine() {}
+	virtual bool insert(const void *pKey, size_t sizeTkey, uint64_t *pValue) = 0;
+	virtual const uint64_t *find(const void *pKey) = 0;
+	virtual void findBatch(const void **ppKeys, unsigned long ulLen, const uint64_t **ppValues) { /* loop unless engine batches */
+		for(unsigned long ul = 0; ul < ulLen; ul++)
+			ppValues[ul] = find(ppKeys[ul]);
+	}
+	virtual bool update(const void *pKey, uint64_t *pValue) = 0;
+	virtual bool erase(const void *pKey) = 0;
+	virtual bool array(size_t *pSizeT) = 0; /* keys in insertion order. Return: false = not supported */
+	virtual bool arraySorted(size_t *pSizeT) = 0;
+	virtual void clear() = 0;
+};
+
+class TreeEngine : public Engine { /* treelibc through the C API, built-in key kinds */
+	Tree tree, snap;
+	bool bCopy, bSnap, bPaged;
+	int iThreads; /* whole tree work, 1 = single thread functions, 0 = treeParallel*() one thread per core */
+	unsigned long ulWrites;
+	std::vector<uint64_t> vBatch; /* paged engine lookup_batch values */
+	void write() { /* snapshot engine: writes copy what the held snapshot shares */
+		if(!bSnap || ((ulWrites++ % BENCH_SNAPSHOT) != 0))
+			return;
+		treeFree(&snap);
+		if(treeSnapshot(&tree, &snap) == NULL) {
+			fputs("ERROR: treeSnapshot() failed!\n", stderr);
+			exit(EXIT_FAILURE);
+		}
+	}
+public:
+	TreeEngine(bool bString, bool bCopy_, int iMode, int iThreads_ = 1, bool bHash = false, bool bSnap_ = false, bool bPaged_ = false)
+	: bCopy(bCopy_ || bPaged_), bSnap(bSnap_), bPaged(bPaged_), iThreads(iThreads_), ulWrites(0) { /* paged values are always copies */
+		if(bPaged)
+			remove(BENCH_PAGES);
+		if((treeInitKey(&tree, bString ? TREE_KEY_STRING : TREE_KEY_UINT64, 0, iMode) == NULL)
+		|| (treeInitKey(&snap, bString ? TREE_KEY_STRING : TREE_KEY_UINT64, 0, iMode) == NULL)
+		|| (bHash && !treeHashIndex(&tree, 1, NULL)) || (bPaged && (treeOpen(&tree, BENCH_PAGES, BENCH_PAGES_MEMORY) == NULL))) {
+			fputs("ERROR: treeInitKey() failed!\n", stderr);
+			exit(EXIT_FAILURE);
+		}
+	}
+	~TreeEngine() { clear(); }
+	bool insert(const void *pKey, size_t sizeTkey, uint64_t *pValue) {
+		write();
+		return(treeInsert(&tree, (void*)pKey, bCopy ? sizeTkey : 0, pValue, bCopy ? sizeof(*pValue) : 0) == 1);
+	}
+	const uint64_t *find(const void *pKey) { return(static_cast<const uint64_t*>(treeValue(&tree, pKey))); }
+	void findBatch(const void **ppKeys, unsigned long ulLen, const uint64_t **ppValues) {
+		if(bPaged) { /* a paged value lasts until the next call, copied out one by one */
+			vBatch.resize(ulLen);
+			for(unsigned long ul = 0; ul < ulLen; ul++) {
+				const uint64_t *pui64 = find(ppKeys[ul]);
+				ppValues[ul] = (pui64 != NULL) ? &(vBatch[ul] = *pui64) : NULL;
+			}
+			return;
+		}
+		treeValueBatch(&tree, const_cast<void**>(ppKeys), ulLen, reinterpret_cast<void**>(const_cast<uint64_t**>(ppValues)));
+	}
+	bool update(const void *pKey, uint64_t *pValue) {
+		write();
+		return(treeUpdate(&tree, pKey, pValue, bCopy ? sizeof(*pValue) : 0) == 1);
+	}
+	bool erase(const void *pKey) {
+		write();
+		return(treeDelete(&tree, pKey) == 1);
+	}
+	bool array(size_t *pSizeT) { *pSizeT = treeLength(&tree); return(treeArray(&tree) != NULL); }
+	bool arraySorted(size_t *pSizeT) {
+		*pSizeT = treeLength(&tree);
+		return(((iThreads == 1) ? treeArraySorted(&tree) : treeParallelArraySorted(&tree, iThreads)) != NULL);
+	}
+	void clear() {
+		treeFree(&snap);
+		ulWrites = 0;
+		if(iThreads == 1)
+			treeFree(&tree);
+		else
+			treeParallelFree(&tree, iThreads);
+		if(bPaged)
+			remove(BENCH_PAGES);
+	}
+};
+
+struct TsearchItem { /* tsearch() holds one pointer per key, key and value hang off it */
+	const void *pKey;
+	uint64_t *pValue;
+};
+
+class TsearchEngine : public Engine { /* POSIX <search.h> binary tree, glibc makes it red-black */
+	void *pRoot;
+	bool bCopy;
+	int (*pfCmp)(const void *, const void *);
+	std::vector<const void*> vArray;
+	static std::vector<const void*> *pvWalk; /* twalk() takes no context */
+	static int cmpU64(const void *p1, const void *p2) {
+		uint64_t ui641 = *static_cast<const uint64_t*>(static_cast<const TsearchItem*>(p1)->pKey);
+		uint64_t ui642 = *static_cast<const uint64_t*>(static_cast<const TsearchItem*>(p2)->pKey);
+		return((ui641 > ui642) - (ui641 < ui642));
+	}
+	static int cmpStr(const void *p1, const void *p2) {
+		return(strcmp(static_cast<const char*>(static_cast<const TsearchItem*>(p1)->pKey),
+			static_cast<const char*>(static_cast<const TsearchItem*>(p2)->pKey)));
+	}
+	static void walk(const void *p, VISIT visit, int) {
+		if((visit == postorder) || (visit == leaf))
+			pvWalk->push_back((*static_cast<TsearchItem* const*>(p))->pKey);
+	}
+	TsearchItem *item(const void *pKey) {
+		TsearchItem probe = { pKey, NULL };
+		void *p = tfind(&probe, &pRoot, pfCmp);
+		return((p == NULL) ? NULL : *static_cast<TsearchItem**>(p));
+	}
+public:
+	TsearchEngine(bool bString, bool bCopy_) : pRoot(NULL), bCopy(bCopy_), pfCmp(bString ? cmpStr : cmpU64) {}
+	~TsearchEngine() { clear(); }
+	bool insert(const void *pKey, size_t sizeTkey, uint64_t *pValue) {
+		TsearchItem *pItem;
+		void *p;
+		if(bCopy) { /* copies follow the item, NUL after the key as treelibc stores it */
+			pItem = static_cast<TsearchItem*>(malloc(sizeof(TsearchItem) + sizeof(uint64_t) + sizeTkey + 1));
+			pItem->pValue = reinterpret_cast<uint64_t*>(pItem + 1);
+			*pItem->pValue = *pValue;
+			memcpy(pItem->pValue + 1, pKey, sizeTkey);
+			reinterpret_cast<char*>(pItem->pValue + 1)[sizeTkey] = '\0';
+			pItem->pKey = pItem->pValue + 1;
+		} else {
+			pItem = static_cast<TsearchItem*>(malloc(sizeof(TsearchItem)));
+			pItem->pKey = pKey;
+			pItem->pValue = pValue;
+		}
+		if(((p = tsearch(pItem, &pRoot, pfCmp)) == NULL) || (*static_cast<TsearchItem**>(p) != pItem)) {
+			free(pItem);
+			return(false);
+		}
+		return(true);
+	}
+	const uint64_t *find(const void *pKey) {
+		TsearchItem *pItem = item(pKey);
+		return((pItem == NULL) ? NULL : pItem->pValue);
+	}
+	bool update(const void *pKey, uint64_t *pValue) {
+		TsearchItem *pItem = item(pKey);
+		if(pItem == NULL)
+			return(false);
+		if(bCopy)
+			*pItem->pValue = *pValue;
+		else
+			pItem->pValue = pValue;
+		return(true);
+	}
+	bool erase(const void *pKey) {
+		TsearchItem *pItem = item(pKey);
+		if(pItem == NULL)
+			return(false);
+		tdelete(pItem, &pRoot, pfCmp);
+		free(pItem);
+		return(true);
+	}
+	bool array(size_t *) { return(false); }
+	bool arraySorted(size_t *pSizeT) {
+		vArray.clear();
+		pvWalk = &vArray;
+		twalk(pRoot, walk);
+		*pSizeT = vArray.size();
+		return(true);
+	}
+	void clear() {
+		tdestroy(pRoot, free); /* copies share the allocation of their item */
+		pRoot = NULL;
+	}
+};
+
+std::vector<const void*> *TsearchEngine::pvWalk;
+
+/* std::map keys and values by type: copies hold the data, pointers only the address */
+template<class T> struct MapType;
+template<> struct MapType<uint64_t> {
+	typedef uint64_t find_type;
+	static uint64_t make(const void *p) { return(*static_cast<const uint64_t*>(p)); }
+	static find_type look(const void *p) { return(*static_cast<const uint64_t*>(p)); }
+	static const void *address(const uint64_t &ui64) { return(&ui64); }
+};
+template<> struct MapType<uint64_t*> {
+	typedef uint64_t *find_type;
+	static uint64_t *make(const void *p) { return(static_cast<uint64_t*>(const_cast<void*>(p))); }
+	static find_type look(const void *p) { return(make(p)); }
+	static const void *address(const uint64_t *pui64) { return(pui64); }
+};
+template<> struct MapType<std::string> {
+	typedef const char *find_type; /* std::less<> looks up without building a string */
+	static std::string make(const void *p) { return(std::string(static_cast<const char*>(p))); }
+	static find_type look(const void *p) { return(static_cast<const char*>(p)); }
+	static const void *address(const std::string &s) { return(s.c_str()); }
+};
+template<> struct MapType<const char*> {
+	typedef const char *find_type;
+	static const char *make(const void *p) { return(static_cast<const char*>(p)); }
+	static find_type look(const void *p) { return(static_cast<const char*>(p)); }
+	static const void *address(const char *pc) { return(pc); }
+};
+
+struct LessU64 { /* pointer keys compared by what they point to */
+	bool operator()(const uint64_t *p1, const uint64_t *p2) const { return(*p1 < *p2); }
+};
+struct LessStr {
+	bool operator()(const char *pc1, const char *pc2) const { return(strcmp(pc1, pc2) < 0); }
+};
+
+template<class K, class V, class L> class MapEngine : public Engine { /* std::map, red-black in libstdc++ */
+	std::map<K, V, L> map;
+	std::vector<const void*> vArray;
+	static const uint64_t *value(const uint64_t &ui64) { return(&ui64); }
+	static const uint64_t *value(const uint64_t *pui64) { return(pui64); }
+public:
+	bool insert(const void *pKey, size_t, uint64_t *pValue) {
+		return(map.insert(std::make_pair(MapType<K>::make(pKey), MapType<V>::make(pValue))).second);
+	}
+	const uint64_t *find(const void *pKey) {
+		typename std::map<K, V, L>::iterator it = map.find(MapType<K>::look(pKey));
+		return((it == map.end()) ? NULL : value(it->second));
+	}
+	bool update(const void *pKey, uint64_t *pValue) {
+		typename std::map<K, V, L>::iterator it = map.find(MapType<K>::look(pKey));
+		if(it == map.end())
+			return(false);
+		it->second = MapType<V>::make(pValue);
+		return(true);
+	}
+	bool erase(const void *pKey) {
+		typename std::map<K, V, L>::iterator it = map.find(MapType<K>::look(pKey));
+		if(it == map.end())
+			return(false);
+		map.erase(it);
+		return(true);
+	}
+	bool array(size_t *) { return(false); }
+	bool arraySorted(size_t *pSizeT) {
+		vArray.clear();
+		vArray.reserve(map.size());
+		for(typename std::map<K, V, L>::iterator it = map.begin(); it != map.end(); ++it)
+			vArray.push_back(MapType<K>::address(it->first));
+		*pSizeT = vArray.size();
+		return(true);
+	}
+	void clear() { map.clear(); }
+};
+
+static Engine *makeEngine(const std::string &sEngine, bool bString, bool bCopy) {
+	if(sEngine == "treelibc")
+		return(new TreeEngine(bString, bCopy, 0));
+	if(sEngine == "pool")
+		return(new TreeEngine(bString, bCopy, TREE_POOL));
+	if(sEngine == "bplus")
+		return(new TreeEngine(bString, bCopy, TREE_BPLUS));
+	if(sEngine == "concurrent")
+		return(new TreeEngine(bString, bCopy, TREE_CONCURRENT));
+	if(sEngine == "parallel")
+		return(new TreeEngine(bString, bCopy, 0, 0));
+	if(sEngine == "hash")
+		return(new TreeEngine(bString, bCopy, 0, 1, true));
+	if(sEngine == "compact")
+		return(new TreeEngine(bString, bCopy, TREE_COMPACT));
+	if(sEngine == "snapshot")
+		return(new TreeEngine(bString, bCopy, TREE_COMPACT, 1, false, true));
+	if(sEngine == "paged")
+		return(new TreeEngine(bString, bCopy, 0, 1, false, false, true));
+	if(sEngine == "tsearch")
+		return(new TsearchEngine(bString, bCopy));
+	if(sEngine == "map") {
+		if(bString)
+			return(bCopy ? (Engine*)new MapEngine<std::string, uint64_t, std::less<> >()
+				: (Engine*)new MapEngine<const char*, uint64_t*, LessStr>());
+		return(bCopy ? (Engine*)new MapEngine<uint64_t, uint64_t, std::less<uint64_t> >()
+			: (Engine*)new MapEngine<uint64_t*, uint64_t*, LessU64>());
+	}
+	return(NULL);
+}
+
+/* ------------------------------ measuring ------------------------------ */
+
+typedef std::chrono::steady_clock Clock;
+
+static double dClockNs; /* cost of one clock read, taken off each latency sample */
+
+static double nanoseconds(Clock::time_point t1, Clock::time_point t2) {
+	return(std::chrono::duration<double, std::nano>(t2 - t1).count());
+}
+
+static void calibrate() { /* least time between two reads, repeated to miss interrupts */
+	double dMin = 1e9;
+	for(int i = 0; i < 10000; i++) {
+		Clock::time_point t1 = Clock::now(), t2 = Clock::now();
+		dMin = std::min(dMin, nanoseconds(t1, t2));
+	}
+	dClockNs = dMin;
+}
+
+struct Result {
+	unsigned long ulOps;
+	double dSeconds;
+	std::vector<double> vLatency; /* nanoseconds of sampled ops */
+};
+
+template<class F> static unsigned long timeOps(unsigned long ulOps, const Options &opt, Result &result, F f) {
+	unsigned long ul, ulStride = std::max((unsigned long)BENCH_STRIDE_MIN, ulOps / std::max(1ul, opt.ulSamples)), ulDone = 0;
+	Clock::time_point t0, t1, tStart;
+	result.ulOps = ulOps;
+	result.vLatency.clear();
+	result.vLatency.reserve((ulOps / ulStride) + 1);
+	tStart = Clock::now();
+	for(ul = 0; ul < ulOps; ul++) {
+		if((ul % ulStride) == 0) {
+			t0 = Clock::now();
+			ulDone += f(ul);
+			t1 = Clock::now();
+			result.vLatency.push_back(std::max(0.0, nanoseconds(t0, t1) - dClockNs));
+		} else
+			ulDone += f(ul);
+	}
+	result.dSeconds = nanoseconds(tStart, Clock::now()) / 1e9;
+	return(ulDone);
+}
+
+template<class F> static bool timeOnce(unsigned long ulElements, Result &result, F f) { /* one call over all keys */
+	Clock::time_point t0 = Clock::now();
+	bool bDone = f();
+	double dNs = nanoseconds(t0, Clock::now());
+	result.ulOps = ulElements;
+	result.dSeconds = dNs / 1e9;
+	result.vLatency.assign(1, dNs);
+	return(bDone);
+}
+
+static double percentile(std::vector<double> &v, double dP) { /* nearest rank, v sorted */
+	if(v.empty())
+		return(0.0);
+	return(v[std::min(v.size() - 1, (size_t)std::ceil(dP * v.size()) - (dP > 0.0))]);
+}
+
+static bool bFirstRow = true;
+
+static void printRow(const Options &opt, const std::string &sEngine, const std::string &sKeys, const std::string &sStorage,
+	const std::string &sDist, unsigned long ulSize, const char *pcOp, Result &result) {
+	std::vector<double> &v = result.vLatency;
+	double dMops = (result.dSeconds > 0.0) ? (result.ulOps / result.dSeconds) / 1e6 : 0.0;
+	std::sort(v.begin(), v.end());
+	if(opt.bJson) {
+		printf("%s\n  {\"engine\":\"%s\",\"keys\":\"%s\",\"storage\":\"%s\",\"dist\":\"%s\",\"size\":%lu,\"op\":\"%s\","
+			"\"ops\":%lu,\"seconds\":%.6f,\"mops\":%.3f,\"samples\":%lu,\"p50_ns\":%.0f,\"p90_ns\":%.0f,"
+			"\"p99_ns\":%.0f,\"p999_ns\":%.0f,\"max_ns\":%.0f}",
+			bFirstRow ? "" : ",", sEngine.c_str(), sKeys.c_str(), sStorage.c_str(), sDist.c_str(), ulSize, pcOp,
+			result.ulOps, result.dSeconds, dMops, (unsigned long)v.size(), percentile(v, 0.5), percentile(v, 0.9),
+			percentile(v, 0.99), percentile(v, 0.999), v.empty() ? 0.0 : v.back());
+	} else {
+		printf("%s,%s,%s,%s,%lu,%s,%lu,%.6f,%.3f,%lu,%.0f,%.0f,%.0f,%.0f,%.0f\n",
+			sEngine.c_str(), sKeys.c_str(), sStorage.c_str(), sDist.c_str(), ulSize, pcOp,
+			result.ulOps, result.dSeconds, dMops, (unsigned long)v.size(), percentile(v, 0.5), percentile(v, 0.9),
+			percentile(v, 0.99), percentile(v, 0.999), v.empty() ? 0.0 : v.back());
+	}
+	bFirstRow = false;
+	fflush(stdout);
+}
+
+static bool check(const char *pcOp, unsigned long ulGot, unsigned long ulWant, const std::string &sEngine) {
+	if(ulGot == ulWant)
+		return(true);
+	fprintf(stderr, "ERROR: %s %s %lu of %lu!\n", sEngine.c_str(), pcOp, ulGot, ulWant);
+	return(false);
+}
+
+static bool run(const Options &opt, const Workload &w, const std::string &sEngine, const std::string &sDist, bool bCopy) {
+	const std::string sKeys = w.bString ? "string" : "int", sStorage = bCopy ? "copy" : "address";
+	Engine *pEngine = makeEngine(sEngine, w.bString, bCopy);
+	unsigned long ulN = w.ulN, ulHalf = ulN / 2;
+	size_t sizeT = 0;
+	bool bOk = true;
+	Result result;
+	Workload &wv = const_cast<Workload&>(w); /* address assigned values are written through by no engine */
+#define ROW(pcOp) printRow(opt, sEngine, sKeys, sStorage, sDist, ulN, pcOp, result)
+	bOk &= check("insert", timeOps(ulN, opt, result, [&](unsigned long ul) {
+		return(pEngine->insert(w.key(ul), w.keySize(), &wv.vValues[ul]));
+	}), ulN, sEngine);
+	ROW("insert");
+	bOk &= check("lookup_hit", timeOps(ulN, opt, result, [&](unsigned long ul) {
+		const uint64_t *pui64 = pEngine->find(w.key(w.vAccess[ul]));
+		return((pui64 != NULL) && (*pui64 == w.vValues[w.vAccess[ul]]));
+	}), ulN, sEngine);
+	ROW("lookup_hit");
+	bOk &= check("lookup_miss", timeOps(ulN, opt, result, [&](unsigned long ul) {
+		return(pEngine->find(w.miss(w.vAccess[ul])) == NULL);
+	}), ulN, sEngine);
+	ROW("lookup_miss");
+	bOk &= check("lookup_batch", BENCH_BATCH * timeOps(ulN / BENCH_BATCH, opt, result, [&](unsigned long ul) {
+		const void *apKeys[BENCH_BATCH];
+		const uint64_t *apValues[BENCH_BATCH];
+		unsigned long i, ulHit = 0;
+		for(i = 0; i < BENCH_BATCH; i++)
+			apKeys[i] = w.key(w.vAccess[(ul * BENCH_BATCH) + i]);
+		pEngine->findBatch(apKeys, BENCH_BATCH, apValues);
+		for(i = 0; i < BENCH_BATCH; i++)
+			ulHit += (apValues[i] != NULL) && (*apValues[i] == w.vValues[w.vAccess[(ul * BENCH_BATCH) + i]]);
+		return(ulHit == BENCH_BATCH);
+	}), (ulN / BENCH_BATCH) * BENCH_BATCH, sEngine);
+	result.ulOps *= BENCH_BATCH; /* throughput per key, latency per batch */
+	ROW("lookup_batch");
+	bOk &= check("update", timeOps(ulN, opt, result, [&](unsigned long ul) {
+		return(pEngine->update(w.key(w.vAccess[ul]), &wv.vUpdates[w.vAccess[ul]]));
+	}), ulN, sEngine);
+	ROW("update");
+	if(timeOnce(ulN, result, [&]() { return(pEngine->array(&sizeT)); })) {
+		bOk &= check("array", sizeT, ulN, sEngine);
+		ROW("array");
+	}
+	if(timeOnce(ulN, result, [&]() { return(pEngine->arraySorted(&sizeT)); })) {
+		bOk &= check("array_sorted", sizeT, ulN, sEngine);
+		ROW("array_sorted");
+	}
+	bOk &= check("delete", timeOps(ulHalf, opt, result, [&](unsigned long ul) {
+		return(pEngine->erase(w.key(w.vDelete[ul])));
+	}), ulHalf, sEngine);
+	ROW("delete");
+	timeOnce(ulN - ulHalf, result, [&]() { pEngine->clear(); return(true); });
+	ROW("free");
+#undef ROW
+	delete pEngine;
+	return(bOk);
+}
+
+/* ---------------------------- command line ---------------------------- */
+
+static std::vector<std::string> split(const char *pc) {
+	std::vector<std::string> v;
+	std::string s;
+	for(; ; pc++) {
+		if((*pc == ',') || (*pc == '\0')) {
+			if(!s.empty())
+				v.push_back(s);
+			s.clear();
+			if(*pc == '\0')
+				break;
+		} else
+			s += *pc;
+	}
+	return(v);
+}
+
+static bool known(const std::vector<std::string> &v, const char *pcAllowed) {
+	std::vector<std::string> vAllowed = split(pcAllowed);
+	for(size_t i = 0; i < v.size(); i++) {
+		if(std::find(vAllowed.begin(), vAllowed.end(), v[i]) == vAllowed.end()) {
+			fprintf(stderr, "ERROR: unknown %s, use %s\n", v[i].c_str(), pcAllowed);
+			return(false);
+		}
+	}
+	return(!v.empty());
+}
+
+static void usage(void) {
+	puts("treelibc_bench [options], lists are comma separated\n"
+		"  --sizes=1e3,1e4,1e5,1e6       keys per run, up to 1e8 given the memory\n"
+		"  --engines=treelibc,pool,bplus,tsearch,map   also concurrent, parallel, hash, compact, snapshot, paged\n"
+		"  --dists=seq,random,zipf       insertion and access order\n"
+		"  --keys=int,string             uint64_t or 16 hex digit strings\n"
+		"  --storage=copy,address        copied into container or by address\n"
+		"  --format=csv|json\n"
+		"  --seed=1                      same seed, same keys and order\n"
+		"  --samples=100000              latency samples per operation at most\n"
+		"  --zipf=0.99                   skew of zipf accesses, below 1");
+}
+
+int main(int argc, char *argv[]) {
+	Options opt;
+	const char *pcArg;
+	bool bOk = true;
+	opt.sizes.push_back(1000);
+	opt.sizes.push_back(10000);
+	opt.sizes.push_back(100000);
+	opt.sizes.push_back(1000000);
+	opt.engines = split("treelibc,pool,bplus,tsearch,map");
+	opt.dists = split("seq,random,zipf");
+	opt.keys = split("int,string");
+	opt.storages = split("copy,address");
+	opt.ui64Seed = 1;
+	opt.ulSamples = 100000;
+	opt.dZipf = 0.99;
+	opt.bJson = false;
+	for(int i = 1; i < argc; i++) {
+		pcArg = strchr(argv[i], '=');
+		pcArg = (pcArg == NULL) ? "" : pcArg + 1;
+		if(strncmp(argv[i], "--sizes=", 8) == 0) {
+			std::vector<std::string> v = split(pcArg);
+			opt.sizes.clear();
+			for(size_t j = 0; j < v.size(); j++) /* strtod() so 1e8 works */
+				opt.sizes.push_back((unsigned long)strtod(v[j].c_str(), NULL));
+		} else if(strncmp(argv[i], "--engines=", 10) == 0)
+			opt.engines = split(pcArg);
+		else if(strncmp(argv[i], "--dists=", 8) == 0)
+			opt.dists = split(pcArg);
+		else if(strncmp(argv[i], "--keys=", 7) == 0)
+			opt.keys = split(pcArg);
+		else if(strncmp(argv[i], "--storage=", 10) == 0)
+			opt.storages = split(pcArg);
+		else if(strcmp(argv[i], "--format=json") == 0)
+			opt.bJson = true;
+		else if(strcmp(argv[i], "--format=csv") == 0)
+			opt.bJson = false;
+		else if(strncmp(argv[i], "--seed=", 7) == 0)
+			opt.ui64Seed = strtoull(pcArg, NULL, 10);
+		else if(strncmp(argv[i], "--samples=", 10) == 0)
+			opt.ulSamples = strtoul(pcArg, NULL, 10);
+		else if(strncmp(argv[i], "--zipf=", 7) == 0)
+			opt.dZipf = strtod(pcArg, NULL);
+		else {
+			usage();
+			return((strcmp(argv[i], "--help") == 0) ? EXIT_SUCCESS : EXIT_FAILURE);
+		}
+	}
+	if(!known(opt.engines, "treelibc,pool,bplus,concurrent,parallel,hash,compact,snapshot,paged,tsearch,map") || !known(opt.dists, "seq,random,zipf")
+	|| !known(opt.keys, "int,string") || !known(opt.storages, "copy,address") || opt.sizes.empty()
+	|| (std::find(opt.sizes.begin(), opt.sizes.end(), 0ul) != opt.sizes.end()) || !(opt.dZipf > 0.0) || !(opt.dZipf < 1.0)) {
+		usage();
+		return EXIT_FAILURE;
+	}
+	calibrate();
+	if(opt.bJson)
+		printf("{\"seed\":%llu,\"zipf\":%.3f,\"clock_ns\":%.1f,\"results\":[", (unsigned long long)opt.ui64Seed, opt.dZipf, dClockNs);
+	else
+		puts("engine,keys,storage,dist,size,op,ops,seconds,mops,samples,p50_ns,p90_ns,p99_ns,p999_ns,max_ns");
+	for(size_t iSize = 0; iSize < opt.sizes.size(); iSize++) {
+		for(size_t iDist = 0; iDist < opt.dists.size(); iDist++) {
+			for(size_t iKeys = 0; iKeys < opt.keys.size(); iKeys++) {
+				Workload w(opt.sizes[iSize], opt.dists[iDist], opt.keys[iKeys] == "string", opt);
+				for(size_t iStorage = 0; iStorage < opt.storages.size(); iStorage++) {
+					for(size_t iEngine = 0; iEngine < opt.engines.size(); iEngine++)
+						bOk &= run(opt, w, opt.engines[iEngine], opt.dists[iDist], opt.storages[iStorage] == "copy");
+				}
+			}
+		}
+	}
+	if(opt.bJson)
+		puts("\n]}");
+
+return(bOk ? EXIT_SUCCESS : EXIT_FAILURE);
+}
@@ -0,0 +1,267 @@
+/*
+ =============================================================================
+ Name        : treelibc_stress.c
+ Author      : David T. Silvers Sr.
+ Contact     : davidtsilvers@aol.com
+ Created     : 2026-10-16
+ Updated     : 2026-10-16
+ Version     : 2.51
+ License     : GNU LGPL
+ Description : Multithreaded stress test for TREE_CONCURRENT and TreeShards
+               Writers insert, update and delete random keys while readers
+               look them up and walk cursors, checking every value read
+               belongs to its key and keys ascend. Tree invariants are
+               checked with treeVerify() once all threads are done.
+               A single threaded run of random mixed operations per mode
+               checks tree invariants, height and contents as it goes.
+               gcc -O2 -pthread -I. treelibc_stress.c ../src/treelibc.c
+               SEE: treelibc.c AND treelibc.h
+
+ Copyright   : Copyright 2014 by David T. Silvers Sr.
+
+	This file is part of treelibc.
+
+    treelibc is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    treelibc is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with treelibc. If not, see <http://www.gnu.org/licenses/>.
+  =============================================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include "treelibc.h"
+
+#define STRESS_WRITERS 2
+#define STRESS_READERS 4
+#define STRESS_KEYS 4096 /* small key space, writers keep hitting the same nodes */
+#define STRESS_WRITES 100000 /* per writer */
+#define STRESS_SHARDS 8
+#define STRESS_SHARD_KEYS 20000 /* per writer */
+#define STRESS_MIXED_KEYS 2048
+#define STRESS_MIXED_OPS 2000000 /* per mode */
+#define STRESS_MIXED_VERIFY 5000 /* ops between treeVerify() */
+#define STRESS_MIXED_SNAPSHOT 64 /* ops between snapshots of the TREE_SNAPSHOT mixed run, each held until the next */
+#define STRESS_PAGES "treelibc_stress.pages" /* file of the TREE_PAGED mixed run, removed when done */
+
+static Tree tree;
+static TreeShards shards;
+static int iWriting; /* writers still running */
+static unsigned long ulErrors, ulReads;
+static pthread_mutex_t mutexCount = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t valueOf(uint64_t ui64Key, unsigned int uiVersion) { /* value tells its key apart from any other */
+return((ui64Key * 2654435761u) ^ ((uint64_t)uiVersion << 48));
+}
+
+static int checkValue(const void *pKey, const void *pValue) { /* Return: 1 = value belongs to key */
+	uint64_t ui64Key = *((const uint64_t*)pKey), ui64Value = *((const uint64_t*)pValue);
+return((ui64Value & ~((uint64_t)0xFFFF << 48)) == (valueOf(ui64Key, 0) & ~((uint64_t)0xFFFF << 48)));
+}
+
+static unsigned int nextRandom(unsigned int *puiSeed) { /* rand() is not thread safe */
+	*puiSeed = (*puiSeed * 1103515245u) + 12345u;
+return(*puiSeed >> 8);
+}
+
+static void countResult(unsigned long ulErr, unsigned long ulRead) {
+	pthread_mutex_lock(&mutexCount);
+	ulErrors += ulErr;
+	ulReads += ulRead;
+	pthread_mutex_unlock(&mutexCount);
+}
+
+static void *writer(void *pArg) {
+	unsigned int uiSeed = (unsigned int)(uintptr_t)pArg, uiVersion = 0;
+	unsigned long ul;
+	uint64_t ui64Key, ui64Value;
+	for(ul = 0; ul < STRESS_WRITES; ul++) {
+		ui64Key = nextRandom(&uiSeed) % STRESS_KEYS;
+		ui64Value = valueOf(ui64Key, ++uiVersion & 0xFFFF);
+		switch(nextRandom(&uiSeed) % 4) {
+		case 0:
+			treeInsert(&tree, &ui64Key, sizeof(ui64Key), &ui64Value, sizeof(ui64Value));
+			break;
+		case 1:
+			treeDelete(&tree, &ui64Key);
+			break;
+		case 2: /* new copy of value, old one retired while readers hold it */
+			treeUpdate(&tree, &ui64Key, &ui64Value, sizeof(ui64Value));
+			break;
+		default:
+			treeUpsert(&tree, &ui64Key, sizeof(ui64Key), &ui64Value, sizeof(ui64Value), NULL);
+		}
+	}
+return(NULL);
+}
+
+static void *reader(void *pArg) {
+	unsigned int uiSeed = (unsigned int)(uintptr_t)pArg;
+	unsigned long ul, ulErr = 0, ulRead = 0;
+	uint64_t ui64Key, ui64Last;
+	void *pKey, *pValue;
+	TreeCursor cursor;
+	int iFound;
+	do {
+		ui64Key = nextRandom(&uiSeed) % STRESS_KEYS;
+		treeReadBegin(&tree); /* keys and values stay valid until treeReadEnd() */
+		if(((pValue = treeValue(&tree, &ui64Key)) != NULL) && !checkValue(&ui64Key, pValue))
+			ulErr++;
+		iFound = treeLowerBound(&tree, &cursor, &ui64Key, &pKey, &pValue);
+		for(ul = 0, ui64Last = 0; iFound && (ul < 32); ul++) {
+			if(((ul > 0) && (*((uint64_t*)pKey) <= ui64Last)) || !checkValue(pKey, pValue))
+				ulErr++;
+			ui64Last = *((uint64_t*)pKey);
+			iFound = treeCursorNext(&cursor, &pKey, &pValue);
+		}
+		treeReadEnd(&tree);
+		ulRead++;
+	} while(__atomic_load_n(&iWriting, __ATOMIC_RELAXED));
+	countResult(ulErr, ulRead);
+return(NULL);
+}
+
+static unsigned long mixedRun(int iMode) { /* Return: errors */
+	static unsigned char acPresent[STRESS_MIXED_KEYS + 1];
+	unsigned int uiSeed = 7, uiVersion = 0;
+	unsigned long ul, ulLen = 0, ulSnapLen = 0, ulErr = 0, ulHeight;
+	uint64_t ui64Key, ui64Value, ui64Pin = STRESS_MIXED_KEYS / 2; /* never deleted, its copies move only when paged or copied for a snapshot */
+	void *pPinned, *pValue;
+	TreeStats stats;
+	Tree t, snap;
+	if(iMode & TREE_PAGED) /* smallest pool, pages split, merge and go through the free list */
+		remove(STRESS_PAGES);
+	if((treeInitKey(&snap, TREE_KEY_UINT64, 0, 0) == NULL)
+	|| (treeInitKey(&t, TREE_KEY_UINT64, 0, iMode & ~(TREE_PAGED | TREE_SNAPSHOT)) == NULL)
+	|| ((iMode & TREE_PAGED) && (treeOpen(&t, STRESS_PAGES, 0) == NULL)))
+		return(1);
+	memset(acPresent, 0, sizeof(acPresent));
+	ui64Value = valueOf(ui64Pin, 0);
+	treeInsert(&t, &ui64Pin, sizeof(ui64Pin), &ui64Value, sizeof(ui64Value));
+	pPinned = treeValue(&t, &ui64Pin);
+	for(ul = 1; ul <= STRESS_MIXED_OPS; ul++) {
+		if((ui64Key = nextRandom(&uiSeed) % STRESS_MIXED_KEYS) == ui64Pin)
+			ui64Key = STRESS_MIXED_KEYS;
+		ui64Value = valueOf(ui64Key, ++uiVersion & 0xFFFF);
+		if((iMode & TREE_SNAPSHOT) && ((ul % STRESS_MIXED_SNAPSHOT) == 0)) { /* writes copy what the held snapshot shares */
+			treeFree(&snap);
+			if(treeSnapshot(&t, &snap) == NULL)
+				ulErr++;
+			ulSnapLen = ulLen + 1;
+		}
+		if((nextRandom(&uiSeed) % 100) < ((ul / (STRESS_MIXED_OPS / 8)) % 2 ? 30u : 70u)) { /* phases of growth then shrink */
+			ulLen += treeInsert(&t, &ui64Key, sizeof(ui64Key), &ui64Value, sizeof(ui64Value)) && !acPresent[ui64Key];
+			acPresent[ui64Key] = 1;
+		} else {
+			if(treeDelete(&t, &ui64Key) != acPresent[ui64Key])
+				ulErr++;
+			ulLen -= acPresent[ui64Key];
+			acPresent[ui64Key] = 0;
+		}
+		if(((pValue = treeValue(&t, &ui64Key)) != NULL) != acPresent[ui64Key])
+			ulErr++;
+		if((pValue != NULL) && !checkValue(&ui64Key, pValue))
+			ulErr++;
+		if((ul % STRESS_MIXED_VERIFY) == 0) { /* black heights, order, sizes, height within 2 log2(n + 1) */
+			for(ulHeight = 0; (1ul << ulHeight) <= ulLen + 1; ulHeight++);
+			if((treeVerify(&t) != 0) || (treeLength(&t) != ulLen + 1) || (treeStats(&t, &stats) == NULL)
+			|| (stats.ulHeight > 2 * ulHeight) || ((pValue = treeValue(&t, &ui64Pin)) == NULL)
+			|| (*((uint64_t*)pValue) != valueOf(ui64Pin, 0)) || (!(iMode & (TREE_PAGED | TREE_SNAPSHOT)) && (pValue != pPinned)))
+				ulErr++;
+			if((iMode & TREE_SNAPSHOT) && ((treeVerify(&snap) != 0) || (treeLength(&snap) != ulSnapLen)
+			|| ((pValue = treeValue(&snap, &ui64Pin)) == NULL) || (*((uint64_t*)pValue) != valueOf(ui64Pin, 0))))
+				ulErr++;
+		}
+	}
+	for(ui64Key = 0; ui64Key <= STRESS_MIXED_KEYS; ui64Key++) /* empty it, last deletes fix up the root */
+		ulErr += (ui64Key != ui64Pin) && (treeDelete(&t, &ui64Key) != acPresent[ui64Key]);
+	treeDelete(&t, &ui64Pin);
+	ulErr += (treeVerify(&t) != 0) || (treeLength(&t) != 0);
+	ulErr += (iMode & TREE_SNAPSHOT) && ((treeVerify(&snap) != 0) || (treeLength(&snap) != ulSnapLen)); /* untouched by the emptying */
+	treeFree(&snap);
+	treeFree(&t);
+	if(iMode & TREE_PAGED)
+		remove(STRESS_PAGES);
+return(ulErr);
+}
+
+static void *shardWriter(void *pArg) {
+	uint64_t ui64Key, ui64Base = (uint64_t)(uintptr_t)pArg * STRESS_SHARD_KEYS;
+	for(ui64Key = ui64Base; ui64Key < ui64Base + STRESS_SHARD_KEYS; ui64Key++)
+		treeInsert(treeShard(&shards, &ui64Key), &ui64Key, sizeof(ui64Key), &ui64Key, sizeof(ui64Key));
+return(NULL);
+}
+
+int main(void) {
+	static const int aiMixed[] = { 0, TREE_POOL, TREE_CONCURRENT, TREE_BPLUS, TREE_PAGED, TREE_COMPACT, TREE_COMPACT | TREE_SNAPSHOT };
+	pthread_t aWriters[STRESS_WRITERS], aReaders[STRESS_READERS];
+	unsigned long ul, ulLen = 0;
+	uint64_t ui64Key;
+	void *pKey;
+	TreeCursor cursor;
+	int i, iBad, iFound;
+
+	/* ---- TREE_CONCURRENT, READERS CHECK WHILE WRITERS CHANGE ---- */
+	if(treeInitKey(&tree, TREE_KEY_UINT64, 0, TREE_CONCURRENT) == NULL) {
+		puts("TREE_CONCURRENT not available");
+		return EXIT_FAILURE;
+	}
+	iWriting = 1;
+	for(i = 0; i < STRESS_READERS; i++)
+		pthread_create(&aReaders[i], NULL, reader, (void*)(uintptr_t)(1000 + i));
+	for(i = 0; i < STRESS_WRITERS; i++)
+		pthread_create(&aWriters[i], NULL, writer, (void*)(uintptr_t)(1 + i));
+	for(i = 0; i < STRESS_WRITERS; i++)
+		pthread_join(aWriters[i], NULL);
+	__atomic_store_n(&iWriting, 0, __ATOMIC_RELAXED);
+	for(i = 0; i < STRESS_READERS; i++)
+		pthread_join(aReaders[i], NULL);
+	for(iFound = treeCursorFirst(&tree, &cursor, TREE_SORTED, &pKey, NULL); iFound; iFound = treeCursorNext(&cursor, &pKey, NULL))
+		ulLen++;
+	iBad = treeVerify(&tree);
+	printf("Concurrent: length %lu walked %lu reads %lu errors %lu verify %x\n", treeLength(&tree), ulLen, ulReads, ulErrors, iBad);
+	if((ulLen != treeLength(&tree)) || (ulErrors > 0) || (iBad != 0))
+		return EXIT_FAILURE;
+	treeFree(&tree);
+
+	/* ---- TREE SHARDS, WRITERS OF DIFFERENT SHARDS IN PARALLEL ---- */
+	if(treeShardsInit(&shards, STRESS_SHARDS, NULL, NULL, TREE_KEY_UINT64, 0, TREE_POOL) == NULL)
+		return EXIT_FAILURE;
+	for(i = 0; i < STRESS_WRITERS; i++)
+		pthread_create(&aWriters[i], NULL, shardWriter, (void*)(uintptr_t)i);
+	for(i = 0; i < STRESS_WRITERS; i++)
+		pthread_join(aWriters[i], NULL);
+	for(ul = iBad = 0; ul < shards.ulShards; ul++)
+		iBad |= treeVerify(&shards.pTrees[ul]);
+	for(ui64Key = 0, ulLen = 0; ui64Key < STRESS_WRITERS * STRESS_SHARD_KEYS; ui64Key++) {
+		uint64_t *pui64 = treeValue(treeShard(&shards, &ui64Key), &ui64Key);
+		ulLen += (pui64 != NULL) && (*pui64 == ui64Key);
+	}
+	printf("Shards: %lu length %lu found %lu verify %x\n", shards.ulShards, treeShardsLength(&shards), ulLen, iBad);
+	if((treeShardsLength(&shards) != STRESS_WRITERS * STRESS_SHARD_KEYS) || (ulLen != treeShardsLength(&shards)) || (iBad != 0))
+		return EXIT_FAILURE;
+	treeShardsFree(&shards);
+
+	/* ---- RANDOM MIXED OPERATIONS, TREE INVARIANTS CHECKED AS THEY GO ---- */
+	for(i = 0; i < (int)(sizeof(aiMixed) / sizeof(*aiMixed)); i++) {
+		ul = mixedRun(aiMixed[i]);
+		printf("Mixed: mode %d ops %lu errors %lu\n", aiMixed[i], (unsigned long)STRESS_MIXED_OPS, ul);
+		if(ul > 0)
+			return EXIT_FAILURE;
+	}
+
+	puts("FINISHED!");
+
+return EXIT_SUCCESS;
+}
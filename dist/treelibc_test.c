@@ -4,8 +4,8 @@
  Author      : David T. Silvers Sr.
  Contact     : davidtsilvers@aol.com
  Created     : 2014-02-03
- Updated     : 2014-02-14
- Version     : 1.10
+ Updated     : 2026-10-16
+ Version     : 4.00
  License     : GNU LGPL
  Description : Tester and usage example for treelibc
                treelibc "Associative Balanced Tree Container"
@@ -53,34 +53,53 @@ static int compareDescendUL(const void* pKeyOld, const void* pKeyNew) { /* numbe
 return(0);
 }
 
-static void printData(Tree *pTree, int iType) { /* shared general purpose function */
-	void **pp;
-	unsigned long ul, ulLen = treeLength(pTree);
+static unsigned long hashStr(const void *pKey) { /* string hash function, equal for keys compareStr() finds equal */
+	const unsigned char *puc = pKey;
+	unsigned long ulHash = 5381;
+	for(; *puc != '\0'; puc++)
+		ulHash = (ulHash * 33) ^ *puc;
+return(ulHash);
+}
 
-	printf("Length: %lu\n", ulLen); /* get number of keys */
+static void markVisit(void *pKey, void *pValue, void *pArg) { /* parallel visitor, each key marks its own slot */
+	((char*)pArg)[*(unsigned long*)pKey] = 1;
+}
 
-	puts("--- order ---");
-	pp = treeArray(pTree); /* get array of keys */
-	for(ul = 0; ul < ulLen; ul++) {
-		if(iType)
-			printf("%lu - %s\n", *((unsigned long*)pp[ul]), (char*)treeValue(pTree, pp[ul]));
-		else
-			printf("%s - %s\n", (char*)pp[ul], (char*)treeValue(pTree, pp[ul]));
-	}
+static void sumReduce(void *pAcc, void *pKey, void *pValue, void *pArg) { /* parallel reducer, one sum per piece */
+	*(unsigned long*)pAcc += *(unsigned long*)pKey;
+}
+
+static void sumJoin(void *pAcc, void *pNext, void *pArg) { /* sums of pieces added up */
+	*(unsigned long*)pAcc += *(unsigned long*)pNext;
+}
+
+static void printEvict(void *pKey, void *pValue, void *pArg) { /* cache eviction, address values would be freed here */
+	printf(" %s", (char*)pKey);
+}
+
+static void printData(Tree *pTree, int iType) { /* shared general purpose function */
+	void *pKey, *pValue;
+	TreeCursor cursor; /* walks keys with their values, no lookup or allocation needed */
+	int iOrder, iFound;
+
+	printf("Length: %lu\n", treeLength(pTree)); /* get number of keys */
 
-	puts("--- sorted ---");
-	pp = treeArraySorted(pTree); /* get array of sorted keys */
-	for(ul = 0; ul < ulLen; ul++) {
-		if(iType)
-			printf("%lu - %s\n", *((unsigned long*)pp[ul]), (char*)treeValue(pTree, pp[ul]));
-		else
-			printf("%s - %s\n", (char*)pp[ul], (char*)treeValue(pTree, (char*)pp[ul]));
+	for(iOrder = TREE_INSERTED; iOrder >= TREE_SORTED; iOrder--) {
+		puts((iOrder == TREE_INSERTED) ? "--- order ---" : "--- sorted ---");
+		iFound = treeCursorFirst(pTree, &cursor, iOrder, &pKey, &pValue);
+		for(; iFound; iFound = treeCursorNext(&cursor, &pKey, &pValue)) {
+			if(iType)
+				printf("%lu - %s\n", *((unsigned long*)pKey), (char*)pValue);
+			else
+				printf("%s - %s\n", (char*)pKey, (char*)pValue);
+		}
 	}
 }
 
 int main(void) {
-	Tree tree, t2;
+	Tree tree, t2, t3;
 	unsigned long ul, ulLen = sizeof(*pppKeysValues) / sizeof(char*);
+	int i;
 
 	/* ----- TEST CASE 1 INSERT ONLY ADDRESSES OF KEYS AND VALUES  ---- */
 	if(treeInit(&tree, compareStr) == NULL) {
@@ -136,6 +155,406 @@ int main(void) {
 		treeInsert(&t2, &ul, sizeof(unsigned long), pppKeysValues[0][ul - 1], 0);
 	printData(&t2, 1);
 
+	/* - TEST CASE 8 POOL MODE, NODES FROM SLABS WITH SMALL COPIES HELD INLINE - */
+	treeFree(&t2);
+	if(treeInitMode(&t2, compareStr, TREE_POOL) == NULL) {
+		fprintf(stderr, "ERROR: pool initialization failed!");
+		return EXIT_FAILURE;
+	}
+	puts("--- insert copy into pool -----------------------");
+	for(ul = 0; ul < ulLen; ul++) /* keys and values under TREELIBC_POOL_KEY/VALUE bytes need no malloc */
+		treeInsert(
+			&t2, pppKeysValues[0][ul], strlen(pppKeysValues[0][ul]),
+			pppKeysValues[1][ul], strlen(pppKeysValues[1][ul])
+		);
+	printf("Delete: %s\n", "Kennedy"); /* node is recycled by next insert */
+	treeDelete(&t2, "Kennedy");
+	printf("Insert: %s - %s\n", "Kennedy", "Reagan");
+	treeInsert(&t2, "Kennedy", strlen("Kennedy"), "Reagan", strlen("Reagan"));
+	printData(&t2, 0);
+
+	/* - TEST CASE 9 ARRAYS ARE REUSED UNTIL THE TREE CHANGES, CURSOR SEEK AND WALK BACK - */
+	puts("--- arrays and cursor seek ----------------------");
+	if((treeArraySorted(&t2) != treeArraySorted(&t2)) || (treeArray(&t2) != treeArray(&t2))) {
+		fprintf(stderr, "ERROR: unchanged tree rebuilt array!");
+		return EXIT_FAILURE;
+	}
+	{
+		void **pp = treeArraySorted(&t2), *pKey;
+		TreeCursor cursor;
+		printf("Sorted first: %s\n", (char*)pp[0]);
+		printf("Seek: %s\n", "L"); /* positions on next greater key */
+		for(ul = treeCursorSeek(&t2, &cursor, "L", &pKey, NULL); ul; ul = treeCursorPrev(&cursor, &pKey, NULL))
+			printf("%s\n", (char*)pKey);
+	}
+
+	/* ------ TEST CASE 10 RANGE, RANK AND SELECT WITHOUT SORTED ARRAY ------ */
+	puts("--- range, rank and select ----------------------");
+	{
+		void *pKey, *pValue;
+		TreeCursor cursor;
+		printf("Range: %s - %s count %lu\n", "B", "K", treeRangeCount(&t2, "B", "K"));
+		for(ul = treeRange(&t2, &cursor, "B", "K", &pKey, &pValue); ul; ul = treeCursorNext(&cursor, &pKey, &pValue))
+			printf("%s - %s\n", (char*)pKey, (char*)pValue);
+		printf("Rank: %s %lu\n", "Roberts", treeRank(&t2, "Roberts"));
+		if(treeSelect(&t2, &cursor, treeLength(&t2) / 2, &pKey, NULL)) /* median */
+			printf("Select: %lu %s\n", treeLength(&t2) / 2, (char*)pKey);
+	}
+
+	/* ---- TEST CASE 11 BUILD FROM SORTED KEYS, INSERTION ORDER SUPPLIED ---- */
+	treeFree(&t2);
+	treeInit(&t2, compareStr);
+	puts("--- build sorted --------------------------------");
+	{
+		void **pp = treeArraySorted(&tree), *ppValues[9]; /* sorted keys of first tree */
+		unsigned long pulOrder[9];
+		for(ul = 0; ul < ulLen; ul++) {
+			ppValues[ul] = treeValue(&tree, pp[ul]);
+			pulOrder[ul] = ulLen - 1 - ul; /* insertion order is descending */
+		}
+		if(!treeBuildSorted(&t2, pp, NULL, ppValues, NULL, ulLen, pulOrder)) {
+			fprintf(stderr, "ERROR: build failed!");
+			return EXIT_FAILURE;
+		}
+	}
+	printData(&t2, 0);
+
+	/* ------ TEST CASE 12 B+TREE MODE, SAME API, SORTED ORDER ONLY ------ */
+	treeFree(&t2);
+	treeInitMode(&t2, compareStr, TREE_BPLUS);
+	puts("--- b+tree --------------------------------------");
+	for(ul = 0; ul < ulLen; ul++) /* insert key copies and value copies */
+		treeInsert(&t2, pppKeysValues[0][ul], strlen(pppKeysValues[0][ul]), pppKeysValues[1][ul], strlen(pppKeysValues[1][ul]));
+	printf("Delete: %s\n", "Breyer");
+	treeDelete(&t2, "Breyer");
+	printf("Update: %s - %s\n", "Thomas", "Bush Sr");
+	treeUpdate(&t2, "Thomas", "Bush Sr", strlen("Bush Sr"));
+	printData(&t2, 0); /* insertion order is not kept */
+	{
+		void *pKey, *pValue;
+		TreeCursor cursor;
+		printf("Range: %s - %s\n", "B", "K");
+		for(ul = treeRange(&t2, &cursor, "B", "K", &pKey, &pValue); ul; ul = treeCursorNext(&cursor, &pKey, &pValue))
+			printf("%s - %s\n", (char*)pKey, (char*)pValue);
+	}
+
+	/* ---- TEST CASE 13 COUNT WITH ONE DESCENT, VALUE CHANGED IN PLACE ---- */
+	treeFree(&t2);
+	treeInit(&t2, compareStr);
+	puts("--- get or insert, upsert -----------------------");
+	for(ul = 0; ul < ulLen; ul++) { /* count appointments per president */
+		unsigned long ulZero = 0, *pulCount;
+		void **ppSlot = treeGetOrInsert(&t2, pppKeysValues[1][ul], strlen(pppKeysValues[1][ul]), &ulZero, sizeof(ulZero), NULL);
+		if(ppSlot == NULL) {
+			fprintf(stderr, "ERROR: get or insert failed!");
+			return EXIT_FAILURE;
+		}
+		pulCount = *ppSlot;
+		(*pulCount)++;
+	}
+	{
+		int iInserted;
+		unsigned long ulCount = 0;
+		treeUpsert(&t2, "Bush", strlen("Bush"), &ulCount, sizeof(ulCount), &iInserted); /* same size, overwritten in place */
+		printf("Upsert: %s %lu %s\n", "Bush", ulCount, iInserted ? "inserted" : "updated");
+		treeUpsert(&t2, "Trump", strlen("Trump"), &ulCount, sizeof(ulCount), &iInserted);
+		printf("Upsert: %s %lu %s\n", "Trump", ulCount, iInserted ? "inserted" : "updated");
+	}
+	{
+		void *pKey, *pValue;
+		TreeCursor cursor;
+		for(ul = treeCursorFirst(&t2, &cursor, TREE_SORTED, &pKey, &pValue); ul; ul = treeCursorNext(&cursor, &pKey, &pValue))
+			printf("%s - %lu\n", (char*)pKey, *((unsigned long*)pValue));
+	}
+
+	/* ---- TEST CASE 14 BUILT-IN KEY KINDS, NO COMPARE FUNCTION CALLS ---- */
+	treeFree(&t2);
+	treeInitKey(&t2, TREE_KEY_STRING, 0, TREE_POOL);
+	puts("--- built-in key kinds --------------------------");
+	for(ul = 0; ul < ulLen; ul++) /* same data as TEST CASE 3 */
+		treeInsert(&t2, pppKeysValues[0][ul], strlen(pppKeysValues[0][ul]), pppKeysValues[1][ul], strlen(pppKeysValues[1][ul]));
+	printData(&t2, 0);
+	treeFree(&t2);
+	treeInitKey(&t2, TREE_KEY_INT64, 0, 0);
+	{
+		long long llKey;
+		void *pKey, *pValue;
+		TreeCursor cursor;
+		for(ul = 0; ul < ulLen; ul++) { /* negative keys sort first */
+			llKey = (long long)ul - 4;
+			treeInsert(&t2, &llKey, sizeof(llKey), pppKeysValues[0][ul], 0);
+		}
+		llKey = -1;
+		for(ul = treeLowerBound(&t2, &cursor, &llKey, &pKey, &pValue); ul; ul = treeCursorNext(&cursor, &pKey, &pValue))
+			printf("%lld - %s\n", *((long long*)pKey), (char*)pValue);
+	}
+
+	/* ---- TEST CASE 15 CONCURRENT MODE AND SHARDS, READS PINNED WHILE KEYS ARE USED ---- */
+	treeFree(&t2);
+	puts("--- concurrent and shards -----------------------");
+	if(treeInitMode(&t2, compareStr, TREE_CONCURRENT) != NULL) { /* NULL when built without threads */
+		TreeShards shards;
+		void *pKey, *pValue;
+		TreeCursor cursor;
+		for(ul = 0; ul < ulLen; ul++)
+			treeInsert(&t2, pppKeysValues[0][ul], strlen(pppKeysValues[0][ul]), pppKeysValues[1][ul], strlen(pppKeysValues[1][ul]));
+		treeDelete(&t2, "Scalia");
+		treeReadBegin(&t2); /* other threads may write, nothing read is freed until treeReadEnd() */
+		for(ul = treeRange(&t2, &cursor, "K", "S", &pKey, &pValue); ul; ul = treeCursorNext(&cursor, &pKey, &pValue))
+			printf("%s - %s\n", (char*)pKey, (char*)pValue);
+		treeReadEnd(&t2);
+		printf("Length: %lu Verify: %d\n", treeLength(&t2), treeVerify(&t2));
+		if(treeInitKey(&t3, TREE_KEY_UINT64, 0, TREE_CONCURRENT) != NULL) { /* built tree read as one written by inserts */
+			unsigned long aul[5] = { 1, 2, 3, 4, 5 };
+			void *apKeys[5] = { &aul[0], &aul[1], &aul[2], &aul[3], &aul[4] };
+			i = treeBuildSorted(&t3, apKeys, NULL, (void**)pppKeysValues[1], NULL, 5, NULL);
+			printf("Built: %d 3 - %s First: %d Rank of 4: %lu\n", i, (char*)treeValue(&t3, &aul[2]),
+				treeCursorFirst(&t3, &cursor, TREE_SORTED, NULL, NULL), treeRank(&t3, &aul[3]));
+			treeFree(&t3);
+		}
+		if(treeShardsInit(&shards, 4, NULL, NULL, TREE_KEY_STRING, 0, 0) != NULL) {
+			for(ul = 0; ul < ulLen; ul++)
+				treeInsert(treeShard(&shards, pppKeysValues[0][ul]), pppKeysValues[0][ul], 0, pppKeysValues[1][ul], 0);
+			printf("Shards: %lu Length: %lu Kagan - %s\n", shards.ulShards, treeShardsLength(&shards),
+				(char*)treeValue(treeShard(&shards, "Kagan"), "Kagan"));
+			treeShardsFree(&shards);
+		}
+	}
+
+	/* ---- TEST CASE 16 SAVE SNAPSHOT, LOAD MAPS FILE AND READS KEYS IN PLACE ---- */
+	treeFree(&t2);
+	puts("--- save and load -------------------------------");
+	if(treeSave(&tree, "treelibc_test.tree") && (treeLoad(&t2, "treelibc_test.tree", compareStr) != NULL)) {
+		printData(&t2, 0); /* same orders as TEST CASE 5 */
+		printf("Kagan - %s Insert: %d Verify: %d\n", (char*)treeValue(&t2, "Kagan"),
+			treeInsert(&t2, "Alito", 0, "W. Bush", 0), treeVerify(&t2)); /* read only until treeFree() */
+		if(treeInit(&t3, compareStr) != NULL) { /* saving again replaces the file whole, the mapped one stays as it was */
+			treeInsert(&t3, "Kagan", strlen("Kagan"), "Biden", strlen("Biden"));
+			printf("Saved over: %d Kagan - %s", treeSave(&t3, "treelibc_test.tree"), (char*)treeValue(&t2, "Kagan"));
+			treeFree(&t3);
+			if(treeLoad(&t3, "treelibc_test.tree", compareStr) != NULL)
+				printf(" Reloaded: %lu Kagan - %s", treeLength(&t3), (char*)treeValue(&t3, "Kagan"));
+			puts("");
+			treeFree(&t3);
+		}
+		{ /* first entry key offset, after 80 byte head and 8 byte prefix, now points outside the file */
+			FILE *pFile = fopen("treelibc_test.tree", "r+b");
+			unsigned long long ullBad = (unsigned long long)-1 / 2;
+			if(pFile != NULL) {
+				fseek(pFile, 88, SEEK_SET);
+				fwrite(&ullBad, sizeof(ullBad), 1, pFile);
+				fclose(pFile);
+				printf("Corrupt loaded: %d\n", treeLoad(&t3, "treelibc_test.tree", compareStr) != NULL);
+			}
+		}
+	}
+	remove("treelibc_test.tree");
+
+	/* ---- TEST CASE 17 STATISTICS, SHAPE ALWAYS, COUNTERS WHEN BUILT WITH TREELIBC_STATS ---- */
+	treeFree(&t2);
+	puts("--- statistics ----------------------------------");
+	for(i = 0; i < 2; i++) {
+		TreeStats stats;
+		treeInitMode(&t2, compareStr, i ? TREE_BPLUS : 0);
+		for(ul = 0; ul < ulLen; ul++)
+			treeInsert(&t2, pppKeysValues[0][ul], strlen(pppKeysValues[0][ul]), pppKeysValues[1][ul], strlen(pppKeysValues[1][ul]));
+		treeValue(&t2, "Kagan");
+		if(treeStats(&t2, &stats) != NULL)
+			printf("%s Length: %lu Nodes: %lu Height: %lu Depth: %.2f Keys: %lu Values: %lu Lookups: %s\n", i ? "B+tree" : "Red-black",
+				stats.ulLength, stats.ulNodes, stats.ulHeight, stats.dDepthAvg, (unsigned long)stats.sizeTkeys, (unsigned long)stats.sizeTvalues,
+				stats.aullCalls[TREE_STATS_LOOKUP] ? "counted" : "not counted");
+		treeStatsReset(&t2);
+		treeFree(&t2);
+	}
+
+	/* ---- TEST CASE 18 BATCHES, UNSORTED KEYS INTERLEAVED, SORTED KEYS FOLLOW SHARED PATH ---- */
+	puts("--- batches -------------------------------------");
+	if(treeInit(&t2, compareStr) != NULL) {
+		void *apKeys[] = { "Thomas", "Souter", "Alito, Jr", "Kagan" }, *apSorted[] = { "Breyer", "Ginsburg", "Kagan", "Kennedy" };
+		void *apValues[4];
+		printf("Inserted: %lu", treeInsertBatch(&t2, (void**)pppKeysValues[0], NULL, (void**)pppKeysValues[1], NULL, ulLen));
+		printf(" Again: %lu\n", treeInsertBatch(&t2, (void**)pppKeysValues[0], NULL, (void**)pppKeysValues[1], NULL, ulLen));
+		for(i = 0; i < 2; i++) {
+			printf("Found: %lu", treeValueBatch(&t2, i ? apSorted : apKeys, 4, apValues));
+			for(ul = 0; ul < 4; ul++)
+				printf(" %s - %s", (char*)(i ? apSorted : apKeys)[ul], (apValues[ul] == NULL) ? "(none)" : (char*)apValues[ul]);
+			puts("");
+		}
+	}
+
+	/* ---- TEST CASE 19 PARALLEL BUILD, VISIT, REDUCE, SORTED ARRAY AND FREE ---- */
+	treeFree(&t2);
+	puts("--- parallel ------------------------------------");
+	if(treeInit(&t2, compareDescendUL) != NULL) {
+		unsigned long *pulKeys, ulSum = 0, ulKeys = 10000;
+		void **ppKeys, **ppSorted;
+		char *pcSeen;
+		pulKeys = malloc(ulKeys * sizeof(unsigned long));
+		ppKeys = malloc(ulKeys * sizeof(void*));
+		pcSeen = calloc(ulKeys, 1);
+		if((pulKeys != NULL) && (ppKeys != NULL) && (pcSeen != NULL)) {
+			for(ul = 0; ul < ulKeys; ul++) { /* descending numbers ascend by compareDescendUL */
+				pulKeys[ul] = ulKeys - 1 - ul;
+				ppKeys[ul] = &pulKeys[ul];
+			}
+			printf("Built: %d", treeParallelBuildSorted(&t2, 4, ppKeys, NULL, NULL, NULL, ulKeys, NULL));
+			printf(" Length: %lu Verify: %d\n", treeLength(&t2), treeVerify(&t2));
+			treeParallelForEach(&t2, 4, markVisit, pcSeen);
+			for(ul = 0, i = 0; ul < ulKeys; ul++)
+				i += pcSeen[ul];
+			treeParallelReduce(&t2, 4, &ulSum, sizeof(ulSum), sumReduce, sumJoin, NULL);
+			if((ppSorted = treeParallelArraySorted(&t2, 4)) != NULL)
+				printf("Visited: %d Sum: %lu First: %lu Last: %lu\n", i, ulSum,
+					*(unsigned long*)ppSorted[0], *(unsigned long*)ppSorted[ulKeys - 1]);
+		}
+		treeParallelFree(&t2, 4);
+		free(pulKeys);
+		free(ppKeys);
+		free(pcSeen);
+	}
+
+	/* ---- TEST CASE 20 BOUNDED CACHE, LOOKUPS KEEP A KEY, OLDEST OTHERS EVICTED ---- */
+	treeFree(&t2);
+	puts("--- cache ---------------------------------------");
+	if((treeInit(&t2, compareStr) != NULL) && treeCacheLimit(&t2, 5, 0, 1, printEvict, NULL)) {
+		printf("Evicted:");
+		for(ul = 0; ul < ulLen; ul++) {
+			treeInsert(&t2, pppKeysValues[0][ul], 0, pppKeysValues[1][ul], 0);
+			if(ul >= 3) /* least recently used goes first */
+				treeValue(&t2, "Scalia");
+		}
+		puts("");
+		printData(&t2, 0);
+	}
+
+	/* ---- TEST CASE 21 HASH INDEX, POINT LOOKUPS WITHOUT DESCENT, ORDER KEPT ---- */
+	treeFree(&t2);
+	puts("--- hash index ----------------------------------");
+	if((treeInit(&t2, compareStr) != NULL) && treeHashIndex(&t2, 1, hashStr)) {
+		for(ul = 0; ul < ulLen; ul++)
+			treeInsert(&t2, pppKeysValues[0][ul], 0, pppKeysValues[1][ul], 0);
+		treeDelete(&t2, "Scalia");
+		treeUpdate(&t2, "Thomas", "H. W. Bush", 0);
+		printf("Kagan - %s Scalia - %s Thomas - %s Verify: %d\n", (char*)treeValue(&t2, "Kagan"),
+			(treeValue(&t2, "Scalia") == NULL) ? "(none)" : "found", (char*)treeValue(&t2, "Thomas"), treeVerify(&t2));
+		printf("Sorted:");
+		for(ul = 0; ul < treeLength(&t2); ul++)
+			printf(" %s", (char*)treeArraySorted(&t2)[ul]);
+		puts("");
+	}
+
+	/* ---- TEST CASE 22 COMPACT NODES, NUMBER KEYS AND SHORT VALUES HELD IN NODE ---- */
+	treeFree(&t2);
+	puts("--- compact -------------------------------------");
+	if(treeInitKey(&t2, TREE_KEY_UINT64, 0, TREE_COMPACT) != NULL) {
+		TreeStats stats;
+		for(ul = 0; ul < ulLen; ul++) /* values of 7 bytes or less need no copy of their own */
+			treeInsert(&t2, &ul, sizeof(ul), pppKeysValues[1][ul], strlen(pppKeysValues[1][ul]));
+		ul = 2;
+		treeDelete(&t2, &ul);
+		ul = 0;
+		treeUpdate(&t2, &ul, "H. W. Bush", strlen("H. W. Bush"));
+		treeStats(&t2, &stats);
+		printf("Node bytes: %lu Value copies: %lu Verify: %d\n", (unsigned long)(stats.sizeTnodes / stats.ulNodes),
+			(unsigned long)stats.sizeTvalues, treeVerify(&t2));
+		printData(&t2, 1);
+	}
+
+	/* ---- TEST CASE 23 SNAPSHOT OF COMPACT TREE UNCHANGED BY LATER WRITES ---- */
+	puts("--- snapshot ------------------------------------");
+	if(treeSnapshot(&t2, &t3) != NULL) {
+		ul = 1;
+		treeDelete(&t2, &ul);
+		ul = 3;
+		treeUpdate(&t2, &ul, "Carter", strlen("Carter"));
+		ul = 9;
+		printf("Snapshot insert: %d Tree insert: %d\n", treeInsert(&t3, &ul, sizeof(ul), "Trump", strlen("Trump")),
+			treeInsert(&t2, &ul, sizeof(ul), "Trump", strlen("Trump")));
+		printf("Verify: %d Snapshot verify: %d\n", treeVerify(&t2), treeVerify(&t3));
+		puts("--- tree ---");
+		printData(&t2, 1);
+		puts("--- snapshot ---");
+		printData(&t3, 1);
+		treeFree(&t3);
+	}
+	printf("Red-black snapshot: %d\n", treeSnapshot(&tree, &t3) != NULL); /* TREE_COMPACT only */
+
+	/* ---- TEST CASE 24 JOIN, SPLIT AND SET OPERATIONS RELINK NODES OF TWO TREES ---- */
+	treeFree(&t2);
+	puts("--- set operations ------------------------------");
+	treeInitKey(&t2, TREE_KEY_UINT64, 0, 0);
+	treeInitKey(&t3, TREE_KEY_UINT64, 0, 0);
+	for(ul = ulLen; ul-- > 0;) { /* even keys newest first, multiples of 3 in the other tree */
+		if((ul % 2) == 0)
+			treeInsert(&t2, &ul, sizeof(ul), pppKeysValues[1][ul], strlen(pppKeysValues[1][ul]));
+		if((ul % 3) == 0)
+			treeInsert(&t3, &ul, sizeof(ul), pppKeysValues[0][ul], 0);
+	}
+	i = treeUnion(&t2, &t3, 1); /* node of tree kept where both hold a key, other left empty */
+	printf("Union: %d Other: %lu Verify: %d\n", i, treeLength(&t3), treeVerify(&t2));
+	printData(&t2, 1);
+	ul = 4;
+	i = treeSplit(&t2, &ul, &t3);
+	printf("Split: %d Lengths: %lu %lu\n", i, treeLength(&t2), treeLength(&t3));
+	i = treeJoin(&t3, &t2); /* lower keys of t2 go below, its insertion order after */
+	printf("Join: %d Length: %lu Verify: %d\n", i, treeLength(&t3), treeVerify(&t3));
+	printData(&t3, 1);
+	for(ul = 2; ul < 6; ul += 3) /* 2 and 5 */
+		treeInsert(&t2, &ul, sizeof(ul), pppKeysValues[0][ul], 0);
+	i = treeDifference(&t3, &t2, 0);
+	printf("Difference: %d Length: %lu\n", i, treeLength(&t3));
+	for(ul = 0; ul < ulLen; ul += 7) /* 0 and 7 */
+		treeInsert(&t2, &ul, sizeof(ul), pppKeysValues[0][ul], 0);
+	i = treeIntersect(&t3, &t2, 0);
+	printf("Intersect: %d Verify: %d\n", i, treeVerify(&t3));
+	printData(&t3, 1);
+	treeFree(&t3);
+
+	/* ---- TEST CASE 25 PAGED TREE IN A FILE, MORE PAGES THAN ITS BUFFER POOL, REOPENED ---- */
+	puts("--- paged ---------------------------------------");
+	remove("treelibc_test.pages");
+	if((treeInitKey(&t3, TREE_KEY_UINT64, 0, 0) != NULL) && (treeOpen(&t3, "treelibc_test.pages", 0) != NULL)) {
+		void *pKey, *pValue;
+		TreeCursor cursor;
+		TreeStats stats;
+		for(ul = 0; ul < 20000; ul++) /* 64 frames of the smallest pool hold a third of the pages */
+			treeInsert(&t3, &ul, sizeof(ul), pppKeysValues[1][ul % ulLen], strlen(pppKeysValues[1][ul % ulLen]));
+		treeStats(&t3, &stats);
+		printf("Length: %lu Pages: %lu Height: %lu Verify: %d\n", treeLength(&t3), stats.ulNodes, stats.ulHeight, treeVerify(&t3));
+		for(ul = ulLen; ul < 20000; ul++)
+			treeDelete(&t3, &ul);
+		ul = 0;
+		treeUpdate(&t3, &ul, "H. W. Bush", strlen("H. W. Bush"));
+		printf("Sync: %d Upsert: %s\n", treeSync(&t3), (treeUpsert(&t3, &ul, sizeof(ul), NULL, 0, NULL) == NULL) ? "refused" : "done");
+		treeFree(&t3); /* written back, file keeps the tree */
+		if((treeInitKey(&t3, TREE_KEY_UINT64, 0, 0) != NULL) && (treeOpen(&t3, "treelibc_test.pages", 1 << 20) != NULL)) {
+			printf("Reopened verify: %d\n", treeVerify(&t3));
+			printData(&t3, 1); /* sorted only */
+			ul = 100;
+			if(treeFloor(&t3, &cursor, &ul, &pKey, &pValue))
+				printf("Floor of 100: %lu - %s\n", *((unsigned long*)pKey), (char*)pValue);
+		}
+		treeFree(&t3);
+	}
+	remove("treelibc_test.pages");
+
+	/* ---- TEST CASE 26 PAGED TREE OF USER COMPARED STRING KEYS, UPDATE TAKES KEY LENGTH FROM ITS PAGE ---- */
+	puts("--- paged user keys -----------------------------");
+	remove("treelibc_test.pages");
+	if((treeInit(&t3, compareStr) != NULL) && (treeOpen(&t3, "treelibc_test.pages", 0) != NULL)) {
+		for(ul = 0; ul < ulLen; ul++)
+			treeInsert(&t3, pppKeysValues[0][ul], strlen(pppKeysValues[0][ul]), pppKeysValues[1][ul], strlen(pppKeysValues[1][ul]));
+		printf("Update: %d Update missing: %d Delete: %d\n", treeUpdate(&t3, "Roberts", "Chief W. Bush", strlen("Chief W. Bush")),
+			treeUpdate(&t3, "Souter", "H. W. Bush", strlen("H. W. Bush")), treeDelete(&t3, "Scalia"));
+		treeFree(&t3);
+		if((treeInit(&t3, compareStr) != NULL) && (treeOpen(&t3, "treelibc_test.pages", 0) != NULL)) {
+			printf("Reopened verify: %d Kagan: %s\n", treeVerify(&t3), (char*)treeValue(&t3, "Kagan"));
+			printData(&t3, 0);
+		}
+		treeFree(&t3);
+	}
+	remove("treelibc_test.pages");
+
 	treeFree(&tree);
 	treeFree(&t2);
 
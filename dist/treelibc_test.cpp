@@ -0,0 +1,70 @@
+/*
+ =============================================================================
+ Name        : treelibc_test.cpp
+ Author      : David T. Silvers Sr.
+ Contact     : davidtsilvers@aol.com
+ Created     : 2026-10-16
+ Updated     : 2026-10-16
+ Version     : 2.20
+ License     : GNU LGPL
+ Description : Tester and usage example for treelibc.hpp
+               treelibc "Associative Balanced Tree Container"
+               SEE: treelibc.hpp, treelibc.c AND treelibc.h
+
+ Copyright   : Copyright 2014 by David T. Silvers Sr.
+
+	This file is part of treelibc.
+
+    treelibc is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    treelibc is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with treelibc. If not, see <http://www.gnu.org/licenses/>.
+  =============================================================================
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include "treelibc.hpp"
+
+static const char *ppcKeys[] = { "Scalia", "Kennedy", "Thomas", "Ginsburg", "Breyer", "Roberts", "Alito, Jr", "Sotomayor", "Kagan" };
+static const long plYears[] = { 1986, 1988, 1991, 1993, 1994, 2005, 2006, 2009, 2010 };
+
+int main(void) {
+	unsigned long ul, ulLen = sizeof(ppcKeys) / sizeof(*ppcKeys);
+
+	/* ------- TEST CASE 1 STRING KEYS, BUILT-IN COMPARE INLINED ------- */
+	treelibc::Tree<std::string, long> byName;
+	puts("--- string keys ---------------------------------");
+	for(ul = 0; ul < ulLen; ul++)
+		byName[ppcKeys[ul]] = plYears[ul];
+	byName.insert_or_assign("Kagan", 2010L);
+	byName.erase("Scalia");
+	for(treelibc::Tree<std::string, long>::iterator it = byName.begin(); it != byName.end(); ++it)
+		printf("%s - %ld\n", it.key(), it.value());
+
+	/* ---- TEST CASE 2 INTEGER KEYS DESCENDING, COMPARE GENERATED ---- */
+	treelibc::Tree<long, unsigned long, std::greater<long> > byYear(TREE_BPLUS);
+	puts("--- integer keys descending ---------------------");
+	for(ul = 0; ul < ulLen; ul++)
+		byYear.insert(plYears[ul], ul);
+	if(byYear.find(1991) == NULL) {
+		fprintf(stderr, "ERROR: key not found!");
+		return EXIT_FAILURE;
+	}
+	for(treelibc::Tree<long, unsigned long, std::greater<long> >::iterator it = byYear.lower_bound(2005); it != byYear.end(); ++it)
+		printf("%ld - %s\n", it.key(), ppcKeys[it.value()]);
+	printf("Length: %lu\n", (unsigned long)byYear.size());
+
+	puts("FINISHED!");
+
+return EXIT_SUCCESS;
+}
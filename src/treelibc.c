@@ -4,8 +4,8 @@
  Author      : David T. Silvers Sr.
  Contact     : davidtsilvers@aol.com
  Created     : 2014-02-03
- Updated     : 2014-02-27
- Version     : 1.101
+ Updated     : 2026-10-16
+ Version     : 4.00
  License     : GNU LGPL
  Description : Associative Balanced Tree Container with no recursive limits.
                Generic implementation requires user supplied compare function.
@@ -33,10 +33,29 @@
     License along with treelibc. If not, see <http://www.gnu.org/licenses/>.
   =============================================================================
  */
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L /* posix_memalign(), pread() */
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <limits.h>
 #include "treelibc.h"
+#if !defined(_WIN32) && !defined(TREELIBC_NO_THREADS) && (defined(__GNUC__) || defined(__clang__))
+#include <pthread.h>
+#include <sched.h>
+#define CONCURRENT_OK /* TREE_CONCURRENT available, link with -pthread */
+#endif
+#if defined(TREELIBC_STATS) && (TREELIBC_STATS >= 2)
+#include <time.h>
+#endif
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 typedef struct node {
 	size_t sizeTkey;
@@ -44,284 +63,2059 @@ typedef struct node {
 	size_t sizeTvalue;
 	void *pValue;
 	enum { NODE_RED, NODE_BLACK } color;
+	unsigned long ulSize; /* nodes in subtree rooted here, for rank and select */
+	uint64_t ui64Prefix; /* keyPrefix() of key for built-in key kinds, spares most key dereferences */
 	struct node *pPrev, *pNext, *pParent, *pRight, *pLeft;
 } Node;
 
+typedef struct slab { /* TREE_POOL block of nodes, released all at once by treeFree() */
+	struct slab *pNext;
+} Slab;
+
+typedef struct pool { /* TREE_POOL allocator state hung from Tree.pp */
+	Slab *pSlabs; /* most recent slab first */
+	Node *pFree; /* nodes recycled by treeDelete(), linked through pNext */
+	char *pcNext; /* next unused node in current slab */
+	unsigned long ulLeft; /* unused nodes left in current slab */
+	unsigned long ulSlabLen; /* nodes in current slab, doubles up to POOL_SLAB_MAX */
+	unsigned long ulOutside; /* copies too large for inline storage, treeFree() skips list walk when 0 */
+} Pool;
+
+#define STALE_ARRAY 0x01 /* Tree.iStale: treeArray() must rebuild */
+#define STALE_SORTED 0x02 /* Tree.iStale: treeArraySorted() must rebuild */
+
+#define BOUND_LOWER 0 /* seekNode(): first key >= */
+#define BOUND_UPPER 1 /* seekNode(): first key > */
+#define BOUND_FLOOR 2 /* seekNode(): last key <= */
+#define BOUND_BELOW 3 /* seekNode(): last key < */
+
+#define BUILD_DEPTH_MAX 64 /* treeBuildSorted() stack, enough for any unsigned long length */
+#define HASH_MIN 16 /* slots of smallest hash index table, power of 2 */
+#define HASH_MOVE 8 /* slots of old table moved per write while hash index grows */
+#define HASH_GONE ((Node*)1) /* old table slot moved or deleted, probes go on past it */
+#define PAR_PIECES 8 /* pieces per thread, threads done early steal the spares */
+#define PAR_GRAIN 1024 /* fewest keys worth a piece of their own */
+#define PAR_THREADS_MAX 256
+#define BATCH_WAYS 8 /* descents interleaved by findBatch(), each one's next node loads while the others compare */
+#define BATCH_CHUNK 256 /* keys resolved per pass of treeValueBatch() and treeInsertBatch() */
+#define BATCH_DEPTH_MAX (2 * BUILD_DEPTH_MAX) /* findSorted() path, red-black height is at most 2 log2(n + 1) */
+#define SET_DEPTH_MAX BATCH_DEPTH_MAX /* split path and merge frames, one per level of a red-black tree */
+#define SET_UNION 0 /* setMerge() keys of either tree, tree's node kept when both hold a key */
+#define SET_INTERSECT 1 /* setMerge() keys of both trees, tree's node kept */
+#define SET_DIFFERENCE 2 /* setMerge() keys of tree missing from other */
+#if defined(__GNUC__) || defined(__clang__)
+#define PREFETCH(p) __builtin_prefetch(p)
+#else
+#define PREFETCH(p) ((void)0)
+#endif
+
+#define SIZE(n) (((n) == NULL) ? 0 : (n)->ulSize)
+#define BLACK(n) (((n) == NULL) || ((n)->color == NODE_BLACK)) /* missing children count as black */
+
+#define SIGN64 ((uint64_t)1 << 63)
+
+#ifndef TREELIBC_BPLUS_ORDER
+#define TREELIBC_BPLUS_ORDER 32 /* most keys held by a B+tree leaf, children of an inner node */
+#endif
+#define BP_ORDER TREELIBC_BPLUS_ORDER
+#if BP_ORDER < 4
+#error TREELIBC_BPLUS_ORDER must be at least 4
+#endif
+#define BP_LEAF_MIN (BP_ORDER / 2)
+#define BP_INNER_MIN ((BP_ORDER / 2) - 1)
+#define BP_DEPTH_MAX 64 /* path stack, B+tree of minimum fanout 2 holding every unsigned long */
+#define BP_ALIGN 64 /* cache line */
+
+typedef struct bpNode { /* TREE_BPLUS header shared by inner nodes and leaves, Tree.pr is root */
+	int iLeaf;
+	int iCount; /* keys held */
+} BpNode;
+
+typedef struct bpInner { /* key i is smallest key below child i + 1, a spare slot eases splitting */
+	BpNode h;
+	uint64_t aui64Prefix[BP_ORDER]; /* keyPrefix() of each key, searched before any key is dereferenced */
+	void *apKey[BP_ORDER];
+	BpNode *apChild[BP_ORDER + 1];
+} BpInner;
+
+typedef struct bpLeaf { /* sorted keys with values, linked from Tree.ph to Tree.pt for scans */
+	BpNode h;
+	uint64_t aui64Prefix[BP_ORDER + 1];
+	void *apKey[BP_ORDER + 1];
+	void *apValue[BP_ORDER + 1];
+	size_t asizeTkey[BP_ORDER + 1];
+	size_t asizeTvalue[BP_ORDER + 1];
+	struct bpLeaf *pPrev, *pNext;
+} BpLeaf;
+
+typedef struct bpPath { /* inner nodes and child taken on the way down, B+tree has no parent links */
+	BpInner *pInner;
+	int iChild;
+} BpPath;
+
+#define CP_CHUNK_BITS 9 /* TREE_COMPACT nodes per chunk as power of 2, chunks never move so keys and values in nodes stay put */
+#define CP_CHUNK (1UL << CP_CHUNK_BITS)
+#define CP_INDEX_MAX ((1UL << 30) - 1) /* child indexes give their two low bits to flags */
+#define CP_DEPTH_MAX 64 /* path stack, red-black height of CP_INDEX_MAX nodes is at most 60 */
+#define CP_RESERVE (3 * CP_DEPTH_MAX) /* free nodes before a write that may copy, path and the siblings fixups touch */
+#define CP_RED 0x01 /* CpNode.ui32Left flag */
+#define CP_KEY_COPY 0x02 /* CpNode.ui32Left flag: key.p is a cpCopy() */
+#define CP_VALUE_ADDR 0 /* CpNode.ui32Right value kind: value.p address assigned */
+#define CP_VALUE_COPY 1 /* CpNode.ui32Right value kind: value.p is a cpCopy() */
+#define CP_VALUE_INLINE 2 /* CpNode.ui32Right value kind: copy of 1 to 7 bytes and NUL in value.auc, length last */
+#define CP_VALUE_INLINE_MAX 7
+#define CP_NODE(c, i) (&(c)->ppChunks[(i) >> CP_CHUNK_BITS][(i) & (CP_CHUNK - 1)])
+#define CP_LEFT(n) ((n)->ui32Left >> 2)
+#define CP_RIGHT(n) ((n)->ui32Right >> 2)
+#define CP_CHILD(n, r) ((r) ? CP_RIGHT(n) : CP_LEFT(n))
+#define CP_KIND(n) ((n)->ui32Right & 3)
+#define CP_KEY_INLINE(t) ((((t)->iKey >= TREE_KEY_INT64) && ((t)->iKey <= TREE_KEY_DOUBLE)) \
+	|| (((t)->iKey == TREE_KEY_MEMCMP) && ((t)->sizeTcmp <= 8)))
+#define CP_KEY(t, n) (CP_KEY_INLINE(t) ? (void*)(n)->key.auc : (n)->key.p)
+#define CP_VALUE(n) ((CP_KIND(n) == CP_VALUE_INLINE) ? (void*)(n)->value.auc : (n)->value.p)
+#define CP_INLINE_LEN(n) (((n)->value.auc[7] == 0) ? CP_VALUE_INLINE_MAX : (size_t)(n)->value.auc[7])
+#define CP_COPY_LEN(p) (((size_t*)(p))[-1])
+#define CP_COPY_REFS(p) (((size_t*)(p))[-2]) /* nodes holding copy beyond the first, copied nodes share it */
+#define CP_EXTRA(c, i) ((c)->ppui32Extra[(i) >> CP_CHUNK_BITS][(i) & (CP_CHUNK - 1)]) /* references beyond the first */
+#if defined(__GNUC__) || defined(__clang__) /* snapshots are released by any thread, chunks freed by the last reference */
+#define CP_PEEK(p) __atomic_load_n(&(p), __ATOMIC_RELAXED)
+#define CP_TAKE(p, pV) ((pV) = __atomic_exchange_n(&(p), NULL, __ATOMIC_ACQUIRE))
+#define CP_PUSH(p, pV) do { (pV)->pNext = CP_PEEK(p); } \
+	while(!__atomic_compare_exchange_n(&(p), &(pV)->pNext, (pV), 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+#define CP_REFS(c, n) __atomic_add_fetch(&(c)->ulRefs, (unsigned long)(n), __ATOMIC_ACQ_REL)
+#else /* snapshots released by the thread writing tree */
+#define CP_PEEK(p) (p)
+#define CP_TAKE(p, pV) ((pV) = (p), (p) = NULL)
+#define CP_PUSH(p, pV) do { (pV)->pNext = (p); (p) = (pV); } while(0)
+#define CP_REFS(c, n) ((c)->ulRefs += (unsigned long)(n))
+#endif
+#define CP_IS_RED(c, i) (((i) != 0) && (CP_NODE(c, i)->ui32Left & CP_RED)) /* index 0 counts as black */
+
+typedef union cpWord { /* TREE_COMPACT key or value, pointer or up to 8 bytes held in node */
+	void *p;
+	uint64_t ui64;
+	unsigned char auc[8];
+} CpWord;
+
+typedef struct cpNode { /* TREE_COMPACT node, 24 bytes, no parent, sizes or insertion order */
+	uint32_t ui32Left; /* left child index << 2 | CP_RED | CP_KEY_COPY, index 0 = none */
+	uint32_t ui32Right; /* right child index << 2 | CP_VALUE_* */
+	CpWord key; /* built-in number kinds and short TREE_KEY_MEMCMP inline, else pointer */
+	CpWord value;
+} CpNode;
+
+typedef struct cpTree { /* TREE_COMPACT state hung from Tree.pr, treeSnapshot() view of another one's chunks */
+	CpNode **ppChunks;
+	uint32_t ui32Chunks, ui32ChunksMax;
+	uint32_t ui32Next; /* index never used yet, starts at 1 */
+	uint32_t ui32Free; /* deleted nodes linked through left index, 0 = none */
+	uint32_t ui32FreeLen;
+	uint32_t ui32Root;
+	uint32_t ui32Views; /* snapshots not yet unreferenced, nodes may be shared while above 0 */
+	uint32_t **ppui32Extra; /* per chunk CP_EXTRA(), NULL until first snapshot */
+	CpNode ***pppOld; /* directories outgrown since first snapshot, views may still read them */
+	uint32_t ui32Old;
+	unsigned long ulRefs; /* tree and views not released, last one frees chunks */
+	struct cpTree *pReleased; /* views released by any thread, unreferenced by next write */
+	struct cpTree *pStore; /* view: tree whose chunks it reads. NULL = tree */
+	struct cpTree *pNext; /* view: next on pReleased */
+} CpTree;
+
+typedef struct cpIter { /* TREE_COMPACT in order walk, nodes hold no parent to climb back to */
+	CpTree *pC;
+	int d;
+	uint32_t aui32Node[CP_DEPTH_MAX];
+	unsigned char aucDepth[CP_DEPTH_MAX];
+	uint32_t ui32Down; /* subtree whose left spine goes on the stack next */
+	int iDown; /* its depth */
+} CpIter;
+
+typedef struct cpRange { /* cpBuild() sorted index range still to link under parent */
+	unsigned long ulLow, ulHigh, ulDepth;
+	uint32_t ui32Parent;
+	int iRight;
+} CpRange;
+
+typedef struct cache { /* treeCacheLimit() state hung from Tree.pe */
+	unsigned long ulMaxLen; /* 0 = any */
+	size_t sizeTmax; /* 0 = any */
+	size_t sizeTbytes; /* nodes with copies held outside them, kept only while cache is set */
+	int iLRU;
+	PFEVICT pfEvict;
+	void *pArg;
+} Cache;
+
+typedef struct hashSlot { /* hash index entry, NULL node = empty */
+	Node *pNode;
+	uint64_t ui64Hash;
+} HashSlot;
+
+typedef struct hashIndex { /* treeHashIndex() linear probe tables hung from Tree.px */
+	PFHASH pfHash; /* NULL = hashKey() */
+	HashSlot *pSlots;
+	unsigned long ulMask, ulUsed;
+	int iShift; /* 64 - log2 slots, slot from top bits of hash times golden ratio */
+	HashSlot *pOld; /* table being emptied into pSlots while growing, NULL = none */
+	unsigned long ulOldMask, ulOldUsed, ulMoved;
+	int iOldShift;
+} HashIndex;
+
+typedef struct buildRange { /* treeBuildSorted() sorted index range still to link under parent */
+	unsigned long ulLow, ulHigh, ulDepth;
+	Node *pParent, **ppLink;
+} BuildRange;
+
+typedef struct setPart { /* red-black subtree with its black height, root may be red, NULL = empty */
+	Node *pRoot;
+	unsigned long ulHeight; /* black nodes on any path from root down, root counted */
+} SetPart;
+
+typedef struct setFrame { /* merge of two halves waiting on their results */
+	Node *pKey; /* node joining left and right results, NULL = join without one */
+	SetPart aRight[2]; /* right halves of tree and other, merged once left is done */
+	SetPart left; /* merged left halves */
+	int iLeft; /* left done */
+} SetFrame;
+
+typedef struct setJob { /* one treeUnion(), treeIntersect() or treeDifference(), or one piece of it */
+	Tree tree; /* copy of tree for comparisons, its root moved about by joins */
+	int iOp; /* SET_* */
+	SetPart aPart[2]; /* subtrees of tree and other to merge, result left in aPart[0] */
+	Node *apDrop[2]; /* nodes dropped from tree and other, chained through pRight */
+} SetJob;
+
+typedef struct setSlot { /* parallel merge, heap of halves where slot i divides into 2i and 2i + 1 */
+	SetJob job;
+	SetFrame frame;
+	int iUsed; /* 0 = none, 1 = piece for a worker, 2 = divided */
+} SetSlot;
+
+typedef struct parPiece { /* in-order share of whole tree work, pieces of one call never overlap */
+	void *pStart; /* red-black subtree root or lone node, B+tree first leaf */
+	void *pEnd; /* B+tree leaf after piece, NULL = last leaf */
+	unsigned long ulFirst; /* sorted index of first key, or first array index */
+	unsigned long ulLen; /* keys, 0 for B+tree */
+	int iSingle; /* red-black node without its subtrees, they are pieces of their own */
+	int iFailed; /* out of memory */
+	BuildRange range; /* treeParallelBuildSorted() subtree below the cut */
+	SetJob *pSet; /* treeUnion(), treeIntersect() and treeDifference() halves to merge */
+} ParPiece;
+
+typedef struct parQueue { /* pieces of a worker not yet taken, owner takes from the front, thieves from the back */
+	unsigned long ulNext, ulEnd;
+#ifdef CONCURRENT_OK
+	pthread_mutex_t mutex;
+#endif
+} ParQueue;
+
+typedef struct parJob { /* one treeParallel*() call, shared by its workers */
+	Tree *pTree;
+	void (*pfPiece)(struct parJob *, ParPiece *); /* work of one piece */
+	ParPiece *pPieces;
+	unsigned long ulPieces;
+	ParQueue *pQueues;
+	int iThreads; /* asked for */
+	int iWorkers; /* running this parRun() */
+	PFVISIT pfVisit;
+	PFREDUCE pfReduce;
+	void *pArg;
+	char *pcAcc; /* accumulator per piece, each on its own cache lines */
+	size_t sizeTstride;
+	void **ppOut; /* treeParallelArraySorted() */
+	Node **ppNodes; /* treeParallelBuildSorted() node per sorted index */
+	void **ppKeys, **ppValues;
+	const size_t *pSizeTkeys, *pSizeTvalues;
+	unsigned long ulRed; /* treeParallelBuildSorted() depth of red nodes */
+} ParJob;
+
+typedef struct parWorker {
+	ParJob *pJob;
+	int iWorker;
+} ParWorker;
+
+#ifdef CONCURRENT_OK
+#define CONC_TLS __thread
+#define CONC_STRIPES 16 /* reader counters, threads spread over them round robin, one bit each in Concurrent.uiClear */
+#define CONC_TRIES 4 /* optimistic reads before a reader takes the writer lock */
+#define CONC_RETIRE 256 /* retired entries before a writer tries to free them */
+#define CONC_SPARE 3 /* most entries one write retires: node, its old key and value */
+#define CONC_LOAD(x) __atomic_load_n(&(x), __ATOMIC_ACQUIRE) /* node field optimistic readers follow, see seekNode() */
+#define CONC_STORE(x, v) __atomic_store_n(&(x), (v), __ATOMIC_RELEASE) /* node field a reader may be loading, data behind it first */
+
+typedef struct retired { /* memory unlinked by a writer, freed once every reader counter was seen at zero after */
+	void *p;
+	size_t sizeT; /* data size for releaseData() */
+	int iNode; /* p is a Node for releaseNode() */
+} Retired;
+
+typedef struct concurrent { /* TREE_CONCURRENT state hung from Tree.pc */
+	struct { unsigned long ulReaders; char acPad[BP_ALIGN - sizeof(unsigned long)]; } aStripe[CONC_STRIPES];
+	unsigned long ulSeq; /* odd while a writer changes the tree */
+	pthread_mutex_t mutex; /* serializes writers and readers out of tries */
+	Retired *pRetired;
+	unsigned long ulRetired, ulRetiredMax;
+	unsigned long ulGrace; /* pRetired entries waiting out a grace period, later ones wait for the next */
+	unsigned int uiClear; /* bit per reader counter seen at zero since the grace period began */
+} Concurrent;
+
+static CONC_TLS unsigned int uiStripe; /* 1 based reader counter of calling thread, 0 = unassigned */
+static unsigned int uiThreads; /* threads seen by readPin() */
+#else
+#define CONC_LOAD(x) (x)
+#define CONC_STORE(x, v) ((x) = (v))
+#endif
+
+#define MAP_MAGIC "TREELIBC" /* treeSave() file starts with these 8 bytes */
+#define MAP_VERSION 1 /* file layout, treeLoad() refuses others */
+#define MAP_ENDIAN 0x01020304 /* written in native byte order, read back only by same order */
+#define MAP_ALIGN(n) (((n) + 1 + 7) & ~(uint64_t)7) /* copy with NUL, next copy 8 byte aligned */
+#define MAP_TEMP ".XXXXXX" /* treeSave() writes file name plus this, mkstemp() fills the X, renamed over file when complete */
+
+typedef struct mapHead { /* treeSave() file: head, sorted entries, insertion order, keys and values */
+	char acMagic[8];
+	uint32_t ui32Version;
+	uint32_t ui32Endian;
+	int32_t i32Key; /* key kind */
+	uint32_t ui32Pad;
+	uint64_t ui64Cmp; /* TREE_KEY_MEMCMP length */
+	uint64_t ui64Len; /* keys */
+	uint64_t ui64Entries; /* file offset of ui64Len MapEntry in sorted order */
+	uint64_t ui64Order; /* file offset of ui64Len sorted indexes in insertion order */
+	uint64_t ui64Data; /* file offset of keys and values */
+	uint64_t ui64Size; /* file length */
+} MapHead;
+
+typedef struct mapEntry { /* TREE_MAPPED key and value, offsets from start of file */
+	uint64_t ui64Prefix; /* keyPrefix() of key */
+	uint64_t ui64Key, ui64KeyLen;
+	uint64_t ui64Value, ui64ValueLen; /* offset 0 = NULL value */
+} MapEntry;
+
+#ifndef TREELIBC_PAGE_SIZE
+#define TREELIBC_PAGE_SIZE 4096 /* bytes per TREE_PAGED page, a file opens only with the size it was made with */
+#endif
+#define PG_SIZE TREELIBC_PAGE_SIZE
+#if (PG_SIZE < 512) || (PG_SIZE > 32768) || (PG_SIZE % 8)
+#error TREELIBC_PAGE_SIZE must be a multiple of 8 from 512 to 32768
+#endif
+#define PG_MAGIC "TREEPAGE" /* treeOpen() file starts with these 8 bytes */
+#define PG_VERSION 1 /* page layout, treeOpen() refuses others */
+#define PG_FRAMES_MIN 64 /* smallest buffer pool, well above the pages one call pins */
+#define PG_DEPTH_MAX 32 /* path stack, 4 entries or more per page */
+#define PG_SLOT_BITS 12 /* cursor position is page << PG_SLOT_BITS | slot, more slots than any page holds */
+#define PG_LEAF 1 /* PgPage.ui16Kind */
+#define PG_INNER 2
+#define PG_FREE 3
+#define PG_NULL 1 /* PgEntry.ui32Link of leaf entry: NULL value */
+#define PG_ALIGN(n) (((size_t)(n) + 1 + 7) & ~(size_t)7) /* copy with NUL, next copy 8 byte aligned */
+#define PG_ROOM (PG_SIZE - sizeof(PgPage)) /* bytes for slots and entries */
+#define PG_ENTRY_MAX (((PG_ROOM / 4) - sizeof(uint16_t)) & ~(size_t)7) /* 4 entries with slots fit a page, any split fits */
+#define PG_SLOTS_MAX (PG_ROOM / (sizeof(PgEntry) + 8 + sizeof(uint16_t))) /* smallest entry is an inner one of 7 key bytes */
+#define PG_SLOTS(p) ((uint16_t*)((PgPage*)(p) + 1))
+#define PG_ENTRY(p, i) ((PgEntry*)((char*)(p) + PG_SLOTS(p)[i]))
+#define PG_KEY(e) ((char*)((PgEntry*)(e) + 1))
+#define PG_VALUE(e) (((e)->ui32Link & PG_NULL) ? NULL : PG_KEY(e) + PG_ALIGN((e)->ui16Key)) /* leaf entries only */
+#define PG_FREE_BYTES(p) (PG_ROOM - ((p)->ui16Count * sizeof(uint16_t)) - (p)->ui16Used)
+#define PG_FITS(p, n) (PG_FREE_BYTES(p) >= (n) + sizeof(uint16_t))
+#define PG_FRAME(c, p) ((size_t)((char*)(p) - (c)->pcFrames) / PG_SIZE)
+#define PG_ID(c, p) ((c)->pFrames[PG_FRAME(c, p)].ui32Page)
+#define PG_HASH(c, u) ((((uint32_t)(u)) * 2654435761U) & (c)->ui32Mask)
+#define PG_POS(u, i) ((void*)(((uintptr_t)(u) << PG_SLOT_BITS) | (uintptr_t)(i)))
+#define PG_POS_PAGE(p) ((uint32_t)((uintptr_t)(p) >> PG_SLOT_BITS))
+#define PG_POS_SLOT(p) ((int)((uintptr_t)(p) & ((1U << PG_SLOT_BITS) - 1)))
+#define PG_PUT_INSERT 0 /* pgPut(): key missing, present one kept */
+#define PG_PUT_UPDATE 1 /* pgPut(): key present, value replaced */
+
+typedef struct pgPage { /* TREE_PAGED page head, slots of entry offsets in key order follow, entries fill from page end down */
+	uint16_t ui16Kind; /* PG_LEAF, PG_INNER or PG_FREE */
+	uint16_t ui16Count; /* entries */
+	uint16_t ui16Used; /* bytes of entries, space of deleted ones comes back when page is compacted */
+	uint16_t ui16Low; /* offset of lowest entry, free bytes between it and slots */
+	uint32_t ui32Prev; /* leaf: previous leaf. inner: child of keys below first entry */
+	uint32_t ui32Next; /* leaf: next leaf. free: next free page */
+} PgPage;
+
+typedef struct pgEntry { /* key with NUL, leaf value with NUL after it, both 8 byte aligned */
+	uint16_t ui16Key; /* key bytes */
+	uint16_t ui16Value; /* value bytes of leaf entry */
+	uint32_t ui32Link; /* inner: child of keys from this one up to next entry's. leaf: PG_NULL or 0 */
+} PgEntry;
+
+typedef struct pgHead { /* TREE_PAGED page 0, native byte order */
+	char acMagic[8];
+	uint32_t ui32Version;
+	uint32_t ui32Endian;
+	int32_t i32Key; /* key kind */
+	uint32_t ui32PageSize;
+	uint64_t ui64Cmp; /* TREE_KEY_MEMCMP length */
+	uint64_t ui64Len; /* keys */
+	uint32_t ui32Pages; /* pages of file, head included */
+	uint32_t ui32Root; /* 0 = empty */
+	uint32_t ui32Height; /* levels, 1 = root is a leaf */
+	uint32_t ui32First, ui32Last; /* ends of leaf chain */
+	uint32_t ui32Free; /* freed pages linked through ui32Next, 0 = none */
+	uint32_t ui32FreeLen;
+	uint32_t ui32Pad;
+} PgHead;
+
+typedef struct pgFrame { /* buffer pool frame holding one page */
+	uint32_t ui32Page; /* 0 = none */
+	uint32_t ui32Pins; /* held across other fetches of a call, never evicted */
+	int iDirty; /* written back before frame is reused */
+	int32_t i32Hash; /* next frame of hash bucket, -1 = none */
+	int32_t i32Older, i32Newer; /* LRU order, -1 = none */
+} PgFrame;
+
+typedef struct pgPool { /* TREE_PAGED state hung from Tree.pr */
+	PgHead head; /* written to page 0 by pgFlush() */
+#ifdef _WIN32
+	FILE *pFile;
+#else
+	int iFd;
+#endif
+	char *pcFrames; /* ui32Frames pages */
+	PgFrame *pFrames;
+	uint32_t ui32Frames, ui32Taken; /* frames, frames used so far */
+	int32_t *pi32Buckets; /* first frame of page hash, -1 = none */
+	uint32_t ui32Mask;
+	int32_t i32Oldest, i32Newest; /* ends of LRU order, eviction looks from oldest */
+	char *pcScratch; /* two pages: copy of page being rebuilt, entry waiting to go in */
+	PgEntry **ppEntries; /* entries of page being rebuilt, PG_SLOTS_MAX + 1 */
+} PgPool;
+
+typedef struct pgPath { /* pinned page and child taken on the way down */
+	PgPage *pPage;
+	int iChild;
+} PgPath;
+
+typedef struct walk { /* treeSave() position in sorted order of any engine */
+	void *p; /* Node, BpLeaf, MapEntry or TREE_PAGED page number, NULL before first */
+	int i; /* entry within BpLeaf or page */
+	void *pKey, *pValue;
+	size_t sizeTkey, sizeTvalue;
+} Walk;
+
+#ifdef TREELIBC_STATS
+#if defined(__GNUC__) || defined(__clang__) /* TREE_CONCURRENT readers count side by side */
+#define STAT_ADD(t, m, n) do { if((t)->ps != NULL) __atomic_fetch_add(&((TreeStats*)(t)->ps)->m, (n), __ATOMIC_RELAXED); } while(0)
+#else
+#define STAT_ADD(t, m, n) do { if((t)->ps != NULL) ((TreeStats*)(t)->ps)->m += (n); } while(0)
+#endif
+#else
+#define STAT_ADD(t, m, n) ((void)0) /* counters compiled out */
+#endif
+
+#define SEEK_FIND 4 /* seekNode(): key, after BOUND_* */
+#define SEEK_FIRST 5 /* seekNode(): smallest key */
+#define SEEK_LAST 6 /* seekNode(): largest key */
+#define SEEK_INDEX 7 /* seekNode(): key at sorted index */
+#define SEEK_RANK 8 /* seekNode(): number of keys less than key */
+#define SEEK_RANK_EQ 9 /* seekNode(): number of keys less than or equal to key */
+#define CONC_STEPS 256 /* nodes an optimistic read visits, more means a writer moved them */
+#define CONC_LOCKED ((unsigned long)-1) /* readBegin() took the lock, sequences seen are even */
+
+#define POOL_SLAB_MIN 64
+#define POOL_SLAB_MAX 65536
+#define POOL_NODE_SIZE (sizeof(Node) + TREELIBC_POOL_KEY + TREELIBC_POOL_VALUE)
+#define INLINE_OK(t) (((t)->iMode & (TREE_POOL | TREE_CONCURRENT)) == TREE_POOL) /* readers may hold old copies */
+#define KEY_INLINE(t, n) (INLINE_OK(t) ? (char*)((Node*)(n) + 1) : NULL)
+#define VALUE_INLINE(t, n) (INLINE_OK(t) ? (char*)((Node*)(n) + 1) + TREELIBC_POOL_KEY : NULL)
+
 static Node* initNode(Tree *, Node *, void *, size_t, void *, size_t); /* Allocates memory for each node */
+static Node* makeNode(Tree *, void *, size_t, void *, size_t); /* initNode() without list, safe on several threads unless TREE_POOL */
+static void appendNode(Tree *, Node *); /* count node and put it last in insertion order */
+static size_t cacheBytes(Tree *, Node *); /* node and its outside copies, as shapeStats() */
+static void cacheTouch(Tree *, Node *); /* iLRU: found node goes last in insertion order */
+static void cacheTrim(Tree *, Node *); /* evict from head of insertion order until within limits, node kept */
+static uint64_t hashOf(Tree *, const void *); /* user or built-in hash of key for hash index */
+static Node* hashFind(Tree *, const void *); /* node of key from hash index. Return: NULL = none */
+static void hashAdd(Tree *, Node *); /* node into hash index, dropped without memory to grow */
+static void hashRemove(Tree *, Node *); /* node out of hash index */
+static void hashPut(HashSlot *, unsigned long, int, Node *, uint64_t); /* linear probe to empty slot */
+static void hashMove(HashIndex *, unsigned long); /* slots of old table into new one, old freed when empty */
+static void hashDrop(Tree *); /* free hash index */
 static void copyKeyValue(Tree *, Node *, void *, size_t, void *, size_t); /* General purpose copy key/value */
 static void copyValue(Tree *, Node *pNode, void*, size_t); /* General purpose copy value */
+static void* storeData(Tree *, char *, size_t, void *, size_t); /* copy into inline buffer or malloc */
+static void* replaceData(Tree *, char *, size_t, void *, size_t, void *, size_t); /* overwrite same size copy or store anew */
+static void releaseData(Tree *, char *, void *, size_t); /* free copy unless held inline */
+static Node* allocNode(Tree *); /* malloc or pool allocation of node */
+static void releaseNode(Tree *, Node *); /* free node with its key/value copies */
+static void discardNode(Tree *, Node *); /* releaseNode() or retire until readers are gone */
+static void discardData(Tree *, char *, void *, size_t); /* releaseData() or retire until readers are gone */
 static void balanceTree(Tree *, Node *); /* Entry point to add Red-Black Tree to Binary Tree */
 static Node* resolveRB(Tree *, Node *, Node *); /* Consolidates shared left/right and Red-Black logic */
+static Node* resolveDeleteRB(Tree *, Node *, Node **); /* one double black step of delete, shared left/right */
 static void rotateRightRB(Tree *, Node *); /* Rotate Red-Black Tree to right when tree needs re-balancing */
 static void rotateLeftRB(Tree *, Node *); /* Rotate Red-Black Tree to left when tree needs re-balancing */
 static Node* getNodeByKey(Tree *, const void *); /* General purpose called by various functions */
-static void removeNode(Node *); /* General purpose to remove node from tree */
-static void spliceLeft(Node *); /* General purpose to assign node's parent to node's left child */
-static void spliceRight(Node *);  /* General purpose to assign node's parent to node's right child */
+static Tree* initTree(Tree *, PFCMP, int, size_t, int); /* shared treeInitMode() and treeInitKey() */
+static int cmpInt64(const void *, const void *); /* TREE_KEY_INT64 pfCmp */
+static int cmpUint64(const void *, const void *); /* TREE_KEY_UINT64 pfCmp */
+static int cmpDouble(const void *, const void *); /* TREE_KEY_DOUBLE pfCmp */
+static int cmpString(const void *, const void *); /* TREE_KEY_STRING pfCmp */
+static inline uint64_t doubleOrder(const void *); /* unsigned integer in double order */
+static inline uint64_t keyPrefix(Tree *, const void *); /* order preserving first 8 bytes or value of key */
+static inline int cmpKeyPrefix(Tree *, const void *, uint64_t, const void *, uint64_t); /* compare keys with known prefixes */
+static inline int cmpKey(Tree *, const void *, const void *); /* compare by key kind */
+static Node* insertNode(Tree *, void *, size_t, void *, size_t, int *); /* find key or insert it, one descent */
+static void** upsertSlot(Tree *, void *, size_t, void *, size_t, int, int *); /* shared treeUpsert() and treeGetOrInsert() */
+static int batchSorted(Tree *, void **, unsigned long); /* Return: 1 = keys ascend, none NULL */
+static void findBatch(Tree *, void **, unsigned long, Node **); /* node of each key, descents interleaved with prefetch */
+static void findSorted(Tree *, void **, unsigned long, Node **); /* node of each ascending key, descents resume from shared path */
+static unsigned long findChunk(Tree *, void **, unsigned long, int, Node **); /* BATCH_CHUNK keys or fewer. Return: keys found */
+static void replaceNode(Tree *, Node *, Node *); /* General purpose to put node, or NULL, in place of another */
 static void resetList(Tree *, Node *); /* General purpose to remove node from list */
+static Node* edgeNode(Node *, int); /* leftmost or rightmost node of subtree */
+static Node* stepNode(Node *, int); /* in order successor or predecessor */
+static int cursorAt(TreeCursor *, Node *, void **, void **); /* shared cursor positioning */
+static int cursorBound(Tree *, TreeCursor *, const void *, int, void **, void **); /* shared ordered queries */
+static void countPath(Node *, int); /* grow or shrink subtree sizes from node to root */
+static void** sizeArray(void ***, unsigned long); /* grow or shrink cached array */
+static void* alignedAlloc(size_t); /* cache line aligned malloc */
+static void alignedFree(void *); /* free memory from alignedAlloc() */
+static BpNode* bpAlloc(Tree *, int); /* new empty B+tree leaf or inner node */
+static int bpSearch(Tree *, void **, const uint64_t *, int, const void *, int *); /* binary search within node, keys read on prefix ties */
+static BpLeaf* bpDescend(Tree *, const void *, BpPath *, int *); /* root to leaf, optionally recording path */
+static void bpLeafMove(BpLeaf *, int, BpLeaf *, int, int); /* move entries with their values and sizes */
+static BpLeaf* bpFind(Tree *, const void *, int *); /* leaf and index of key */
+static BpLeaf* bpInsert(Tree *, void *, size_t, void *, size_t, int *, int *); /* B+tree find key or insert it */
+static void bpMerge(Tree *, BpInner *, int); /* join two children of node */
+static void bpBorrow(BpInner *, int, int); /* move one entry from sibling */
+static int bpDelete(Tree *, const void *); /* B+tree treeDelete() */
+static void bpFree(Tree *); /* B+tree treeFree() */
+static void bpFreeInner(BpNode *); /* free inner nodes below and including node */
+static int bpBuild(Tree *, void **, const size_t *, void **, const size_t *, unsigned long); /* bulk load */
+static BpLeaf* bpBound(Tree *, const void *, int, int *); /* nearest leaf and index per BOUND_* */
+static int bpCursorAt(TreeCursor *, BpLeaf *, int, void **, void **); /* B+tree cursor positioning */
+static int bpCursorStep(TreeCursor *, int, void **, void **); /* B+tree cursor next or previous */
+static CpTree* cpStart(Tree *); /* compact state of tree, made when missing. Return: NULL = fail */
+static int cpAddChunk(Tree *); /* chunk of nodes, directory grown as needed. Return: 0 = fail */
+static uint32_t cpAlloc(Tree *); /* index of free or new compact node, chunk added as needed. Return: 0 = fail */
+static void cpRelease(Tree *, uint32_t); /* free copies of compact node, node onto free list */
+static void* cpCopy(Tree *, void *, size_t); /* malloc copy with NUL, length and holders kept before it. Return: NULL = fail */
+static void cpDrop(void *); /* copy loses a holder, freed with its last */
+static int cpWriteBegin(Tree *); /* refuse snapshots, unreference released ones, nodes for copying. Return: 0 = fail */
+static int cpReserve(Tree *, uint32_t); /* at least that many nodes allocatable without failing. Return: 0 = fail */
+static uint32_t cpOwn(Tree *, uint32_t, int); /* child of a private parent made private, copied if shared. Return: child */
+static void cpOwnPath(Tree *, uint32_t *, int); /* cpOwn() down a path from root, indexes replaced by private ones */
+static uint32_t cpOwnKey(Tree *, const void *); /* private node of key for change in place. Return: 0 = none */
+static void cpUnref(Tree *, uint32_t); /* drop a reference to subtree, nodes left without one freed */
+static void cpReclaim(Tree *); /* unreference views released since last write */
+static void cpFreeStore(CpTree *); /* free chunks, copies and views of a tree no one references */
+static int cpStore(Tree *, CpNode *, void *, size_t, void *, size_t, int); /* key and value into new compact node. Return: 0 = fail */
+static int cpSetValue(Tree *, CpNode *, void *, size_t, int); /* value inline, copied or assigned, slot keeps pointer. Return: 0 = fail */
+static uint32_t cpSeek(Tree *, int, const void *); /* compact descent per BOUND_* or SEEK_*. Return: 0 = none */
+static void cpSetChild(CpTree *, uint32_t, int, uint32_t); /* link child under parent, parent 0 = root */
+static void cpRotate(Tree *, uint32_t, uint32_t, int); /* rotate node under parent left or right */
+static CpNode* cpInsert(Tree *, void *, size_t, void *, size_t, int, int *); /* compact find key or insert it, one descent */
+static int cpDelete(Tree *, const void *); /* compact treeDelete(), nodes relinked so held keys stay put */
+static void cpDeleteFix(Tree *, uint32_t *, int, uint32_t, int); /* double black steps up the path */
+static void cpFree(Tree *); /* compact treeFree() */
+static int cpBuild(Tree *, void **, const size_t *, void **, const size_t *, unsigned long); /* compact bulk load */
+static void cpIterStart(CpIter *, CpTree *, uint32_t); /* in order walk of subtree */
+static uint32_t cpIterNext(CpIter *, int *); /* next node and its depth. Return: 0 = end */
+static int cpCursorAt(TreeCursor *, uint32_t, void **, void **); /* compact cursor positioning, cursor holds key */
+static int cpVerify(Tree *); /* treeVerify() for TREE_COMPACT */
+static void unlinkNode(Tree *, Node *); /* take node out of tree and list, then discard */
+static void cutNode(Tree *, Node *); /* unlinkNode() out of tree only, sizes and colors fixed up */
+static Node* seekNode(Tree *, int, const void *, unsigned long *, unsigned long); /* descent per BOUND_* or SEEK_*, at most steps */
+static int readNode(Tree *, int, const void *, unsigned long *, void **, void **); /* seekNode() validated against writers */
+static int cursorRead(TreeCursor *, int, const void *, unsigned long *, void **, void **); /* TREE_CONCURRENT cursorAt() */
+static int writeBegin(Tree *); /* refuse TREE_MAPPED and TREE_PAGED. TREE_CONCURRENT: lock out writers, readers retry. Return: 0 = fail */
+static void writeEnd(Tree *); /* TREE_CONCURRENT: readers valid again, free retired when unpinned */
+static int retireRoom(Tree *); /* TREE_CONCURRENT: room for one more change in retired list. Return: 0 = fail */
+static int lockTree(Tree *, int); /* TREE_CONCURRENT: take or give writer lock, made on first use. Return: 0 = fail */
+static int readPin(Tree *, int); /* TREE_CONCURRENT: count reader in or out, retired memory stays */
+static unsigned long readBegin(Tree *, int); /* TREE_CONCURRENT: even sequence, or lock after tries */
+static int readEnd(Tree *, unsigned long); /* TREE_CONCURRENT: Return: 0 = retry; 1 = read was consistent */
+static void retire(Tree *, void *, size_t, int); /* TREE_CONCURRENT: keep memory until no reader is pinned */
+static void reclaim(Tree *, int); /* TREE_CONCURRENT: free retired memory after a grace period, or all state for treeFree() */
+static int rbVerify(Tree *); /* treeVerify() for red-black tree */
+static int bpVerify(Tree *); /* treeVerify() for B+tree */
+static uint64_t hashKey(Tree *, const void *); /* built-in hash for key kinds */
+static int walkNext(Tree *, Walk *); /* next key in sorted order with sizes. Return: 0 = end */
+static int saveTree(Tree *, FILE *); /* treeSave() to open file */
+static unsigned long nodeRank(Node *); /* sorted index of node from subtree sizes */
+static void mapUnload(void *, uint64_t); /* unmap or free file of treeLoad() */
+static unsigned long mapRank(Tree *, const void *, int); /* mapped keys less than, or less or equal to, key */
+static MapEntry* mapBound(Tree *, const void *, int); /* nearest mapped entry per BOUND_* */
+static int mapCursorAt(TreeCursor *, void *, void **, void **); /* mapped cursor positioning */
+static int mapCursorStep(TreeCursor *, int, void **, void **); /* mapped cursor next or previous */
+static int mapVerify(Tree *); /* treeVerify() for TREE_MAPPED, treeLoad() before trusting a file */
+static int mapData(MapHead *, uint64_t, uint64_t); /* copy at offset and length lies in data part of file, NUL ended */
+static int pgIO(PgPool *, uint32_t, void *, int); /* read or write one page of file. Return: 0 = fail */
+static int32_t pgTake(PgPool *); /* frame for another page, oldest unpinned written back first. Return: -1 = fail */
+static void pgNewest(PgPool *, int32_t); /* frame to newest end of LRU order */
+static void pgHold(PgPool *, int32_t, uint32_t); /* frame holds page, found by hash from now */
+static PgPage* pgFetch(PgPool *, uint32_t, int); /* page from its frame or file, pinned if asked. Return: NULL = fail */
+static void pgUnpin(PgPool *, PgPage *); /* give up pin of pgFetch() or pgAlloc() */
+static void pgDirty(PgPool *, PgPage *); /* frame written back before reuse */
+static PgPage* pgAlloc(PgPool *, int); /* pinned empty page of kind, free list first. Return: NULL = fail */
+static void pgRelease(PgPool *, PgPage *); /* pinned page onto free list, pin given up */
+static int pgFlush(Tree *); /* dirty frames then head to file, synced. Return: 0 = fail */
+static void pgClose(Tree *); /* paged treeFree(), written back first if open */
+static size_t pgEntrySize(int, PgEntry *); /* bytes of entry in page of kind, slot aside */
+static int pgSearch(Tree *, PgPage *, const void *, uint64_t, int *); /* first slot with key >= key */
+static PgPage* pgDescend(Tree *, const void *, PgPath *, int *, int); /* root to leaf, path pinned if asked. Return: NULL = empty or fail */
+static void pgUnpinPath(PgPool *, PgPath *, int); /* pgUnpin() pages of path */
+static void pgFill(PgPage *, PgEntry **, int); /* page entries replaced by copies of those given */
+static void pgPlace(PgPool *, PgPage *, int, PgEntry *, size_t); /* entry into page at slot, compacted if need be, page has room */
+static void pgRemove(PgPool *, PgPage *, int); /* entry at slot out of page */
+static void pgSplit(PgPool *, PgPage *, PgPage *, int, PgEntry *, int); /* page and entry over page and right sibling, separator to scratch */
+static int pgPut(Tree *, void *, size_t, void *, size_t, int); /* paged insert or update per PG_PUT_*. Return: 0 = fail */
+static void pgDropChild(Tree *, PgPath *, int); /* child of path page gone, empty pages above go too */
+static int pgDelete(Tree *, const void *); /* paged treeDelete(), pages freed once they hold nothing */
+static void* pgFind(Tree *, const void *); /* paged treeValue() */
+static uint32_t pgBound(Tree *, const void *, int, int *); /* leaf and slot of nearest key per BOUND_*. Return: 0 = none */
+static int pgCursorAt(TreeCursor *, uint32_t, int, void **, void **); /* paged cursor positioning, slot -1 = last of leaf */
+static int pgCursorStep(TreeCursor *, int, void **, void **); /* paged cursor next or previous */
+static int pgVerify(Tree *); /* treeVerify() for TREE_PAGED */
+static void* findValue(Tree *, const void *); /* treeValue() uncounted */
+static int insertKey(Tree *, void *, size_t, void *, size_t); /* treeInsert() uncounted */
+static int deleteKey(Tree *, const void *); /* treeDelete() uncounted */
+static inline uint64_t statStart(Tree *); /* TREELIBC_STATS: make counters on first call, clock for TREELIBC_STATS=2 */
+static inline void statEnd(Tree *, int, uint64_t); /* TREELIBC_STATS: count call per TREE_STATS_*, latency for TREELIBC_STATS=2 */
+static void shapeStats(Tree *, TreeStats *); /* treeStats() height, depths and bytes per engine */
+static unsigned long buildShape(Node **, BuildRange *, unsigned long, unsigned long, BuildRange *); /* link range, ranges at cut depth left. Return: ranges left */
+static int parThreads(int); /* threads for iThreads argument, 1 without thread support */
+static int parStart(ParJob *, Tree *, int, void (*)(ParJob *, ParPiece *)); /* job over tree cut into pieces. Return: 0 = fail */
+static unsigned long parSplitRB(Node *, unsigned long, int, ParPiece *, unsigned long); /* red-black pieces in order below node */
+static unsigned long parSplitCP(CpTree *, uint32_t, int, ParPiece *, unsigned long); /* compact pieces in order below node */
+static void parRun(ParJob *); /* every piece done by threads that steal from each other, calling thread alone if need be */
+static void* parWork(void *); /* worker thread, own pieces then stolen ones */
+static int parTake(ParJob *, int, unsigned long *); /* next piece for worker. Return: 0 = none left */
+static void parVisit(ParJob *, ParPiece *); /* keys of piece to visitor, reducer or sorted array */
+static void parKey(ParJob *, void *, unsigned long, void *, void *); /* one key of parVisit() */
+static void parRelease(ParJob *, ParPiece *); /* treeParallelFree() nodes of red-black piece */
+static void parFreeNode(Tree *, Node *); /* releaseNode() without pool bookkeeping, slabs go whole */
+static void parMake(ParJob *, ParPiece *); /* treeParallelBuildSorted() nodes of index range */
+static void parLink(ParJob *, ParPiece *); /* treeParallelBuildSorted() subtree below the cut */
+static void parKeys(ParJob *, ParPiece *); /* treeParallelBuildSorted() sorted array of index range */
+static void parSet(ParJob *, ParPiece *); /* setRun() of piece */
+static int setFits(Tree *, Tree *); /* tree, and other when not NULL, plain red-black trees of one key order. Return: 0 = no */
+static void setStart(SetJob *, Tree *, Tree *, int); /* job over whole trees */
+static void setFree(Tree *, Tree *, SetJob *); /* dropped nodes out of insertion order and freed */
+static void setEnd(Tree *, Tree *, SetPart *); /* result becomes tree, insertion order of other appended, other empty */
+static int setMerge(Tree *, Tree *, int, int); /* SET_* of tree and other into tree. Return: 0 = fail */
+static void setRun(SetJob *); /* merge parts of job, frames on a stack */
+static int setStep(SetJob *, SetPart *, SetPart *, SetFrame *); /* divide at a root into halves. Return: 0 = done, result in first part */
+static void setJoin(SetJob *, SetFrame *, SetPart *); /* merged left of frame, its node and merged right into right */
+static void setDrop(SetJob *, int, Node *, int); /* node, or its whole subtree, onto dropped chain of tree or other */
+static unsigned long rbHeight(Node *); /* black height of subtree */
+static void rbJoin(Tree *, SetPart *, Node *, SetPart *, SetPart *); /* left, node and right into one, keys ascending */
+static void rbJoin2(Tree *, SetPart *, SetPart *, SetPart *); /* left and right into one, smallest of right between */
+static Node* rbSplit(Tree *, SetPart *, const void *, uint64_t, SetPart *, SetPart *); /* keys below and above key. Return: node of key, NULL = none */
+#if defined(TREELIBC_STATS) && (TREELIBC_STATS >= 2)
+static uint64_t statClock(void); /* nanoseconds, monotonic where available */
+#endif
 
 unsigned long treeLength(Tree *pTree) { return(pTree->ulTreeLen); }
 
-Tree* treeInit(Tree *pTree, PFCMP pfCmp) {
-	if((pTree == NULL) || (pfCmp == NULL))
+Tree* treeInit(Tree *pTree, PFCMP pfCmp) { return(treeInitMode(pTree, pfCmp, 0)); }
+
+Tree* treeInitMode(Tree *pTree, PFCMP pfCmp, int iMode) {
+	if(pfCmp == NULL)
+		return(NULL);
+return(initTree(pTree, pfCmp, TREE_KEY_USER, 0, iMode));
+}
+
+Tree* treeInitKey(Tree *pTree, int iKey, size_t sizeTkey, int iMode) {
+	static const PFCMP apfCmp[] = { NULL, cmpInt64, cmpUint64, cmpDouble, cmpString, NULL };
+	if((iKey <= TREE_KEY_USER) || (iKey > TREE_KEY_MEMCMP) || ((iKey == TREE_KEY_MEMCMP) && (sizeTkey == 0)))
+		return(NULL);
+return(initTree(pTree, apfCmp[iKey], iKey, (iKey == TREE_KEY_MEMCMP) ? sizeTkey : 0, iMode));
+}
+
+static Tree* initTree(Tree *pTree, PFCMP pfCmp, int iKey, size_t sizeTkey, int iMode) {
+	if((pTree == NULL) || ((iMode & ~(TREE_POOL | TREE_BPLUS | TREE_CONCURRENT | TREE_COMPACT)) != 0)
+	|| ((iMode & TREE_POOL) && (iMode & TREE_BPLUS))
+	|| ((iMode & TREE_CONCURRENT) && (iMode & TREE_BPLUS))
+	|| ((iMode & TREE_COMPACT) && (iMode & (TREE_POOL | TREE_BPLUS | TREE_CONCURRENT))))
 		return(NULL);
+#ifndef CONCURRENT_OK
+	if(iMode & TREE_CONCURRENT)
+		return(NULL);
+#endif
 	pTree->pfCmp = pfCmp;
+	pTree->iKey = iKey;
+	pTree->sizeTcmp = sizeTkey;
 	pTree->ulTreeLen = 0;
-	pTree->pr = pTree->ph = pTree->pt = pTree->ppArray = pTree->ppArraySorted = NULL;
+	pTree->iMode = iMode;
+	pTree->iStale = 0;
+	pTree->pr = pTree->ph = pTree->pt = pTree->ppArray = pTree->ppArraySorted = pTree->pp = pTree->pc = pTree->ps = pTree->pe = pTree->px = NULL;
 return(pTree);
 }
 
-void *treeValue(Tree *pTree, const void *pKey) {
+void* treeValue(Tree *pTree, const void *pKey) {
+	uint64_t ui64Start = statStart(pTree);
+	void *pValue = findValue(pTree, pKey);
+	statEnd(pTree, TREE_STATS_LOOKUP, ui64Start);
+return(pValue);
+}
+
+static void* findValue(Tree *pTree, const void *pKey) {
 	Node *pNode;
-	if((pTree != NULL) && (pKey != NULL) && ((pNode = getNodeByKey(pTree, pKey)) != NULL))
+	if((pTree != NULL) && (pTree->iMode & TREE_BPLUS)) {
+		int i;
+		BpLeaf *pLeaf = bpFind(pTree, pKey, &i);
+		return((pLeaf == NULL) ? NULL : pLeaf->apValue[i]);
+	}
+	if((pTree != NULL) && (pKey != NULL) && (pTree->iMode & TREE_COMPACT)) {
+		uint32_t ui = cpSeek(pTree, SEEK_FIND, pKey);
+		return((ui == 0) ? NULL : CP_VALUE(CP_NODE((CpTree*)pTree->pr, ui)));
+	}
+	if((pTree != NULL) && (pKey != NULL) && (pTree->iMode & TREE_PAGED))
+		return(pgFind(pTree, pKey));
+	if((pTree != NULL) && (pKey != NULL) && (pTree->iMode & TREE_MAPPED)) {
+		MapEntry *pE = mapBound(pTree, pKey, BOUND_LOWER);
+		if((pE == NULL) || (cmpKeyPrefix(pTree, (char*)pTree->pr + pE->ui64Key, pE->ui64Prefix, pKey, keyPrefix(pTree, pKey)) != 0))
+			return(NULL);
+		return((pE->ui64Value == 0) ? NULL : (char*)pTree->pr + pE->ui64Value);
+	}
+	if((pTree != NULL) && (pKey != NULL) && (pTree->iMode & TREE_CONCURRENT)) {
+		void *pValue = NULL;
+		readNode(pTree, SEEK_FIND, pKey, NULL, NULL, &pValue);
+		return(pValue);
+	}
+	if((pTree != NULL) && (pKey != NULL) && ((pNode = getNodeByKey(pTree, pKey)) != NULL)) {
+		cacheTouch(pTree, pNode);
 		return(pNode->pValue);
+	}
 return(NULL);
 }
 
 void** const treeArray(Tree *pTree) {
 	Node *pNode;
-	unsigned long l, lIndex = 0;
-	if((pTree == NULL) || (pTree->ulTreeLen <= 0))
+	unsigned long lIndex = 0;
+	if((pTree == NULL) || (pTree->ulTreeLen <= 0) || (pTree->iMode & (TREE_BPLUS | TREE_COMPACT | TREE_PAGED)))
 		return NULL;
-	if(pTree->ppArray != NULL)
-		free(pTree->ppArray);
-	pTree->ppArray = malloc(pTree->ulTreeLen * sizeof(void*));
-	for(l = 0; l < pTree->ulTreeLen; l++)
-		pTree->ppArray[l] = NULL;
-	for(pNode = pTree->ph; pNode != NULL; pNode = pNode->pNext)
-		pTree->ppArray[lIndex++] = pNode->pKey;
+	if((pTree->ppArray != NULL) && !(pTree->iStale & STALE_ARRAY))
+		return(pTree->ppArray);
+	lockTree(pTree, 1);
+	if(sizeArray(&pTree->ppArray, pTree->ulTreeLen) == NULL) {
+		lockTree(pTree, 0);
+		return NULL;
+	}
+	if(pTree->iMode & TREE_MAPPED) {
+		for(; lIndex < pTree->ulTreeLen; lIndex++)
+			pTree->ppArray[lIndex] = (char*)pTree->pr + ((MapEntry*)pTree->ph)[((uint64_t*)pTree->pt)[lIndex]].ui64Key;
+	} else {
+		for(pNode = pTree->ph; pNode != NULL; pNode = pNode->pNext)
+			pTree->ppArray[lIndex++] = pNode->pKey;
+	}
+	pTree->iStale &= ~STALE_ARRAY;
+	lockTree(pTree, 0);
 return(pTree->ppArray);
 }
 
 void** const treeArraySorted(Tree *pTree) {
-	unsigned long l, lIndex = 0;
-	Node *p, *pN, *pNode = pTree->pr;
-	if((pTree == NULL) || (pTree->ulTreeLen <= 0))
+	unsigned long lIndex = 0;
+	Node *pNode;
+	if((pTree == NULL) || (pTree->ulTreeLen <= 0) || (pTree->iMode & TREE_PAGED)) /* keys move with their pages */
 		return NULL;
-	if(pTree->ppArraySorted != NULL)
-		free(pTree->ppArraySorted);
-	pTree->ppArraySorted = malloc(pTree->ulTreeLen * sizeof(void*));
-	for(l = 0; l < pTree->ulTreeLen; l++)
-		pTree->ppArraySorted[l] = NULL;
-	while(pNode != NULL) {
-		for(p = pNode; p != NULL; p = p->pLeft)
-			pNode = p;
-		pTree->ppArraySorted[lIndex++] = pNode->pKey;
-		pN = pNode;
-		pNode = pNode->pRight;
-		if(pNode == NULL) {
-			for(pNode = pN->pParent; pNode != NULL; pNode = pNode->pParent) {
-				if(pNode->pRight != pN) {
-					if(pNode->pLeft != NULL)
-						pTree->ppArraySorted[lIndex++] = pNode->pKey;
-					if(pNode->pRight != NULL) {
-						pNode = pNode->pRight;
-						break;
-					}
-				}
-				pN = pNode;
-			}
+	if((pTree->ppArraySorted != NULL) && !(pTree->iStale & STALE_SORTED))
+		return(pTree->ppArraySorted);
+	lockTree(pTree, 1);
+	if(sizeArray(&pTree->ppArraySorted, pTree->ulTreeLen) == NULL) {
+		lockTree(pTree, 0);
+		return NULL;
+	}
+	if(pTree->iMode & TREE_MAPPED) {
+		for(; lIndex < pTree->ulTreeLen; lIndex++)
+			pTree->ppArraySorted[lIndex] = (char*)pTree->pr + ((MapEntry*)pTree->ph)[lIndex].ui64Key;
+	} else if(pTree->iMode & TREE_BPLUS) {
+		BpLeaf *pLeaf;
+		for(pLeaf = pTree->ph; pLeaf != NULL; pLeaf = pLeaf->pNext) {
+			memcpy(&pTree->ppArraySorted[lIndex], pLeaf->apKey, pLeaf->h.iCount * sizeof(void*));
+			lIndex += pLeaf->h.iCount;
 		}
+	} else if(pTree->iMode & TREE_COMPACT) {
+		CpIter iter;
+		uint32_t ui;
+		for(cpIterStart(&iter, pTree->pr, ((CpTree*)pTree->pr)->ui32Root); (ui = cpIterNext(&iter, NULL)) != 0; )
+			pTree->ppArraySorted[lIndex++] = CP_KEY(pTree, CP_NODE((CpTree*)pTree->pr, ui));
+	} else {
+		for(pNode = edgeNode(pTree->pr, 0); pNode != NULL; pNode = stepNode(pNode, 1))
+			pTree->ppArraySorted[lIndex++] = pNode->pKey;
 	}
+	pTree->iStale &= ~STALE_SORTED;
+	lockTree(pTree, 0);
 return(pTree->ppArraySorted);
 }
 
+int treeCursorFirst(Tree *pTree, TreeCursor *pCursor, int iOrder, void **ppKey, void **ppValue) {
+	if((pTree == NULL) || (pCursor == NULL))
+		return(0);
+	pCursor->pTree = pTree;
+	pCursor->iOrder = iOrder;
+	pCursor->pb = pCursor->pe = NULL;
+	if(pTree->iMode & TREE_BPLUS) {
+		if((iOrder == TREE_INSERTED) || (pTree->ph == NULL))
+			return(bpCursorAt(pCursor, NULL, 0, ppKey, ppValue));
+		return(bpCursorAt(pCursor, pTree->ph, 0, ppKey, ppValue));
+	}
+	if(pTree->iMode & TREE_COMPACT)
+		return(cpCursorAt(pCursor, (iOrder == TREE_INSERTED) ? 0 : cpSeek(pTree, SEEK_FIRST, NULL), ppKey, ppValue));
+	if(pTree->iMode & TREE_PAGED)
+		return(pgCursorAt(pCursor, (iOrder == TREE_INSERTED) ? 0 : ((PgPool*)pTree->pr)->head.ui32First, 0, ppKey, ppValue));
+	if(pTree->iMode & TREE_MAPPED)
+		return(mapCursorAt(pCursor, (pTree->ulTreeLen == 0) ? NULL : (iOrder == TREE_INSERTED) ? pTree->pt : pTree->ph, ppKey, ppValue));
+	if(pTree->iMode & TREE_CONCURRENT) /* insertion order is not walked concurrently */
+		return((iOrder == TREE_INSERTED) ? cursorAt(pCursor, NULL, ppKey, ppValue) : cursorRead(pCursor, SEEK_FIRST, NULL, NULL, ppKey, ppValue));
+return(cursorAt(pCursor, (iOrder == TREE_INSERTED) ? pTree->ph : edgeNode(pTree->pr, 0), ppKey, ppValue));
+}
+
+int treeCursorLast(Tree *pTree, TreeCursor *pCursor, int iOrder, void **ppKey, void **ppValue) {
+	if((pTree == NULL) || (pCursor == NULL))
+		return(0);
+	pCursor->pTree = pTree;
+	pCursor->iOrder = iOrder;
+	pCursor->pb = pCursor->pe = NULL;
+	if(pTree->iMode & TREE_BPLUS) {
+		if((iOrder == TREE_INSERTED) || (pTree->pt == NULL))
+			return(bpCursorAt(pCursor, NULL, 0, ppKey, ppValue));
+		return(bpCursorAt(pCursor, pTree->pt, ((BpLeaf*)pTree->pt)->h.iCount - 1, ppKey, ppValue));
+	}
+	if(pTree->iMode & TREE_COMPACT)
+		return(cpCursorAt(pCursor, (iOrder == TREE_INSERTED) ? 0 : cpSeek(pTree, SEEK_LAST, NULL), ppKey, ppValue));
+	if(pTree->iMode & TREE_PAGED)
+		return(pgCursorAt(pCursor, (iOrder == TREE_INSERTED) ? 0 : ((PgPool*)pTree->pr)->head.ui32Last, -1, ppKey, ppValue));
+	if(pTree->iMode & TREE_MAPPED) {
+		if(pTree->ulTreeLen == 0)
+			return(mapCursorAt(pCursor, NULL, ppKey, ppValue));
+		if(iOrder == TREE_INSERTED)
+			return(mapCursorAt(pCursor, (uint64_t*)pTree->pt + pTree->ulTreeLen - 1, ppKey, ppValue));
+		return(mapCursorAt(pCursor, (MapEntry*)pTree->ph + pTree->ulTreeLen - 1, ppKey, ppValue));
+	}
+	if(pTree->iMode & TREE_CONCURRENT)
+		return((iOrder == TREE_INSERTED) ? cursorAt(pCursor, NULL, ppKey, ppValue) : cursorRead(pCursor, SEEK_LAST, NULL, NULL, ppKey, ppValue));
+return(cursorAt(pCursor, (iOrder == TREE_INSERTED) ? pTree->pt : edgeNode(pTree->pr, 1), ppKey, ppValue));
+}
+
+int treeCursorSeek(Tree *pTree, TreeCursor *pCursor, const void *pKey, void **ppKey, void **ppValue) {
+return(cursorBound(pTree, pCursor, pKey, BOUND_LOWER, ppKey, ppValue));
+}
+
+int treeCursorNext(TreeCursor *pCursor, void **ppKey, void **ppValue) {
+	Node *pNode;
+	if((pCursor == NULL) || ((pNode = pCursor->pn) == NULL))
+		return(0);
+	if(pCursor->pTree->iMode & TREE_BPLUS)
+		return(bpCursorStep(pCursor, 1, ppKey, ppValue));
+	if(pCursor->pTree->iMode & TREE_COMPACT) /* cursor holds a key as for TREE_CONCURRENT */
+		return(cpCursorAt(pCursor, cpSeek(pCursor->pTree, BOUND_UPPER, pCursor->pn), ppKey, ppValue));
+	if(pCursor->pTree->iMode & TREE_MAPPED)
+		return(mapCursorStep(pCursor, 1, ppKey, ppValue));
+	if(pCursor->pTree->iMode & TREE_PAGED) /* cursor holds page and slot */
+		return(pgCursorStep(pCursor, 1, ppKey, ppValue));
+	if(pCursor->pTree->iMode & TREE_CONCURRENT) /* cursor holds a key, next one found from root */
+		return(cursorRead(pCursor, BOUND_UPPER, pCursor->pn, NULL, ppKey, ppValue));
+	if(pNode == pCursor->pe)
+		return(cursorAt(pCursor, NULL, ppKey, ppValue));
+return(cursorAt(pCursor, (pCursor->iOrder == TREE_INSERTED) ? pNode->pNext : stepNode(pNode, 1), ppKey, ppValue));
+}
+
+int treeCursorPrev(TreeCursor *pCursor, void **ppKey, void **ppValue) {
+	Node *pNode;
+	if((pCursor == NULL) || ((pNode = pCursor->pn) == NULL))
+		return(0);
+	if(pCursor->pTree->iMode & TREE_BPLUS)
+		return(bpCursorStep(pCursor, 0, ppKey, ppValue));
+	if(pCursor->pTree->iMode & TREE_COMPACT)
+		return(cpCursorAt(pCursor, cpSeek(pCursor->pTree, BOUND_BELOW, pCursor->pn), ppKey, ppValue));
+	if(pCursor->pTree->iMode & TREE_MAPPED)
+		return(mapCursorStep(pCursor, 0, ppKey, ppValue));
+	if(pCursor->pTree->iMode & TREE_PAGED)
+		return(pgCursorStep(pCursor, 0, ppKey, ppValue));
+	if(pCursor->pTree->iMode & TREE_CONCURRENT)
+		return(cursorRead(pCursor, BOUND_BELOW, pCursor->pn, NULL, ppKey, ppValue));
+	if(pNode == pCursor->pb)
+		return(cursorAt(pCursor, NULL, ppKey, ppValue));
+return(cursorAt(pCursor, (pCursor->iOrder == TREE_INSERTED) ? pNode->pPrev : stepNode(pNode, 0), ppKey, ppValue));
+}
+
+int treeLowerBound(Tree *pTree, TreeCursor *pCursor, const void *pKey, void **ppKey, void **ppValue) {
+return(cursorBound(pTree, pCursor, pKey, BOUND_LOWER, ppKey, ppValue));
+}
+
+int treeUpperBound(Tree *pTree, TreeCursor *pCursor, const void *pKey, void **ppKey, void **ppValue) {
+return(cursorBound(pTree, pCursor, pKey, BOUND_UPPER, ppKey, ppValue));
+}
+
+int treeFloor(Tree *pTree, TreeCursor *pCursor, const void *pKey, void **ppKey, void **ppValue) {
+return(cursorBound(pTree, pCursor, pKey, BOUND_FLOOR, ppKey, ppValue));
+}
+
+int treeCeiling(Tree *pTree, TreeCursor *pCursor, const void *pKey, void **ppKey, void **ppValue) {
+return(cursorBound(pTree, pCursor, pKey, BOUND_LOWER, ppKey, ppValue));
+}
+
+int treeRange(Tree *pTree, TreeCursor *pCursor, const void *pLow, const void *pHigh, void **ppKey, void **ppValue) {
+	Node *pB, *pE;
+	if((pTree == NULL) || (pCursor == NULL) || (pLow == NULL) || (pHigh == NULL))
+		return(0);
+	pCursor->pTree = pTree;
+	pCursor->iOrder = TREE_SORTED;
+	if(pTree->iMode & TREE_BPLUS) {
+		int iB, iE;
+		BpLeaf *pLB = bpBound(pTree, pLow, BOUND_LOWER, &iB), *pLE = bpBound(pTree, pHigh, BOUND_FLOOR, &iE);
+		if((pLB == NULL) || (pLE == NULL) || (cmpKey(pTree, pLB->apKey[iB], pLE->apKey[iE]) > 0))
+			pLB = pLE = NULL;
+		pCursor->pb = (pLB == NULL) ? NULL : pLB->apKey[iB]; /* B+tree bounds are key addresses */
+		pCursor->pe = (pLE == NULL) ? NULL : pLE->apKey[iE];
+		return(bpCursorAt(pCursor, pLB, iB, ppKey, ppValue));
+	}
+	if(pTree->iMode & TREE_COMPACT) { /* bounds are keys, cpCursorAt() stops outside them */
+		uint32_t uiE = cpSeek(pTree, BOUND_FLOOR, pHigh);
+		pCursor->pb = pCursor->pe = NULL;
+		if(uiE != 0)
+			pCursor->pe = CP_KEY(pTree, CP_NODE((CpTree*)pTree->pr, uiE));
+		if(!cpCursorAt(pCursor, (uiE == 0) ? 0 : cpSeek(pTree, BOUND_LOWER, pLow), ppKey, ppValue))
+			return(0);
+		pCursor->pb = pCursor->pn;
+		return(1);
+	}
+	if(pTree->iMode & TREE_MAPPED) { /* bounds are entries */
+		MapEntry *pEB = mapBound(pTree, pLow, BOUND_LOWER), *pEE = mapBound(pTree, pHigh, BOUND_FLOOR);
+		if((pEB == NULL) || (pEE == NULL) || (pEB > pEE))
+			pEB = pEE = NULL;
+		pCursor->pb = pEB;
+		pCursor->pe = pEE;
+		return(mapCursorAt(pCursor, pEB, ppKey, ppValue));
+	}
+	if(pTree->iMode & TREE_PAGED) { /* bounds are positions, first key above pHigh means none */
+		int iB, iE;
+		uint32_t uiB = pgBound(pTree, pLow, BOUND_LOWER, &iB), uiE = pgBound(pTree, pHigh, BOUND_FLOOR, &iE);
+		void *pK;
+		pCursor->pb = pCursor->pe = NULL;
+		if((uiE == 0) || !pgCursorAt(pCursor, uiB, iB, &pK, NULL) || (cmpKey(pTree, pK, pHigh) > 0))
+			return(pgCursorAt(pCursor, 0, 0, ppKey, ppValue));
+		pCursor->pb = PG_POS(uiB, iB);
+		pCursor->pe = PG_POS(uiE, iE);
+		return(pgCursorAt(pCursor, uiB, iB, ppKey, ppValue));
+	}
+	if(pTree->iMode & TREE_CONCURRENT) { /* bounds are keys as for B+tree, a node may take over another key */
+		int iFound = 0;
+		pCursor->pb = pCursor->pe = NULL;
+		readPin(pTree, 1);
+		if(readNode(pTree, BOUND_FLOOR, pHigh, NULL, &pCursor->pe, NULL))
+			iFound = cursorRead(pCursor, BOUND_LOWER, pLow, NULL, ppKey, ppValue);
+		else
+			cursorAt(pCursor, NULL, ppKey, ppValue);
+		pCursor->pb = pCursor->pn;
+		readPin(pTree, 0);
+		return(iFound);
+	}
+	pB = seekNode(pTree, BOUND_LOWER, pLow, NULL, ULONG_MAX);
+	pE = seekNode(pTree, BOUND_FLOOR, pHigh, NULL, ULONG_MAX);
+	if((pB == NULL) || (pE == NULL) || (cmpKeyPrefix(pTree, pB->pKey, pB->ui64Prefix, pE->pKey, pE->ui64Prefix) > 0))
+		pB = pE = NULL;
+	pCursor->pb = pB;
+	pCursor->pe = pE;
+return(cursorAt(pCursor, pB, ppKey, ppValue));
+}
+
+int treeSelect(Tree *pTree, TreeCursor *pCursor, unsigned long ulIndex, void **ppKey, void **ppValue) {
+	if((pTree == NULL) || (pCursor == NULL) || (pTree->iMode & (TREE_BPLUS | TREE_COMPACT | TREE_PAGED)))
+		return(0);
+	pCursor->pTree = pTree;
+	pCursor->iOrder = TREE_SORTED;
+	pCursor->pb = pCursor->pe = NULL;
+	if(pTree->iMode & TREE_MAPPED)
+		return(mapCursorAt(pCursor, (ulIndex < pTree->ulTreeLen) ? (MapEntry*)pTree->ph + ulIndex : NULL, ppKey, ppValue));
+	if(pTree->iMode & TREE_CONCURRENT)
+		return(cursorRead(pCursor, SEEK_INDEX, NULL, &ulIndex, ppKey, ppValue));
+return(cursorAt(pCursor, seekNode(pTree, SEEK_INDEX, NULL, &ulIndex, ULONG_MAX), ppKey, ppValue));
+}
+
+unsigned long treeRank(Tree *pTree, const void *pKey) {
+	unsigned long ulRank = 0;
+	if((pTree == NULL) || (pKey == NULL) || (pTree->iMode & (TREE_BPLUS | TREE_COMPACT | TREE_PAGED)))
+		return(0);
+	if(pTree->iMode & TREE_MAPPED)
+		ulRank = mapRank(pTree, pKey, 0);
+	else if(pTree->iMode & TREE_CONCURRENT)
+		readNode(pTree, SEEK_RANK, pKey, &ulRank, NULL, NULL);
+	else
+		seekNode(pTree, SEEK_RANK, pKey, &ulRank, ULONG_MAX);
+return(ulRank);
+}
+
+unsigned long treeRangeCount(Tree *pTree, const void *pLow, const void *pHigh) {
+	unsigned long ulLow = 0, ulHigh = 0;
+	if((pTree == NULL) || (pLow == NULL) || (pHigh == NULL) || (pTree->iMode & (TREE_BPLUS | TREE_COMPACT | TREE_PAGED)))
+		return(0);
+	if(pTree->iMode & TREE_MAPPED) {
+		ulLow = mapRank(pTree, pLow, 0);
+		ulHigh = mapRank(pTree, pHigh, 1);
+	} else if(pTree->iMode & TREE_CONCURRENT) { /* two reads, counts may straddle a write */
+		readNode(pTree, SEEK_RANK, pLow, &ulLow, NULL, NULL);
+		readNode(pTree, SEEK_RANK_EQ, pHigh, &ulHigh, NULL, NULL);
+	} else {
+		seekNode(pTree, SEEK_RANK, pLow, &ulLow, ULONG_MAX);
+		seekNode(pTree, SEEK_RANK_EQ, pHigh, &ulHigh, ULONG_MAX);
+	}
+return((ulHigh > ulLow) ? ulHigh - ulLow : 0);
+}
+
 int treeUpdate(Tree *pTree, const void *pKey, void *pValue, size_t sizeTvalue) {
 	Node *pNode;
-	if((pTree != NULL) && (pKey != NULL) && ((pNode = getNodeByKey(pTree, pKey)) != NULL)) {
-		copyValue(pTree, pNode, pValue, sizeTvalue);
+	if((pTree != NULL) && (pTree->iMode & TREE_BPLUS)) {
+		int i;
+		BpLeaf *pLeaf = bpFind(pTree, pKey, &i);
+		if(pLeaf == NULL)
+			return(0);
+		pLeaf->apValue[i] = replaceData(pTree, NULL, 0, pLeaf->apValue[i], pLeaf->asizeTvalue[i], pValue, sizeTvalue);
+		pLeaf->asizeTvalue[i] = sizeTvalue;
 		return(1);
 	}
-return(0);
+	if((pTree != NULL) && (pKey != NULL) && (pTree->iMode & TREE_COMPACT)) {
+		uint32_t ui = cpWriteBegin(pTree) ? cpOwnKey(pTree, pKey) : 0;
+		return((ui != 0) && cpSetValue(pTree, CP_NODE((CpTree*)pTree->pr, ui), pValue, sizeTvalue, 0));
+	}
+	if((pTree != NULL) && (pKey != NULL) && (pTree->iMode & TREE_PAGED))
+		return(pgPut(pTree, (void*)pKey, 0, pValue, sizeTvalue, PG_PUT_UPDATE));
+	if((pTree == NULL) || (pKey == NULL) || !writeBegin(pTree))
+		return(0);
+	if((pNode = getNodeByKey(pTree, pKey)) != NULL) {
+		if(pTree->pe != NULL) /* value copy may change size */
+			((Cache*)pTree->pe)->sizeTbytes -= cacheBytes(pTree, pNode);
+		copyValue(pTree, pNode, pValue, sizeTvalue);
+		if(pTree->pe != NULL)
+			((Cache*)pTree->pe)->sizeTbytes += cacheBytes(pTree, pNode);
+		cacheTouch(pTree, pNode);
+		cacheTrim(pTree, pNode);
+	}
+	writeEnd(pTree);
+return(pNode != NULL);
 }
 
 int treeDelete(Tree *pTree, const void *pKey) {
-	int iRet = 0, iListSettled = 0;
+	uint64_t ui64Start = statStart(pTree);
+	int iDeleted = deleteKey(pTree, pKey);
+	statEnd(pTree, TREE_STATS_DELETE, ui64Start);
+return(iDeleted);
+}
+
+static int deleteKey(Tree *pTree, const void *pKey) {
 	Node *pNode;
 	if((pTree == NULL) || (pKey == NULL))
 		return 0;
-	if((pNode = getNodeByKey(pTree, pKey)) != NULL) {
-		if((pNode->pLeft == NULL) && (pNode->pRight == NULL)) {
-			if(pNode == pTree->pr) {
-				treeFree(pTree);
-				return(1);
-			}
-			removeNode(pNode);
-		} else if((pNode->pLeft != NULL) && (pNode->pRight != NULL)) {
-			Node *p, *pN;
-			for(p = pNode->pLeft; p != NULL; p = p->pRight)
-				pN = p;
-			copyKeyValue(pTree, pNode, pN->pKey, pN->sizeTkey, pN->pValue, pN->sizeTvalue);
-			resetList(pTree, pNode);
-			pNode->pPrev = pN->pPrev;
-			pNode->pNext = pN->pNext;
-			if(pNode->pPrev != NULL)
-				pNode->pPrev->pNext = pNode;
-			if(pNode->pNext != NULL)
-				pNode->pNext->pPrev = pNode;
-			iListSettled = 1;
-			if(pN->pLeft != NULL) {
-				spliceLeft(pN);
-				balanceTree(pTree, pN->pLeft);
-			} else
-				removeNode(pN);
-			pNode = pN;
-		} else if(pNode->pLeft != NULL) {
-			if(pNode == pTree->pr) {
-				pTree->pr = pNode->pLeft;
-				((Node*)pTree->pr)->color = NODE_BLACK;
-			} else {
-				spliceLeft(pNode);
-				balanceTree(pTree, pNode->pLeft);
-			}
-		} else {
-			if(pNode == pTree->pr) {
-				pTree->pr = pNode->pRight;
-				((Node*)pTree->pr)->color = NODE_BLACK;
-			} else {
-				spliceRight(pNode);
-				balanceTree(pTree, pNode->pRight);
-			}
-		}
-		if(!iListSettled)
-			resetList(pTree, pNode);
-		if((pNode->pValue != NULL) && (pNode->sizeTvalue > 0))
-			free(pNode->pValue);
-		if(pNode->sizeTkey > 0)
-			free(pNode->pKey);
-		free(pNode);
-		pTree->ulTreeLen--;
-		iRet = 1;
-	}
-return(iRet);
+	if(pTree->iMode & TREE_BPLUS)
+		return(bpDelete(pTree, pKey));
+	if(pTree->iMode & TREE_COMPACT)
+		return(cpDelete(pTree, pKey));
+	if(pTree->iMode & TREE_PAGED)
+		return(pgDelete(pTree, pKey));
+	if(!writeBegin(pTree))
+		return(0);
+	if((pNode = getNodeByKey(pTree, pKey)) != NULL)
+		unlinkNode(pTree, pNode);
+	writeEnd(pTree);
+return(pNode != NULL);
 }
 
 void treeFree(Tree *pTree) {
 	Node *pN, *pNode = pTree->ph;
-	while(pNode != NULL) {
-		pN = pNode;
-		pNode = pNode->pNext;
-		if((pN->pValue != NULL) && (pN->sizeTvalue > 0))
-			free(pN->pValue);
-		if(pN->sizeTkey > 0)
-			free(pN->pKey);
-		free(pN);
+	Pool *pPool = pTree->pp;
+	reclaim(pTree, 1); /* retired nodes go back to the pool before its slabs do */
+	if(pTree->iMode & TREE_PAGED)
+		pgClose(pTree);
+	else if(pTree->iMode & TREE_MAPPED)
+		mapUnload(pTree->pr, ((MapHead*)pTree->pr)->ui64Size);
+	else if(pTree->iMode & TREE_BPLUS)
+		bpFree(pTree);
+	else if(pTree->iMode & TREE_COMPACT)
+		cpFree(pTree);
+	else if(pPool != NULL) {
+		Slab *pS;
+		for(; (pNode != NULL) && (pPool->ulOutside > 0); pNode = pNode->pNext) {
+			releaseData(pTree, KEY_INLINE(pTree, pNode), pNode->pKey, pNode->sizeTkey);
+			releaseData(pTree, VALUE_INLINE(pTree, pNode), pNode->pValue, pNode->sizeTvalue);
+		}
+		while((pS = pPool->pSlabs) != NULL) {
+			pPool->pSlabs = pS->pNext;
+			free(pS);
+		}
+		free(pPool);
+	} else {
+		while(pNode != NULL) {
+			pN = pNode;
+			pNode = pNode->pNext;
+			releaseNode(pTree, pN);
+		}
 	}
 	if(pTree->ppArray != NULL)
 		free(pTree->ppArray);
 	if(pTree->ppArraySorted != NULL)
 		free(pTree->ppArraySorted);
-	treeInit(pTree, pTree->pfCmp);
+	if(pTree->ps != NULL)
+		free(pTree->ps);
+	if(pTree->pe != NULL)
+		free(pTree->pe);
+	hashDrop(pTree);
+	initTree(pTree, pTree->pfCmp, pTree->iKey, pTree->sizeTcmp, pTree->iMode & ~(TREE_MAPPED | TREE_SNAPSHOT | TREE_PAGED));
 return;
 }
 
+Tree* treeSnapshot(Tree *pTree, Tree *pSnap) {
+	CpTree *pC, *pV;
+	uint32_t ui;
+	if((pTree == NULL) || (pSnap == NULL) || (pSnap == pTree) || !(pTree->iMode & TREE_COMPACT)
+	|| !cpWriteBegin(pTree) || ((pC = cpStart(pTree)) == NULL))
+		return(NULL);
+	if(pC->ppui32Extra == NULL) { /* counts kept from first snapshot on */
+		if((pC->ppui32Extra = calloc((pC->ui32ChunksMax == 0) ? 1 : pC->ui32ChunksMax, sizeof(uint32_t*))) == NULL)
+			return(NULL);
+		for(ui = 0; ui < pC->ui32Chunks; ui++) {
+			if((pC->ppui32Extra[ui] = calloc(CP_CHUNK, sizeof(uint32_t))) == NULL) {
+				while(ui > 0)
+					free(pC->ppui32Extra[--ui]);
+				free(pC->ppui32Extra);
+				pC->ppui32Extra = NULL;
+				return(NULL);
+			}
+		}
+	}
+	if((pV = calloc(1, sizeof(CpTree))) == NULL)
+		return(NULL);
+	pV->ppChunks = pC->ppChunks; /* directory never freed while view holds it */
+	pV->ui32Chunks = pC->ui32Chunks;
+	pV->ui32Next = pC->ui32Next;
+	pV->ui32Root = pC->ui32Root;
+	pV->pStore = pC;
+	if(pC->ui32Root != 0) /* whole tree shared, writes copy their path from here on */
+		CP_EXTRA(pC, pC->ui32Root)++;
+	pC->ui32Views++;
+	CP_REFS(pC, 1);
+	memcpy(pSnap, pTree, sizeof(Tree));
+	pSnap->iMode |= TREE_SNAPSHOT;
+	pSnap->iStale = STALE_ARRAY | STALE_SORTED;
+	pSnap->pr = pV;
+	pSnap->ppArray = pSnap->ppArraySorted = NULL;
+	pSnap->ph = pSnap->pt = pSnap->pp = pSnap->pc = pSnap->ps = pSnap->pe = pSnap->px = NULL;
+return(pSnap);
+}
+
 int treeInsert(Tree *pTree, void *pKey, size_t sizeTkey, void *pValue, size_t sizeTvalue) {
-	int iCmp;
-	Node *pN, *pNode;
+	uint64_t ui64Start = statStart(pTree);
+	int iInserted = insertKey(pTree, pKey, sizeTkey, pValue, sizeTvalue);
+	statEnd(pTree, TREE_STATS_INSERT, ui64Start);
+return(iInserted);
+}
+
+static int insertKey(Tree *pTree, void *pKey, size_t sizeTkey, void *pValue, size_t sizeTvalue) {
+	Node *pNode;
+	int i, iInserted;
 	if((pTree == NULL) || (pKey == NULL))
 		return(0);
-	if((pNode = initNode(pTree, pTree->pr, pKey, sizeTkey, pValue, sizeTvalue)) != NULL) {
-		pNode->color = NODE_BLACK;
-		pTree->pr = pNode;
-		return(1);
-	}
-	pNode = pTree->pr;
-	while(pNode != NULL) {
-		if((iCmp = pTree->pfCmp(pNode->pKey, pKey)) < 0) {
-			if((pN = initNode(pTree, pNode->pRight, pKey, sizeTkey, pValue, sizeTvalue)) != NULL) {
-				pNode->pRight = pN;
-				pN->pParent = pNode;
-				balanceTree(pTree, pN);
-				break;
-			}
-			pNode = pNode->pRight;
-		} else if(iCmp > 0) {
-			if((pN = initNode(pTree, pNode->pLeft, pKey, sizeTkey, pValue, sizeTvalue)) != NULL) {
-				pNode->pLeft = pN;
-				pN->pParent = pNode;
-				balanceTree(pTree, pN);
-				break;
+	if(pTree->iMode & TREE_BPLUS)
+		return((bpInsert(pTree, pKey, sizeTkey, pValue, sizeTvalue, &i, &iInserted) != NULL) && iInserted);
+	if(pTree->iMode & TREE_COMPACT)
+		return((cpInsert(pTree, pKey, sizeTkey, pValue, sizeTvalue, 0, &iInserted) != NULL) && iInserted);
+	if(pTree->iMode & TREE_PAGED)
+		return(pgPut(pTree, pKey, sizeTkey, pValue, sizeTvalue, PG_PUT_INSERT));
+	if(!writeBegin(pTree))
+		return(0);
+	pNode = insertNode(pTree, pKey, sizeTkey, pValue, sizeTvalue, &iInserted);
+	i = (pNode != NULL) && iInserted;
+	if(pNode != NULL)
+		cacheTrim(pTree, pNode);
+	writeEnd(pTree);
+return(i);
+}
+
+void** treeUpsert(Tree *pTree, void *pKey, size_t sizeTkey, void *pValue, size_t sizeTvalue, int *piInserted) {
+	uint64_t ui64Start = statStart(pTree);
+	void **ppSlot = upsertSlot(pTree, pKey, sizeTkey, pValue, sizeTvalue, 1, piInserted);
+	statEnd(pTree, TREE_STATS_INSERT, ui64Start);
+return(ppSlot);
+}
+
+unsigned long treeValueBatch(Tree *pTree, void **ppKeys, unsigned long ulLen, void **ppValues) {
+	Node *apNodes[BATCH_CHUNK];
+	unsigned long ul, ulChunk, ulFound = 0;
+	int i, iSorted;
+	if((pTree == NULL) || (ppKeys == NULL) || (ppValues == NULL))
+		return(0);
+	statStart(pTree);
+	if(pTree->iMode & TREE_PAGED) /* values stay valid only until the next call */
+		return(0);
+	if((pTree->iMode & (TREE_BPLUS | TREE_MAPPED | TREE_CONCURRENT | TREE_COMPACT)) || (pTree->px != NULL)) { /* one descent or probe at a time, see treelibc.h */
+		for(ul = 0; ul < ulLen; ul++)
+			ulFound += ((ppValues[ul] = findValue(pTree, ppKeys[ul])) != NULL);
+	} else {
+		iSorted = batchSorted(pTree, ppKeys, ulLen);
+		for(ul = 0; ul < ulLen; ul += ulChunk) {
+			ulChunk = ((ulLen - ul) < BATCH_CHUNK) ? ulLen - ul : BATCH_CHUNK;
+			findChunk(pTree, ppKeys + ul, ulChunk, iSorted, apNodes);
+			for(i = 0; i < (int)ulChunk; i++) {
+				if(apNodes[i] != NULL)
+					cacheTouch(pTree, apNodes[i]);
+				ulFound += ((ppValues[ul + i] = (apNodes[i] == NULL) ? NULL : apNodes[i]->pValue) != NULL);
 			}
-			pNode = pNode->pLeft;
-		} else
-			return(0);
+		}
 	}
-return(1);
+	STAT_ADD(pTree, aullCalls[TREE_STATS_LOOKUP], ulLen);
+return(ulFound);
 }
 
-static Node* initNode(
-	Tree *pTree, Node *pNode, void *pKey, size_t sizeTkey, void *pValue, size_t sizeTvalue
+unsigned long treeInsertBatch(
+	Tree *pTree, void **ppKeys, const size_t *pSizeTkeys, void **ppValues, const size_t *pSizeTvalues, unsigned long ulLen
 ) {
-	if(pNode != NULL)
-		return(NULL);
-	pTree->ulTreeLen++;
-	pNode = malloc(sizeof(Node));
-	pNode->color = NODE_RED;
-	pNode->sizeTkey = sizeTkey;
-	pNode->sizeTvalue = sizeTvalue;
-	pNode->pKey = pNode->pValue = NULL;
-	pNode->pParent = pNode->pRight = pNode->pLeft = pNode->pNext = NULL;
-	pNode->pPrev = pTree->pt;
-	if(pTree->ph == NULL)
-		pTree->ph = pTree->pt = pNode;
-	else
-		((Node*)pTree->pt)->pNext = pNode;
-	pTree->pt = pNode;
-	copyKeyValue(pTree, pNode, pKey, sizeTkey, pValue, sizeTvalue);
-return(pNode);
+	Node *apNodes[BATCH_CHUNK];
+	unsigned long ul, ulChunk, ulInserted = 0;
+	int i, iSorted, iWarm;
+	if((pTree == NULL) || (ppKeys == NULL))
+		return(0);
+	statStart(pTree);
+	iWarm = !(pTree->iMode & (TREE_BPLUS | TREE_MAPPED | TREE_CONCURRENT | TREE_COMPACT | TREE_PAGED)) && (pTree->pe == NULL) && (pTree->px == NULL); /* evictions free found nodes, index finds present keys */
+	iSorted = iWarm && batchSorted(pTree, ppKeys, ulLen);
+	for(ul = 0; ul < ulLen; ul += ulChunk) {
+		ulChunk = ((ulLen - ul) < BATCH_CHUNK) ? ulLen - ul : BATCH_CHUNK;
+		if(iWarm) /* paths loaded together, keys present need no second descent */
+			findChunk(pTree, ppKeys + ul, ulChunk, iSorted, apNodes);
+		for(i = 0; i < (int)ulChunk; i++) {
+			if(iWarm && (apNodes[i] != NULL))
+				cacheTouch(pTree, apNodes[i]);
+			else
+				ulInserted += insertKey(
+					pTree, ppKeys[ul + i], (pSizeTkeys == NULL) ? 0 : pSizeTkeys[ul + i],
+					(ppValues == NULL) ? NULL : ppValues[ul + i], (pSizeTvalues == NULL) ? 0 : pSizeTvalues[ul + i]
+				);
+		}
+	}
+	STAT_ADD(pTree, aullCalls[TREE_STATS_INSERT], ulLen);
+return(ulInserted);
 }
 
-static void copyKeyValue(
-	Tree *pTree, Node *pNode, void *pKey, size_t sizeTkey, void *pValue, size_t sizeTvalue
-) {
-	if((pNode->pKey != NULL) && (pNode->sizeTkey > 0))
-		free(pNode->pKey);
-	if(sizeTkey > 0) {
-		pNode->pKey = malloc(sizeTkey + 1);
-		memcpy(pNode->pKey, pKey, sizeTkey);
-		((char*)pNode->pKey)[sizeTkey] = '\0';
-	} else
-		pNode->pKey = pKey;
- 	copyValue(pTree, pNode, pValue, sizeTvalue);
+void** treeGetOrInsert(Tree *pTree, void *pKey, size_t sizeTkey, void *pValue, size_t sizeTvalue, int *piInserted) {
+	uint64_t ui64Start = statStart(pTree);
+	void **ppSlot = upsertSlot(pTree, pKey, sizeTkey, pValue, sizeTvalue, 0, piInserted);
+	statEnd(pTree, TREE_STATS_INSERT, ui64Start);
+return(ppSlot);
+}
+
+void treeReadBegin(Tree *pTree) {
+	if((pTree != NULL) && (pTree->iMode & TREE_CONCURRENT))
+		readPin(pTree, 1);
 return;
 }
 
-static void copyValue(Tree *pTree, Node *pNode, void *pValue, size_t sizeTvalue) {
-	if((pNode->pValue != NULL) && (pNode->sizeTvalue > 0))
-		free(pNode->pValue);
-	if(sizeTvalue > 0) {
-		pNode->pValue = malloc(sizeTvalue + 1);
-		memcpy(pNode->pValue, pValue, sizeTvalue);
-		((char*)pNode->pValue)[sizeTvalue] = '\0';
-	} else
-		pNode->pValue = pValue;
+void treeReadEnd(Tree *pTree) {
+	if((pTree != NULL) && (pTree->iMode & TREE_CONCURRENT))
+		readPin(pTree, 0);
 return;
 }
 
-static void balanceTree(Tree *pTree, Node *pNode) {
-	if((pNode != NULL ) && (pNode->color == NODE_RED)) {
-		while((pNode != pTree->pr)
-		&& (pNode->pParent->color == NODE_RED)
-		&& (pNode->pParent->pParent != NULL)) {
-			if(pNode->pParent == pNode->pParent->pParent->pLeft)
-				pNode = resolveRB(pTree, pNode, pNode->pParent->pParent->pRight);
-			else
-				pNode = resolveRB(pTree, pNode, pNode->pParent->pParent->pLeft);
+int treeVerify(Tree *pTree) {
+	int iBad;
+	if((pTree == NULL) || !lockTree(pTree, 1))
+		return(TREE_BAD_LINK);
+	if(pTree->iMode & TREE_MAPPED)
+		iBad = mapVerify(pTree);
+	else if(pTree->iMode & TREE_PAGED)
+		iBad = pgVerify(pTree);
+	else if(pTree->iMode & TREE_COMPACT)
+		iBad = cpVerify(pTree);
+	else
+		iBad = (pTree->iMode & TREE_BPLUS) ? bpVerify(pTree) : rbVerify(pTree);
+	lockTree(pTree, 0);
+return(iBad);
+}
+
+TreeShards* treeShardsInit(
+	TreeShards *pShards, unsigned long ulShards, PFHASH pfHash, PFCMP pfCmp, int iKey, size_t sizeTkey, int iMode
+) {
+	unsigned long ul;
+	if((pShards == NULL) || (ulShards == 0) || ((iKey == TREE_KEY_USER) && (pfHash == NULL)))
+		return(NULL);
+	if((pShards->pTrees = malloc(ulShards * sizeof(Tree))) == NULL)
+		return(NULL);
+	for(ul = 0; ul < ulShards; ul++) {
+		if(((iKey == TREE_KEY_USER) ? treeInitMode(&pShards->pTrees[ul], pfCmp, iMode | TREE_CONCURRENT)
+		: treeInitKey(&pShards->pTrees[ul], iKey, sizeTkey, iMode | TREE_CONCURRENT)) == NULL) {
+			free(pShards->pTrees);
+			return(NULL);
 		}
-		pNode = pTree->pr;
-		if((pNode->color == NODE_RED)
-		&& (((pNode->pLeft != NULL) && (pNode->pLeft->color == NODE_RED))
-		|| ((pNode->pRight != NULL) && (pNode->pRight->color == NODE_RED))))
-			pNode->color = NODE_BLACK;
 	}
+	pShards->ulShards = ulShards;
+	pShards->pfHash = pfHash;
+return(pShards);
+}
+
+Tree* treeShard(TreeShards *pShards, const void *pKey) {
+	uint64_t ui64;
+	if((pShards == NULL) || (pKey == NULL))
+		return(NULL);
+	ui64 = (pShards->pfHash != NULL) ? pShards->pfHash(pKey) : hashKey(pShards->pTrees, pKey);
+return(&pShards->pTrees[ui64 % pShards->ulShards]);
+}
+
+unsigned long treeShardsLength(TreeShards *pShards) {
+	unsigned long ul, ulLen = 0;
+	for(ul = 0; ul < pShards->ulShards; ul++)
+		ulLen += pShards->pTrees[ul].ulTreeLen;
+return(ulLen);
+}
+
+void treeShardsFree(TreeShards *pShards) {
+	unsigned long ul;
+	for(ul = 0; ul < pShards->ulShards; ul++)
+		treeFree(&pShards->pTrees[ul]);
+	free(pShards->pTrees);
+	pShards->pTrees = NULL;
+	pShards->ulShards = 0;
 return;
 }
 
-static Node* resolveRB(Tree *pTree, Node *pNode, Node *pUncle) {
-	if((pUncle != NULL) && (pUncle->color == NODE_RED)) {
-		pNode->pParent->pParent->color = NODE_RED;
-		pNode->pParent->color = NODE_BLACK;
-		pUncle->color = NODE_BLACK;
+int treeSave(Tree *pTree, const char *pcFile) {
+	FILE *pFile = NULL;
+	char *pcTemp;
+	int iSaved;
+	if((pTree == NULL) || (pcFile == NULL) || ((pcTemp = malloc(strlen(pcFile) + sizeof(MAP_TEMP))) == NULL))
+		return(0);
+	strcat(strcpy(pcTemp, pcFile), MAP_TEMP); /* same directory, so rename() only swaps names */
+#ifdef _WIN32
+	pFile = fopen(pcTemp, "wb");
+#else
+	{
+		struct stat st;
+		int iFd = mkstemp(pcTemp);
+		if(iFd >= 0) { /* mkstemp() makes it 0600, keep the mode of the file it replaces or 0644 */
+			if((fchmod(iFd, (stat(pcFile, &st) == 0) ? (st.st_mode & 0777) : 0644) != 0)
+			|| ((pFile = fdopen(iFd, "wb")) == NULL)) {
+				close(iFd);
+				remove(pcTemp);
+			}
+		}
+	}
+#endif
+	if((pFile != NULL) && !lockTree(pTree, 1)) {
+		fclose(pFile);
+		remove(pcTemp);
+		pFile = NULL;
+	}
+	if(pFile == NULL) {
+		free(pcTemp);
+		return(0);
+	}
+	iSaved = saveTree(pTree, pFile);
+	lockTree(pTree, 0);
+	iSaved = iSaved && (fflush(pFile) == 0);
+#ifndef _WIN32
+	iSaved = iSaved && (fsync(fileno(pFile)) == 0); /* on disk before its name replaces the old file */
+#endif
+	if((fclose(pFile) != 0) || !iSaved) {
+		remove(pcTemp); /* no partial snapshot left, old file untouched */
+		free(pcTemp);
+		return(0);
+	}
+#ifdef _WIN32
+	remove(pcFile); /* rename() does not replace there */
+#endif
+	if(rename(pcTemp, pcFile) != 0) {
+		remove(pcTemp);
+		free(pcTemp);
+		return(0);
+	}
+#ifndef _WIN32
+	{ /* rename itself on disk, best effort */
+		char *pc;
+		int iFd;
+		if((pc = strrchr(pcTemp, '/')) == NULL)
+			strcpy(pcTemp, ".");
+		else
+			pc[pc == pcTemp] = '\0';
+		if((iFd = open(pcTemp, O_RDONLY)) >= 0) {
+			fsync(iFd);
+			close(iFd);
+		}
+	}
+#endif
+	free(pcTemp);
+return(1);
+}
+
+Tree* treeLoad(Tree *pTree, const char *pcFile, PFCMP pfCmp) {
+	MapHead *pHead;
+	uint64_t ui64Size;
+	if((pTree == NULL) || (pcFile == NULL))
+		return(NULL);
+#ifdef _WIN32
+	{ /* no mmap(), file read whole into one buffer, still no per key work */
+		FILE *pFile = fopen(pcFile, "rb");
+		long lSize;
+		if(pFile == NULL)
+			return(NULL);
+		if((fseek(pFile, 0, SEEK_END) != 0) || ((lSize = ftell(pFile)) < (long)sizeof(MapHead))
+		|| (fseek(pFile, 0, SEEK_SET) != 0) || ((pHead = alignedAlloc(lSize)) == NULL)) {
+			fclose(pFile);
+			return(NULL);
+		}
+		ui64Size = (uint64_t)lSize;
+		if(fread(pHead, 1, lSize, pFile) != (size_t)lSize) {
+			fclose(pFile);
+			alignedFree(pHead);
+			return(NULL);
+		}
+		fclose(pFile);
+	}
+#else
+	{ /* pages come in on first touch, shared with other processes mapping the file */
+		struct stat st;
+		int iFd = open(pcFile, O_RDONLY);
+		if(iFd < 0)
+			return(NULL);
+		if((fstat(iFd, &st) != 0) || (st.st_size < (off_t)sizeof(MapHead))) {
+			close(iFd);
+			return(NULL);
+		}
+		ui64Size = (uint64_t)st.st_size;
+		pHead = mmap(NULL, (size_t)ui64Size, PROT_READ, MAP_SHARED, iFd, 0);
+		close(iFd);
+		if(pHead == MAP_FAILED)
+			return(NULL);
+	}
+#endif
+	if((memcmp(pHead->acMagic, MAP_MAGIC, sizeof(pHead->acMagic)) != 0) || (pHead->ui32Version != MAP_VERSION)
+	|| (pHead->ui32Endian != MAP_ENDIAN) || (pHead->ui64Size != ui64Size)
+	|| (pHead->ui64Len > (ui64Size / (sizeof(MapEntry) + sizeof(uint64_t))))
+	|| (pHead->ui64Entries != sizeof(MapHead))
+	|| (pHead->ui64Order != pHead->ui64Entries + (pHead->ui64Len * sizeof(MapEntry)))
+	|| (pHead->ui64Data != pHead->ui64Order + (pHead->ui64Len * sizeof(uint64_t))) || (pHead->ui64Data > ui64Size)
+	|| (((pHead->i32Key == TREE_KEY_USER) ? treeInitMode(pTree, pfCmp, 0)
+	: treeInitKey(pTree, pHead->i32Key, (size_t)pHead->ui64Cmp, 0)) == NULL)) {
+		mapUnload(pHead, ui64Size);
+		return(NULL);
+	}
+	pTree->iMode = TREE_MAPPED;
+	pTree->ulTreeLen = (unsigned long)pHead->ui64Len;
+	pTree->pr = pHead;
+	pTree->ph = (char*)pHead + pHead->ui64Entries;
+	pTree->pt = (char*)pHead + pHead->ui64Order;
+	if(mapVerify(pTree) != 0) { /* every offset checked once, lookups then follow them unchecked */
+		treeFree(pTree);
+		return(NULL);
+	}
+return(pTree);
+}
+
+Tree* treeOpen(Tree *pTree, const char *pcFile, size_t sizeTmemory) {
+	PgPool *pPool;
+	PgHead *pHead;
+	uint64_t ui64Size = 0;
+	size_t sizeTframes = sizeTmemory / PG_SIZE;
+	int iOk;
+	if((pTree == NULL) || (pcFile == NULL) || (pTree->iMode != 0) || (pTree->ulTreeLen != 0) || (pTree->pe != NULL)
+	|| (pTree->px != NULL) || ((pPool = calloc(1, sizeof(PgPool))) == NULL))
+		return(NULL);
+	pTree->pr = pPool;
+	pPool->ui32Frames = (sizeTframes < PG_FRAMES_MIN) ? PG_FRAMES_MIN : (sizeTframes > (1U << 30)) ? (1U << 30) : (uint32_t)sizeTframes;
+	for(pPool->ui32Mask = 1; pPool->ui32Mask < pPool->ui32Frames; pPool->ui32Mask <<= 1)
+		;
+	pPool->i32Oldest = pPool->i32Newest = -1;
+#ifdef _WIN32
+	if((pPool->pFile = fopen(pcFile, "r+b")) == NULL)
+		pPool->pFile = fopen(pcFile, "w+b");
+	iOk = (pPool->pFile != NULL) && (_fseeki64(pPool->pFile, 0, SEEK_END) == 0) && (_ftelli64(pPool->pFile) >= 0);
+	ui64Size = iOk ? (uint64_t)_ftelli64(pPool->pFile) : 0;
+#else
+	{
+		struct stat st;
+		iOk = ((pPool->iFd = open(pcFile, O_RDWR | O_CREAT, 0666)) >= 0) && (fstat(pPool->iFd, &st) == 0);
+		ui64Size = iOk ? (uint64_t)st.st_size : 0;
+	}
+#endif
+	if(!iOk || ((pPool->pcFrames = alignedAlloc((size_t)pPool->ui32Frames * PG_SIZE)) == NULL)
+	|| ((pPool->pFrames = malloc(pPool->ui32Frames * sizeof(PgFrame))) == NULL)
+	|| ((pPool->pi32Buckets = malloc(pPool->ui32Mask * sizeof(int32_t))) == NULL)
+	|| ((pPool->pcScratch = alignedAlloc(2 * PG_SIZE)) == NULL)
+	|| ((pPool->ppEntries = malloc((PG_SLOTS_MAX + 1) * sizeof(PgEntry*))) == NULL)) {
+		pgClose(pTree);
+		pTree->pr = NULL;
+		return(NULL);
+	}
+	memset(pPool->pi32Buckets, 0xff, pPool->ui32Mask * sizeof(int32_t)); /* all -1 */
+	pPool->ui32Mask--;
+	pHead = &pPool->head;
+	if(ui64Size == 0) { /* new file, head written now so a reopen finds it */
+		memcpy(pHead->acMagic, PG_MAGIC, sizeof(pHead->acMagic));
+		pHead->ui32Version = PG_VERSION;
+		pHead->ui32Endian = MAP_ENDIAN;
+		pHead->i32Key = pTree->iKey;
+		pHead->ui32PageSize = PG_SIZE;
+		pHead->ui64Cmp = pTree->sizeTcmp;
+		pHead->ui32Pages = 1;
+		iOk = pgFlush(pTree);
+	} else if((iOk = pgIO(pPool, 0, pPool->pcScratch, 0)) != 0) { /* made by same kind of tree, pages named by head all there */
+		memcpy(pHead, pPool->pcScratch, sizeof(PgHead));
+		iOk = (memcmp(pHead->acMagic, PG_MAGIC, sizeof(pHead->acMagic)) == 0) && (pHead->ui32Version == PG_VERSION)
+		&& (pHead->ui32Endian == MAP_ENDIAN) && (pHead->ui32PageSize == PG_SIZE) && (pHead->i32Key == pTree->iKey)
+		&& (pHead->ui64Cmp == pTree->sizeTcmp) && (pHead->ui64Len <= ULONG_MAX) && (pHead->ui32Pages >= 1)
+		&& (ui64Size >= (uint64_t)pHead->ui32Pages * PG_SIZE) && (pHead->ui32Root < pHead->ui32Pages)
+		&& (pHead->ui32First < pHead->ui32Pages) && (pHead->ui32Last < pHead->ui32Pages) && (pHead->ui32Free < pHead->ui32Pages)
+		&& (pHead->ui32Height <= PG_DEPTH_MAX) && ((pHead->ui32Root == 0) == (pHead->ui32Height == 0));
+	}
+	if(!iOk) {
+		pgClose(pTree);
+		pTree->pr = NULL;
+		return(NULL);
+	}
+	pTree->iMode = TREE_PAGED;
+	pTree->ulTreeLen = (unsigned long)pHead->ui64Len;
+return(pTree);
+}
+
+int treeSync(Tree *pTree) {
+	if((pTree == NULL) || !(pTree->iMode & TREE_PAGED))
+		return(0);
+return(pgFlush(pTree));
+}
+
+TreeStats* treeStats(Tree *pTree, TreeStats *pStats) {
+	if((pTree == NULL) || (pStats == NULL) || !lockTree(pTree, 1))
+		return(NULL);
+	if(pTree->ps != NULL) /* counters, shape filled in below */
+		memcpy(pStats, pTree->ps, sizeof(TreeStats));
+	else
+		memset(pStats, 0, sizeof(TreeStats));
+	shapeStats(pTree, pStats);
+	lockTree(pTree, 0);
+return(pStats);
+}
+
+void treeStatsReset(Tree *pTree) {
+	if((pTree != NULL) && (pTree->ps != NULL))
+		memset(pTree->ps, 0, sizeof(TreeStats));
+return;
+}
+
+int treeHashIndex(Tree *pTree, int iIndex, PFHASH pfHash) {
+	HashIndex *pIndex;
+	Node *pNode;
+	unsigned long ulSlots = HASH_MIN;
+	int iBits = 4;
+	if((pTree == NULL) || (pTree->iMode & (TREE_BPLUS | TREE_MAPPED | TREE_CONCURRENT | TREE_COMPACT | TREE_PAGED)))
+		return(0);
+	hashDrop(pTree);
+	if(!iIndex)
+		return(1);
+	if((pTree->iKey == TREE_KEY_USER) && (pfHash == NULL))
+		return(0);
+	for(; ulSlots < 2 * pTree->ulTreeLen + 2; ulSlots <<= 1) /* at most half full */
+		iBits++;
+	if((pIndex = calloc(1, sizeof(HashIndex))) == NULL)
+		return(0);
+	if((pIndex->pSlots = calloc(ulSlots, sizeof(HashSlot))) == NULL) {
+		free(pIndex);
+		return(0);
+	}
+	pIndex->pfHash = pfHash;
+	pIndex->ulMask = ulSlots - 1;
+	pIndex->iShift = 64 - iBits;
+	pTree->px = pIndex;
+	for(pNode = pTree->ph; pNode != NULL; pNode = pNode->pNext) {
+		hashPut(pIndex->pSlots, pIndex->ulMask, pIndex->iShift, pNode, hashOf(pTree, pNode->pKey));
+		pIndex->ulUsed++;
+	}
+return(1);
+}
+
+int treeCacheLimit(Tree *pTree, unsigned long ulMaxLen, size_t sizeTmaxBytes, int iLRU, PFEVICT pfEvict, void *pArg) {
+	Cache *pCache;
+	Node *pNode;
+	if((pTree == NULL) || (pTree->iMode & (TREE_BPLUS | TREE_MAPPED | TREE_COMPACT | TREE_PAGED)) || (iLRU && (pTree->iMode & TREE_CONCURRENT)))
+		return(0);
+	if(!writeBegin(pTree))
+		return(0);
+	if((ulMaxLen == 0) && (sizeTmaxBytes == 0)) {
+		free(pTree->pe);
+		pTree->pe = NULL;
+	} else {
+		if((pCache = pTree->pe) == NULL) {
+			if((pCache = malloc(sizeof(Cache))) == NULL) {
+				writeEnd(pTree);
+				return(0);
+			}
+			pCache->sizeTbytes = 0;
+			for(pNode = pTree->ph; pNode != NULL; pNode = pNode->pNext)
+				pCache->sizeTbytes += cacheBytes(pTree, pNode);
+			pTree->pe = pCache;
+		}
+		pCache->ulMaxLen = ulMaxLen;
+		pCache->sizeTmax = sizeTmaxBytes;
+		pCache->iLRU = iLRU;
+		pCache->pfEvict = pfEvict;
+		pCache->pArg = pArg;
+		cacheTrim(pTree, NULL);
+	}
+	writeEnd(pTree);
+return(1);
+}
+
+int treeParallelForEach(Tree *pTree, int iThreads, PFVISIT pfVisit, void *pArg) {
+	ParJob job;
+	int iDone;
+	if((pTree == NULL) || (pfVisit == NULL))
+		return(0);
+	if(pTree->ulTreeLen == 0)
+		return(1);
+	if(!lockTree(pTree, 1))
+		return(0);
+	if((iDone = parStart(&job, pTree, iThreads, parVisit)) != 0) {
+		job.pfVisit = pfVisit;
+		job.pArg = pArg;
+		parRun(&job);
+		free(job.pPieces);
+	}
+	lockTree(pTree, 0);
+return(iDone);
+}
+
+int treeParallelReduce(Tree *pTree, int iThreads, void *pAcc, size_t sizeTacc, PFREDUCE pfReduce, PFJOIN pfJoin, void *pArg) {
+	ParJob job;
+	unsigned long ul;
+	int iDone = 0;
+	if((pTree == NULL) || (pAcc == NULL) || (sizeTacc == 0) || (pfReduce == NULL) || (pfJoin == NULL))
+		return(0);
+	if(pTree->ulTreeLen == 0)
+		return(1);
+	if(!lockTree(pTree, 1))
+		return(0);
+	if(parStart(&job, pTree, iThreads, parVisit)) {
+		job.pfReduce = pfReduce;
+		job.pArg = pArg;
+		job.sizeTstride = ((sizeTacc + BP_ALIGN - 1) / BP_ALIGN) * BP_ALIGN;
+		if((job.pcAcc = alignedAlloc(job.ulPieces * job.sizeTstride)) != NULL) {
+			for(ul = 0; ul < job.ulPieces; ul++) /* every piece starts from the identity */
+				memcpy(job.pcAcc + (ul * job.sizeTstride), pAcc, sizeTacc);
+			parRun(&job);
+			memcpy(pAcc, job.pcAcc, sizeTacc);
+			for(ul = 1; ul < job.ulPieces; ul++) /* pieces are in key order */
+				pfJoin(pAcc, job.pcAcc + (ul * job.sizeTstride), pArg);
+			iDone = 1;
+			alignedFree(job.pcAcc);
+		}
+		free(job.pPieces);
+	}
+	lockTree(pTree, 0);
+return(iDone);
+}
+
+void** const treeParallelArraySorted(Tree *pTree, int iThreads) {
+	ParJob job;
+	if((pTree == NULL) || (pTree->ulTreeLen <= 0))
+		return NULL;
+	if((pTree->ppArraySorted != NULL) && !(pTree->iStale & STALE_SORTED))
+		return(pTree->ppArraySorted);
+	if(pTree->iMode & (TREE_BPLUS | TREE_COMPACT | TREE_PAGED)) /* nodes hold no count of keys before them */
+		return(treeArraySorted(pTree));
+	lockTree(pTree, 1);
+	if((sizeArray(&pTree->ppArraySorted, pTree->ulTreeLen) != NULL) && parStart(&job, pTree, iThreads, parVisit)) {
+		job.ppOut = pTree->ppArraySorted;
+		parRun(&job);
+		pTree->iStale &= ~STALE_SORTED;
+		free(job.pPieces);
+	}
+	lockTree(pTree, 0);
+return((pTree->iStale & STALE_SORTED) ? NULL : pTree->ppArraySorted);
+}
+
+int treeParallelBuildSorted(
+	Tree *pTree, int iThreads, void **ppKeys, const size_t *pSizeTkeys, void **ppValues, const size_t *pSizeTvalues,
+	unsigned long ulLen, const unsigned long *pulOrder
+) {
+	ParJob job;
+	ParPiece *pMakes;
+	BuildRange range, *pCut;
+	unsigned long ul, ulCuts, ulMakes, ulCut = 0;
+	int iDone = 0;
+	iThreads = parThreads(iThreads);
+	if((pTree == NULL) || (ppKeys == NULL) || (pTree->ulTreeLen > 0) || (pTree->iMode & (TREE_MAPPED | TREE_SNAPSHOT | TREE_PAGED))
+	|| !lockTree(pTree, 1)) /* TREE_CONCURRENT state made first, readers take a tree without one as empty */
+		return(0);
+	lockTree(pTree, 0);
+	if((iThreads == 1) || (ulLen < 2 * PAR_GRAIN) || (pTree->iMode & (TREE_BPLUS | TREE_POOL | TREE_COMPACT))) /* one thread carves the pool or chunks */
+		return(treeBuildSorted(pTree, ppKeys, pSizeTkeys, ppValues, pSizeTvalues, ulLen, pulOrder));
+	if(sizeArray(&pTree->ppArraySorted, ulLen) == NULL)
+		return(0);
+	memset(&job, 0, sizeof(ParJob));
+	job.pTree = pTree;
+	job.iThreads = iThreads;
+	job.ppNodes = (Node**)pTree->ppArraySorted;
+	job.ppKeys = ppKeys;
+	job.ppValues = ppValues;
+	job.pSizeTkeys = pSizeTkeys;
+	job.pSizeTvalues = pSizeTvalues;
+	memset(job.ppNodes, 0, ulLen * sizeof(Node*));
+	for(ul = 0; (pulOrder != NULL) && (ul < ulLen); ul++) { /* order checked before any node is made */
+		if((pulOrder[ul] >= ulLen) || (job.ppNodes[pulOrder[ul]] != NULL)) {
+			treeFree(pTree); /* not a permutation */
+			return(0);
+		}
+		job.ppNodes[pulOrder[ul]] = (Node*)pTree;
+	}
+	job.ulPieces = ulLen / PAR_GRAIN; /* index ranges for making nodes and the sorted array */
+	if(job.ulPieces > (unsigned long)iThreads * PAR_PIECES)
+		job.ulPieces = (unsigned long)iThreads * PAR_PIECES;
+	for(; (1UL << ulCut) < job.ulPieces; ulCut++);
+	pMakes = job.pPieces = calloc(job.ulPieces, sizeof(ParPiece));
+	pCut = malloc((1UL << ulCut) * sizeof(BuildRange));
+	if((pMakes != NULL) && (pCut != NULL)) {
+		for(ul = 0; ul < job.ulPieces; ul++) {
+			pMakes[ul].ulFirst = (ulLen / job.ulPieces) * ul;
+			pMakes[ul].ulLen = (ul + 1 < job.ulPieces) ? ulLen / job.ulPieces : ulLen - pMakes[ul].ulFirst;
+		}
+		job.pfPiece = parMake;
+		parRun(&job);
+		for(ul = 0, iDone = 1; iDone && (ul < job.ulPieces); ul++)
+			iDone = !pMakes[ul].iFailed;
+	}
+	if(!iDone) { /* nodes made are in no list yet */
+		for(ul = 0; ul < ulLen; ul++) {
+			if((job.ppNodes[ul] != NULL) && (job.ppNodes[ul] != (Node*)pTree))
+				parFreeNode(pTree, job.ppNodes[ul]);
+		}
+	} else {
+		for(ul = 0; ul < ulLen; ul++) /* insertion order follows pulOrder */
+			appendNode(pTree, job.ppNodes[(pulOrder == NULL) ? ul : pulOrder[ul]]);
+		for(ul = ulLen, job.ulRed = 0; ul > 1; ul >>= 1) /* red level as treeBuildSorted() */
+			job.ulRed++;
+		if(ulLen == (2UL << job.ulRed) - 1)
+			job.ulRed = BUILD_DEPTH_MAX;
+		range.ulLow = 0;
+		range.ulHigh = ulLen;
+		range.ulDepth = 0;
+		range.pParent = NULL;
+		range.ppLink = (Node**)&pTree->pr;
+		ulCuts = buildShape(job.ppNodes, &range, job.ulRed, ulCut, pCut); /* top levels here, subtrees below the cut on the threads */
+		ulMakes = job.ulPieces;
+		if((job.pPieces = calloc(ulCuts, sizeof(ParPiece))) != NULL) {
+			for(ul = 0; ul < ulCuts; ul++)
+				job.pPieces[ul].range = pCut[ul];
+			job.ulPieces = ulCuts;
+			job.pfPiece = parLink;
+			parRun(&job);
+			free(job.pPieces);
+		} else {
+			for(ul = 0; ul < ulCuts; ul++)
+				buildShape(job.ppNodes, &pCut[ul], job.ulRed, ULONG_MAX, NULL);
+		}
+		job.pPieces = pMakes; /* sorted array over the same index ranges */
+		job.ulPieces = ulMakes;
+		job.pfPiece = parKeys;
+		parRun(&job);
+		pTree->iStale &= ~STALE_SORTED;
+		cacheTrim(pTree, NULL);
+	}
+	free(pCut);
+	free(pMakes);
+	if(!iDone) {
+		treeFree(pTree);
+		return(0);
+	}
+return(1);
+}
+
+void treeParallelFree(Tree *pTree, int iThreads) {
+	ParJob job;
+	if(pTree == NULL)
+		return;
+	reclaim(pTree, 1); /* retired nodes back first, as treeFree() */
+	if(!(pTree->iMode & (TREE_BPLUS | TREE_MAPPED | TREE_COMPACT | TREE_PAGED)) && (pTree->ulTreeLen > 0)
+	&& ((pTree->pp == NULL) || (((Pool*)pTree->pp)->ulOutside > 0)) /* pool nodes go with their slabs */
+	&& parStart(&job, pTree, iThreads, parRelease)) {
+		parRun(&job);
+		pTree->pr = pTree->ph = pTree->pt = NULL;
+		if(pTree->pp != NULL)
+			((Pool*)pTree->pp)->ulOutside = 0;
+		free(job.pPieces);
+	}
+	treeFree(pTree);
+return;
+}
+
+int treeJoin(Tree *pTree, Tree *pOther) {
+	SetJob job;
+	Node *pHigh, *pLow;
+	int iAfter = 1;
+	if(!setFits(pTree, pOther))
+		return(0);
+	if((pTree->pr != NULL) && (pOther->pr != NULL)) { /* ranges apart, other's keys above or below */
+		pHigh = edgeNode(pTree->pr, 1);
+		pLow = edgeNode(pOther->pr, 0);
+		iAfter = (cmpKeyPrefix(pTree, pHigh->pKey, pHigh->ui64Prefix, pLow->pKey, pLow->ui64Prefix) < 0);
+		pHigh = edgeNode(pOther->pr, 1);
+		pLow = edgeNode(pTree->pr, 0);
+		if(!iAfter && (cmpKeyPrefix(pTree, pHigh->pKey, pHigh->ui64Prefix, pLow->pKey, pLow->ui64Prefix) >= 0))
+			return(0);
+	}
+	setStart(&job, pTree, pOther, SET_UNION);
+	if(iAfter)
+		rbJoin2(&job.tree, &job.aPart[0], &job.aPart[1], &job.aPart[0]);
+	else
+		rbJoin2(&job.tree, &job.aPart[1], &job.aPart[0], &job.aPart[0]);
+	setEnd(pTree, pOther, &job.aPart[0]);
+return(1);
+}
+
+int treeSplit(Tree *pTree, const void *pKey, Tree *pOther) {
+	SetJob job;
+	SetPart high;
+	Node *pNode, *pNext;
+	uint64_t ui64Prefix;
+	unsigned long ulMove;
+	if((pKey == NULL) || (pOther == NULL) || (pOther == pTree) || !setFits(pTree, NULL))
+		return(0);
+	memcpy(pOther, pTree, sizeof(Tree)); /* same kind and order, empty */
+	pOther->ulTreeLen = 0;
+	pOther->iStale = STALE_ARRAY | STALE_SORTED;
+	pOther->pr = pOther->ph = pOther->pt = pOther->ppArray = pOther->ppArraySorted = pOther->pp = pOther->pc = pOther->ps = pOther->pe = pOther->px = NULL;
+	setStart(&job, pTree, pOther, SET_UNION);
+	ui64Prefix = keyPrefix(pTree, pKey);
+	if((pNode = rbSplit(&job.tree, &job.aPart[0], pKey, ui64Prefix, &job.aPart[0], &high)) != NULL) /* key itself goes above */
+		rbJoin(&job.tree, &job.aPart[1], pNode, &high, &high);
+	if((pTree->pr = job.aPart[0].pRoot) != NULL)
+		((Node*)pTree->pr)->color = NODE_BLACK;
+	if((pOther->pr = high.pRoot) != NULL)
+		((Node*)pOther->pr)->color = NODE_BLACK;
+	pTree->iStale = STALE_ARRAY | STALE_SORTED;
+	for(ulMove = SIZE(high.pRoot), pNode = pTree->ph; (ulMove > 0) && (pNode != NULL); pNode = pNext) { /* one pass keeps both orders */
+		pNext = pNode->pNext;
+		if(cmpKeyPrefix(pTree, pNode->pKey, pNode->ui64Prefix, pKey, ui64Prefix) >= 0) {
+			resetList(pTree, pNode);
+			appendNode(pOther, pNode);
+			ulMove--;
+		}
+	}
+	pTree->ulTreeLen -= pOther->ulTreeLen;
+return(1);
+}
+
+int treeUnion(Tree *pTree, Tree *pOther, int iThreads) { return(setMerge(pTree, pOther, SET_UNION, iThreads)); }
+
+int treeIntersect(Tree *pTree, Tree *pOther, int iThreads) { return(setMerge(pTree, pOther, SET_INTERSECT, iThreads)); }
+
+int treeDifference(Tree *pTree, Tree *pOther, int iThreads) { return(setMerge(pTree, pOther, SET_DIFFERENCE, iThreads)); }
+
+int treeBuildSorted(
+	Tree *pTree, void **ppKeys, const size_t *pSizeTkeys, void **ppValues, const size_t *pSizeTvalues,
+	unsigned long ulLen, const unsigned long *pulOrder
+) {
+	BuildRange range;
+	unsigned long ul, ulIndex, ulDepth = 0;
+	Node **ppNodes;
+	if((pTree == NULL) || (ppKeys == NULL) || (pTree->ulTreeLen > 0) || (pTree->iMode & (TREE_MAPPED | TREE_SNAPSHOT | TREE_PAGED))
+	|| !lockTree(pTree, 1)) /* TREE_CONCURRENT state made first, readers take a tree without one as empty */
+		return(0);
+	lockTree(pTree, 0);
+	if(ulLen == 0)
+		return(1);
+	if(pTree->iMode & TREE_BPLUS) /* no insertion order to keep */
+		return(bpBuild(pTree, ppKeys, pSizeTkeys, ppValues, pSizeTvalues, ulLen));
+	if(pTree->iMode & TREE_COMPACT)
+		return(cpBuild(pTree, ppKeys, pSizeTkeys, ppValues, pSizeTvalues, ulLen));
+	if((ppNodes = (Node**)sizeArray(&pTree->ppArraySorted, ulLen)) == NULL)
+		return(0);
+	for(ul = 0; ul < ulLen; ul++)
+		ppNodes[ul] = NULL;
+	for(ul = 0; ul < ulLen; ul++) { /* list follows pulOrder since initNode() appends */
+		ulIndex = (pulOrder == NULL) ? ul : pulOrder[ul];
+		if((ulIndex >= ulLen) || (ppNodes[ulIndex] != NULL)
+		|| ((ppNodes[ulIndex] = initNode(
+			pTree, NULL, ppKeys[ulIndex], (pSizeTkeys == NULL) ? 0 : pSizeTkeys[ulIndex],
+			(ppValues == NULL) ? NULL : ppValues[ulIndex], (pSizeTvalues == NULL) ? 0 : pSizeTvalues[ulIndex]
+		)) == NULL)) {
+			treeFree(pTree); /* not a permutation or out of memory */
+			return(0);
+		}
+	}
+	for(ul = ulLen; ul > 1; ul >>= 1) /* depth of lowest level, only partly filled levels are red */
+		ulDepth++;
+	if(ulLen == (2UL << ulDepth) - 1)
+		ulDepth = BUILD_DEPTH_MAX; /* perfect tree, all black */
+	range.ulLow = 0;
+	range.ulHigh = ulLen;
+	range.ulDepth = 0;
+	range.pParent = NULL;
+	range.ppLink = (Node**)&pTree->pr;
+	buildShape(ppNodes, &range, ulDepth, ULONG_MAX, NULL);
+	for(ul = 0; ul < ulLen; ul++) /* buffer becomes the sorted array */
+		pTree->ppArraySorted[ul] = ppNodes[ul]->pKey;
+	pTree->iStale &= ~STALE_SORTED;
+	cacheTrim(pTree, NULL);
+return(1);
+}
+
+static Node* initNode(
+	Tree *pTree, Node *pNode, void *pKey, size_t sizeTkey, void *pValue, size_t sizeTvalue
+) {
+	if((pNode != NULL) || ((pNode = makeNode(pTree, pKey, sizeTkey, pValue, sizeTvalue)) == NULL))
+		return(NULL);
+	appendNode(pTree, pNode);
+return(pNode);
+}
+
+static Node* makeNode(Tree *pTree, void *pKey, size_t sizeTkey, void *pValue, size_t sizeTvalue) {
+	Node *pNode;
+	if((pNode = allocNode(pTree)) == NULL)
+		return(NULL);
+	pNode->color = NODE_RED;
+	pNode->ulSize = 1;
+	pNode->sizeTkey = sizeTkey;
+	pNode->sizeTvalue = sizeTvalue;
+	pNode->pKey = pNode->pValue = NULL;
+	pNode->pParent = pNode->pRight = pNode->pLeft = pNode->pPrev = pNode->pNext = NULL;
+	copyKeyValue(pTree, pNode, pKey, sizeTkey, pValue, sizeTvalue);
+return(pNode);
+}
+
+static void appendNode(Tree *pTree, Node *pNode) {
+	pTree->ulTreeLen++;
+	pTree->iStale = STALE_ARRAY | STALE_SORTED;
+	pNode->pNext = NULL;
+	pNode->pPrev = pTree->pt;
+	if(pTree->ph == NULL)
+		pTree->ph = pNode;
+	else
+		((Node*)pTree->pt)->pNext = pNode;
+	pTree->pt = pNode;
+	if(pTree->pe != NULL)
+		((Cache*)pTree->pe)->sizeTbytes += cacheBytes(pTree, pNode);
+	if(pTree->px != NULL)
+		hashAdd(pTree, pNode);
+return;
+}
+
+static void copyKeyValue(
+	Tree *pTree, Node *pNode, void *pKey, size_t sizeTkey, void *pValue, size_t sizeTvalue
+) {
+	discardData(pTree, KEY_INLINE(pTree, pNode), pNode->pKey, pNode->sizeTkey);
+	CONC_STORE(pNode->pKey, storeData(pTree, KEY_INLINE(pTree, pNode), TREELIBC_POOL_KEY, pKey, sizeTkey));
+	pNode->sizeTkey = sizeTkey;
+	CONC_STORE(pNode->ui64Prefix, keyPrefix(pTree, pKey));
+ 	copyValue(pTree, pNode, pValue, sizeTvalue);
+return;
+}
+
+static void copyValue(Tree *pTree, Node *pNode, void *pValue, size_t sizeTvalue) {
+	CONC_STORE(pNode->pValue, replaceData(
+		pTree, VALUE_INLINE(pTree, pNode), TREELIBC_POOL_VALUE, pNode->pValue, pNode->sizeTvalue, pValue, sizeTvalue
+	));
+	pNode->sizeTvalue = sizeTvalue;
+return;
+}
+
+static void* storeData(Tree *pTree, char *pcInline, size_t sizeTinline, void *pData, size_t sizeTdata) {
+	char *pc;
+	if(sizeTdata == 0)
+		return(pData);
+	if((pcInline != NULL) && (sizeTdata < sizeTinline))
+		pc = pcInline;
+	else {
+		pc = malloc(sizeTdata + 1);
+		STAT_ADD(pTree, ullAllocs, 1);
+		if(pTree->pp != NULL)
+			((Pool*)pTree->pp)->ulOutside++;
+	}
+	memcpy(pc, pData, sizeTdata);
+	pc[sizeTdata] = '\0'; /* readers find the copy through a CONC_STORE() after it */
+return(pc);
+}
+
+static void* replaceData(
+	Tree *pTree, char *pcInline, size_t sizeTinline, void *pOld, size_t sizeTold, void *pData, size_t sizeTdata
+) {
+	if((pOld != NULL) && (sizeTdata > 0) && (sizeTdata == sizeTold) && !(pTree->iMode & TREE_CONCURRENT)) {
+		memmove(pOld, pData, sizeTdata); /* same size, reuse the copy wherever it lives */
+		return(pOld);
+	}
+	discardData(pTree, pcInline, pOld, sizeTold); /* concurrent readers may still hold the old copy */
+return(storeData(pTree, pcInline, sizeTinline, pData, sizeTdata));
+}
+
+static void releaseData(Tree *pTree, char *pcInline, void *pData, size_t sizeTdata) {
+	if((pData != NULL) && (sizeTdata > 0) && (pData != (void*)pcInline)) {
+		free(pData);
+		if(pTree->pp != NULL)
+			((Pool*)pTree->pp)->ulOutside--;
+	}
+return;
+}
+
+static Node* allocNode(Tree *pTree) {
+	Node *pNode;
+	Pool *pPool = pTree->pp;
+	if(!(pTree->iMode & TREE_POOL)) {
+		STAT_ADD(pTree, ullAllocs, 1);
+		return(malloc(sizeof(Node)));
+	}
+	if(pPool == NULL) {
+		STAT_ADD(pTree, ullAllocs, 1);
+		if((pPool = calloc(1, sizeof(Pool))) == NULL)
+			return(NULL);
+		pTree->pp = pPool;
+	}
+	if((pNode = pPool->pFree) != NULL) {
+		pPool->pFree = pNode->pNext;
+		return(pNode);
+	}
+	if(pPool->ulLeft == 0) {
+		Slab *pS;
+		unsigned long ulLen = (pPool->ulSlabLen == 0) ? POOL_SLAB_MIN : pPool->ulSlabLen * 2;
+		if(ulLen > POOL_SLAB_MAX)
+			ulLen = POOL_SLAB_MAX;
+		STAT_ADD(pTree, ullAllocs, 1);
+		if((pS = malloc(sizeof(Slab) + (ulLen * POOL_NODE_SIZE))) == NULL)
+			return(NULL);
+		pS->pNext = pPool->pSlabs;
+		pPool->pSlabs = pS;
+		pPool->pcNext = (char*)(pS + 1); /* Slab holds one pointer, keeps nodes pointer aligned */
+		pPool->ulLeft = pPool->ulSlabLen = ulLen;
+	}
+	pNode = (Node*)pPool->pcNext;
+	pPool->pcNext += POOL_NODE_SIZE;
+	pPool->ulLeft--;
+return(pNode);
+}
+
+static void releaseNode(Tree *pTree, Node *pNode) {
+	releaseData(pTree, KEY_INLINE(pTree, pNode), pNode->pKey, pNode->sizeTkey);
+	releaseData(pTree, VALUE_INLINE(pTree, pNode), pNode->pValue, pNode->sizeTvalue);
+	if(pTree->iMode & TREE_POOL) {
+		pNode->pNext = ((Pool*)pTree->pp)->pFree;
+		((Pool*)pTree->pp)->pFree = pNode;
+	} else
+		free(pNode);
+return;
+}
+
+static void balanceTree(Tree *pTree, Node *pNode) {
+	if((pNode != NULL ) && (pNode->color == NODE_RED)) {
+		while((pNode != pTree->pr)
+		&& (pNode->pParent->color == NODE_RED)
+		&& (pNode->pParent->pParent != NULL)) {
+			if(pNode->pParent == pNode->pParent->pParent->pLeft)
+				pNode = resolveRB(pTree, pNode, pNode->pParent->pParent->pRight);
+			else
+				pNode = resolveRB(pTree, pNode, pNode->pParent->pParent->pLeft);
+		}
+		pNode = pTree->pr;
+		if((pNode->color == NODE_RED)
+		&& (((pNode->pLeft != NULL) && (pNode->pLeft->color == NODE_RED))
+		|| ((pNode->pRight != NULL) && (pNode->pRight->color == NODE_RED))))
+			pNode->color = NODE_BLACK;
+	}
+return;
+}
+
+static Node* resolveRB(Tree *pTree, Node *pNode, Node *pUncle) {
+	if((pUncle != NULL) && (pUncle->color == NODE_RED)) {
+		pNode->pParent->pParent->color = NODE_RED;
+		pNode->pParent->color = NODE_BLACK;
+		pUncle->color = NODE_BLACK;
 		pNode = pNode->pParent->pParent;
 	} else {
 		char parentOnLeft = (pNode->pParent == pNode->pParent->pParent->pLeft) ? 1 : 0;
@@ -352,81 +2146,160 @@ return(pNode);
 
 static void rotateLeftRB(Tree *pTree, Node *pNode) {
     Node *y, *x = pNode;
+    STAT_ADD(pTree, ullRotations, 1);
     y = x->pRight;
-    x->pRight = y->pLeft;
+    CONC_STORE(x->pRight, y->pLeft);
     if ( y->pLeft != NULL )
         y->pLeft->pParent = x;
     y->pParent = x->pParent;
     if(x->pParent != NULL) {
         if(x == x->pParent->pLeft )
-            x->pParent->pLeft = y;
+            CONC_STORE(x->pParent->pLeft, y);
         else
-            x->pParent->pRight = y;
+            CONC_STORE(x->pParent->pRight, y);
     }
     else
-    	pTree->pr = y;
-    y->pLeft = x;
+    	CONC_STORE(pTree->pr, y);
+    CONC_STORE(y->pLeft, x);
     x->pParent = y;
+    CONC_STORE(y->ulSize, x->ulSize);
+    CONC_STORE(x->ulSize, SIZE(x->pLeft) + SIZE(x->pRight) + 1);
 return;
 }
 
 static void rotateRightRB(Tree *pTree, Node *pNode) {
     Node *y, *x = pNode;
+    STAT_ADD(pTree, ullRotations, 1);
     y = x->pLeft;
-    x->pLeft = y->pRight;
+    CONC_STORE(x->pLeft, y->pRight);
     if ( y->pRight != NULL )
         y->pRight->pParent = x;
     y->pParent = x->pParent;
     if(x->pParent != NULL) {
     	if(x == x->pParent->pRight )
-            x->pParent->pRight = y;
+            CONC_STORE(x->pParent->pRight, y);
         else
-            x->pParent->pLeft = y;
+            CONC_STORE(x->pParent->pLeft, y);
     }
     else
-    	pTree->pr = y;
-    y->pRight = x;
+    	CONC_STORE(pTree->pr, y);
+    CONC_STORE(y->pRight, x);
     x->pParent = y;
+    CONC_STORE(y->ulSize, x->ulSize);
+    CONC_STORE(x->ulSize, SIZE(x->pLeft) + SIZE(x->pRight) + 1);
 return;
 }
 
-static void spliceLeft(Node *pNode) {
-	if(pNode->pParent != NULL) {
-		pNode->pLeft->pParent = pNode->pParent;
-		if(pNode->pParent->pLeft == pNode)
-			pNode->pParent->pLeft = pNode->pLeft;
-		else
-			pNode->pParent->pRight = pNode->pLeft;
-	}
+static void replaceNode(Tree *pTree, Node *pOld, Node *pNew) {
+	if(pOld->pParent == NULL)
+		CONC_STORE(pTree->pr, pNew);
+	else if(pOld->pParent->pLeft == pOld)
+		CONC_STORE(pOld->pParent->pLeft, pNew);
+	else
+		CONC_STORE(pOld->pParent->pRight, pNew);
+	if(pNew != NULL)
+		pNew->pParent = pOld->pParent;
 return;
 }
 
-static void spliceRight(Node *pNode) {
-	if(pNode->pParent != NULL) {
-		pNode->pRight->pParent = pNode->pParent;
-		if(pNode->pParent->pRight == pNode)
-			pNode->pParent->pRight = pNode->pRight;
-		else
-			pNode->pParent->pLeft = pNode->pRight;
+static void unlinkNode(Tree *pTree, Node *pNode) {
+	cutNode(pTree, pNode);
+	resetList(pTree, pNode);
+	if(pTree->pe != NULL)
+		((Cache*)pTree->pe)->sizeTbytes -= cacheBytes(pTree, pNode);
+	if(pTree->px != NULL)
+		hashRemove(pTree, pNode);
+	discardNode(pTree, pNode);
+	pTree->ulTreeLen--;
+	pTree->iStale = STALE_ARRAY | STALE_SORTED;
+return;
+}
+
+static void cutNode(Tree *pTree, Node *pNode) {
+	Node *pX, *pXParent, *pY = pNode;
+	int iColor = pNode->color;
+	if((pNode->pLeft == NULL) || (pNode->pRight == NULL)) {
+		pX = (pNode->pLeft != NULL) ? pNode->pLeft : pNode->pRight;
+		pXParent = pNode->pParent;
+		replaceNode(pTree, pNode, pX);
+	} else { /* successor takes the node's place, keys and values stay where they are */
+		pY = edgeNode(pNode->pRight, 0);
+		iColor = pY->color;
+		pX = pY->pRight;
+		if(pY->pParent == pNode)
+			pXParent = pY;
+		else {
+			pXParent = pY->pParent;
+			replaceNode(pTree, pY, pX);
+			CONC_STORE(pY->pRight, pNode->pRight);
+			pY->pRight->pParent = pY;
+		}
+		replaceNode(pTree, pNode, pY);
+		CONC_STORE(pY->pLeft, pNode->pLeft);
+		pY->pLeft->pParent = pY;
+		pY->color = pNode->color;
+		CONC_STORE(pY->ulSize, pNode->ulSize);
+	}
+	countPath(pXParent, 0);
+	if(iColor == NODE_BLACK) { /* a path lost a black node, push the deficit up until absorbed */
+		while((pX != pTree->pr) && BLACK(pX))
+			pX = resolveDeleteRB(pTree, pX, &pXParent);
+		if(pX != NULL)
+			pX->color = NODE_BLACK;
 	}
+return;
 }
 
-static void removeNode(Node *pNode) {
-	if(pNode->pParent != NULL) {
-		if(pNode->pParent->pLeft == pNode)
-			pNode->pParent->pLeft = NULL;
+static Node* resolveDeleteRB(Tree *pTree, Node *pNode, Node **ppParent) {
+	Node *pParent = *ppParent, *pSibling, *pNear, *pFar;
+	char nodeOnLeft = (pNode == pParent->pLeft) ? 1 : 0;
+	pSibling = nodeOnLeft ? pParent->pRight : pParent->pLeft;
+	if(pSibling->color == NODE_RED) {
+		pSibling->color = NODE_BLACK;
+		pParent->color = NODE_RED;
+		if(nodeOnLeft)
+			rotateLeftRB(pTree, pParent);
 		else
-			pNode->pParent->pRight = NULL;
+			rotateRightRB(pTree, pParent);
+		pSibling = nodeOnLeft ? pParent->pRight : pParent->pLeft;
 	}
-return;
+	pNear = nodeOnLeft ? pSibling->pLeft : pSibling->pRight;
+	pFar = nodeOnLeft ? pSibling->pRight : pSibling->pLeft;
+	if(BLACK(pNear) && BLACK(pFar)) {
+		pSibling->color = NODE_RED;
+		*ppParent = pParent->pParent;
+		return(pParent);
+	}
+	if(BLACK(pFar)) {
+		pNear->color = NODE_BLACK;
+		pSibling->color = NODE_RED;
+		if(nodeOnLeft)
+			rotateRightRB(pTree, pSibling);
+		else
+			rotateLeftRB(pTree, pSibling);
+		pFar = pSibling;
+		pSibling = pNear;
+	}
+	pSibling->color = pParent->color;
+	pParent->color = NODE_BLACK;
+	pFar->color = NODE_BLACK;
+	if(nodeOnLeft)
+		rotateLeftRB(pTree, pParent);
+	else
+		rotateRightRB(pTree, pParent);
+	*ppParent = NULL;
+return(pTree->pr);
 }
 
 static Node* getNodeByKey(Tree *pTree, const void *pKey) {
+	if((pKey != NULL) && (pTree->px != NULL))
+		return(hashFind(pTree, pKey));
 	if(pKey != NULL) {
 		int iCmp;
+		uint64_t ui64Prefix = keyPrefix(pTree, pKey);
 		Node *pNode = pTree->pr;
 		while(pNode != NULL) {
-			if((iCmp = pTree->pfCmp(pNode->pKey, pKey)) == 0)
+			if((iCmp = cmpKeyPrefix(pTree, pNode->pKey, pNode->ui64Prefix, pKey, ui64Prefix)) == 0)
 				return(pNode);
 			pNode = (iCmp > 0) ? pNode->pLeft : pNode->pRight;
 		}
@@ -434,17 +2307,3781 @@ static Node* getNodeByKey(Tree *pTree, const void *pKey) {
 return(NULL);
 }
 
-static void resetList(Tree *pTree, Node *pNode) {
-	if(pNode->pPrev != NULL) {
-		if(pNode->pNext != NULL) {
-			pNode->pPrev->pNext = pNode->pNext;
-			pNode->pNext->pPrev = pNode->pPrev;
-		} else {
-			pNode->pPrev->pNext = NULL;
-			pTree->pt = pNode->pPrev;
-		}
-	} else {
-		pNode->pNext->pPrev = NULL;
-		pTree->ph = pNode->pNext;
+static int batchSorted(Tree *pTree, void **ppKeys, unsigned long ulLen) {
+	unsigned long ul;
+	for(ul = 0; ul < ulLen; ul++) {
+		if((ppKeys[ul] == NULL) || ((ul > 0) && (cmpKey(pTree, ppKeys[ul - 1], ppKeys[ul]) > 0)))
+			return(0);
 	}
+return(1);
+}
+
+static void findBatch(Tree *pTree, void **ppKeys, unsigned long ulLen, Node **ppNodes) {
+	struct { Node *pNode; uint64_t ui64Prefix; unsigned long ulKey; } aWays[BATCH_WAYS], *pW;
+	unsigned long ulNext = 0;
+	int i, iCmp, iBusy;
+	for(i = 0; i < BATCH_WAYS; i++)
+		aWays[i].pNode = NULL;
+	do { /* one step of every descent per round */
+		for(i = iBusy = 0, pW = aWays; i < BATCH_WAYS; i++, pW++) {
+			if(pW->pNode == NULL) { /* found or fell off, start next key */
+				if((ulNext >= ulLen) || ((pW->pNode = pTree->pr) == NULL))
+					continue;
+				pW->ulKey = ulNext++;
+				ppNodes[pW->ulKey] = NULL;
+				if(ppKeys[pW->ulKey] == NULL) {
+					pW->pNode = NULL;
+					iBusy = 1;
+					continue;
+				}
+				pW->ui64Prefix = keyPrefix(pTree, ppKeys[pW->ulKey]);
+			}
+			iBusy = 1;
+			if((iCmp = cmpKeyPrefix(pTree, pW->pNode->pKey, pW->pNode->ui64Prefix, ppKeys[pW->ulKey], pW->ui64Prefix)) == 0) {
+				ppNodes[pW->ulKey] = pW->pNode;
+				pW->pNode = NULL;
+			} else if((pW->pNode = (iCmp > 0) ? pW->pNode->pLeft : pW->pNode->pRight) != NULL)
+				PREFETCH(pW->pNode);
+		}
+	} while(iBusy);
+	for(; ulNext < ulLen; ulNext++) /* empty tree */
+		ppNodes[ulNext] = NULL;
+return;
+}
+
+static void findSorted(Tree *pTree, void **ppKeys, unsigned long ulLen, Node **ppNodes) {
+	Node *apPath[BATCH_DEPTH_MAX], *pNode;
+	int aiHigh[BATCH_DEPTH_MAX]; /* depth of nearest ancestor greater than whole subtree, -1 = none */
+	unsigned long ul;
+	uint64_t ui64Prefix;
+	int d = 0, iCmp;
+	apPath[0] = pTree->pr;
+	aiHigh[0] = -1;
+	for(ul = 0; ul < ulLen; ul++) {
+		ui64Prefix = keyPrefix(pTree, ppKeys[ul]);
+		while((aiHigh[d] >= 0) /* climb while key is past subtree, ascending keys never fall below it */
+		&& (cmpKeyPrefix(pTree, apPath[aiHigh[d]]->pKey, apPath[aiHigh[d]]->ui64Prefix, ppKeys[ul], ui64Prefix) <= 0))
+			d = aiHigh[d];
+		ppNodes[ul] = NULL;
+		for(pNode = apPath[d]; pNode != NULL; pNode = apPath[++d]) {
+			if((iCmp = cmpKeyPrefix(pTree, pNode->pKey, pNode->ui64Prefix, ppKeys[ul], ui64Prefix)) == 0) {
+				ppNodes[ul] = pNode;
+				break;
+			}
+			if((apPath[d + 1] = (iCmp > 0) ? pNode->pLeft : pNode->pRight) == NULL)
+				break;
+			aiHigh[d + 1] = (iCmp > 0) ? d : aiHigh[d];
+		}
+	}
+return;
+}
+
+static unsigned long findChunk(Tree *pTree, void **ppKeys, unsigned long ulLen, int iSorted, Node **ppNodes) {
+	unsigned long ul, ulFound = 0;
+	if(iSorted)
+		findSorted(pTree, ppKeys, ulLen, ppNodes);
+	else
+		findBatch(pTree, ppKeys, ulLen, ppNodes);
+	for(ul = 0; ul < ulLen; ul++)
+		ulFound += (ppNodes[ul] != NULL);
+return(ulFound);
+}
+
+static Node* insertNode(Tree *pTree, void *pKey, size_t sizeTkey, void *pValue, size_t sizeTvalue, int *piInserted) {
+	int iCmp = 0;
+	uint64_t ui64Prefix = keyPrefix(pTree, pKey);
+	Node *pN, *pParent = NULL, *pNode = pTree->pr;
+	*piInserted = 0;
+	if((pTree->px != NULL) && ((pN = hashFind(pTree, pKey)) != NULL)) { /* descent only for new keys */
+		cacheTouch(pTree, pN);
+		return(pN);
+	}
+	while(pNode != NULL) { /* parent of the new node is known when the walk falls off */
+		if((iCmp = cmpKeyPrefix(pTree, pNode->pKey, pNode->ui64Prefix, pKey, ui64Prefix)) == 0) {
+			cacheTouch(pTree, pNode);
+			return(pNode);
+		}
+		pParent = pNode;
+		pNode = (iCmp < 0) ? pNode->pRight : pNode->pLeft;
+	}
+	if((pN = initNode(pTree, NULL, pKey, sizeTkey, pValue, sizeTvalue)) == NULL)
+		return(NULL);
+	*piInserted = 1;
+	if(pParent == NULL) {
+		pN->color = NODE_BLACK;
+		CONC_STORE(pTree->pr, pN); /* node complete before readers can find it */
+		return(pN);
+	}
+	if(iCmp < 0)
+		CONC_STORE(pParent->pRight, pN);
+	else
+		CONC_STORE(pParent->pLeft, pN);
+	pN->pParent = pParent;
+	countPath(pParent, 1);
+	balanceTree(pTree, pN);
+return(pN);
+}
+
+static void** upsertSlot(
+	Tree *pTree, void *pKey, size_t sizeTkey, void *pValue, size_t sizeTvalue, int iReplace, int *piInserted
+) {
+	int i, iInserted = 0;
+	void **ppSlot = NULL;
+	if((pTree != NULL) && (pKey != NULL) && (pTree->iMode & TREE_BPLUS)) {
+		BpLeaf *pLeaf = bpInsert(pTree, pKey, sizeTkey, pValue, sizeTvalue, &i, &iInserted);
+		if(pLeaf != NULL) {
+			if(iReplace && !iInserted) {
+				pLeaf->apValue[i] = replaceData(
+					pTree, NULL, 0, pLeaf->apValue[i], pLeaf->asizeTvalue[i], pValue, sizeTvalue
+				);
+				pLeaf->asizeTvalue[i] = sizeTvalue;
+			}
+			ppSlot = &pLeaf->apValue[i];
+		}
+	} else if((pTree != NULL) && (pKey != NULL) && (pTree->iMode & TREE_COMPACT)) {
+		CpNode *pN = cpInsert(pTree, pKey, sizeTkey, pValue, sizeTvalue, 1, &iInserted);
+		if((pN != NULL) && (iInserted || (iReplace ? cpSetValue(pTree, pN, pValue, sizeTvalue, 1)
+		: (CP_KIND(pN) != CP_VALUE_INLINE) || cpSetValue(pTree, pN, pN->value.auc, CP_INLINE_LEN(pN), 1)))) /* bytes in node move out */
+			ppSlot = &pN->value.p;
+	} else if((pTree != NULL) && (pKey != NULL) && writeBegin(pTree)) {
+		Node *pNode = insertNode(pTree, pKey, sizeTkey, pValue, sizeTvalue, &iInserted);
+		if(pNode != NULL) {
+			if(iReplace && !iInserted) {
+				if(pTree->pe != NULL)
+					((Cache*)pTree->pe)->sizeTbytes -= cacheBytes(pTree, pNode);
+				copyValue(pTree, pNode, pValue, sizeTvalue);
+				if(pTree->pe != NULL)
+					((Cache*)pTree->pe)->sizeTbytes += cacheBytes(pTree, pNode);
+			}
+			cacheTrim(pTree, pNode);
+			ppSlot = &pNode->pValue;
+		}
+		writeEnd(pTree);
+	}
+	if(piInserted != NULL)
+		*piInserted = iInserted;
+return(ppSlot);
+}
+
+static void resetList(Tree *pTree, Node *pNode) {
+	if(pNode->pPrev != NULL) {
+		if(pNode->pNext != NULL) {
+			pNode->pPrev->pNext = pNode->pNext;
+			pNode->pNext->pPrev = pNode->pPrev;
+		} else {
+			pNode->pPrev->pNext = NULL;
+			pTree->pt = pNode->pPrev;
+		}
+	} else {
+		if(pNode->pNext != NULL)
+			pNode->pNext->pPrev = NULL;
+		else
+			pTree->pt = NULL;
+		pTree->ph = pNode->pNext;
+	}
+}
+
+static Node* edgeNode(Node *pNode, int iRight) {
+	if(pNode != NULL) {
+		if(iRight) {
+			while(pNode->pRight != NULL)
+				pNode = pNode->pRight;
+		} else {
+			while(pNode->pLeft != NULL)
+				pNode = pNode->pLeft;
+		}
+	}
+return(pNode);
+}
+
+static Node* stepNode(Node *pNode, int iNext) {
+	Node *pN;
+	if(iNext ? (pNode->pRight != NULL) : (pNode->pLeft != NULL))
+		return(edgeNode(iNext ? pNode->pRight : pNode->pLeft, !iNext));
+	for(pN = pNode->pParent; pN != NULL; pN = pN->pParent) {
+		if(pNode != (iNext ? pN->pRight : pN->pLeft))
+			break;
+		pNode = pN;
+	}
+return(pN);
+}
+
+static int cursorAt(TreeCursor *pCursor, Node *pNode, void **ppKey, void **ppValue) {
+	pCursor->pn = pNode;
+	if(pNode == NULL)
+		return(0);
+	if(ppKey != NULL)
+		*ppKey = pNode->pKey;
+	if(ppValue != NULL)
+		*ppValue = pNode->pValue;
+return(1);
+}
+
+static int cursorBound(
+	Tree *pTree, TreeCursor *pCursor, const void *pKey, int iBound, void **ppKey, void **ppValue
+) {
+	if((pTree == NULL) || (pCursor == NULL) || (pKey == NULL))
+		return(0);
+	pCursor->pTree = pTree;
+	pCursor->iOrder = TREE_SORTED;
+	pCursor->pb = pCursor->pe = NULL;
+	if(pTree->iMode & TREE_BPLUS) {
+		int i = 0;
+		BpLeaf *pLeaf = bpBound(pTree, pKey, iBound, &i);
+		return(bpCursorAt(pCursor, pLeaf, i, ppKey, ppValue));
+	}
+	if(pTree->iMode & TREE_COMPACT)
+		return(cpCursorAt(pCursor, cpSeek(pTree, iBound, pKey), ppKey, ppValue));
+	if(pTree->iMode & TREE_MAPPED)
+		return(mapCursorAt(pCursor, mapBound(pTree, pKey, iBound), ppKey, ppValue));
+	if(pTree->iMode & TREE_PAGED) {
+		int i = 0;
+		uint32_t ui = pgBound(pTree, pKey, iBound, &i);
+		return(pgCursorAt(pCursor, ui, i, ppKey, ppValue));
+	}
+	if(pTree->iMode & TREE_CONCURRENT)
+		return(cursorRead(pCursor, iBound, pKey, NULL, ppKey, ppValue));
+return(cursorAt(pCursor, seekNode(pTree, iBound, pKey, NULL, ULONG_MAX), ppKey, ppValue));
+}
+
+static int cmpInt64(const void *pA, const void *pB) {
+	int64_t i64A, i64B;
+	memcpy(&i64A, pA, sizeof(i64A));
+	memcpy(&i64B, pB, sizeof(i64B));
+return((i64A < i64B) ? -1 : (i64A > i64B));
+}
+
+static int cmpUint64(const void *pA, const void *pB) {
+	uint64_t ui64A, ui64B;
+	memcpy(&ui64A, pA, sizeof(ui64A));
+	memcpy(&ui64B, pB, sizeof(ui64B));
+return((ui64A < ui64B) ? -1 : (ui64A > ui64B));
+}
+
+static int cmpDouble(const void *pA, const void *pB) {
+	uint64_t ui64A = doubleOrder(pA), ui64B = doubleOrder(pB);
+return((ui64A < ui64B) ? -1 : (ui64A > ui64B));
+}
+
+static inline uint64_t doubleOrder(const void *pKey) {
+	uint64_t ui64;
+	double d;
+	memcpy(&d, pKey, sizeof(d));
+	if(d == 0.0)
+		return(SIGN64); /* -0.0 equals 0.0 */
+	memcpy(&ui64, &d, sizeof(ui64));
+return((ui64 & SIGN64) ? ~ui64 : (ui64 | SIGN64)); /* total order, NaN beyond infinities */
+}
+
+static int cmpString(const void *pA, const void *pB) {
+return(strcmp(pA, pB));
+}
+
+static inline uint64_t keyPrefix(Tree *pTree, const void *pKey) {
+	const unsigned char *puc = pKey;
+	uint64_t ui64 = 0;
+	size_t i;
+	switch(pTree->iKey) {
+	case TREE_KEY_INT64:
+		memcpy(&ui64, pKey, sizeof(ui64));
+		return(ui64 ^ SIGN64); /* negatives below positives as unsigned */
+	case TREE_KEY_UINT64:
+		memcpy(&ui64, pKey, sizeof(ui64));
+		return(ui64);
+	case TREE_KEY_DOUBLE:
+		return(doubleOrder(pKey));
+	case TREE_KEY_STRING:
+		for(i = 0; (i < 8) && (puc[i] != '\0'); i++)
+			ui64 |= (uint64_t)puc[i] << (56 - (8 * i));
+		return(ui64); /* big endian, unsigned compare is strcmp() order */
+	case TREE_KEY_MEMCMP:
+		for(i = 0; (i < 8) && (i < pTree->sizeTcmp); i++)
+			ui64 |= (uint64_t)puc[i] << (56 - (8 * i));
+		return(ui64);
+	}
+return(0);
+}
+
+static inline int cmpKeyPrefix(Tree *pTree, const void *pA, uint64_t ui64A, const void *pB, uint64_t ui64B) {
+	STAT_ADD(pTree, ullCompares, 1);
+	if(pTree->iKey == TREE_KEY_USER)
+		return(pTree->pfCmp(pA, pB));
+	if(ui64A != ui64B)
+		return((ui64A < ui64B) ? -1 : 1);
+	if((pTree->iKey == TREE_KEY_STRING) && ((ui64A & 0xFF) != 0)) /* both at least 8 long */
+		return(strcmp((const char*)pA + 8, (const char*)pB + 8));
+	if((pTree->iKey == TREE_KEY_MEMCMP) && (pTree->sizeTcmp > 8))
+		return(memcmp((const char*)pA + 8, (const char*)pB + 8, pTree->sizeTcmp - 8));
+return(0); /* prefix is whole key */
+}
+
+static inline int cmpKey(Tree *pTree, const void *pA, const void *pB) {
+	if(pTree->iKey == TREE_KEY_USER) /* no prefixes, counted there */
+		return(cmpKeyPrefix(pTree, pA, 0, pB, 0));
+return(cmpKeyPrefix(pTree, pA, keyPrefix(pTree, pA), pB, keyPrefix(pTree, pB)));
+}
+
+static void countPath(Node *pNode, int iGrow) {
+	for(; pNode != NULL; pNode = pNode->pParent) {
+		if(iGrow)
+			CONC_STORE(pNode->ulSize, pNode->ulSize + 1);
+		else
+			CONC_STORE(pNode->ulSize, pNode->ulSize - 1);
+	}
+return;
+}
+
+static void** sizeArray(void ***pppArray, unsigned long ulLen) {
+	void **pp = realloc(*pppArray, ulLen * sizeof(void*));
+	if(pp != NULL)
+		*pppArray = pp;
+return(pp);
+}
+
+static void* alignedAlloc(size_t sizeT) {
+	void *p;
+#ifdef _WIN32
+	p = _aligned_malloc(sizeT, BP_ALIGN);
+#else
+	if(posix_memalign(&p, BP_ALIGN, sizeT) != 0)
+		p = NULL;
+#endif
+return(p);
+}
+
+static void alignedFree(void *p) {
+#ifdef _WIN32
+	_aligned_free(p);
+#else
+	free(p);
+#endif
+return;
+}
+
+static BpNode* bpAlloc(Tree *pTree, int iLeaf) {
+	BpNode *pNode = alignedAlloc(iLeaf ? sizeof(BpLeaf) : sizeof(BpInner));
+	STAT_ADD(pTree, ullAllocs, 1);
+	if(pNode != NULL) {
+		pNode->iLeaf = iLeaf;
+		pNode->iCount = 0;
+		if(iLeaf)
+			((BpLeaf*)pNode)->pPrev = ((BpLeaf*)pNode)->pNext = NULL;
+	}
+return(pNode);
+}
+
+static int bpSearch(Tree *pTree, void **apKey, const uint64_t *aui64Prefix, int iCount, const void *pKey, int *piFound) {
+	int iCmp, iMid, iLow = 0, iHigh = iCount;
+	uint64_t ui64Prefix = keyPrefix(pTree, pKey);
+	*piFound = 0;
+	while(iLow < iHigh) { /* first index with key >= pKey */
+		iMid = (iLow + iHigh) / 2;
+		if((iCmp = cmpKeyPrefix(pTree, apKey[iMid], aui64Prefix[iMid], pKey, ui64Prefix)) < 0)
+			iLow = iMid + 1;
+		else if(iCmp > 0)
+			iHigh = iMid;
+		else {
+			*piFound = 1;
+			return(iMid);
+		}
+	}
+return(iLow);
+}
+
+static BpLeaf* bpDescend(Tree *pTree, const void *pKey, BpPath *pPath, int *piDepth) {
+	int i, iFound, iDepth = 0;
+	BpNode *pNode = pTree->pr;
+	while(!pNode->iLeaf) { /* key equal to separator lives in right child */
+		i = bpSearch(pTree, ((BpInner*)pNode)->apKey, ((BpInner*)pNode)->aui64Prefix, pNode->iCount, pKey, &iFound) + iFound;
+		if(pPath != NULL) {
+			pPath[iDepth].pInner = (BpInner*)pNode;
+			pPath[iDepth].iChild = i;
+		}
+		iDepth++;
+		pNode = ((BpInner*)pNode)->apChild[i];
+	}
+	if(piDepth != NULL)
+		*piDepth = iDepth;
+return((BpLeaf*)pNode);
+}
+
+static void bpLeafMove(BpLeaf *pTo, int iTo, BpLeaf *pFrom, int iFrom, int iLen) {
+	if(iLen > 0) {
+		memmove(&pTo->aui64Prefix[iTo], &pFrom->aui64Prefix[iFrom], iLen * sizeof(uint64_t));
+		memmove(&pTo->apKey[iTo], &pFrom->apKey[iFrom], iLen * sizeof(void*));
+		memmove(&pTo->apValue[iTo], &pFrom->apValue[iFrom], iLen * sizeof(void*));
+		memmove(&pTo->asizeTkey[iTo], &pFrom->asizeTkey[iFrom], iLen * sizeof(size_t));
+		memmove(&pTo->asizeTvalue[iTo], &pFrom->asizeTvalue[iFrom], iLen * sizeof(size_t));
+	}
+return;
+}
+
+static BpLeaf* bpFind(Tree *pTree, const void *pKey, int *pi) {
+	int iFound;
+	BpLeaf *pLeaf;
+	if((pTree->pr == NULL) || (pKey == NULL))
+		return(NULL);
+	pLeaf = bpDescend(pTree, pKey, NULL, NULL);
+	*pi = bpSearch(pTree, pLeaf->apKey, pLeaf->aui64Prefix, pLeaf->h.iCount, pKey, &iFound);
+return(iFound ? pLeaf : NULL);
+}
+
+static BpLeaf* bpInsert(
+	Tree *pTree, void *pKey, size_t sizeTkey, void *pValue, size_t sizeTvalue, int *pi, int *piInserted
+) {
+	BpPath aPath[BP_DEPTH_MAX];
+	BpNode *apSpare[BP_DEPTH_MAX + 1], *pNew;
+	BpLeaf *pLeaf, *pRight;
+	int i, d, iFound, iDepth, iSpare = 0, iNeed = 0;
+	void *pSep;
+	uint64_t ui64Sep;
+	*piInserted = 0;
+	if(pTree->pr == NULL) {
+		if((pTree->pr = bpAlloc(pTree, 1)) == NULL)
+			return(NULL);
+		pTree->ph = pTree->pt = pTree->pr;
+	}
+	pLeaf = bpDescend(pTree, pKey, aPath, &iDepth);
+	*pi = i = bpSearch(pTree, pLeaf->apKey, pLeaf->aui64Prefix, pLeaf->h.iCount, pKey, &iFound);
+	if(iFound)
+		return(pLeaf);
+	if(pLeaf->h.iCount == BP_ORDER) { /* allocate every split up front, nothing to undo on failure */
+		for(iNeed = 1, d = iDepth - 1; (d >= 0) && (aPath[d].pInner->h.iCount == BP_ORDER - 1); d--)
+			iNeed++;
+		if(d < 0)
+			iNeed++; /* new root */
+		for(iSpare = 0; iSpare < iNeed; iSpare++) {
+			if((apSpare[iSpare] = bpAlloc(pTree, iSpare == 0)) == NULL) {
+				while(iSpare > 0)
+					alignedFree(apSpare[--iSpare]);
+				return(NULL);
+			}
+		}
+	}
+	bpLeafMove(pLeaf, i + 1, pLeaf, i, pLeaf->h.iCount - i);
+	pLeaf->aui64Prefix[i] = keyPrefix(pTree, pKey);
+	pLeaf->apKey[i] = storeData(pTree, NULL, 0, pKey, sizeTkey);
+	pLeaf->apValue[i] = storeData(pTree, NULL, 0, pValue, sizeTvalue);
+	pLeaf->asizeTkey[i] = sizeTkey;
+	pLeaf->asizeTvalue[i] = sizeTvalue;
+	pLeaf->h.iCount++;
+	pTree->ulTreeLen++;
+	pTree->iStale = STALE_ARRAY | STALE_SORTED;
+	*piInserted = 1;
+	if(iNeed == 0)
+		return(pLeaf);
+	pRight = (BpLeaf*)apSpare[0];
+	i = (BP_ORDER + 1) / 2;
+	bpLeafMove(pRight, 0, pLeaf, i, pLeaf->h.iCount - i);
+	pRight->h.iCount = pLeaf->h.iCount - i;
+	pLeaf->h.iCount = i;
+	pRight->pPrev = pLeaf;
+	if((pRight->pNext = pLeaf->pNext) != NULL)
+		pRight->pNext->pPrev = pRight;
+	else
+		pTree->pt = pRight;
+	pLeaf->pNext = pRight;
+	pSep = pRight->apKey[0];
+	ui64Sep = pRight->aui64Prefix[0];
+	pNew = &pRight->h;
+	if(*pi >= i) { /* new key went right */
+		*pi -= i;
+		pLeaf = pRight;
+	}
+	for(iSpare = 1, d = iDepth - 1; d >= 0; d--) { /* separator and new node go up until a parent has room */
+		BpInner *pIn = aPath[d].pInner, *pR;
+		int c = aPath[d].iChild, m = BP_ORDER / 2;
+		memmove(&pIn->aui64Prefix[c + 1], &pIn->aui64Prefix[c], (pIn->h.iCount - c) * sizeof(uint64_t));
+		memmove(&pIn->apKey[c + 1], &pIn->apKey[c], (pIn->h.iCount - c) * sizeof(void*));
+		memmove(&pIn->apChild[c + 2], &pIn->apChild[c + 1], (pIn->h.iCount - c) * sizeof(BpNode*));
+		pIn->aui64Prefix[c] = ui64Sep;
+		pIn->apKey[c] = pSep;
+		pIn->apChild[c + 1] = pNew;
+		if(++pIn->h.iCount < BP_ORDER)
+			return(pLeaf);
+		pR = (BpInner*)apSpare[iSpare++];
+		pSep = pIn->apKey[m];
+		ui64Sep = pIn->aui64Prefix[m];
+		pR->h.iCount = BP_ORDER - m - 1;
+		memcpy(pR->aui64Prefix, &pIn->aui64Prefix[m + 1], pR->h.iCount * sizeof(uint64_t));
+		memcpy(pR->apKey, &pIn->apKey[m + 1], pR->h.iCount * sizeof(void*));
+		memcpy(pR->apChild, &pIn->apChild[m + 1], (pR->h.iCount + 1) * sizeof(BpNode*));
+		pIn->h.iCount = m;
+		pNew = &pR->h;
+	}
+	{
+		BpInner *pRoot = (BpInner*)apSpare[iSpare];
+		pRoot->h.iCount = 1;
+		pRoot->aui64Prefix[0] = ui64Sep;
+		pRoot->apKey[0] = pSep;
+		pRoot->apChild[0] = pTree->pr;
+		pRoot->apChild[1] = pNew;
+		pTree->pr = pRoot;
+	}
+return(pLeaf);
+}
+
+static void bpMerge(Tree *pTree, BpInner *pParent, int s) {
+	BpNode *pL = pParent->apChild[s], *pR = pParent->apChild[s + 1];
+	if(pL->iLeaf) {
+		BpLeaf *pLeft = (BpLeaf*)pL, *pRight = (BpLeaf*)pR;
+		bpLeafMove(pLeft, pL->iCount, pRight, 0, pR->iCount);
+		if((pLeft->pNext = pRight->pNext) != NULL)
+			pLeft->pNext->pPrev = pLeft;
+		else
+			pTree->pt = pLeft;
+	} else {
+		BpInner *pLeft = (BpInner*)pL, *pRight = (BpInner*)pR;
+		pLeft->aui64Prefix[pL->iCount] = pParent->aui64Prefix[s];
+		pLeft->apKey[pL->iCount] = pParent->apKey[s];
+		memcpy(&pLeft->aui64Prefix[pL->iCount + 1], pRight->aui64Prefix, pR->iCount * sizeof(uint64_t));
+		memcpy(&pLeft->apKey[pL->iCount + 1], pRight->apKey, pR->iCount * sizeof(void*));
+		memcpy(&pLeft->apChild[pL->iCount + 1], pRight->apChild, (pR->iCount + 1) * sizeof(BpNode*));
+		pL->iCount++;
+	}
+	pL->iCount += pR->iCount;
+	alignedFree(pR);
+	memmove(&pParent->aui64Prefix[s], &pParent->aui64Prefix[s + 1], (pParent->h.iCount - s - 1) * sizeof(uint64_t));
+	memmove(&pParent->apKey[s], &pParent->apKey[s + 1], (pParent->h.iCount - s - 1) * sizeof(void*));
+	memmove(&pParent->apChild[s + 1], &pParent->apChild[s + 2], (pParent->h.iCount - s - 1) * sizeof(BpNode*));
+	pParent->h.iCount--;
+return;
+}
+
+static void bpBorrow(BpInner *pParent, int c, int iFromRight) {
+	BpNode *pN = pParent->apChild[c], *pS = pParent->apChild[iFromRight ? c + 1 : c - 1];
+	if(pN->iLeaf) {
+		BpLeaf *pLeaf = (BpLeaf*)pN, *pSib = (BpLeaf*)pS;
+		if(iFromRight) {
+			bpLeafMove(pLeaf, pN->iCount, pSib, 0, 1);
+			bpLeafMove(pSib, 0, pSib, 1, pS->iCount - 1);
+			pParent->aui64Prefix[c] = pSib->aui64Prefix[0];
+			pParent->apKey[c] = pSib->apKey[0];
+		} else {
+			bpLeafMove(pLeaf, 1, pLeaf, 0, pN->iCount);
+			bpLeafMove(pLeaf, 0, pSib, pS->iCount - 1, 1);
+			pParent->aui64Prefix[c - 1] = pLeaf->aui64Prefix[0];
+			pParent->apKey[c - 1] = pLeaf->apKey[0];
+		}
+	} else { /* separator rotates through parent */
+		BpInner *pIn = (BpInner*)pN, *pSib = (BpInner*)pS;
+		if(iFromRight) {
+			pIn->aui64Prefix[pN->iCount] = pParent->aui64Prefix[c];
+			pIn->apKey[pN->iCount] = pParent->apKey[c];
+			pIn->apChild[pN->iCount + 1] = pSib->apChild[0];
+			pParent->aui64Prefix[c] = pSib->aui64Prefix[0];
+			pParent->apKey[c] = pSib->apKey[0];
+			memmove(pSib->aui64Prefix, &pSib->aui64Prefix[1], (pS->iCount - 1) * sizeof(uint64_t));
+			memmove(pSib->apKey, &pSib->apKey[1], (pS->iCount - 1) * sizeof(void*));
+			memmove(pSib->apChild, &pSib->apChild[1], pS->iCount * sizeof(BpNode*));
+		} else {
+			memmove(&pIn->aui64Prefix[1], pIn->aui64Prefix, pN->iCount * sizeof(uint64_t));
+			memmove(&pIn->apKey[1], pIn->apKey, pN->iCount * sizeof(void*));
+			memmove(&pIn->apChild[1], pIn->apChild, (pN->iCount + 1) * sizeof(BpNode*));
+			pIn->aui64Prefix[0] = pParent->aui64Prefix[c - 1];
+			pIn->apKey[0] = pParent->apKey[c - 1];
+			pIn->apChild[0] = pSib->apChild[pS->iCount];
+			pParent->aui64Prefix[c - 1] = pSib->aui64Prefix[pS->iCount - 1];
+			pParent->apKey[c - 1] = pSib->apKey[pS->iCount - 1];
+		}
+	}
+	pN->iCount++;
+	pS->iCount--;
+return;
+}
+
+static int bpDelete(Tree *pTree, const void *pKey) {
+	BpPath aPath[BP_DEPTH_MAX];
+	BpLeaf *pLeaf;
+	BpNode *pNode;
+	int i, d, iFound, iDepth;
+	void *pOldKey, *pOldValue;
+	size_t sizeTkey, sizeTvalue;
+	if(pTree->pr == NULL)
+		return(0);
+	pLeaf = bpDescend(pTree, pKey, aPath, &iDepth);
+	i = bpSearch(pTree, pLeaf->apKey, pLeaf->aui64Prefix, pLeaf->h.iCount, pKey, &iFound);
+	if(!iFound)
+		return(0);
+	pOldKey = pLeaf->apKey[i];
+	pOldValue = pLeaf->apValue[i];
+	sizeTkey = pLeaf->asizeTkey[i];
+	sizeTvalue = pLeaf->asizeTvalue[i];
+	bpLeafMove(pLeaf, i, pLeaf, i + 1, pLeaf->h.iCount - i - 1);
+	pLeaf->h.iCount--;
+	if(i == 0) { /* smallest key of a subtree is its separator, successor takes its place */
+		for(d = iDepth - 1; (d >= 0) && (aPath[d].iChild == 0); d--)
+			;
+		if(d >= 0) {
+			BpLeaf *pSucc = (pLeaf->h.iCount > 0) ? pLeaf : pLeaf->pNext;
+			if(pSucc != NULL) {
+				aPath[d].pInner->aui64Prefix[aPath[d].iChild - 1] = pSucc->aui64Prefix[0];
+				aPath[d].pInner->apKey[aPath[d].iChild - 1] = pSucc->apKey[0];
+			}
+		}
+	}
+	for(pNode = &pLeaf->h, d = iDepth - 1; d >= 0; d--) {
+		BpInner *pParent = aPath[d].pInner;
+		int c = aPath[d].iChild, iMin = pNode->iLeaf ? BP_LEAF_MIN : BP_INNER_MIN;
+		if(pNode->iCount >= iMin)
+			break;
+		if((c > 0) && (pParent->apChild[c - 1]->iCount > iMin)) {
+			bpBorrow(pParent, c, 0);
+			break;
+		}
+		if((c < pParent->h.iCount) && (pParent->apChild[c + 1]->iCount > iMin)) {
+			bpBorrow(pParent, c, 1);
+			break;
+		}
+		bpMerge(pTree, pParent, (c > 0) ? c - 1 : c);
+		pNode = &pParent->h;
+	}
+	pNode = pTree->pr;
+	if(pNode->iCount == 0) {
+		if(pNode->iLeaf)
+			pTree->pr = pTree->ph = pTree->pt = NULL;
+		else
+			pTree->pr = ((BpInner*)pNode)->apChild[0];
+		alignedFree(pNode);
+	}
+	releaseData(pTree, NULL, pOldKey, sizeTkey);
+	releaseData(pTree, NULL, pOldValue, sizeTvalue);
+	pTree->ulTreeLen--;
+	pTree->iStale = STALE_ARRAY | STALE_SORTED;
+return(1);
+}
+
+static void bpFree(Tree *pTree) {
+	BpLeaf *pLeaf, *pNext;
+	int i;
+	bpFreeInner(pTree->pr); /* inner nodes first, the walk looks at the leaf flag of children */
+	for(pLeaf = pTree->ph; pLeaf != NULL; pLeaf = pNext) {
+		pNext = pLeaf->pNext;
+		for(i = 0; i < pLeaf->h.iCount; i++) {
+			releaseData(pTree, NULL, pLeaf->apKey[i], pLeaf->asizeTkey[i]);
+			releaseData(pTree, NULL, pLeaf->apValue[i], pLeaf->asizeTvalue[i]);
+		}
+		alignedFree(pLeaf);
+	}
+return;
+}
+
+static void bpFreeInner(BpNode *pNode) {
+	BpPath aPath[BP_DEPTH_MAX];
+	int d = 0;
+	if((pNode == NULL) || pNode->iLeaf)
+		return;
+	aPath[0].pInner = (BpInner*)pNode; /* depth first, children before parent, leaves are left alone */
+	aPath[0].iChild = 0;
+	while(d >= 0) {
+		BpInner *pIn = aPath[d].pInner;
+		if(aPath[d].iChild > pIn->h.iCount) {
+			alignedFree(pIn);
+			d--;
+		} else if(pIn->apChild[aPath[d].iChild]->iLeaf) {
+			aPath[d].iChild = pIn->h.iCount + 1;
+		} else {
+			aPath[d + 1].pInner = (BpInner*)pIn->apChild[aPath[d].iChild++];
+			aPath[++d].iChild = 0;
+		}
+	}
+return;
+}
+
+static int bpBuild(
+	Tree *pTree, void **ppKeys, const size_t *pSizeTkeys, void **ppValues, const size_t *pSizeTvalues,
+	unsigned long ulLen
+) {
+	unsigned long ul, ulNodes, ulEnd, ulLevel = (ulLen + BP_ORDER - 1) / BP_ORDER, ulNext = 0;
+	BpNode **ppLevel;
+	void **ppMin;
+	int i;
+	if((ppLevel = malloc(ulLevel * 2 * sizeof(void*))) == NULL)
+		return(0);
+	ppMin = (void**)(ppLevel + ulLevel); /* smallest key below each node of level */
+	for(ul = 0; ul < ulLevel; ul++) { /* entries spread evenly, every leaf at least half full */
+		BpLeaf *pLeaf = (BpLeaf*)bpAlloc(pTree, 1);
+		if(pLeaf == NULL) {
+			pTree->pr = NULL;
+			bpFree(pTree);
+			pTree->ph = pTree->pt = NULL;
+			free(ppLevel);
+			return(0);
+		}
+		if((pLeaf->pPrev = (BpLeaf*)pTree->pt) != NULL)
+			pLeaf->pPrev->pNext = pLeaf;
+		else
+			pTree->ph = pLeaf;
+		pTree->pt = pLeaf;
+		ulEnd = ulNext + (ulLen / ulLevel) + ((ul < (ulLen % ulLevel)) ? 1 : 0);
+		for(i = 0; ulNext < ulEnd; ulNext++, i++) {
+			pLeaf->asizeTkey[i] = (pSizeTkeys == NULL) ? 0 : pSizeTkeys[ulNext];
+			pLeaf->asizeTvalue[i] = (pSizeTvalues == NULL) ? 0 : pSizeTvalues[ulNext];
+			pLeaf->aui64Prefix[i] = keyPrefix(pTree, ppKeys[ulNext]);
+			pLeaf->apKey[i] = storeData(pTree, NULL, 0, ppKeys[ulNext], pLeaf->asizeTkey[i]);
+			pLeaf->apValue[i] = storeData(
+				pTree, NULL, 0, (ppValues == NULL) ? NULL : ppValues[ulNext], pLeaf->asizeTvalue[i]
+			);
+		}
+		pLeaf->h.iCount = i;
+		ppLevel[ul] = &pLeaf->h;
+		ppMin[ul] = pLeaf->apKey[0];
+	}
+	for(; ulLevel > 1; ulLevel = ulNodes) { /* children spread evenly into parents up to one root */
+		ulNodes = (ulLevel + BP_ORDER - 1) / BP_ORDER;
+		for(ulNext = 0, ul = 0; ul < ulNodes; ul++) {
+			BpInner *pIn = (BpInner*)bpAlloc(pTree, 0);
+			void *pMin = ppMin[ulNext];
+			if(pIn == NULL) { /* free built parents and orphaned children, then leaves */
+				while(ulNext < ulLevel)
+					bpFreeInner(ppLevel[ulNext++]);
+				while(ul > 0)
+					bpFreeInner(ppLevel[--ul]);
+				pTree->pr = NULL;
+				bpFree(pTree);
+				pTree->ph = pTree->pt = NULL;
+				free(ppLevel);
+				return(0);
+			}
+			ulEnd = ulNext + (ulLevel / ulNodes) + ((ul < (ulLevel % ulNodes)) ? 1 : 0);
+			pIn->apChild[0] = ppLevel[ulNext++];
+			for(i = 0; ulNext < ulEnd; ulNext++, i++) {
+				pIn->aui64Prefix[i] = keyPrefix(pTree, ppMin[ulNext]);
+				pIn->apKey[i] = ppMin[ulNext];
+				pIn->apChild[i + 1] = ppLevel[ulNext];
+			}
+			pIn->h.iCount = i;
+			ppLevel[ul] = &pIn->h;
+			ppMin[ul] = pMin;
+		}
+	}
+	pTree->pr = ppLevel[0];
+	pTree->ulTreeLen = ulLen;
+	pTree->iStale = STALE_ARRAY | STALE_SORTED;
+	free(ppLevel);
+return(1);
+}
+
+static BpLeaf* bpBound(Tree *pTree, const void *pKey, int iBound, int *pi) {
+	int i, iFound;
+	BpLeaf *pLeaf;
+	if(pTree->pr == NULL)
+		return(NULL);
+	pLeaf = bpDescend(pTree, pKey, NULL, NULL);
+	i = bpSearch(pTree, pLeaf->apKey, pLeaf->aui64Prefix, pLeaf->h.iCount, pKey, &iFound);
+	if(iBound == BOUND_FLOOR) {
+		if(!iFound && (--i < 0)) {
+			if((pLeaf = pLeaf->pPrev) != NULL)
+				i = pLeaf->h.iCount - 1;
+		}
+	} else {
+		if(iFound && (iBound == BOUND_UPPER))
+			i++;
+		if(i >= pLeaf->h.iCount) {
+			pLeaf = pLeaf->pNext;
+			i = 0;
+		}
+	}
+	*pi = i;
+return(pLeaf);
+}
+
+static int bpCursorAt(TreeCursor *pCursor, BpLeaf *pLeaf, int i, void **ppKey, void **ppValue) {
+	pCursor->pn = pLeaf;
+	pCursor->iIndex = i;
+	if(pLeaf == NULL)
+		return(0);
+	if(ppKey != NULL)
+		*ppKey = pLeaf->apKey[i];
+	if(ppValue != NULL)
+		*ppValue = pLeaf->apValue[i];
+return(1);
+}
+
+static int bpCursorStep(TreeCursor *pCursor, int iNext, void **ppKey, void **ppValue) {
+	BpLeaf *pLeaf = pCursor->pn;
+	int i = pCursor->iIndex;
+	if(pLeaf->apKey[i] == (iNext ? pCursor->pe : pCursor->pb))
+		return(bpCursorAt(pCursor, NULL, 0, ppKey, ppValue));
+	if(iNext && (++i >= pLeaf->h.iCount)) {
+		pLeaf = pLeaf->pNext;
+		i = 0;
+	} else if(!iNext && (--i < 0)) {
+		if((pLeaf = pLeaf->pPrev) != NULL)
+			i = pLeaf->h.iCount - 1;
+	}
+return(bpCursorAt(pCursor, pLeaf, i, ppKey, ppValue));
+}
+
+static CpTree* cpStart(Tree *pTree) {
+	CpTree *pC = pTree->pr;
+	if((pC == NULL) && ((pC = pTree->pr = calloc(1, sizeof(CpTree))) != NULL)) {
+		pC->ui32Next = 1; /* index 0 is none */
+		pC->ulRefs = 1;
+	}
+return(pC);
+}
+
+static int cpAddChunk(Tree *pTree) {
+	CpTree *pC = pTree->pr;
+	CpNode **ppChunks, ***pppOld;
+	uint32_t **ppui32Extra, ui32Max;
+	if(pC->ui32Chunks == pC->ui32ChunksMax) { /* chunks stay put, only their directory moves */
+		ui32Max = (pC->ui32ChunksMax == 0) ? 4 : pC->ui32ChunksMax * 2;
+		if(pC->ppui32Extra == NULL) {
+			if((ppChunks = realloc(pC->ppChunks, ui32Max * sizeof(CpNode*))) == NULL)
+				return(0);
+		} else { /* snapshots may read the old directory, kept until chunks go */
+			if((ppui32Extra = realloc(pC->ppui32Extra, ui32Max * sizeof(uint32_t*))) == NULL)
+				return(0);
+			pC->ppui32Extra = ppui32Extra;
+			if((pppOld = realloc(pC->pppOld, (pC->ui32Old + 1) * sizeof(CpNode**))) == NULL)
+				return(0);
+			pC->pppOld = pppOld;
+			if((ppChunks = malloc(ui32Max * sizeof(CpNode*))) == NULL)
+				return(0);
+			if(pC->ppChunks != NULL) {
+				memcpy(ppChunks, pC->ppChunks, pC->ui32Chunks * sizeof(CpNode*));
+				pC->pppOld[pC->ui32Old++] = pC->ppChunks;
+			}
+		}
+		pC->ppChunks = ppChunks;
+		pC->ui32ChunksMax = ui32Max;
+	}
+	if((pC->ppChunks[pC->ui32Chunks] = malloc(CP_CHUNK * sizeof(CpNode))) == NULL)
+		return(0);
+	if((pC->ppui32Extra != NULL) && ((pC->ppui32Extra[pC->ui32Chunks] = malloc(CP_CHUNK * sizeof(uint32_t))) == NULL)) {
+		free(pC->ppChunks[pC->ui32Chunks]);
+		return(0);
+	}
+	STAT_ADD(pTree, ullAllocs, 1);
+	pC->ui32Chunks++;
+return(1);
+}
+
+static uint32_t cpAlloc(Tree *pTree) {
+	CpTree *pC = pTree->pr;
+	uint32_t ui = pC->ui32Free;
+	if(ui != 0) {
+		pC->ui32Free = CP_LEFT(CP_NODE(pC, ui));
+		pC->ui32FreeLen--;
+	} else {
+		if(pC->ui32Next > CP_INDEX_MAX)
+			return(0);
+		if(((pC->ui32Next >> CP_CHUNK_BITS) == pC->ui32Chunks) && !cpAddChunk(pTree))
+			return(0);
+		ui = pC->ui32Next++;
+	}
+	memset(CP_NODE(pC, ui), 0, sizeof(CpNode));
+	if(pC->ppui32Extra != NULL)
+		CP_EXTRA(pC, ui) = 0;
+return(ui);
+}
+
+static void cpRelease(Tree *pTree, uint32_t ui) {
+	CpTree *pC = pTree->pr;
+	CpNode *pN = CP_NODE(pC, ui);
+	if(pN->ui32Left & CP_KEY_COPY)
+		cpDrop(pN->key.p);
+	if(CP_KIND(pN) == CP_VALUE_COPY)
+		cpDrop(pN->value.p);
+	pN->ui32Left = pC->ui32Free << 2; /* no flags, cpFree() finds no copies here */
+	pN->ui32Right = 0;
+	pC->ui32Free = ui;
+	pC->ui32FreeLen++;
+return;
+}
+
+static void* cpCopy(Tree *pTree, void *pData, size_t sizeTdata) {
+	size_t *pSize = malloc((2 * sizeof(size_t)) + sizeTdata + 1);
+	if(pSize == NULL)
+		return(NULL);
+	STAT_ADD(pTree, ullAllocs, 1);
+	pSize[0] = 0;
+	pSize[1] = sizeTdata; /* node has no room for sizes */
+	memcpy(pSize + 2, pData, sizeTdata);
+	((char*)(pSize + 2))[sizeTdata] = '\0';
+return(pSize + 2);
+}
+
+static void cpDrop(void *p) {
+	if(CP_COPY_REFS(p) > 0)
+		CP_COPY_REFS(p)--;
+	else
+		free((size_t*)p - 2);
+return;
+}
+
+static int cpWriteBegin(Tree *pTree) {
+	CpTree *pC = pTree->pr;
+	if(pTree->iMode & TREE_SNAPSHOT)
+		return(0);
+	if(pC == NULL)
+		return(1);
+	if(CP_PEEK(pC->pReleased) != NULL)
+		cpReclaim(pTree);
+return((pC->ui32Views == 0) || cpReserve(pTree, CP_RESERVE)); /* copies never fail halfway through a fixup */
+}
+
+static int cpReserve(Tree *pTree, uint32_t ui32Len) {
+	CpTree *pC = pTree->pr;
+	while(pC->ui32FreeLen + ((pC->ui32Chunks << CP_CHUNK_BITS) - pC->ui32Next) < ui32Len) {
+		if(((pC->ui32Chunks << CP_CHUNK_BITS) > CP_INDEX_MAX) || !cpAddChunk(pTree))
+			return(0);
+	}
+return(1);
+}
+
+static uint32_t cpOwn(Tree *pTree, uint32_t uiParent, int iRight) {
+	CpTree *pC = pTree->pr;
+	CpNode *pN;
+	uint32_t uiNew, ui = (uiParent == 0) ? pC->ui32Root : CP_CHILD(CP_NODE(pC, uiParent), iRight);
+	if((ui == 0) || (pC->ui32Views == 0) || (CP_EXTRA(pC, ui) == 0))
+		return(ui);
+	uiNew = cpAlloc(pTree); /* room made by cpWriteBegin() */
+	pN = CP_NODE(pC, uiNew);
+	*pN = *CP_NODE(pC, ui); /* children and copies gain the copy as holder */
+	if(CP_LEFT(pN) != 0)
+		CP_EXTRA(pC, CP_LEFT(pN))++;
+	if(CP_RIGHT(pN) != 0)
+		CP_EXTRA(pC, CP_RIGHT(pN))++;
+	if(pN->ui32Left & CP_KEY_COPY)
+		CP_COPY_REFS(pN->key.p)++;
+	if(CP_KIND(pN) == CP_VALUE_COPY)
+		CP_COPY_REFS(pN->value.p)++;
+	CP_EXTRA(pC, ui)--;
+	cpSetChild(pC, uiParent, iRight, uiNew);
+	pTree->iStale |= STALE_SORTED; /* keys held in node moved */
+return(uiNew);
+}
+
+static void cpOwnPath(Tree *pTree, uint32_t *pui32Path, int d) {
+	CpTree *pC = pTree->pr;
+	int i;
+	if(pC->ui32Views == 0)
+		return;
+	for(i = 0; i < d; i++) /* parent made private first, its copy has the same children */
+		pui32Path[i] = cpOwn(pTree, (i == 0) ? 0 : pui32Path[i - 1], (i > 0) && (CP_RIGHT(CP_NODE(pC, pui32Path[i - 1])) == pui32Path[i]));
+return;
+}
+
+static uint32_t cpOwnKey(Tree *pTree, const void *pKey) {
+	uint32_t aui32Path[CP_DEPTH_MAX], ui;
+	uint64_t ui64Prefix = keyPrefix(pTree, pKey);
+	CpTree *pC = pTree->pr;
+	CpNode *pN;
+	int iCmp, d = 0;
+	if((pC == NULL) || (pC->ui32Views == 0))
+		return(cpSeek(pTree, SEEK_FIND, pKey));
+	for(ui = pC->ui32Root; (ui != 0) && (d < CP_DEPTH_MAX); ui = CP_CHILD(pN, iCmp < 0)) {
+		pN = CP_NODE(pC, ui);
+		aui32Path[d++] = ui;
+		if((iCmp = cmpKeyPrefix(pTree, CP_KEY(pTree, pN), keyPrefix(pTree, CP_KEY(pTree, pN)), pKey, ui64Prefix)) == 0) {
+			cpOwnPath(pTree, aui32Path, d);
+			return(aui32Path[d - 1]);
+		}
+	}
+return(0);
+}
+
+static void cpUnref(Tree *pTree, uint32_t ui) {
+	CpTree *pC = pTree->pr;
+	CpNode *pN;
+	uint32_t aui32Stack[2 * CP_DEPTH_MAX];
+	int d = 0;
+	if(ui != 0)
+		aui32Stack[d++] = ui;
+	while(d > 0) { /* depth first, one subtree waits per level */
+		ui = aui32Stack[--d];
+		if(CP_EXTRA(pC, ui) > 0) { /* still held elsewhere, so is all below */
+			CP_EXTRA(pC, ui)--;
+			continue;
+		}
+		pN = CP_NODE(pC, ui);
+		if(CP_LEFT(pN) != 0)
+			aui32Stack[d++] = CP_LEFT(pN);
+		if(CP_RIGHT(pN) != 0)
+			aui32Stack[d++] = CP_RIGHT(pN);
+		cpRelease(pTree, ui);
+	}
+return;
+}
+
+static void cpReclaim(Tree *pTree) {
+	CpTree *pC = pTree->pr, *pV, *pNext;
+	CP_TAKE(pC->pReleased, pV);
+	for(; pV != NULL; pV = pNext) {
+		pNext = pV->pNext;
+		cpUnref(pTree, pV->ui32Root);
+		pC->ui32Views--;
+		free(pV);
+	}
+return;
+}
+
+static void cpFreeStore(CpTree *pC) {
+	CpTree *pV, *pNext;
+	CpNode *pN;
+	uint32_t ui;
+	for(ui = 1; ui < pC->ui32Next; ui++) { /* chunk order, nodes on free list have no flags, shared copies go with last holder */
+		pN = CP_NODE(pC, ui);
+		if(pN->ui32Left & CP_KEY_COPY)
+			cpDrop(pN->key.p);
+		if(CP_KIND(pN) == CP_VALUE_COPY)
+			cpDrop(pN->value.p);
+	}
+	for(pV = pC->pReleased; pV != NULL; pV = pNext) {
+		pNext = pV->pNext;
+		free(pV);
+	}
+	for(ui = 0; ui < pC->ui32Chunks; ui++) {
+		free(pC->ppChunks[ui]);
+		if(pC->ppui32Extra != NULL)
+			free(pC->ppui32Extra[ui]);
+	}
+	for(ui = 0; ui < pC->ui32Old; ui++)
+		free(pC->pppOld[ui]);
+	free(pC->pppOld);
+	free(pC->ppui32Extra);
+	free(pC->ppChunks);
+	free(pC);
+return;
+}
+
+static int cpStore(Tree *pTree, CpNode *pN, void *pKey, size_t sizeTkey, void *pValue, size_t sizeTvalue, int iSlot) {
+	if(CP_KEY_INLINE(pTree)) /* copied whatever sizeTkey, length is known from key kind */
+		memcpy(pN->key.auc, pKey, (pTree->iKey == TREE_KEY_MEMCMP) ? pTree->sizeTcmp : 8);
+	else if(sizeTkey == 0)
+		pN->key.p = pKey;
+	else if((pN->key.p = cpCopy(pTree, pKey, sizeTkey)) == NULL)
+		return(0);
+	else
+		pN->ui32Left |= CP_KEY_COPY;
+return(cpSetValue(pTree, pN, pValue, sizeTvalue, iSlot));
+}
+
+static int cpSetValue(Tree *pTree, CpNode *pN, void *pValue, size_t sizeTvalue, int iSlot) {
+	CpWord word;
+	int iKind = CP_VALUE_ADDR;
+	memset(&word, 0, sizeof(word));
+	if((sizeTvalue > 0) && (sizeTvalue <= CP_VALUE_INLINE_MAX) && !iSlot) { /* slots hold a pointer, never bytes */
+		memcpy(word.auc, pValue, sizeTvalue);
+		word.auc[7] = (sizeTvalue < CP_VALUE_INLINE_MAX) ? (unsigned char)sizeTvalue : 0; /* NUL after 7 bytes */
+		iKind = CP_VALUE_INLINE;
+	} else if(sizeTvalue > 0) {
+		if((CP_KIND(pN) == CP_VALUE_COPY) && (CP_COPY_LEN(pN->value.p) == sizeTvalue) && (CP_COPY_REFS(pN->value.p) == 0)) {
+			memmove(pN->value.p, pValue, sizeTvalue); /* same size and no snapshot holds it, reuse the copy */
+			return(1);
+		}
+		if((word.p = cpCopy(pTree, pValue, sizeTvalue)) == NULL)
+			return(0);
+		iKind = CP_VALUE_COPY;
+	} else
+		word.p = pValue;
+	if(CP_KIND(pN) == CP_VALUE_COPY)
+		cpDrop(pN->value.p);
+	pN->value = word;
+	pN->ui32Right = (pN->ui32Right & ~(uint32_t)3) | (uint32_t)iKind;
+return(1);
+}
+
+static uint32_t cpSeek(Tree *pTree, int iSeek, const void *pKey) {
+	CpTree *pC = pTree->pr;
+	CpNode *pN;
+	uint32_t ui, uiFound = 0;
+	uint64_t ui64Prefix = (pKey == NULL) ? 0 : keyPrefix(pTree, pKey);
+	int iCmp, iBelow = (iSeek == BOUND_FLOOR) || (iSeek == BOUND_BELOW);
+	for(ui = (pC == NULL) ? 0 : pC->ui32Root; ui != 0; ) {
+		pN = CP_NODE(pC, ui);
+		if((iSeek == SEEK_FIRST) || (iSeek == SEEK_LAST)) {
+			uiFound = ui;
+			ui = CP_CHILD(pN, iSeek == SEEK_LAST);
+			continue;
+		}
+		iCmp = cmpKeyPrefix(pTree, CP_KEY(pTree, pN), keyPrefix(pTree, CP_KEY(pTree, pN)), pKey, ui64Prefix);
+		if((iCmp == 0) && (iSeek != BOUND_UPPER) && (iSeek != BOUND_BELOW))
+			return(ui);
+		if(iSeek == SEEK_FIND)
+			ui = CP_CHILD(pN, iCmp < 0);
+		else if(iBelow ? (iCmp < 0) : (iCmp > 0)) {
+			uiFound = ui; /* nearest candidate so far, keep looking closer to key */
+			ui = CP_CHILD(pN, iBelow);
+		} else
+			ui = CP_CHILD(pN, !iBelow);
+	}
+return(uiFound);
+}
+
+static void cpSetChild(CpTree *pC, uint32_t uiParent, int iRight, uint32_t ui) {
+	CpNode *pP;
+	if(uiParent == 0) {
+		pC->ui32Root = ui;
+		return;
+	}
+	pP = CP_NODE(pC, uiParent);
+	if(iRight)
+		pP->ui32Right = (ui << 2) | (pP->ui32Right & 3);
+	else
+		pP->ui32Left = (ui << 2) | (pP->ui32Left & 3);
+return;
+}
+
+static void cpRotate(Tree *pTree, uint32_t uiParent, uint32_t uiX, int iLeft) {
+	CpTree *pC = pTree->pr;
+	uint32_t uiY = CP_CHILD(CP_NODE(pC, uiX), iLeft); /* rotating left lifts the right child */
+	STAT_ADD(pTree, ullRotations, 1);
+	cpSetChild(pC, uiX, iLeft, CP_CHILD(CP_NODE(pC, uiY), !iLeft));
+	cpSetChild(pC, uiY, !iLeft, uiX);
+	cpSetChild(pC, uiParent, (uiParent != 0) && (CP_RIGHT(CP_NODE(pC, uiParent)) == uiX), uiY);
+return;
+}
+
+static CpNode* cpInsert(
+	Tree *pTree, void *pKey, size_t sizeTkey, void *pValue, size_t sizeTvalue, int iSlot, int *piInserted
+) {
+	uint32_t aui32Path[CP_DEPTH_MAX + 1], ui, uiNew, uiP, uiG, uiU;
+	uint64_t ui64Prefix = keyPrefix(pTree, pKey);
+	CpTree *pC;
+	CpNode *pN;
+	int iCmp = 0, iRight, d = 0;
+	*piInserted = 0;
+	if(!cpWriteBegin(pTree) || ((pC = cpStart(pTree)) == NULL))
+		return(NULL);
+	for(ui = pC->ui32Root; ui != 0; ui = CP_CHILD(pN, iCmp < 0)) { /* path kept, nodes have no parent */
+		pN = CP_NODE(pC, ui);
+		if((iCmp = cmpKeyPrefix(pTree, CP_KEY(pTree, pN), keyPrefix(pTree, CP_KEY(pTree, pN)), pKey, ui64Prefix)) == 0) {
+			aui32Path[d] = ui; /* caller may change value or slot */
+			cpOwnPath(pTree, aui32Path, d + 1);
+			return(CP_NODE(pC, aui32Path[d]));
+		}
+		if(d == CP_DEPTH_MAX)
+			return(NULL);
+		aui32Path[d++] = ui;
+	}
+	cpOwnPath(pTree, aui32Path, d);
+	if((uiNew = cpAlloc(pTree)) == 0)
+		return(NULL);
+	if(!cpStore(pTree, pN = CP_NODE(pC, uiNew), pKey, sizeTkey, pValue, sizeTvalue, iSlot)) {
+		cpRelease(pTree, uiNew);
+		return(NULL);
+	}
+	*piInserted = 1;
+	pTree->ulTreeLen++;
+	pTree->iStale |= STALE_SORTED;
+	pN->ui32Left |= CP_RED;
+	cpSetChild(pC, (d == 0) ? 0 : aui32Path[d - 1], iCmp < 0, uiNew);
+	for(ui = uiNew; (d > 0) && CP_IS_RED(pC, aui32Path[d - 1]); ) { /* red parent is never root, grandparent on path */
+		uiP = aui32Path[d - 1];
+		uiG = aui32Path[d - 2];
+		iRight = (CP_RIGHT(CP_NODE(pC, uiG)) == uiP);
+		uiU = CP_CHILD(CP_NODE(pC, uiG), !iRight);
+		if(CP_IS_RED(pC, uiU)) { /* red uncle, blackness moves up two levels */
+			uiU = cpOwn(pTree, uiG, !iRight);
+			CP_NODE(pC, uiP)->ui32Left &= ~CP_RED;
+			CP_NODE(pC, uiU)->ui32Left &= ~CP_RED;
+			CP_NODE(pC, uiG)->ui32Left |= CP_RED;
+			ui = uiG;
+			d -= 2;
+			continue;
+		}
+		if(ui == CP_CHILD(CP_NODE(pC, uiP), !iRight)) { /* inner grandchild turned outer first */
+			cpRotate(pTree, uiG, uiP, !iRight);
+			uiP = ui;
+		}
+		cpRotate(pTree, (d > 2) ? aui32Path[d - 3] : 0, uiG, iRight);
+		CP_NODE(pC, uiP)->ui32Left &= ~CP_RED;
+		CP_NODE(pC, uiG)->ui32Left |= CP_RED;
+		break;
+	}
+	CP_NODE(pC, pC->ui32Root)->ui32Left &= ~CP_RED;
+return(pN);
+}
+
+static int cpDelete(Tree *pTree, const void *pKey) {
+	uint32_t aui32Path[CP_DEPTH_MAX + 2], uiZ, uiY, uiYR, uiZL, uiZR;
+	uint64_t ui64Prefix = keyPrefix(pTree, pKey);
+	uint32_t ui32Red;
+	CpTree *pC = pTree->pr;
+	CpNode *pZ, *pY;
+	int iCmp, iZ, iTwo, iRight = 0, d = 0;
+	if(!cpWriteBegin(pTree))
+		return(0);
+	for(uiZ = (pC == NULL) ? 0 : pC->ui32Root; uiZ != 0; uiZ = CP_CHILD(pZ, iRight = (iCmp < 0))) {
+		pZ = CP_NODE(pC, uiZ);
+		if((iCmp = cmpKeyPrefix(pTree, CP_KEY(pTree, pZ), keyPrefix(pTree, CP_KEY(pTree, pZ)), pKey, ui64Prefix)) == 0)
+			break;
+		aui32Path[d++] = uiZ;
+	}
+	if(uiZ == 0)
+		return(0);
+	iZ = d;
+	aui32Path[d++] = uiZ;
+	if((iTwo = (CP_LEFT(pZ) != 0) && (CP_RIGHT(pZ) != 0))) {
+		iRight = 1;
+		for(uiY = CP_RIGHT(pZ); CP_LEFT(CP_NODE(pC, uiY)) != 0; uiY = CP_LEFT(CP_NODE(pC, uiY))) {
+			aui32Path[d++] = uiY;
+			iRight = 0;
+		}
+		aui32Path[d] = uiY;
+	}
+	cpOwnPath(pTree, aui32Path, d + iTwo); /* every node relinked or recolored below is on path */
+	uiZ = aui32Path[iZ];
+	pZ = CP_NODE(pC, uiZ);
+	if(iTwo) { /* successor takes the place of node, node the place of successor */
+		uiY = aui32Path[d];
+		pY = CP_NODE(pC, uiY);
+		uiZL = CP_LEFT(pZ);
+		uiZR = CP_RIGHT(pZ);
+		uiYR = CP_RIGHT(pY);
+		ui32Red = pZ->ui32Left & CP_RED;
+		cpSetChild(pC, (iZ > 0) ? aui32Path[iZ - 1] : 0, (iZ > 0) && (CP_RIGHT(CP_NODE(pC, aui32Path[iZ - 1])) == uiZ), uiY);
+		cpSetChild(pC, uiY, 0, uiZL);
+		if(aui32Path[d - 1] == uiZ)
+			cpSetChild(pC, uiY, 1, uiZ);
+		else {
+			cpSetChild(pC, uiY, 1, uiZR);
+			cpSetChild(pC, aui32Path[d - 1], 0, uiZ);
+		}
+		pZ->ui32Left = (pZ->ui32Left & CP_KEY_COPY) | (pY->ui32Left & CP_RED); /* colors swap with places */
+		pZ->ui32Right = (uiYR << 2) | CP_KIND(pZ);
+		pY->ui32Left = (pY->ui32Left & ~CP_RED) | ui32Red;
+		aui32Path[iZ] = uiY;
+	} else
+		d--; /* node leaves path */
+	uiY = (CP_LEFT(pZ) != 0) ? CP_LEFT(pZ) : CP_RIGHT(pZ); /* at most one child left */
+	cpSetChild(pC, (d > 0) ? aui32Path[d - 1] : 0, iRight, uiY);
+	if(!(pZ->ui32Left & CP_RED))
+		cpDeleteFix(pTree, aui32Path, d, uiY, iRight);
+	cpRelease(pTree, uiZ);
+	pTree->ulTreeLen--;
+	pTree->iStale |= STALE_SORTED;
+return(1);
+}
+
+static void cpDeleteFix(Tree *pTree, uint32_t *pui32Path, int d, uint32_t uiX, int iRight) {
+	CpTree *pC = pTree->pr;
+	CpNode *pS;
+	uint32_t uiP, uiS;
+	if(CP_IS_RED(pC, uiX)) /* only blackened, loop below never runs */
+		uiX = cpOwn(pTree, (d > 0) ? pui32Path[d - 1] : 0, iRight);
+	while((d > 0) && !CP_IS_RED(pC, uiX)) { /* x short one black, on side iRight of last node on path */
+		uiP = pui32Path[d - 1];
+		uiS = cpOwn(pTree, uiP, !iRight); /* every case changes sibling */
+		if(CP_IS_RED(pC, uiS)) { /* red sibling rotated above parent, path grows by it */
+			CP_NODE(pC, uiS)->ui32Left &= ~CP_RED;
+			CP_NODE(pC, uiP)->ui32Left |= CP_RED;
+			cpRotate(pTree, (d > 1) ? pui32Path[d - 2] : 0, uiP, !iRight);
+			pui32Path[d - 1] = uiS;
+			pui32Path[d++] = uiP;
+			uiS = cpOwn(pTree, uiP, !iRight);
+		}
+		pS = CP_NODE(pC, uiS);
+		if(!CP_IS_RED(pC, CP_LEFT(pS)) && !CP_IS_RED(pC, CP_RIGHT(pS))) {
+			pS->ui32Left |= CP_RED;
+			uiX = uiP;
+			if(--d > 0)
+				iRight = (CP_RIGHT(CP_NODE(pC, pui32Path[d - 1])) == uiX);
+			continue;
+		}
+		if(!CP_IS_RED(pC, CP_CHILD(pS, !iRight))) { /* near red nephew rotated up as sibling */
+			CP_NODE(pC, cpOwn(pTree, uiS, iRight))->ui32Left &= ~CP_RED;
+			pS->ui32Left |= CP_RED;
+			cpRotate(pTree, uiP, uiS, iRight);
+			uiS = CP_CHILD(CP_NODE(pC, uiP), !iRight);
+			pS = CP_NODE(pC, uiS);
+		}
+		pS->ui32Left = (pS->ui32Left & ~CP_RED) | (CP_NODE(pC, uiP)->ui32Left & CP_RED);
+		CP_NODE(pC, uiP)->ui32Left &= ~CP_RED;
+		CP_NODE(pC, cpOwn(pTree, uiS, !iRight))->ui32Left &= ~CP_RED;
+		cpRotate(pTree, (d > 1) ? pui32Path[d - 2] : 0, uiP, !iRight);
+		uiX = 0;
+		break;
+	}
+	if(uiX != 0)
+		CP_NODE(pC, uiX)->ui32Left &= ~CP_RED;
+return;
+}
+
+static void cpFree(Tree *pTree) {
+	CpTree *pC = pTree->pr, *pStore;
+	if(pC == NULL)
+		return;
+	if((pStore = pC->pStore) != NULL) { /* snapshot, its nodes unreferenced by next write of tree */
+		CP_PUSH(pStore->pReleased, pC);
+		if(CP_REFS(pStore, -1) == 0)
+			cpFreeStore(pStore);
+	} else {
+		if(CP_PEEK(pC->pReleased) != NULL)
+			cpReclaim(pTree);
+		if(pC->ui32Views > 0) { /* chunks stay for snapshots, nodes only tree held go now */
+			cpUnref(pTree, pC->ui32Root);
+			pC->ui32Root = 0;
+		}
+		if(CP_REFS(pC, -1) == 0)
+			cpFreeStore(pC);
+	}
+	pTree->pr = NULL;
+return;
+}
+
+static int cpBuild(
+	Tree *pTree, void **ppKeys, const size_t *pSizeTkeys, void **ppValues, const size_t *pSizeTvalues, unsigned long ulLen
+) {
+	CpRange aStack[2 * BUILD_DEPTH_MAX], *pS = aStack, range;
+	unsigned long ul, ulIndex, ulRed = 0;
+	CpTree *pC;
+	if(ulLen > CP_INDEX_MAX)
+		return(0);
+	cpFree(pTree); /* chunks of deleted keys go, node of sorted index i is i + 1 */
+	if((pC = cpStart(pTree)) == NULL)
+		return(0);
+	for(ul = 0; ul < ulLen; ul++) {
+		if((cpAlloc(pTree) == 0) || !cpStore(
+			pTree, CP_NODE(pC, ul + 1), ppKeys[ul], (pSizeTkeys == NULL) ? 0 : pSizeTkeys[ul],
+			(ppValues == NULL) ? NULL : ppValues[ul], (pSizeTvalues == NULL) ? 0 : pSizeTvalues[ul], 0
+		)) {
+			cpFree(pTree);
+			return(0);
+		}
+	}
+	for(ul = ulLen; ul > 1; ul >>= 1) /* red level as treeBuildSorted() */
+		ulRed++;
+	if(ulLen == (2UL << ulRed) - 1)
+		ulRed = BUILD_DEPTH_MAX;
+	pS->ulLow = 0; pS->ulHigh = ulLen; pS->ulDepth = 0;
+	pS->ui32Parent = 0; pS->iRight = 0;
+	while(pS >= aStack) { /* middle of each range becomes subtree root, no recursion */
+		range = *pS--;
+		if(range.ulLow >= range.ulHigh)
+			continue;
+		ulIndex = range.ulLow + ((range.ulHigh - range.ulLow) / 2);
+		cpSetChild(pC, range.ui32Parent, range.iRight, (uint32_t)ulIndex + 1);
+		if(range.ulDepth == ulRed)
+			CP_NODE(pC, ulIndex + 1)->ui32Left |= CP_RED;
+		pS++;
+		pS->ulLow = range.ulLow; pS->ulHigh = ulIndex; pS->ulDepth = range.ulDepth + 1;
+		pS->ui32Parent = (uint32_t)ulIndex + 1; pS->iRight = 0;
+		pS++;
+		pS->ulLow = ulIndex + 1; pS->ulHigh = range.ulHigh; pS->ulDepth = range.ulDepth + 1;
+		pS->ui32Parent = (uint32_t)ulIndex + 1; pS->iRight = 1;
+	}
+	pTree->ulTreeLen = ulLen;
+	pTree->iStale |= STALE_SORTED;
+return(1);
+}
+
+static void cpIterStart(CpIter *pIter, CpTree *pC, uint32_t ui) {
+	pIter->pC = pC;
+	pIter->d = 0;
+	pIter->ui32Down = ui;
+	pIter->iDown = 1;
+return;
+}
+
+static uint32_t cpIterNext(CpIter *pIter, int *piDepth) {
+	uint32_t ui;
+	for(ui = pIter->ui32Down; (ui != 0) && (pIter->d < CP_DEPTH_MAX); ui = CP_LEFT(CP_NODE(pIter->pC, ui))) {
+		pIter->aucDepth[pIter->d] = (unsigned char)pIter->iDown++; /* left spine below last node taken */
+		pIter->aui32Node[pIter->d++] = ui;
+	}
+	if(pIter->d == 0)
+		return(0);
+	ui = pIter->aui32Node[--pIter->d];
+	if(piDepth != NULL)
+		*piDepth = pIter->aucDepth[pIter->d];
+	pIter->ui32Down = CP_RIGHT(CP_NODE(pIter->pC, ui));
+	pIter->iDown = pIter->aucDepth[pIter->d] + 1;
+return(ui);
+}
+
+static int cpCursorAt(TreeCursor *pCursor, uint32_t ui, void **ppKey, void **ppValue) {
+	Tree *pTree = pCursor->pTree;
+	CpNode *pN = (ui == 0) ? NULL : CP_NODE((CpTree*)pTree->pr, ui);
+	pCursor->pn = NULL;
+	if((pN == NULL)
+	|| ((pCursor->pb != NULL) && (cmpKey(pTree, CP_KEY(pTree, pN), pCursor->pb) < 0))
+	|| ((pCursor->pe != NULL) && (cmpKey(pTree, CP_KEY(pTree, pN), pCursor->pe) > 0)))
+		return(0);
+	pCursor->pn = CP_KEY(pTree, pN); /* key address, next one found from root */
+	if(ppKey != NULL)
+		*ppKey = pCursor->pn;
+	if(ppValue != NULL)
+		*ppValue = CP_VALUE(pN);
+return(1);
+}
+
+static int cpVerify(Tree *pTree) {
+	CpTree *pC = pTree->pr;
+	CpIter iter;
+	CpNode *pN, *pPrev = NULL;
+	uint32_t ui, uiDown;
+	unsigned long ul = 0, ulBlack, ulHeight = ULONG_MAX;
+	int iBad = 0;
+	if(pC == NULL)
+		return((pTree->ulTreeLen == 0) ? 0 : TREE_BAD_COUNT);
+	for(cpIterStart(&iter, pC, pC->ui32Root); (ui = cpIterNext(&iter, NULL)) != 0; pPrev = pN) {
+		if(++ul > pTree->ulTreeLen) /* no walking around a cycle */
+			break;
+		pN = CP_NODE(pC, ui);
+		if((CP_LEFT(pN) >= pC->ui32Next) || (CP_RIGHT(pN) >= pC->ui32Next)) {
+			iBad |= TREE_BAD_LINK;
+			break;
+		}
+		if((pPrev != NULL) && (cmpKey(pTree, CP_KEY(pTree, pPrev), CP_KEY(pTree, pN)) >= 0))
+			iBad |= TREE_BAD_ORDER;
+		if((pN->ui32Left & CP_RED) && (CP_IS_RED(pC, CP_LEFT(pN)) || CP_IS_RED(pC, CP_RIGHT(pN))))
+			iBad |= TREE_BAD_RED;
+		if((CP_LEFT(pN) == 0) || (CP_RIGHT(pN) == 0)) { /* black count from root, no parent to climb */
+			for(ulBlack = 0, uiDown = pC->ui32Root; (uiDown != 0) && (uiDown != ui); ) {
+				ulBlack += !(CP_NODE(pC, uiDown)->ui32Left & CP_RED);
+				uiDown = CP_CHILD(CP_NODE(pC, uiDown), cmpKey(pTree, CP_KEY(pTree, CP_NODE(pC, uiDown)), CP_KEY(pTree, pN)) < 0);
+			}
+			if(uiDown != ui)
+				iBad |= TREE_BAD_ORDER;
+			ulBlack += !(pN->ui32Left & CP_RED);
+			if(ulHeight == ULONG_MAX)
+				ulHeight = ulBlack;
+			else if(ulBlack != ulHeight)
+				iBad |= TREE_BAD_BALANCE;
+		}
+	}
+	if(ul != pTree->ulTreeLen)
+		iBad |= TREE_BAD_COUNT;
+return(iBad);
+}
+
+static void discardNode(Tree *pTree, Node *pNode) {
+	if(pTree->pc != NULL)
+		retire(pTree, pNode, 0, 1);
+	else
+		releaseNode(pTree, pNode);
+return;
+}
+
+static void discardData(Tree *pTree, char *pcInline, void *pData, size_t sizeTdata) {
+	if((pTree->pc != NULL) && (pData != NULL) && (sizeTdata > 0)) /* never inline when concurrent */
+		retire(pTree, pData, sizeTdata, 0);
+	else
+		releaseData(pTree, pcInline, pData, sizeTdata);
+return;
+}
+
+static Node* seekNode(Tree *pTree, int iSeek, const void *pKey, unsigned long *pul, unsigned long ulSteps) {
+	int iCmp, iBelow = (iSeek == BOUND_FLOOR) || (iSeek == BOUND_BELOW);
+	uint64_t ui64Prefix = (pKey == NULL) ? 0 : keyPrefix(pTree, pKey);
+	unsigned long ulIndex = (pul == NULL) ? 0 : *pul, ulRank = 0, ulLeft;
+	Node *pN = NULL, *pNode = CONC_LOAD(pTree->pr), *pLeft, *pRight;
+	for(; (pNode != NULL) && (ulSteps > 0); ulSteps--) {
+		pLeft = CONC_LOAD(pNode->pLeft); /* each field loaded once, a TREE_CONCURRENT writer may change it between loads */
+		pRight = CONC_LOAD(pNode->pRight);
+		if((iSeek == SEEK_FIRST) || (iSeek == SEEK_LAST)) {
+			pN = pNode;
+			pNode = (iSeek == SEEK_FIRST) ? pLeft : pRight;
+		} else if(iSeek == SEEK_INDEX) {
+			if(ulIndex == (ulLeft = (pLeft == NULL) ? 0 : CONC_LOAD(pLeft->ulSize)))
+				return(pNode);
+			if(ulIndex < ulLeft)
+				pNode = pLeft;
+			else {
+				ulIndex -= ulLeft + 1;
+				pNode = pRight;
+			}
+		} else {
+			iCmp = cmpKeyPrefix(pTree, CONC_LOAD(pNode->pKey), CONC_LOAD(pNode->ui64Prefix), pKey, ui64Prefix);
+			if((iSeek == SEEK_RANK) || (iSeek == SEEK_RANK_EQ)) {
+				if((iCmp < 0) || ((iSeek == SEEK_RANK_EQ) && (iCmp == 0))) {
+					ulRank += ((pLeft == NULL) ? 0 : CONC_LOAD(pLeft->ulSize)) + 1;
+					pNode = pRight;
+				} else
+					pNode = pLeft;
+			} else if((iCmp == 0) && (iSeek != BOUND_UPPER) && (iSeek != BOUND_BELOW))
+				return(pNode);
+			else if(iSeek == SEEK_FIND)
+				pNode = (iCmp > 0) ? pLeft : pRight;
+			else if(iBelow ? (iCmp < 0) : (iCmp > 0)) {
+				pN = pNode; /* nearest candidate so far, keep looking closer to key */
+				pNode = iBelow ? pRight : pLeft;
+			} else
+				pNode = iBelow ? pLeft : pRight;
+		}
+	}
+	if((iSeek == SEEK_RANK) || (iSeek == SEEK_RANK_EQ))
+		*pul = ulRank;
+return(pN);
+}
+
+static int readNode(Tree *pTree, int iSeek, const void *pKey, unsigned long *pul, void **ppKey, void **ppValue) {
+	int iTry = 0;
+	unsigned long ul, ulSeq;
+	void *pK, *pV;
+	Node *pNode;
+	if(!readPin(pTree, 1))
+		return(0); /* no writer yet, tree is empty */
+	do {
+		ul = (pul == NULL) ? 0 : *pul;
+		pK = pV = NULL;
+		ulSeq = readBegin(pTree, iTry++);
+		if((pNode = seekNode(pTree, iSeek, pKey, &ul, (ulSeq == CONC_LOCKED) ? ULONG_MAX : CONC_STEPS)) != NULL) {
+			pK = CONC_LOAD(pNode->pKey);
+			pV = CONC_LOAD(pNode->pValue);
+		}
+	} while(!readEnd(pTree, ulSeq));
+	readPin(pTree, 0);
+	if(pul != NULL)
+		*pul = ul;
+	if(ppKey != NULL)
+		*ppKey = pK;
+	if(ppValue != NULL)
+		*ppValue = pV;
+return(pNode != NULL);
+}
+
+static int cursorRead(
+	TreeCursor *pCursor, int iSeek, const void *pKey, unsigned long *pul, void **ppKey, void **ppValue
+) {
+	Tree *pTree = pCursor->pTree;
+	void *pK, *pV;
+	readPin(pTree, 1); /* key stays allocated while compared to range */
+	if(readNode(pTree, iSeek, pKey, pul, &pK, &pV)
+	&& ((pCursor->pb == NULL) || (cmpKey(pTree, pK, pCursor->pb) >= 0))
+	&& ((pCursor->pe == NULL) || (cmpKey(pTree, pK, pCursor->pe) <= 0))) {
+		pCursor->pn = pK; /* key address, its node may be gone or hold another key by the next step */
+		if(ppKey != NULL)
+			*ppKey = pK;
+		if(ppValue != NULL)
+			*ppValue = pV;
+	} else
+		pCursor->pn = NULL;
+	readPin(pTree, 0);
+return(pCursor->pn != NULL);
+}
+
+#ifdef CONCURRENT_OK
+static int writeBegin(Tree *pTree) {
+	Concurrent *pC;
+	if(pTree->iMode & (TREE_MAPPED | TREE_PAGED))
+		return(0);
+	if(!(pTree->iMode & TREE_CONCURRENT))
+		return(1);
+	if(!lockTree(pTree, 1))
+		return(0);
+	pC = pTree->pc;
+	if(!retireRoom(pTree)) {
+		lockTree(pTree, 0);
+		return(0);
+	}
+	__atomic_store_n(&pC->ulSeq, pC->ulSeq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE); /* odd sequence seen before any change */
+return(1);
+}
+
+static int retireRoom(Tree *pTree) {
+	Concurrent *pC = pTree->pc;
+	if((pC != NULL) && (pC->ulRetired + CONC_SPARE > pC->ulRetiredMax)) { /* room up front, retire() cannot fail mid change */
+		unsigned long ulMax = (pC->ulRetiredMax == 0) ? CONC_RETIRE : pC->ulRetiredMax * 2;
+		Retired *pR = realloc(pC->pRetired, ulMax * sizeof(Retired));
+		if(pR == NULL)
+			return(0);
+		pC->pRetired = pR;
+		pC->ulRetiredMax = ulMax;
+	}
+return(1);
+}
+
+static void writeEnd(Tree *pTree) {
+	Concurrent *pC = pTree->pc;
+	if(pC != NULL) {
+		__atomic_store_n(&pC->ulSeq, pC->ulSeq + 1, __ATOMIC_RELEASE);
+		if(pC->ulRetired >= CONC_RETIRE)
+			reclaim(pTree, 0);
+		lockTree(pTree, 0);
+	}
+return;
+}
+
+static int lockTree(Tree *pTree, int iLock) {
+	Concurrent *pC, *pNew = NULL;
+	if(!(pTree->iMode & TREE_CONCURRENT))
+		return(1);
+	if(!iLock) {
+		pthread_mutex_unlock(&((Concurrent*)pTree->pc)->mutex);
+		return(1);
+	}
+	if((pC = __atomic_load_n((Concurrent**)&pTree->pc, __ATOMIC_ACQUIRE)) == NULL) { /* first writer makes it */
+		if((pNew = alignedAlloc(sizeof(Concurrent))) == NULL)
+			return(0);
+		memset(pNew, 0, sizeof(Concurrent));
+		if(pthread_mutex_init(&pNew->mutex, NULL) != 0) {
+			alignedFree(pNew);
+			return(0);
+		}
+		if(__atomic_compare_exchange_n((Concurrent**)&pTree->pc, &pC, pNew, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+			pC = pNew;
+		else { /* another writer was first, pC now holds its state */
+			pthread_mutex_destroy(&pNew->mutex);
+			alignedFree(pNew);
+		}
+	}
+	pthread_mutex_lock(&pC->mutex);
+return(1);
+}
+
+static int readPin(Tree *pTree, int iPin) {
+	Concurrent *pC = __atomic_load_n((Concurrent**)&pTree->pc, __ATOMIC_ACQUIRE);
+	if(pC == NULL)
+		return(0);
+	if(uiStripe == 0)
+		uiStripe = (__atomic_fetch_add(&uiThreads, 1, __ATOMIC_RELAXED) % CONC_STRIPES) + 1;
+	if(iPin)
+		__atomic_add_fetch(&pC->aStripe[uiStripe - 1].ulReaders, 1, __ATOMIC_SEQ_CST);
+	else
+		__atomic_sub_fetch(&pC->aStripe[uiStripe - 1].ulReaders, 1, __ATOMIC_SEQ_CST);
+return(1);
+}
+
+static unsigned long readBegin(Tree *pTree, int iTry) {
+	Concurrent *pC = pTree->pc;
+	unsigned long ulSeq;
+	if(iTry >= CONC_TRIES) { /* writers keep winning, queue behind them instead */
+		pthread_mutex_lock(&pC->mutex);
+		return(CONC_LOCKED);
+	}
+	while((ulSeq = __atomic_load_n(&pC->ulSeq, __ATOMIC_SEQ_CST)) & 1)
+		sched_yield();
+return(ulSeq);
+}
+
+static int readEnd(Tree *pTree, unsigned long ulSeq) {
+	Concurrent *pC = pTree->pc;
+	if(ulSeq == CONC_LOCKED) {
+		pthread_mutex_unlock(&pC->mutex);
+		return(1);
+	}
+	__atomic_thread_fence(__ATOMIC_ACQUIRE); /* reads of tree done before sequence is checked */
+return(__atomic_load_n(&pC->ulSeq, __ATOMIC_RELAXED) == ulSeq);
+}
+
+static void retire(Tree *pTree, void *p, size_t sizeT, int iNode) {
+	Concurrent *pC = pTree->pc;
+	Retired *pR = &pC->pRetired[pC->ulRetired++]; /* room made by writeBegin() */
+	pR->p = p;
+	pR->sizeT = sizeT;
+	pR->iNode = iNode;
+return;
+}
+
+static void reclaim(Tree *pTree, int iFree) {
+	Concurrent *pC = pTree->pc;
+	unsigned long ul;
+	int i;
+	if(pC == NULL)
+		return;
+	__atomic_thread_fence(__ATOMIC_SEQ_CST); /* readers pinned later see the new sequence */
+	while(pC->ulRetired > 0) {
+		if(pC->ulGrace == 0) { /* grace period begins for all retired so far */
+			pC->ulGrace = pC->ulRetired;
+			pC->uiClear = 0;
+		}
+		for(i = 0; !iFree && (i < CONC_STRIPES); i++) { /* zero once is enough, a reader counted in since cannot reach them */
+			if(__atomic_load_n(&pC->aStripe[i].ulReaders, __ATOMIC_SEQ_CST) == 0)
+				pC->uiClear |= 1u << i;
+		}
+		if(!iFree && (pC->uiClear != (1u << CONC_STRIPES) - 1))
+			return;
+		for(ul = 0; ul < pC->ulGrace; ul++) {
+			if(pC->pRetired[ul].iNode)
+				releaseNode(pTree, pC->pRetired[ul].p);
+			else
+				releaseData(pTree, NULL, pC->pRetired[ul].p, pC->pRetired[ul].sizeT);
+		}
+		pC->ulRetired -= pC->ulGrace;
+		memmove(pC->pRetired, pC->pRetired + pC->ulGrace, pC->ulRetired * sizeof(Retired));
+		pC->ulGrace = 0;
+	}
+	if(iFree) {
+		pthread_mutex_destroy(&pC->mutex);
+		free(pC->pRetired);
+		alignedFree(pC);
+		pTree->pc = NULL;
+	}
+return;
+}
+#else /* TREE_CONCURRENT refused by initTree(), Tree.pc stays NULL */
+static int writeBegin(Tree *pTree) { return(!(pTree->iMode & (TREE_MAPPED | TREE_PAGED))); }
+static void writeEnd(Tree *pTree) { return; }
+static int retireRoom(Tree *pTree) { return(1); }
+static int lockTree(Tree *pTree, int iLock) { return(1); }
+static int readPin(Tree *pTree, int iPin) { return(0); }
+static unsigned long readBegin(Tree *pTree, int iTry) { return(0); }
+static int readEnd(Tree *pTree, unsigned long ulSeq) { return(1); }
+static void retire(Tree *pTree, void *p, size_t sizeT, int iNode) { return; }
+static void reclaim(Tree *pTree, int iFree) { return; }
+#endif
+
+static int rbVerify(Tree *pTree) {
+	int iBad = 0;
+	unsigned long ul = 0, ulBlack, ulHeight = ULONG_MAX;
+	Node *pN, *pPrev = NULL, *pNode = pTree->pr;
+	if((pNode != NULL) && (pNode->pParent != NULL))
+		iBad |= TREE_BAD_LINK;
+	for(pNode = edgeNode(pNode, 0); pNode != NULL; pNode = stepNode(pNode, 1)) {
+		if(++ul > pTree->ulTreeLen) /* no walking around a cycle */
+			break;
+		if((pPrev != NULL) && (cmpKeyPrefix(pTree, pPrev->pKey, pPrev->ui64Prefix, pNode->pKey, pNode->ui64Prefix) >= 0))
+			iBad |= TREE_BAD_ORDER;
+		if(((pNode->pLeft != NULL) && (pNode->pLeft->pParent != pNode))
+		|| ((pNode->pRight != NULL) && (pNode->pRight->pParent != pNode)))
+			iBad |= TREE_BAD_LINK;
+		if((pNode->color == NODE_RED) && (pNode->pParent != NULL) && (pNode->pParent->color == NODE_RED))
+			iBad |= TREE_BAD_RED;
+		if(pNode->ulSize != SIZE(pNode->pLeft) + SIZE(pNode->pRight) + 1)
+			iBad |= TREE_BAD_COUNT;
+		if((pNode->pLeft == NULL) || (pNode->pRight == NULL)) { /* same black count on every path to a leaf */
+			for(ulBlack = 0, pN = pNode; pN != NULL; pN = pN->pParent)
+				ulBlack += (pN->color == NODE_BLACK);
+			if(ulHeight == ULONG_MAX)
+				ulHeight = ulBlack;
+			else if(ulBlack != ulHeight)
+				iBad |= TREE_BAD_BALANCE;
+		}
+		pPrev = pNode;
+	}
+	if(ul != pTree->ulTreeLen)
+		iBad |= TREE_BAD_COUNT;
+	for(ul = 0, pPrev = NULL, pNode = pTree->ph; (pNode != NULL) && (ul <= pTree->ulTreeLen); ul++) {
+		if(pNode->pPrev != pPrev)
+			iBad |= TREE_BAD_LIST;
+		pPrev = pNode;
+		pNode = pNode->pNext;
+	}
+	if((ul != pTree->ulTreeLen) || (pTree->pt != pPrev))
+		iBad |= TREE_BAD_LIST;
+	if(pTree->px != NULL) { /* every key found through the index, nothing else in it */
+		HashIndex *pIndex = pTree->px;
+		if(pIndex->ulUsed + pIndex->ulOldUsed != pTree->ulTreeLen)
+			iBad |= TREE_BAD_INDEX;
+		for(ul = 0, pNode = pTree->ph; (pNode != NULL) && (ul < pTree->ulTreeLen); ul++, pNode = pNode->pNext) {
+			if(hashFind(pTree, pNode->pKey) != pNode)
+				iBad |= TREE_BAD_INDEX;
+		}
+	}
+return(iBad);
+}
+
+static int bpVerify(Tree *pTree) {
+	BpPath aPath[BP_DEPTH_MAX];
+	BpLeaf *pLeaf, *pPrev = NULL;
+	BpNode *pChild, *pN;
+	void *pKey = NULL;
+	int i, iBad = 0, iLeafDepth = -1, d = 0;
+	unsigned long ul = 0;
+	for(pLeaf = pTree->ph; (pLeaf != NULL) && (ul <= pTree->ulTreeLen); pLeaf = pLeaf->pNext) { /* chain holds every key */
+		if(pLeaf->pPrev != pPrev)
+			iBad |= TREE_BAD_LIST;
+		for(i = 0; i < pLeaf->h.iCount; i++, ul++) {
+			if(((pKey != NULL) && (cmpKey(pTree, pKey, pLeaf->apKey[i]) >= 0))
+			|| (pLeaf->aui64Prefix[i] != keyPrefix(pTree, pLeaf->apKey[i])))
+				iBad |= TREE_BAD_ORDER;
+			pKey = pLeaf->apKey[i];
+		}
+		pPrev = pLeaf;
+	}
+	if(ul != pTree->ulTreeLen)
+		iBad |= TREE_BAD_COUNT;
+	if(pTree->pt != pPrev)
+		iBad |= TREE_BAD_LIST;
+	if((pTree->pr == NULL) || ((BpNode*)pTree->pr)->iLeaf)
+		return(iBad | ((pTree->pr != pTree->ph) ? TREE_BAD_LINK : 0));
+	aPath[0].pInner = pTree->pr; /* depth first as bpFreeInner() */
+	aPath[0].iChild = 0;
+	while(d >= 0) {
+		BpInner *pIn = aPath[d].pInner;
+		if((i = aPath[d].iChild++) > pIn->h.iCount) {
+			d--;
+			continue;
+		}
+		if((i == 0) && (((d > 0) && (pIn->h.iCount < BP_INNER_MIN)) || (pIn->h.iCount > BP_ORDER - 1)))
+			iBad |= TREE_BAD_BALANCE;
+		pChild = pIn->apChild[i];
+		if(i > 0) { /* separator is smallest key below its right child */
+			for(pN = pChild; !pN->iLeaf; pN = ((BpInner*)pN)->apChild[0])
+				;
+			if((cmpKey(pTree, pIn->apKey[i - 1], ((BpLeaf*)pN)->apKey[0]) != 0)
+			|| (pIn->aui64Prefix[i - 1] != keyPrefix(pTree, pIn->apKey[i - 1])))
+				iBad |= TREE_BAD_ORDER;
+		}
+		if(pChild->iLeaf) {
+			if(iLeafDepth < 0)
+				iLeafDepth = d + 1;
+			if((iLeafDepth != d + 1) || (pChild->iCount < BP_LEAF_MIN) || (pChild->iCount > BP_ORDER))
+				iBad |= TREE_BAD_BALANCE;
+		} else if(d + 1 < BP_DEPTH_MAX) {
+			aPath[++d].pInner = (BpInner*)pChild;
+			aPath[d].iChild = 0;
+		} else
+			iBad |= TREE_BAD_BALANCE;
+	}
+return(iBad);
+}
+
+static uint64_t hashKey(Tree *pTree, const void *pKey) {
+	const unsigned char *puc = pKey;
+	uint64_t ui64 = 14695981039346656037ULL; /* FNV-1a for bytes */
+	size_t i;
+	switch(pTree->iKey) {
+	case TREE_KEY_INT64:
+	case TREE_KEY_UINT64:
+		memcpy(&ui64, pKey, sizeof(ui64));
+		break;
+	case TREE_KEY_DOUBLE:
+		ui64 = doubleOrder(pKey); /* -0.0 hashes as 0.0 */
+		break;
+	case TREE_KEY_STRING:
+		for(; *puc != '\0'; puc++)
+			ui64 = (ui64 ^ *puc) * 1099511628211ULL;
+		return(ui64);
+	default:
+		for(i = 0; i < pTree->sizeTcmp; i++)
+			ui64 = (ui64 ^ puc[i]) * 1099511628211ULL;
+		return(ui64);
+	}
+	ui64 += 0x9E3779B97F4A7C15ULL; /* splitmix64 spreads sequential numbers over shards */
+	ui64 = (ui64 ^ (ui64 >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	ui64 = (ui64 ^ (ui64 >> 27)) * 0x94D049BB133111EBULL;
+return(ui64 ^ (ui64 >> 31));
+}
+
+static int walkNext(Tree *pTree, Walk *pW) {
+	if(pTree->iMode & TREE_MAPPED) {
+		MapEntry *pE = (pW->p == NULL) ? (MapEntry*)pTree->ph : (MapEntry*)pW->p + 1;
+		if(pE >= (MapEntry*)pTree->ph + pTree->ulTreeLen)
+			return(0);
+		pW->p = pE;
+		pW->pKey = (char*)pTree->pr + pE->ui64Key;
+		pW->sizeTkey = (size_t)pE->ui64KeyLen;
+		pW->pValue = (pE->ui64Value == 0) ? NULL : (char*)pTree->pr + pE->ui64Value;
+		pW->sizeTvalue = (size_t)pE->ui64ValueLen;
+	} else if(pTree->iMode & TREE_PAGED) { /* key read before the next fetch, saveTree() writes it first */
+		PgPool *pPool = pTree->pr;
+		PgPage *pPage;
+		PgEntry *pE;
+		uint32_t ui = (pW->p == NULL) ? pPool->head.ui32First : (uint32_t)(uintptr_t)pW->p;
+		for(pW->i = (pW->p == NULL) ? 0 : pW->i + 1; ; ui = pPage->ui32Next, pW->i = 0) {
+			if((ui == 0) || ((pPage = pgFetch(pPool, ui, 0)) == NULL))
+				return(0);
+			if(pW->i < pPage->ui16Count)
+				break;
+		}
+		pE = PG_ENTRY(pPage, pW->i);
+		pW->p = (void*)(uintptr_t)ui;
+		pW->pKey = PG_KEY(pE);
+		pW->sizeTkey = pE->ui16Key;
+		pW->pValue = PG_VALUE(pE);
+		pW->sizeTvalue = pE->ui16Value;
+	} else if(pTree->iMode & TREE_BPLUS) {
+		BpLeaf *pLeaf = pW->p;
+		if(pLeaf == NULL) {
+			pLeaf = pTree->ph;
+			pW->i = 0;
+		} else
+			pW->i++;
+		while((pLeaf != NULL) && (pW->i >= pLeaf->h.iCount)) {
+			pLeaf = pLeaf->pNext;
+			pW->i = 0;
+		}
+		if((pW->p = pLeaf) == NULL)
+			return(0);
+		pW->pKey = pLeaf->apKey[pW->i];
+		pW->sizeTkey = pLeaf->asizeTkey[pW->i];
+		pW->pValue = pLeaf->apValue[pW->i];
+		pW->sizeTvalue = pLeaf->asizeTvalue[pW->i];
+	} else if(pTree->iMode & TREE_COMPACT) { /* walk holds key, next one found from root */
+		uint32_t ui = cpSeek(pTree, (pW->p == NULL) ? SEEK_FIRST : BOUND_UPPER, pW->p);
+		CpNode *pN;
+		if(ui == 0)
+			return(0);
+		pN = CP_NODE((CpTree*)pTree->pr, ui);
+		pW->p = pW->pKey = CP_KEY(pTree, pN);
+		pW->sizeTkey = (pN->ui32Left & CP_KEY_COPY) ? CP_COPY_LEN(pN->key.p) : 0;
+		pW->pValue = CP_VALUE(pN);
+		pW->sizeTvalue = (CP_KIND(pN) == CP_VALUE_COPY) ? CP_COPY_LEN(pN->value.p) : (CP_KIND(pN) == CP_VALUE_INLINE) ? CP_INLINE_LEN(pN) : 0;
+	} else {
+		Node *pNode = (pW->p == NULL) ? edgeNode(pTree->pr, 0) : stepNode(pW->p, 1);
+		if((pW->p = pNode) == NULL)
+			return(0);
+		pW->pKey = pNode->pKey;
+		pW->sizeTkey = pNode->sizeTkey;
+		pW->pValue = pNode->pValue;
+		pW->sizeTvalue = pNode->sizeTvalue;
+	}
+	if(pW->sizeTkey == 0) { /* address assigned key, length known for key kinds only */
+		if((pTree->iKey == TREE_KEY_INT64) || (pTree->iKey == TREE_KEY_UINT64) || (pTree->iKey == TREE_KEY_DOUBLE))
+			pW->sizeTkey = 8;
+		else if(pTree->iKey == TREE_KEY_STRING)
+			pW->sizeTkey = strlen(pW->pKey);
+		else if(pTree->iKey == TREE_KEY_MEMCMP)
+			pW->sizeTkey = pTree->sizeTcmp;
+	}
+return(1);
+}
+
+static int saveTree(Tree *pTree, FILE *pFile) {
+	static const char acPad[8] = { 0 };
+	MapHead head;
+	MapEntry entry;
+	Walk walk;
+	Node *pNode;
+	uint64_t ui64, ui64Off;
+	unsigned long ul = 0;
+	memset(&head, 0, sizeof(head));
+	memcpy(head.acMagic, MAP_MAGIC, sizeof(head.acMagic));
+	head.ui32Version = MAP_VERSION;
+	head.ui32Endian = MAP_ENDIAN;
+	head.i32Key = pTree->iKey;
+	head.ui64Cmp = pTree->sizeTcmp;
+	head.ui64Len = pTree->ulTreeLen;
+	head.ui64Entries = sizeof(MapHead);
+	head.ui64Order = head.ui64Entries + (head.ui64Len * sizeof(MapEntry));
+	head.ui64Data = ui64Off = head.ui64Order + (head.ui64Len * sizeof(uint64_t));
+	if(fwrite(&head, sizeof(head), 1, pFile) != 1) /* written again once size is known */
+		return(0);
+	for(walk.p = NULL; walkNext(pTree, &walk); ul++) { /* entries, data follows in same order */
+		if((walk.sizeTkey == 0) || ((walk.sizeTvalue == 0) && (walk.pValue != NULL)))
+			return(0); /* address assigned, nothing to copy */
+		entry.ui64Prefix = keyPrefix(pTree, walk.pKey);
+		entry.ui64Key = ui64Off;
+		entry.ui64KeyLen = walk.sizeTkey;
+		ui64Off += MAP_ALIGN(walk.sizeTkey);
+		entry.ui64Value = (walk.pValue == NULL) ? 0 : ui64Off;
+		entry.ui64ValueLen = walk.sizeTvalue;
+		ui64Off += (walk.pValue == NULL) ? 0 : MAP_ALIGN(walk.sizeTvalue);
+		if(fwrite(&entry, sizeof(entry), 1, pFile) != 1)
+			return(0);
+	}
+	if(ul != pTree->ulTreeLen)
+		return(0);
+	for(ul = 0; ul < pTree->ulTreeLen; ul++) { /* sorted index of each key in insertion order */
+		if(pTree->iMode & TREE_MAPPED)
+			ui64 = ((uint64_t*)pTree->pt)[ul];
+		else if(pTree->iMode & (TREE_BPLUS | TREE_COMPACT | TREE_PAGED))
+			ui64 = ul;
+		else {
+			pNode = (ul == 0) ? pTree->ph : pNode->pNext;
+			ui64 = nodeRank(pNode);
+		}
+		if(fwrite(&ui64, sizeof(ui64), 1, pFile) != 1)
+			return(0);
+	}
+	for(walk.p = NULL; walkNext(pTree, &walk); ) {
+		if((fwrite(walk.pKey, 1, walk.sizeTkey, pFile) != walk.sizeTkey)
+		|| (fwrite(acPad, 1, MAP_ALIGN(walk.sizeTkey) - walk.sizeTkey, pFile) != MAP_ALIGN(walk.sizeTkey) - walk.sizeTkey))
+			return(0);
+		if((walk.pValue != NULL) && ((fwrite(walk.pValue, 1, walk.sizeTvalue, pFile) != walk.sizeTvalue)
+		|| (fwrite(acPad, 1, MAP_ALIGN(walk.sizeTvalue) - walk.sizeTvalue, pFile) != MAP_ALIGN(walk.sizeTvalue) - walk.sizeTvalue)))
+			return(0);
+	}
+	head.ui64Size = ui64Off;
+	rewind(pFile);
+return(fwrite(&head, sizeof(head), 1, pFile) == 1);
+}
+
+static unsigned long nodeRank(Node *pNode) {
+	unsigned long ulRank = SIZE(pNode->pLeft);
+	for(; pNode->pParent != NULL; pNode = pNode->pParent) {
+		if(pNode == pNode->pParent->pRight)
+			ulRank += SIZE(pNode->pParent->pLeft) + 1;
+	}
+return(ulRank);
+}
+
+static void mapUnload(void *pMap, uint64_t ui64Size) {
+#ifdef _WIN32
+	alignedFree(pMap);
+#else
+	munmap(pMap, (size_t)ui64Size);
+#endif
+return;
+}
+
+static unsigned long mapRank(Tree *pTree, const void *pKey, int iEqual) {
+	int iCmp;
+	uint64_t ui64Prefix = keyPrefix(pTree, pKey);
+	unsigned long ulMid, ulLow = 0, ulHigh = pTree->ulTreeLen;
+	MapEntry *pE = pTree->ph;
+	while(ulLow < ulHigh) {
+		ulMid = ulLow + ((ulHigh - ulLow) / 2);
+		iCmp = cmpKeyPrefix(pTree, (char*)pTree->pr + pE[ulMid].ui64Key, pE[ulMid].ui64Prefix, pKey, ui64Prefix);
+		if((iCmp < 0) || (iEqual && (iCmp == 0)))
+			ulLow = ulMid + 1;
+		else
+			ulHigh = ulMid;
+	}
+return(ulLow);
+}
+
+static MapEntry* mapBound(Tree *pTree, const void *pKey, int iBound) {
+	unsigned long ul = mapRank(pTree, pKey, (iBound == BOUND_UPPER) || (iBound == BOUND_FLOOR));
+	if((iBound == BOUND_FLOOR) || (iBound == BOUND_BELOW))
+		return((ul == 0) ? NULL : (MapEntry*)pTree->ph + ul - 1);
+return((ul >= pTree->ulTreeLen) ? NULL : (MapEntry*)pTree->ph + ul);
+}
+
+static int mapCursorAt(TreeCursor *pCursor, void *p, void **ppKey, void **ppValue) {
+	Tree *pTree = pCursor->pTree;
+	MapEntry *pE;
+	pCursor->pn = p; /* MapEntry when sorted, sorted index in insertion order array otherwise */
+	if(p == NULL)
+		return(0);
+	pE = (pCursor->iOrder == TREE_INSERTED) ? (MapEntry*)pTree->ph + *((uint64_t*)p) : p;
+	if(ppKey != NULL)
+		*ppKey = (char*)pTree->pr + pE->ui64Key;
+	if(ppValue != NULL)
+		*ppValue = (pE->ui64Value == 0) ? NULL : (char*)pTree->pr + pE->ui64Value;
+return(1);
+}
+
+static int mapCursorStep(TreeCursor *pCursor, int iNext, void **ppKey, void **ppValue) {
+	Tree *pTree = pCursor->pTree;
+	size_t sizeT = (pCursor->iOrder == TREE_INSERTED) ? sizeof(uint64_t) : sizeof(MapEntry);
+	char *pc = pCursor->pn, *pcFirst = (pCursor->iOrder == TREE_INSERTED) ? pTree->pt : pTree->ph;
+	if((pc == (iNext ? pCursor->pe : pCursor->pb)) || (pc == (iNext ? pcFirst + ((pTree->ulTreeLen - 1) * sizeT) : pcFirst)))
+		return(mapCursorAt(pCursor, NULL, ppKey, ppValue));
+return(mapCursorAt(pCursor, iNext ? pc + sizeT : pc - sizeT, ppKey, ppValue));
+}
+
+static int mapVerify(Tree *pTree) {
+	int iBad = 0;
+	unsigned long ul;
+	MapEntry *pE = pTree->ph;
+	uint64_t ui64Min = ((pTree->iKey == TREE_KEY_USER) || (pTree->iKey == TREE_KEY_STRING)) ? 0
+		: (pTree->iKey == TREE_KEY_MEMCMP) ? pTree->sizeTcmp : sizeof(uint64_t); /* bytes a compare reads */
+	for(ul = 0; ul < pTree->ulTreeLen; ul++) {
+		if(!mapData(pTree->pr, pE[ul].ui64Key, pE[ul].ui64KeyLen) || (pE[ul].ui64KeyLen < ui64Min)
+		|| ((pE[ul].ui64Value != 0) && !mapData(pTree->pr, pE[ul].ui64Value, pE[ul].ui64ValueLen))
+		|| (pE[ul].ui64Prefix != keyPrefix(pTree, (char*)pTree->pr + pE[ul].ui64Key)))
+			iBad |= TREE_BAD_LINK;
+		else if((ul > 0) && (cmpKeyPrefix(pTree, (char*)pTree->pr + pE[ul - 1].ui64Key, pE[ul - 1].ui64Prefix,
+		(char*)pTree->pr + pE[ul].ui64Key, pE[ul].ui64Prefix) >= 0))
+			iBad |= TREE_BAD_ORDER;
+		if(((uint64_t*)pTree->pt)[ul] >= pTree->ulTreeLen)
+			iBad |= TREE_BAD_LIST;
+	}
+return(iBad);
+}
+
+static int mapData(MapHead *pHead, uint64_t ui64Off, uint64_t ui64Len) {
+	if((ui64Off < pHead->ui64Data) || (ui64Off >= pHead->ui64Size) || (ui64Off & 7)) /* saveTree() aligns every copy */
+		return(0);
+return((ui64Len < pHead->ui64Size - ui64Off) && (((char*)pHead)[ui64Off + ui64Len] == '\0'));
+}
+
+static int pgIO(PgPool *pPool, uint32_t ui32Page, void *pPage, int iWrite) {
+	uint64_t ui64Off = (uint64_t)ui32Page * PG_SIZE;
+	size_t sizeT;
+#ifdef _WIN32 /* no pread(), seek then read or write */
+	if(_fseeki64(pPool->pFile, (__int64)ui64Off, SEEK_SET) != 0)
+		return(0);
+	sizeT = iWrite ? fwrite(pPage, 1, PG_SIZE, pPool->pFile) : fread(pPage, 1, PG_SIZE, pPool->pFile);
+#else
+	ssize_t ss = iWrite ? pwrite(pPool->iFd, pPage, PG_SIZE, (off_t)ui64Off) : pread(pPool->iFd, pPage, PG_SIZE, (off_t)ui64Off);
+	sizeT = (ss < 0) ? 0 : (size_t)ss;
+#endif
+return(sizeT == PG_SIZE);
+}
+
+static int32_t pgTake(PgPool *pPool) {
+	PgFrame *pF;
+	int32_t *pi, i;
+	if(pPool->ui32Taken < pPool->ui32Frames) { /* pool fills before anything is evicted */
+		i = (int32_t)pPool->ui32Taken++;
+		pF = &pPool->pFrames[i];
+		pF->ui32Page = pF->ui32Pins = 0;
+		pF->iDirty = 0;
+		pF->i32Newer = pF->i32Hash = -1;
+		if((pF->i32Older = pPool->i32Newest) >= 0)
+			pPool->pFrames[pF->i32Older].i32Newer = i;
+		else
+			pPool->i32Oldest = i;
+		pPool->i32Newest = i;
+		return(i);
+	}
+	for(i = pPool->i32Oldest; (i >= 0) && (pPool->pFrames[i].ui32Pins > 0); i = pPool->pFrames[i].i32Newer)
+		;
+	if(i < 0)
+		return(-1);
+	pF = &pPool->pFrames[i];
+	if(pF->iDirty) {
+		if(!pgIO(pPool, pF->ui32Page, pPool->pcFrames + ((size_t)i * PG_SIZE), 1))
+			return(-1); /* page stays, a later sync may still write it */
+		pF->iDirty = 0;
+	}
+	if(pF->ui32Page != 0) {
+		for(pi = &pPool->pi32Buckets[PG_HASH(pPool, pF->ui32Page)]; *pi != i; pi = &pPool->pFrames[*pi].i32Hash)
+			;
+		*pi = pF->i32Hash;
+		pF->ui32Page = 0;
+	}
+	pgNewest(pPool, i);
+return(i);
+}
+
+static void pgNewest(PgPool *pPool, int32_t i) {
+	PgFrame *pF = &pPool->pFrames[i];
+	if(i == pPool->i32Newest)
+		return;
+	if(pF->i32Older >= 0)
+		pPool->pFrames[pF->i32Older].i32Newer = pF->i32Newer;
+	else
+		pPool->i32Oldest = pF->i32Newer;
+	pPool->pFrames[pF->i32Newer].i32Older = pF->i32Older;
+	pF->i32Older = pPool->i32Newest;
+	pF->i32Newer = -1;
+	pPool->pFrames[pPool->i32Newest].i32Newer = i;
+	pPool->i32Newest = i;
+return;
+}
+
+static void pgHold(PgPool *pPool, int32_t i, uint32_t ui32Page) {
+	int32_t *pi = &pPool->pi32Buckets[PG_HASH(pPool, ui32Page)];
+	pPool->pFrames[i].ui32Page = ui32Page;
+	pPool->pFrames[i].i32Hash = *pi;
+	*pi = i;
+return;
+}
+
+static PgPage* pgFetch(PgPool *pPool, uint32_t ui32Page, int iPin) {
+	PgPage *pPage;
+	int32_t i;
+	if((ui32Page == 0) || (ui32Page >= pPool->head.ui32Pages))
+		return(NULL);
+	for(i = pPool->pi32Buckets[PG_HASH(pPool, ui32Page)]; (i >= 0) && (pPool->pFrames[i].ui32Page != ui32Page); i = pPool->pFrames[i].i32Hash)
+		;
+	if(i >= 0) {
+		pPage = (PgPage*)(pPool->pcFrames + ((size_t)i * PG_SIZE));
+		pgNewest(pPool, i);
+	} else { /* read into a frame taken from oldest page not pinned */
+		if((i = pgTake(pPool)) < 0)
+			return(NULL);
+		pPage = (PgPage*)(pPool->pcFrames + ((size_t)i * PG_SIZE));
+		if(!pgIO(pPool, ui32Page, pPage, 0) || (pPage->ui16Kind < PG_LEAF) || (pPage->ui16Kind > PG_FREE)
+		|| (pPage->ui16Count > PG_SLOTS_MAX) || (pPage->ui16Low > PG_SIZE)
+		|| (pPage->ui16Low < sizeof(PgPage) + (pPage->ui16Count * sizeof(uint16_t))))
+			return(NULL); /* frame left holding no page */
+		pgHold(pPool, i, ui32Page);
+	}
+	if(iPin)
+		pPool->pFrames[i].ui32Pins++;
+return(pPage);
+}
+
+static void pgUnpin(PgPool *pPool, PgPage *pPage) {
+	pPool->pFrames[PG_FRAME(pPool, pPage)].ui32Pins--;
+return;
+}
+
+static void pgDirty(PgPool *pPool, PgPage *pPage) {
+	pPool->pFrames[PG_FRAME(pPool, pPage)].iDirty = 1;
+return;
+}
+
+static PgPage* pgAlloc(PgPool *pPool, int iKind) {
+	PgPage *pPage;
+	int32_t i;
+	if(pPool->head.ui32Free != 0) {
+		if((pPage = pgFetch(pPool, pPool->head.ui32Free, 1)) == NULL)
+			return(NULL);
+		pPool->head.ui32Free = pPage->ui32Next;
+		pPool->head.ui32FreeLen--;
+	} else { /* page past end of file, written there when evicted or synced */
+		if((pPool->head.ui32Pages == UINT32_MAX) || ((uint64_t)pPool->head.ui32Pages >= ((uint64_t)UINTPTR_MAX >> PG_SLOT_BITS))
+		|| ((i = pgTake(pPool)) < 0)) /* cursors hold page numbers in a pointer */
+			return(NULL);
+		pgHold(pPool, i, pPool->head.ui32Pages++);
+		pPool->pFrames[i].ui32Pins = 1;
+		pPage = (PgPage*)(pPool->pcFrames + ((size_t)i * PG_SIZE));
+	}
+	memset(pPage, 0, PG_SIZE); /* no stale bytes reach the file */
+	pPage->ui16Kind = (uint16_t)iKind;
+	pPage->ui16Low = PG_SIZE;
+	pgDirty(pPool, pPage);
+return(pPage);
+}
+
+static void pgRelease(PgPool *pPool, PgPage *pPage) {
+	pPage->ui16Kind = PG_FREE;
+	pPage->ui16Count = pPage->ui16Used = 0;
+	pPage->ui16Low = PG_SIZE;
+	pPage->ui32Prev = 0;
+	pPage->ui32Next = pPool->head.ui32Free;
+	pPool->head.ui32Free = PG_ID(pPool, pPage);
+	pPool->head.ui32FreeLen++;
+	pgDirty(pPool, pPage);
+	pgUnpin(pPool, pPage);
+return;
+}
+
+static int pgFlush(Tree *pTree) {
+	PgPool *pPool = pTree->pr;
+	PgFrame *pF;
+	uint32_t ui;
+	int iDone = 1;
+	for(ui = 0; ui < pPool->ui32Taken; ui++) {
+		pF = &pPool->pFrames[ui];
+		if(pF->iDirty && (pF->ui32Page != 0)) {
+			if(pgIO(pPool, pF->ui32Page, pPool->pcFrames + ((size_t)ui * PG_SIZE), 1))
+				pF->iDirty = 0;
+			else
+				iDone = 0;
+		}
+	}
+	pPool->head.ui64Len = pTree->ulTreeLen;
+	memset(pPool->pcScratch, 0, PG_SIZE);
+	memcpy(pPool->pcScratch, &pPool->head, sizeof(PgHead));
+	if(!iDone || !pgIO(pPool, 0, pPool->pcScratch, 1)) /* head last, it names only pages written */
+		return(0);
+#ifdef _WIN32
+return(fflush(pPool->pFile) == 0);
+#else
+return(fsync(pPool->iFd) == 0);
+#endif
+}
+
+static void pgClose(Tree *pTree) {
+	PgPool *pPool = pTree->pr;
+	if(pTree->iMode & TREE_PAGED) /* failure seen only by treeSync(), treeOpen() failing writes nothing */
+		pgFlush(pTree);
+#ifdef _WIN32
+	if(pPool->pFile != NULL)
+		fclose(pPool->pFile);
+#else
+	if(pPool->iFd >= 0)
+		close(pPool->iFd);
+#endif
+	alignedFree(pPool->pcFrames);
+	alignedFree(pPool->pcScratch);
+	free(pPool->pFrames);
+	free(pPool->pi32Buckets);
+	free(pPool->ppEntries);
+	free(pPool);
+return;
+}
+
+static size_t pgEntrySize(int iKind, PgEntry *pE) {
+	size_t sizeT = sizeof(PgEntry) + PG_ALIGN(pE->ui16Key);
+	if((iKind == PG_LEAF) && !(pE->ui32Link & PG_NULL))
+		sizeT += PG_ALIGN(pE->ui16Value);
+return(sizeT);
+}
+
+static int pgSearch(Tree *pTree, PgPage *pPage, const void *pKey, uint64_t ui64Prefix, int *piFound) {
+	int iCmp, iMid, iLow = 0, iHigh = pPage->ui16Count;
+	char *pc;
+	*piFound = 0;
+	while(iLow < iHigh) { /* first slot with key >= pKey */
+		iMid = (iLow + iHigh) / 2;
+		pc = PG_KEY(PG_ENTRY(pPage, iMid));
+		if((iCmp = cmpKeyPrefix(pTree, pc, keyPrefix(pTree, pc), pKey, ui64Prefix)) < 0)
+			iLow = iMid + 1;
+		else if(iCmp > 0)
+			iHigh = iMid;
+		else {
+			*piFound = 1;
+			return(iMid);
+		}
+	}
+return(iLow);
+}
+
+static PgPage* pgDescend(Tree *pTree, const void *pKey, PgPath *pPath, int *piDepth, int iPin) {
+	PgPool *pPool = pTree->pr;
+	PgPage *pPage;
+	uint64_t ui64Prefix = keyPrefix(pTree, pKey);
+	uint32_t ui = pPool->head.ui32Root;
+	int i, iFound, iDepth = 0;
+	while((pPage = pgFetch(pPool, ui, iPin)) != NULL) {
+		if(pPage->ui16Kind == PG_LEAF) {
+			if(piDepth != NULL)
+				*piDepth = iDepth;
+			return(pPage);
+		}
+		if((pPage->ui16Kind != PG_INNER) || (iDepth >= PG_DEPTH_MAX - 1)) { /* damaged file */
+			if(iPin)
+				pgUnpin(pPool, pPage);
+			break;
+		}
+		i = pgSearch(pTree, pPage, pKey, ui64Prefix, &iFound) + iFound; /* key equal to an entry's lives in its child */
+		if(pPath != NULL) {
+			pPath[iDepth].pPage = pPage;
+			pPath[iDepth].iChild = i;
+		}
+		iDepth++;
+		ui = (i == 0) ? pPage->ui32Prev : PG_ENTRY(pPage, i - 1)->ui32Link;
+	}
+	if(iPin)
+		pgUnpinPath(pPool, pPath, iDepth);
+return(NULL);
+}
+
+static void pgUnpinPath(PgPool *pPool, PgPath *pPath, int iDepth) {
+	while(iDepth-- > 0) {
+		if(pPath[iDepth].pPage != NULL) /* NULL once released */
+			pgUnpin(pPool, pPath[iDepth].pPage);
+	}
+return;
+}
+
+static void pgFill(PgPage *pPage, PgEntry **ppEntries, int iLen) {
+	size_t sizeT;
+	int i;
+	pPage->ui16Used = 0;
+	pPage->ui16Low = PG_SIZE;
+	for(i = 0; i < iLen; i++) {
+		sizeT = pgEntrySize(pPage->ui16Kind, ppEntries[i]);
+		pPage->ui16Low -= (uint16_t)sizeT;
+		memcpy((char*)pPage + pPage->ui16Low, ppEntries[i], sizeT);
+		PG_SLOTS(pPage)[i] = pPage->ui16Low;
+		pPage->ui16Used += (uint16_t)sizeT;
+	}
+	pPage->ui16Count = (uint16_t)iLen;
+return;
+}
+
+static void pgPlace(PgPool *pPool, PgPage *pPage, int i, PgEntry *pE, size_t sizeT) {
+	PgPage *pCopy = (PgPage*)pPool->pcScratch;
+	int j;
+	if(pPage->ui16Low < sizeof(PgPage) + ((pPage->ui16Count + 1) * sizeof(uint16_t)) + sizeT) { /* room once holes close */
+		memcpy(pCopy, pPage, PG_SIZE);
+		for(j = 0; j < pCopy->ui16Count; j++)
+			pPool->ppEntries[j] = PG_ENTRY(pCopy, j);
+		pgFill(pPage, pPool->ppEntries, pCopy->ui16Count);
+	}
+	pPage->ui16Low -= (uint16_t)sizeT;
+	memcpy((char*)pPage + pPage->ui16Low, pE, sizeT);
+	memmove(&PG_SLOTS(pPage)[i + 1], &PG_SLOTS(pPage)[i], (pPage->ui16Count - i) * sizeof(uint16_t));
+	PG_SLOTS(pPage)[i] = pPage->ui16Low;
+	pPage->ui16Count++;
+	pPage->ui16Used += (uint16_t)sizeT;
+	pgDirty(pPool, pPage);
+return;
+}
+
+static void pgRemove(PgPool *pPool, PgPage *pPage, int i) {
+	pPage->ui16Used -= (uint16_t)pgEntrySize(pPage->ui16Kind, PG_ENTRY(pPage, i));
+	memmove(&PG_SLOTS(pPage)[i], &PG_SLOTS(pPage)[i + 1], (pPage->ui16Count - i - 1) * sizeof(uint16_t));
+	if(--pPage->ui16Count == 0)
+		pPage->ui16Low = PG_SIZE;
+	pgDirty(pPool, pPage);
+return;
+}
+
+static void pgSplit(PgPool *pPool, PgPage *pPage, PgPage *pRight, int i, PgEntry *pE, int iAppend) {
+	PgPage *pCopy = (PgPage*)pPool->pcScratch;
+	PgEntry *pSep = (PgEntry*)(pPool->pcScratch + PG_SIZE), *pFrom, **ppE = pPool->ppEntries;
+	size_t sizeTall = 0, sizeTleft = 0;
+	int j, m, iLen = pPage->ui16Count + 1, iLeaf = (pPage->ui16Kind == PG_LEAF);
+	memcpy(pCopy, pPage, PG_SIZE);
+	for(j = 0; j < iLen; j++) { /* entries of page with the new one in its place */
+		ppE[j] = (j < i) ? PG_ENTRY(pCopy, j) : (j == i) ? pE : PG_ENTRY(pCopy, j - 1);
+		sizeTall += pgEntrySize(pPage->ui16Kind, ppE[j]) + sizeof(uint16_t);
+	}
+	if(iAppend) /* keys arriving in order leave full pages behind, last entry starts the right one */
+		m = iLen - 1;
+	else { /* halves by bytes, leaf keeps entry m - 1, inner lifts entry m */
+		for(m = 0; 2 * (sizeTleft += pgEntrySize(pPage->ui16Kind, ppE[m]) + sizeof(uint16_t)) < sizeTall; m++)
+			;
+		m += iLeaf;
+	}
+	pgFill(pPage, ppE, m);
+	if(iLeaf) {
+		pgFill(pRight, ppE + m, iLen - m);
+		pFrom = PG_ENTRY(pRight, 0);
+	} else {
+		pgFill(pRight, ppE + m + 1, iLen - m - 1);
+		pRight->ui32Prev = ppE[m]->ui32Link;
+		pFrom = ppE[m];
+	}
+	memmove(pSep, pFrom, sizeof(PgEntry) + PG_ALIGN(pFrom->ui16Key)); /* separator is a copy of the key */
+	pSep->ui16Value = 0;
+	pSep->ui32Link = PG_ID(pPool, pRight);
+	pgDirty(pPool, pPage);
+	pgDirty(pPool, pRight);
+return;
+}
+
+static int pgPut(Tree *pTree, void *pKey, size_t sizeTkey, void *pValue, size_t sizeTvalue, int iPut) {
+	PgPool *pPool = pTree->pr;
+	PgPath aPath[PG_DEPTH_MAX];
+	PgPage *apSpare[PG_DEPTH_MAX + 1], *pLeaf, *pRight, *pNext = NULL;
+	PgEntry *pE = (PgEntry*)(pPool->pcScratch + PG_SIZE), *pOld = NULL;
+	char *pcValue = PG_KEY(pE) + PG_ENTRY_MAX;
+	size_t sizeT, sizeTold;
+	int i = 0, d, iFound = 0, iDepth = 0, iSpare, iNeed = 1, iAppend;
+	if((sizeTkey == 0) && (pTree->iKey != TREE_KEY_USER)) /* address assigned key, length known for key kinds only */
+		sizeTkey = (pTree->iKey == TREE_KEY_STRING) ? strlen(pKey) + 1 : (pTree->iKey == TREE_KEY_MEMCMP) ? pTree->sizeTcmp : sizeof(uint64_t);
+	if(((sizeTvalue == 0) && (pValue != NULL)) || (sizeTkey >= PG_ENTRY_MAX) || (sizeTvalue >= PG_ENTRY_MAX)
+	|| ((sizeTkey == 0) && (iPut != PG_PUT_UPDATE)) /* an update takes the length of the key found */
+	|| ((pTree->iKey == TREE_KEY_MEMCMP) && (sizeTkey < pTree->sizeTcmp))) /* an address assigned value would not outlive the process */
+		return(0);
+	if(sizeTkey > 0) { /* staged before any fetch, pages read below may hold the caller's copy */
+		memcpy(PG_KEY(pE), pKey, sizeTkey);
+		memset(PG_KEY(pE) + sizeTkey, 0, PG_ALIGN(sizeTkey) - sizeTkey);
+		pKey = PG_KEY(pE);
+	}
+	if(pValue != NULL)
+		memcpy(pcValue, pValue, sizeTvalue);
+	if(pPool->head.ui32Root != 0) {
+		if((pLeaf = pgDescend(pTree, pKey, aPath, &iDepth, 1)) == NULL)
+			return(0);
+		i = pgSearch(pTree, pLeaf, pKey, keyPrefix(pTree, pKey), &iFound);
+		if(iFound && (iPut == PG_PUT_UPDATE)) { /* key as stored is kept */
+			pOld = PG_ENTRY(pLeaf, i);
+			sizeTkey = pOld->ui16Key;
+			memcpy(PG_KEY(pE), PG_KEY(pOld), PG_ALIGN(sizeTkey));
+		}
+	} else
+		pLeaf = NULL;
+	sizeT = sizeof(PgEntry) + PG_ALIGN(sizeTkey) + ((pValue == NULL) ? 0 : PG_ALIGN(sizeTvalue));
+	if((iFound != (iPut == PG_PUT_UPDATE)) || (sizeT > PG_ENTRY_MAX)) {
+		if(pLeaf != NULL)
+			pgUnpin(pPool, pLeaf);
+		pgUnpinPath(pPool, aPath, iDepth);
+		return(0);
+	}
+	if(pLeaf == NULL) {
+		if((pLeaf = pgAlloc(pPool, PG_LEAF)) == NULL)
+			return(0);
+		pPool->head.ui32Root = pPool->head.ui32First = pPool->head.ui32Last = PG_ID(pPool, pLeaf);
+		pPool->head.ui32Height = 1;
+	}
+	if(pValue != NULL) {
+		memmove(PG_KEY(pE) + PG_ALIGN(sizeTkey), pcValue, sizeTvalue);
+		memset(PG_KEY(pE) + PG_ALIGN(sizeTkey) + sizeTvalue, 0, PG_ALIGN(sizeTvalue) - sizeTvalue);
+	}
+	pE->ui16Key = (uint16_t)sizeTkey;
+	pE->ui16Value = (pValue == NULL) ? 0 : (uint16_t)sizeTvalue;
+	pE->ui32Link = (pValue == NULL) ? PG_NULL : 0;
+	if(iFound) {
+		if((sizeTold = pgEntrySize(PG_LEAF, pOld)) == sizeT) {
+			memcpy(pOld, pE, sizeT);
+			pgDirty(pPool, pLeaf);
+			iNeed = 0;
+		} else if(PG_FREE_BYTES(pLeaf) + sizeTold >= sizeT) {
+			pgRemove(pPool, pLeaf, i);
+			pgPlace(pPool, pLeaf, i, pE, sizeT);
+			iNeed = 0;
+		}
+	} else if(PG_FITS(pLeaf, sizeT)) {
+		pgPlace(pPool, pLeaf, i, pE, sizeT);
+		iNeed = 0;
+	}
+	if(iNeed > 0) { /* every page a split may need taken up front, nothing to undo on failure */
+		for(d = iDepth - 1; (d >= 0) && !PG_FITS(aPath[d].pPage, PG_ENTRY_MAX); d--)
+			iNeed++;
+		iNeed += (d < 0); /* new root */
+		if((pLeaf->ui32Next != 0) && ((pNext = pgFetch(pPool, pLeaf->ui32Next, 1)) == NULL))
+			iNeed = 0;
+		for(iSpare = 0; iSpare < iNeed; iSpare++) {
+			if((apSpare[iSpare] = pgAlloc(pPool, (iSpare == 0) ? PG_LEAF : PG_INNER)) == NULL) {
+				while(iSpare > 0)
+					pgRelease(pPool, apSpare[--iSpare]);
+				break;
+			}
+		}
+		if(iSpare == 0) {
+			if(pNext != NULL)
+				pgUnpin(pPool, pNext);
+			pgUnpin(pPool, pLeaf);
+			pgUnpinPath(pPool, aPath, iDepth);
+			return(0);
+		}
+		iAppend = !iFound && (pLeaf->ui32Next == 0) && (i == pLeaf->ui16Count);
+		if(iFound)
+			pgRemove(pPool, pLeaf, i);
+		pRight = apSpare[0];
+		pgSplit(pPool, pLeaf, pRight, i, pE, iAppend);
+		pRight->ui32Prev = PG_ID(pPool, pLeaf);
+		pRight->ui32Next = pLeaf->ui32Next;
+		pLeaf->ui32Next = PG_ID(pPool, pRight);
+		if(pNext != NULL) {
+			pNext->ui32Prev = pLeaf->ui32Next;
+			pgDirty(pPool, pNext);
+			pgUnpin(pPool, pNext);
+		} else
+			pPool->head.ui32Last = pLeaf->ui32Next;
+		for(iSpare = 1, d = iDepth - 1; ; d--) { /* separator goes up until a page has room */
+			if(d < 0) {
+				pRight = apSpare[iSpare++];
+				pRight->ui32Prev = pPool->head.ui32Root;
+				pgPlace(pPool, pRight, 0, pE, pgEntrySize(PG_INNER, pE));
+				pPool->head.ui32Root = PG_ID(pPool, pRight);
+				pPool->head.ui32Height++;
+				break;
+			}
+			if(PG_FITS(aPath[d].pPage, pgEntrySize(PG_INNER, pE))) {
+				pgPlace(pPool, aPath[d].pPage, aPath[d].iChild, pE, pgEntrySize(PG_INNER, pE));
+				break;
+			}
+			pgSplit(pPool, aPath[d].pPage, apSpare[iSpare++], aPath[d].iChild, pE, iAppend);
+		}
+		for(d = 0; d < iNeed; d++) { /* spares a page with room did not need go back */
+			if(d < iSpare)
+				pgUnpin(pPool, apSpare[d]);
+			else
+				pgRelease(pPool, apSpare[d]);
+		}
+	}
+	pgUnpin(pPool, pLeaf);
+	pgUnpinPath(pPool, aPath, iDepth);
+	if(!iFound)
+		pTree->ulTreeLen++;
+return(1);
+}
+
+static void pgDropChild(Tree *pTree, PgPath *pPath, int d) {
+	PgPool *pPool = pTree->pr;
+	PgPage *pPage;
+	for(; d >= 0; d--) {
+		pPage = pPath[d].pPage;
+		if(pPath[d].iChild > 0)
+			pgRemove(pPool, pPage, pPath[d].iChild - 1);
+		else if(pPage->ui16Count > 0) { /* first entry's child becomes leftmost, keys below it are gone */
+			pPage->ui32Prev = PG_ENTRY(pPage, 0)->ui32Link;
+			pgRemove(pPool, pPage, 0);
+		} else
+			pPage->ui32Prev = 0;
+		if((pPage->ui16Count > 0) || (pPage->ui32Prev != 0))
+			break;
+		pgRelease(pPool, pPage); /* holds nothing, out of its parent too */
+		pPath[d].pPage = NULL;
+	}
+	if(d < 0) /* root went, nothing left */
+		pPool->head.ui32Root = pPool->head.ui32First = pPool->head.ui32Last = pPool->head.ui32Height = 0;
+	else if(((pPage = pPath[0].pPage) != NULL) && (pPage->ui16Count == 0)) { /* root of one child steps down, child may be one too */
+		pPath[0].pPage = NULL;
+		while(pPage != NULL) {
+			pPool->head.ui32Root = pPage->ui32Prev;
+			pPool->head.ui32Height--;
+			pgRelease(pPool, pPage);
+			if((pPool->head.ui32Height < 2) || ((pPage = pgFetch(pPool, pPool->head.ui32Root, 1)) == NULL))
+				break;
+			if(pPage->ui16Count > 0) {
+				pgUnpin(pPool, pPage);
+				pPage = NULL;
+			}
+		}
+	}
+return;
+}
+
+static int pgDelete(Tree *pTree, const void *pKey) {
+	PgPool *pPool = pTree->pr;
+	PgPath aPath[PG_DEPTH_MAX];
+	PgPage *pLeaf, *pPrev = NULL, *pNext = NULL;
+	size_t sizeT;
+	int i, iFound, iDepth, iMerge = 0, iFailed = 0;
+	if((pLeaf = pgDescend(pTree, pKey, aPath, &iDepth, 1)) == NULL)
+		return(0);
+	i = pgSearch(pTree, pLeaf, pKey, keyPrefix(pTree, pKey), &iFound);
+	if(iFound && (iDepth > 0)) {
+		sizeT = pgEntrySize(PG_LEAF, PG_ENTRY(pLeaf, i));
+		iMerge = (pLeaf->ui16Count == 1) || ((aPath[iDepth - 1].iChild > 0) /* left sibling under same parent */
+		&& ((PG_ROOM - PG_FREE_BYTES(pLeaf) - sizeT - sizeof(uint16_t)) < PG_ROOM / 4));
+		if(iMerge) { /* neighbours relinked around leaf */
+			if((pLeaf->ui32Prev != 0) && ((pPrev = pgFetch(pPool, pLeaf->ui32Prev, 1)) == NULL))
+				iFailed = 1;
+			if((pLeaf->ui32Next != 0) && ((pNext = pgFetch(pPool, pLeaf->ui32Next, 1)) == NULL))
+				iFailed = 1;
+			if((pLeaf->ui16Count > 1) && (iFailed || (PG_FREE_BYTES(pPrev) < PG_ROOM - PG_FREE_BYTES(pLeaf) - sizeT - sizeof(uint16_t))))
+				iMerge = iFailed = 0; /* left alone, merge was only for space */
+		}
+	}
+	if(iFound && !iFailed) {
+		pgRemove(pPool, pLeaf, i);
+		pTree->ulTreeLen--;
+		if((pLeaf->ui16Count == 0) && (iDepth == 0)) {
+			pPool->head.ui32Root = pPool->head.ui32First = pPool->head.ui32Last = pPool->head.ui32Height = 0;
+			pgRelease(pPool, pLeaf);
+			pLeaf = NULL;
+		} else if(iMerge) { /* entries left join the previous leaf, leaf goes */
+			for(i = 0; i < pLeaf->ui16Count; i++)
+				pgPlace(pPool, pPrev, pPrev->ui16Count, PG_ENTRY(pLeaf, i), pgEntrySize(PG_LEAF, PG_ENTRY(pLeaf, i)));
+			if(pPrev != NULL) {
+				pPrev->ui32Next = pLeaf->ui32Next;
+				pgDirty(pPool, pPrev);
+			} else
+				pPool->head.ui32First = pLeaf->ui32Next;
+			if(pNext != NULL) {
+				pNext->ui32Prev = pLeaf->ui32Prev;
+				pgDirty(pPool, pNext);
+			} else
+				pPool->head.ui32Last = pLeaf->ui32Prev;
+			pgRelease(pPool, pLeaf);
+			pLeaf = NULL;
+			pgDropChild(pTree, aPath, iDepth - 1);
+		}
+	}
+	if(pPrev != NULL)
+		pgUnpin(pPool, pPrev);
+	if(pNext != NULL)
+		pgUnpin(pPool, pNext);
+	if(pLeaf != NULL)
+		pgUnpin(pPool, pLeaf);
+	pgUnpinPath(pPool, aPath, iDepth);
+return(iFound && !iFailed);
+}
+
+static void* pgFind(Tree *pTree, const void *pKey) {
+	PgPage *pLeaf = pgDescend(pTree, pKey, NULL, NULL, 0);
+	int i, iFound;
+	if(pLeaf == NULL)
+		return(NULL);
+	i = pgSearch(pTree, pLeaf, pKey, keyPrefix(pTree, pKey), &iFound);
+return(iFound ? PG_VALUE(PG_ENTRY(pLeaf, i)) : NULL);
+}
+
+static uint32_t pgBound(Tree *pTree, const void *pKey, int iBound, int *pi) {
+	PgPool *pPool = pTree->pr;
+	PgPage *pLeaf = pgDescend(pTree, pKey, NULL, NULL, 0);
+	uint32_t ui;
+	int i, iFound;
+	if(pLeaf == NULL)
+		return(0);
+	ui = PG_ID(pPool, pLeaf);
+	i = pgSearch(pTree, pLeaf, pKey, keyPrefix(pTree, pKey), &iFound);
+	if((iBound == BOUND_FLOOR) || (iBound == BOUND_BELOW)) {
+		if((!iFound || (iBound == BOUND_BELOW)) && (--i < 0)) { /* last of previous leaf */
+			if(((ui = pLeaf->ui32Prev) != 0) && ((pLeaf = pgFetch(pPool, ui, 0)) != NULL))
+				i = pLeaf->ui16Count - 1;
+			else
+				ui = 0;
+		}
+	} else {
+		if(iFound && (iBound == BOUND_UPPER))
+			i++;
+		if(i >= pLeaf->ui16Count) {
+			ui = pLeaf->ui32Next;
+			i = 0;
+		}
+	}
+	*pi = i;
+return(ui);
+}
+
+static int pgCursorAt(TreeCursor *pCursor, uint32_t ui, int i, void **ppKey, void **ppValue) {
+	PgPage *pPage;
+	PgEntry *pE;
+	pCursor->pn = NULL;
+	if((ui == 0) || ((pPage = pgFetch(pCursor->pTree->pr, ui, 0)) == NULL) || (pPage->ui16Kind != PG_LEAF))
+		return(0);
+	if(i < 0)
+		i = pPage->ui16Count - 1;
+	if((i < 0) || (i >= pPage->ui16Count)) /* cursor kept across a write */
+		return(0);
+	pE = PG_ENTRY(pPage, i);
+	pCursor->pn = PG_POS(ui, i);
+	if(ppKey != NULL)
+		*ppKey = PG_KEY(pE);
+	if(ppValue != NULL)
+		*ppValue = PG_VALUE(pE);
+return(1);
+}
+
+static int pgCursorStep(TreeCursor *pCursor, int iNext, void **ppKey, void **ppValue) {
+	PgPage *pPage;
+	uint32_t ui = PG_POS_PAGE(pCursor->pn);
+	int i = PG_POS_SLOT(pCursor->pn);
+	if((pCursor->pn == (iNext ? pCursor->pe : pCursor->pb)) || ((pPage = pgFetch(pCursor->pTree->pr, ui, 0)) == NULL))
+		return(pgCursorAt(pCursor, 0, 0, ppKey, ppValue));
+	if(iNext && (++i >= pPage->ui16Count)) {
+		ui = pPage->ui32Next;
+		i = 0;
+	} else if(!iNext && (--i < 0))
+		ui = pPage->ui32Prev;
+return(pgCursorAt(pCursor, ui, i, ppKey, ppValue));
+}
+
+static int pgVerify(Tree *pTree) {
+	PgPool *pPool = pTree->pr;
+	PgHead *pHead = &pPool->head;
+	PgPath aPath[PG_DEPTH_MAX];
+	const char *apcLow[PG_DEPTH_MAX], *apcHigh[PG_DEPTH_MAX], *pcKey, *pcLast;
+	PgPage *pPage;
+	PgEntry *pE;
+	uint32_t ui, uiPrev = 0, uiNext = pHead->ui32First, uiPages = 0;
+	unsigned long ulLen = 0;
+	size_t sizeT;
+	int i, d = 0, iBad = 0;
+	if(pHead->ui32Root != 0) {
+		if((pPage = pgFetch(pPool, pHead->ui32Root, 1)) == NULL)
+			return(TREE_BAD_LINK);
+		aPath[0].pPage = pPage;
+		aPath[0].iChild = -1; /* page itself checked first */
+		apcLow[0] = apcHigh[0] = NULL;
+	} else
+		d = -1;
+	while(d >= 0) {
+		pPage = aPath[d].pPage;
+		if(aPath[d].iChild < 0) { /* entries in place, in order and within separators of parents */
+			aPath[d].iChild = 0;
+			uiPages++;
+			for(i = 0, sizeT = 0, pcLast = apcLow[d]; i < pPage->ui16Count; i++) {
+				if((PG_SLOTS(pPage)[i] < pPage->ui16Low) || (PG_SLOTS(pPage)[i] % 8)
+				|| (PG_SLOTS(pPage)[i] + pgEntrySize(pPage->ui16Kind, PG_ENTRY(pPage, i)) > PG_SIZE)) {
+					iBad |= TREE_BAD_LINK;
+					break;
+				}
+				pE = PG_ENTRY(pPage, i);
+				pcKey = PG_KEY(pE);
+				sizeT += pgEntrySize(pPage->ui16Kind, pE);
+				if(((pcLast != NULL) && (cmpKey(pTree, pcLast, pcKey) > ((i == 0) ? 0 : -1)))
+				|| ((apcHigh[d] != NULL) && (cmpKey(pTree, pcKey, apcHigh[d]) >= 0)))
+					iBad |= TREE_BAD_ORDER;
+				pcLast = pcKey;
+			}
+			if(sizeT != pPage->ui16Used)
+				iBad |= TREE_BAD_LINK;
+			if(pPage->ui16Kind == PG_LEAF) {
+				ui = PG_ID(pPool, pPage);
+				if(((unsigned long)d + 1 != pHead->ui32Height) || (pPage->ui16Count == 0))
+					iBad |= TREE_BAD_BALANCE;
+				if((pPage->ui32Prev != uiPrev) || (ui != uiNext))
+					iBad |= TREE_BAD_LIST;
+				ulLen += pPage->ui16Count;
+				uiPrev = ui;
+				uiNext = pPage->ui32Next;
+			} else if((pPage->ui16Kind != PG_INNER) || ((unsigned long)d + 1 >= pHead->ui32Height))
+				iBad |= TREE_BAD_LINK | TREE_BAD_BALANCE;
+			else if((pPage->ui16Count == 0) && ((d == 0) || (pPage->ui32Prev == 0)))
+				iBad |= TREE_BAD_BALANCE; /* root of one child, or page of none */
+		}
+		if((pPage->ui16Kind != PG_INNER) || ((i = aPath[d].iChild++) > pPage->ui16Count) || (d + 1 >= PG_DEPTH_MAX)) {
+			pgUnpin(pPool, pPage);
+			d--;
+			continue;
+		}
+		ui = (i == 0) ? pPage->ui32Prev : PG_ENTRY(pPage, i - 1)->ui32Link;
+		if((ui == 0) || ((pPage = pgFetch(pPool, ui, 1)) == NULL)) {
+			iBad |= (ui == 0) ? 0 : TREE_BAD_LINK;
+			continue;
+		}
+		aPath[d + 1].pPage = pPage;
+		aPath[d + 1].iChild = -1;
+		apcLow[d + 1] = (i == 0) ? apcLow[d] : PG_KEY(PG_ENTRY(aPath[d].pPage, i - 1));
+		apcHigh[d + 1] = (i == aPath[d].pPage->ui16Count) ? apcHigh[d] : PG_KEY(PG_ENTRY(aPath[d].pPage, i));
+		d++;
+	}
+	if((uiPrev != pHead->ui32Last) || (uiNext != 0))
+		iBad |= TREE_BAD_LIST;
+	if((ulLen != pTree->ulTreeLen) || ((pHead->ui32Root == 0) != (pHead->ui32Height == 0)))
+		iBad |= TREE_BAD_COUNT;
+	for(ui = pHead->ui32Free, i = 0; (ui != 0) && ((uint32_t)i <= pHead->ui32FreeLen); ui = pPage->ui32Next, i++) {
+		if(((pPage = pgFetch(pPool, ui, 0)) == NULL) || (pPage->ui16Kind != PG_FREE)) {
+			iBad |= TREE_BAD_LINK;
+			break;
+		}
+	}
+	if(((uint32_t)i != pHead->ui32FreeLen) || (uiPages + pHead->ui32FreeLen + 1 != pHead->ui32Pages))
+		iBad |= TREE_BAD_COUNT; /* pages lost or counted twice */
+return(iBad);
+}
+
+static inline uint64_t statStart(Tree *pTree) {
+#ifdef TREELIBC_STATS
+	if((pTree != NULL) && (pTree->ps == NULL)) {
+		TreeStats *pNew = calloc(1, sizeof(TreeStats));
+#if defined(__GNUC__) || defined(__clang__)
+		void *pNull = NULL;
+		if((pNew != NULL) && !__atomic_compare_exchange_n(&pTree->ps, &pNull, pNew, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+			free(pNew); /* another reader made them first */
+#else
+		pTree->ps = pNew;
+#endif
+	}
+#if TREELIBC_STATS >= 2
+	return(statClock());
+#endif
+#endif
+return(0);
+}
+
+static inline void statEnd(Tree *pTree, int iOp, uint64_t ui64Start) {
+#ifdef TREELIBC_STATS
+	if(pTree == NULL)
+		return;
+	STAT_ADD(pTree, aullCalls[iOp], 1);
+#if TREELIBC_STATS >= 2
+	{
+		uint64_t ui64Ns = statClock() - ui64Start;
+		int iBucket = 0;
+		for(; (ui64Ns > 1) && (iBucket < TREE_STATS_BUCKETS - 1); ui64Ns >>= 1)
+			iBucket++;
+		STAT_ADD(pTree, aaullLatency[iOp][iBucket], 1);
+	}
+#endif
+#endif
+return;
+}
+
+#if defined(TREELIBC_STATS) && (TREELIBC_STATS >= 2)
+static uint64_t statClock(void) {
+	struct timespec ts;
+#ifdef _WIN32
+	timespec_get(&ts, TIME_UTC);
+#else
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+return(((uint64_t)ts.tv_sec * 1000000000u) + (uint64_t)ts.tv_nsec);
+}
+#endif
+
+static void shapeStats(Tree *pTree, TreeStats *pStats) {
+	unsigned long ul, ulDepth = 1;
+	double dDepths = 0.0;
+	int i;
+	pStats->ulLength = pTree->ulTreeLen;
+	pStats->ulNodes = pStats->ulHeight = 0;
+	pStats->dDepthAvg = 0.0;
+	pStats->sizeTnodes = pStats->sizeTkeys = pStats->sizeTvalues = 0;
+	if(pTree->iMode & TREE_MAPPED) { /* entries and order are the nodes, binary search has no depth */
+		MapEntry *pE = pTree->ph;
+		pStats->sizeTnodes = (size_t)((MapHead*)pTree->pr)->ui64Data;
+		for(ul = 0; ul < pTree->ulTreeLen; ul++) {
+			pStats->sizeTkeys += (size_t)MAP_ALIGN(pE[ul].ui64KeyLen);
+			pStats->sizeTvalues += (pE[ul].ui64Value == 0) ? 0 : (size_t)MAP_ALIGN(pE[ul].ui64ValueLen);
+		}
+	} else if(pTree->iMode & TREE_BPLUS) { /* every key at leaf depth */
+		BpLeaf *pLeaf;
+		BpNode *pN;
+		unsigned long ulInner = 0;
+		for(pN = pTree->pr; pN != NULL; pN = pN->iLeaf ? NULL : ((BpInner*)pN)->apChild[0])
+			pStats->ulHeight++;
+		for(pLeaf = pTree->ph; pLeaf != NULL; pLeaf = pLeaf->pNext) {
+			pStats->ulNodes++;
+			for(i = 0; i < pLeaf->h.iCount; i++) {
+				pStats->sizeTkeys += (pLeaf->asizeTkey[i] == 0) ? 0 : pLeaf->asizeTkey[i] + 1;
+				pStats->sizeTvalues += ((pLeaf->asizeTvalue[i] == 0) || (pLeaf->apValue[i] == NULL)) ? 0 : pLeaf->asizeTvalue[i] + 1;
+			}
+		}
+		if(pStats->ulHeight > 1) { /* depth first as bpFreeInner() */
+			BpPath aPath[BP_DEPTH_MAX];
+			int d = 0;
+			aPath[0].pInner = pTree->pr;
+			aPath[0].iChild = 0;
+			ulInner = 1;
+			while(d >= 0) {
+				BpInner *pIn = aPath[d].pInner;
+				if((i = aPath[d].iChild++) > pIn->h.iCount)
+					d--;
+				else if(!pIn->apChild[i]->iLeaf) {
+					ulInner++;
+					aPath[++d].pInner = (BpInner*)pIn->apChild[i];
+					aPath[d].iChild = 0;
+				}
+			}
+		}
+		pStats->sizeTnodes = (pStats->ulNodes * sizeof(BpLeaf)) + (ulInner * sizeof(BpInner));
+		pStats->ulNodes += ulInner;
+		pStats->dDepthAvg = (pTree->ulTreeLen == 0) ? 0.0 : (double)pStats->ulHeight;
+	} else if(pTree->iMode & TREE_PAGED) { /* pages counted from head, none read, keys and values live in them */
+		PgHead *pHead = &((PgPool*)pTree->pr)->head;
+		pStats->ulNodes = pHead->ui32Pages - 1 - pHead->ui32FreeLen;
+		pStats->ulHeight = pHead->ui32Height;
+		pStats->dDepthAvg = (pTree->ulTreeLen == 0) ? 0.0 : (double)pStats->ulHeight;
+		pStats->sizeTnodes = (size_t)pStats->ulNodes * PG_SIZE;
+	} else if(pTree->iMode & TREE_COMPACT) { /* node array, copies carry their holders and length before them */
+		CpTree *pC = pTree->pr;
+		CpIter iter;
+		CpNode *pN;
+		uint32_t ui;
+		int iDepth;
+		for(cpIterStart(&iter, pC, (pC == NULL) ? 0 : pC->ui32Root); (ui = cpIterNext(&iter, &iDepth)) != 0; ) {
+			pN = CP_NODE(pC, ui);
+			pStats->ulNodes++;
+			dDepths += iDepth;
+			if((unsigned long)iDepth > pStats->ulHeight)
+				pStats->ulHeight = iDepth;
+			if(pN->ui32Left & CP_KEY_COPY)
+				pStats->sizeTkeys += (2 * sizeof(size_t)) + CP_COPY_LEN(pN->key.p) + 1;
+			if(CP_KIND(pN) == CP_VALUE_COPY)
+				pStats->sizeTvalues += (2 * sizeof(size_t)) + CP_COPY_LEN(pN->value.p) + 1;
+		}
+		pStats->sizeTnodes = pStats->ulNodes * sizeof(CpNode);
+		pStats->dDepthAvg = (pStats->ulNodes == 0) ? 0.0 : dDepths / pStats->ulNodes;
+	} else { /* each node once, down then back up parent links */
+		Node *pNode = pTree->pr, *pFrom = NULL, *pTo;
+		while(pNode != NULL) {
+			if(pFrom == pNode->pParent) {
+				pStats->ulNodes++;
+				dDepths += ulDepth;
+				if(ulDepth > pStats->ulHeight)
+					pStats->ulHeight = ulDepth;
+				if((pNode->sizeTkey > 0) && (pNode->pKey != (void*)KEY_INLINE(pTree, pNode)))
+					pStats->sizeTkeys += pNode->sizeTkey + 1;
+				if((pNode->sizeTvalue > 0) && (pNode->pValue != NULL) && (pNode->pValue != (void*)VALUE_INLINE(pTree, pNode)))
+					pStats->sizeTvalues += pNode->sizeTvalue + 1;
+				pTo = (pNode->pLeft != NULL) ? pNode->pLeft : (pNode->pRight != NULL) ? pNode->pRight : pNode->pParent;
+			} else if((pFrom == pNode->pLeft) && (pNode->pRight != NULL))
+				pTo = pNode->pRight;
+			else
+				pTo = pNode->pParent;
+			if(pTo == pNode->pParent)
+				ulDepth--;
+			else
+				ulDepth++;
+			pFrom = pNode;
+			pNode = pTo;
+		}
+		pStats->sizeTnodes = pStats->ulNodes * ((pTree->iMode & TREE_POOL) ? POOL_NODE_SIZE : sizeof(Node));
+		pStats->dDepthAvg = (pStats->ulNodes == 0) ? 0.0 : dDepths / pStats->ulNodes;
+	}
+return;
+}
+
+static unsigned long buildShape(Node **ppNodes, BuildRange *pRange, unsigned long ulRed, unsigned long ulCut, BuildRange *pCut) {
+	BuildRange aStack[2 * BUILD_DEPTH_MAX], *pS = aStack, range;
+	unsigned long ulIndex, ulCuts = 0;
+	Node *pNode;
+	*pS = *pRange;
+	while(pS >= aStack) { /* middle of each range becomes subtree root, no recursion */
+		range = *pS--;
+		if(range.ulLow >= range.ulHigh) {
+			*range.ppLink = NULL;
+			continue;
+		}
+		if(range.ulDepth == ulCut) {
+			pCut[ulCuts++] = range;
+			continue;
+		}
+		ulIndex = range.ulLow + ((range.ulHigh - range.ulLow) / 2);
+		pNode = *range.ppLink = ppNodes[ulIndex];
+		pNode->pParent = range.pParent;
+		pNode->ulSize = range.ulHigh - range.ulLow;
+		pNode->color = (range.ulDepth == ulRed) ? NODE_RED : NODE_BLACK;
+		pS++;
+		pS->ulLow = range.ulLow; pS->ulHigh = ulIndex; pS->ulDepth = range.ulDepth + 1;
+		pS->pParent = pNode; pS->ppLink = &pNode->pLeft;
+		pS++;
+		pS->ulLow = ulIndex + 1; pS->ulHigh = range.ulHigh; pS->ulDepth = range.ulDepth + 1;
+		pS->pParent = pNode; pS->ppLink = &pNode->pRight;
+	}
+return(ulCuts);
+}
+
+static int parThreads(int iThreads) {
+#ifdef CONCURRENT_OK
+	long lCores;
+	if(iThreads <= 0) {
+		lCores = sysconf(_SC_NPROCESSORS_ONLN);
+		iThreads = (lCores < 1) ? 1 : (lCores > PAR_THREADS_MAX) ? PAR_THREADS_MAX : (int)lCores;
+	}
+return((iThreads > PAR_THREADS_MAX) ? PAR_THREADS_MAX : iThreads);
+#else
+return(1);
+#endif
+}
+
+static int parStart(ParJob *pJob, Tree *pTree, int iThreads, void (*pfPiece)(ParJob *, ParPiece *)) {
+	unsigned long ul, ulWant, ulMax, ulDepth = 0;
+	memset(pJob, 0, sizeof(ParJob));
+	pJob->pTree = pTree;
+	pJob->pfPiece = pfPiece;
+	pJob->iThreads = parThreads(iThreads);
+	ulWant = pTree->ulTreeLen / PAR_GRAIN; /* small trees are one piece */
+	if(ulWant > (unsigned long)pJob->iThreads * PAR_PIECES)
+		ulWant = (unsigned long)pJob->iThreads * PAR_PIECES;
+	if(ulWant == 0)
+		ulWant = 1;
+	if(pTree->iMode & TREE_PAGED) { /* one piece on the calling thread, frames are not shared */
+		pJob->iThreads = 1;
+		if((pJob->pPieces = calloc(1, sizeof(ParPiece))) == NULL)
+			return(0);
+		pJob->ulPieces = 1;
+	} else if(pTree->iMode & TREE_MAPPED) { /* index ranges of the sorted entries */
+		if((pJob->pPieces = calloc(ulWant, sizeof(ParPiece))) == NULL)
+			return(0);
+		for(ul = 0; ul < ulWant; ul++) {
+			pJob->pPieces[ul].ulFirst = (pTree->ulTreeLen / ulWant) * ul;
+			pJob->pPieces[ul].ulLen = (ul + 1 < ulWant) ? pTree->ulTreeLen / ulWant : pTree->ulTreeLen - pJob->pPieces[ul].ulFirst;
+		}
+		pJob->ulPieces = ulWant;
+	} else if(pTree->iMode & TREE_BPLUS) { /* whole levels of inner nodes until enough, then runs of their leaves */
+		BpNode **ppLevel = NULL, **ppMore;
+		unsigned long ulLen = 1, ulNext;
+		int i;
+		if((ppLevel = malloc(sizeof(BpNode*))) == NULL)
+			return(0);
+		ppLevel[0] = pTree->pr;
+		while((ulLen < ulWant) && !ppLevel[0]->iLeaf) {
+			for(ul = 0, ulNext = 0; ul < ulLen; ul++)
+				ulNext += ppLevel[ul]->iCount + 1;
+			if((ppMore = realloc(ppLevel, ulNext * sizeof(BpNode*))) == NULL) {
+				free(ppLevel);
+				return(0);
+			}
+			ppLevel = ppMore;
+			for(ul = ulLen, ulLen = ulNext; ul-- > 0; ) { /* back to front, children never land on a parent not yet read */
+				BpInner *pInner = (BpInner*)ppLevel[ul];
+				for(i = pInner->h.iCount; i >= 0; i--)
+					ppLevel[--ulNext] = pInner->apChild[i];
+			}
+		}
+		if(ulWant > ulLen)
+			ulWant = ulLen;
+		if((pJob->pPieces = calloc(ulWant, sizeof(ParPiece))) == NULL) {
+			free(ppLevel);
+			return(0);
+		}
+		for(ul = 0; ul < ulWant; ul++) { /* leftmost leaf of first node in each run */
+			BpNode *pNode = ppLevel[(ulLen / ulWant) * ul + ((ul < ulLen % ulWant) ? ul : ulLen % ulWant)];
+			while(!pNode->iLeaf)
+				pNode = ((BpInner*)pNode)->apChild[0];
+			pJob->pPieces[ul].pStart = pNode;
+			if(ul > 0)
+				pJob->pPieces[ul - 1].pEnd = pNode;
+		}
+		free(ppLevel);
+		pJob->ulPieces = ulWant;
+	} else {
+		for(; (1UL << ulDepth) < ulWant; ulDepth++);
+		ulMax = 2UL << ulDepth;
+		if((pJob->pPieces = calloc(ulMax, sizeof(ParPiece))) == NULL)
+			return(0);
+		if(pTree->iMode & TREE_COMPACT) /* no sizes, subtrees at cut depth whatever they hold */
+			pJob->ulPieces = parSplitCP(pTree->pr, ((CpTree*)pTree->pr)->ui32Root, (int)ulDepth, pJob->pPieces, 0);
+		else
+			pJob->ulPieces = parSplitRB(pTree->pr, 0, (int)ulDepth, pJob->pPieces, 0);
+	}
+return(1);
+}
+
+static unsigned long parSplitRB(Node *pNode, unsigned long ulFirst, int iDepth, ParPiece *pPieces, unsigned long ulAt) {
+	if(pNode == NULL)
+		return(ulAt);
+	if((iDepth == 0) || (pNode->ulSize < 2 * PAR_GRAIN)) { /* whole subtree */
+		pPieces[ulAt].pStart = pNode;
+		pPieces[ulAt].ulFirst = ulFirst;
+		pPieces[ulAt].ulLen = pNode->ulSize;
+		return(ulAt + 1);
+	}
+	ulAt = parSplitRB(pNode->pLeft, ulFirst, iDepth - 1, pPieces, ulAt);
+	pPieces[ulAt].pStart = pNode; /* node alone between its subtrees keeps pieces in key order */
+	pPieces[ulAt].ulFirst = ulFirst + SIZE(pNode->pLeft);
+	pPieces[ulAt].ulLen = 1;
+	pPieces[ulAt].iSingle = 1;
+return(parSplitRB(pNode->pRight, ulFirst + SIZE(pNode->pLeft) + 1, iDepth - 1, pPieces, ulAt + 1));
+}
+
+static unsigned long parSplitCP(CpTree *pC, uint32_t ui, int iDepth, ParPiece *pPieces, unsigned long ulAt) {
+	if(ui == 0)
+		return(ulAt);
+	pPieces[ulAt].pStart = (void*)(uintptr_t)ui; /* node index */
+	if(iDepth == 0)
+		return(ulAt + 1);
+	ulAt = parSplitCP(pC, CP_LEFT(CP_NODE(pC, ui)), iDepth - 1, pPieces, ulAt);
+	pPieces[ulAt].pStart = (void*)(uintptr_t)ui;
+	pPieces[ulAt].iSingle = 1;
+return(parSplitCP(pC, CP_RIGHT(CP_NODE(pC, ui)), iDepth - 1, pPieces, ulAt + 1));
+}
+
+static void parRun(ParJob *pJob) {
+	ParQueue queue, *pQueues = &queue;
+	ParWorker aWorkers[PAR_THREADS_MAX];
+	int i, iWorkers = pJob->iThreads;
+#ifdef CONCURRENT_OK
+	pthread_t aThreads[PAR_THREADS_MAX];
+	int iStarted = 1;
+#endif
+	if((unsigned long)iWorkers > pJob->ulPieces)
+		iWorkers = (int)pJob->ulPieces;
+	if(iWorkers < 1)
+		iWorkers = 1;
+#ifndef CONCURRENT_OK
+	iWorkers = 1;
+#endif
+	if((iWorkers > 1) && ((pQueues = calloc(iWorkers, sizeof(ParQueue))) == NULL)) {
+		pQueues = &queue; /* calling thread does it all */
+		iWorkers = 1;
+	}
+	pJob->pQueues = pQueues;
+	pJob->iWorkers = iWorkers;
+	for(i = 0; i < iWorkers; i++) { /* contiguous runs keep neighbouring pieces on one core */
+		pQueues[i].ulNext = (pJob->ulPieces * i) / iWorkers;
+		pQueues[i].ulEnd = (pJob->ulPieces * (i + 1)) / iWorkers;
+#ifdef CONCURRENT_OK
+		pthread_mutex_init(&pQueues[i].mutex, NULL);
+#endif
+		aWorkers[i].pJob = pJob;
+		aWorkers[i].iWorker = i;
+	}
+#ifdef CONCURRENT_OK
+	for(; (iStarted < iWorkers) && (pthread_create(&aThreads[iStarted], NULL, parWork, &aWorkers[iStarted]) == 0); iStarted++);
+	parWork(&aWorkers[0]); /* pieces of threads that failed to start are stolen */
+	for(i = 1; i < iStarted; i++)
+		pthread_join(aThreads[i], NULL);
+	for(i = 0; i < iWorkers; i++)
+		pthread_mutex_destroy(&pQueues[i].mutex);
+#else
+	parWork(&aWorkers[0]);
+#endif
+	if(pQueues != &queue)
+		free(pQueues);
+	pJob->pQueues = NULL;
+return;
+}
+
+static void* parWork(void *pArg) {
+	ParWorker *pWorker = pArg;
+	unsigned long ulPiece;
+	while(parTake(pWorker->pJob, pWorker->iWorker, &ulPiece))
+		pWorker->pJob->pfPiece(pWorker->pJob, &pWorker->pJob->pPieces[ulPiece]);
+return(NULL);
+}
+
+static int parTake(ParJob *pJob, int iWorker, unsigned long *pulPiece) {
+	ParQueue *pQueue;
+	int i, iTaken = 0;
+	for(i = 0; !iTaken && (i < pJob->iWorkers); i++) { /* own queue first, then steal from the next ones round */
+		pQueue = &pJob->pQueues[(iWorker + i) % pJob->iWorkers];
+#ifdef CONCURRENT_OK
+		pthread_mutex_lock(&pQueue->mutex);
+#endif
+		if(pQueue->ulNext < pQueue->ulEnd) {
+			*pulPiece = (i == 0) ? pQueue->ulNext++ : --pQueue->ulEnd;
+			iTaken = 1;
+		}
+#ifdef CONCURRENT_OK
+		pthread_mutex_unlock(&pQueue->mutex);
+#endif
+	}
+return(iTaken);
+}
+
+static void parVisit(ParJob *pJob, ParPiece *pPiece) {
+	Tree *pTree = pJob->pTree;
+	void *pAcc = (pJob->pcAcc == NULL) ? NULL : pJob->pcAcc + ((pPiece - pJob->pPieces) * pJob->sizeTstride);
+	unsigned long ul = pPiece->ulFirst;
+	if(pTree->iMode & TREE_MAPPED) {
+		MapEntry *pE = (MapEntry*)pTree->ph + ul;
+		for(; ul < pPiece->ulFirst + pPiece->ulLen; ul++, pE++)
+			parKey(pJob, pAcc, ul, (char*)pTree->pr + pE->ui64Key, (pE->ui64Value == 0) ? NULL : (char*)pTree->pr + pE->ui64Value);
+	} else if(pTree->iMode & TREE_PAGED) {
+		PgPool *pPool = pTree->pr;
+		PgPage *pPage;
+		uint32_t ui;
+		int i;
+		for(ui = pPool->head.ui32First; (ui != 0) && ((pPage = pgFetch(pPool, ui, 1)) != NULL); ui = pPage->ui32Next) {
+			for(i = 0; i < pPage->ui16Count; i++) /* leaf pinned, visitor may read the tree */
+				parKey(pJob, pAcc, 0, PG_KEY(PG_ENTRY(pPage, i)), PG_VALUE(PG_ENTRY(pPage, i)));
+			pgUnpin(pPool, pPage);
+		}
+	} else if(pTree->iMode & TREE_BPLUS) {
+		BpLeaf *pLeaf;
+		int i;
+		for(pLeaf = pPiece->pStart; pLeaf != pPiece->pEnd; pLeaf = pLeaf->pNext) {
+			for(i = 0; i < pLeaf->h.iCount; i++)
+				parKey(pJob, pAcc, 0, pLeaf->apKey[i], pLeaf->apValue[i]);
+		}
+	} else if(pTree->iMode & TREE_COMPACT) {
+		CpIter iter;
+		CpNode *pN;
+		uint32_t ui = (uint32_t)(uintptr_t)pPiece->pStart;
+		if(pPiece->iSingle) {
+			pN = CP_NODE((CpTree*)pTree->pr, ui);
+			parKey(pJob, pAcc, 0, CP_KEY(pTree, pN), CP_VALUE(pN));
+		} else {
+			for(cpIterStart(&iter, pTree->pr, ui); (ui = cpIterNext(&iter, NULL)) != 0; ) {
+				pN = CP_NODE((CpTree*)pTree->pr, ui);
+				parKey(pJob, pAcc, 0, CP_KEY(pTree, pN), CP_VALUE(pN));
+			}
+		}
+	} else if(pPiece->iSingle)
+		parKey(pJob, pAcc, ul, ((Node*)pPiece->pStart)->pKey, ((Node*)pPiece->pStart)->pValue);
+	else {
+		Node *pNode = edgeNode(pPiece->pStart, 0), *pLast = edgeNode(pPiece->pStart, 1);
+		for(;; pNode = stepNode(pNode, 1)) { /* stepping from the last node would climb out of the piece */
+			parKey(pJob, pAcc, ul++, pNode->pKey, pNode->pValue);
+			if(pNode == pLast)
+				break;
+		}
+	}
+return;
+}
+
+static void parKey(ParJob *pJob, void *pAcc, unsigned long ulIndex, void *pKey, void *pValue) {
+	if(pJob->ppOut != NULL)
+		pJob->ppOut[ulIndex] = pKey;
+	else if(pAcc != NULL)
+		pJob->pfReduce(pAcc, pKey, pValue, pJob->pArg);
+	else
+		pJob->pfVisit(pKey, pValue, pJob->pArg);
+return;
+}
+
+static void parRelease(ParJob *pJob, ParPiece *pPiece) {
+	Node *pNode = pPiece->pStart, *pParent;
+	if(pPiece->iSingle) { /* its subtrees are other pieces */
+		parFreeNode(pJob->pTree, pNode);
+		return;
+	}
+	for(;;) { /* leaves first, links above the piece belong to others */
+		if(pNode->pLeft != NULL)
+			pNode = pNode->pLeft;
+		else if(pNode->pRight != NULL)
+			pNode = pNode->pRight;
+		else {
+			if(pNode == pPiece->pStart)
+				break;
+			pParent = pNode->pParent;
+			if(pParent->pLeft == pNode)
+				pParent->pLeft = NULL;
+			else
+				pParent->pRight = NULL;
+			parFreeNode(pJob->pTree, pNode);
+			pNode = pParent;
+		}
+	}
+	parFreeNode(pJob->pTree, pNode);
+return;
+}
+
+static void parFreeNode(Tree *pTree, Node *pNode) {
+	if((pNode->pKey != NULL) && (pNode->sizeTkey > 0) && (pNode->pKey != (void*)KEY_INLINE(pTree, pNode)))
+		free(pNode->pKey);
+	if((pNode->pValue != NULL) && (pNode->sizeTvalue > 0) && (pNode->pValue != (void*)VALUE_INLINE(pTree, pNode)))
+		free(pNode->pValue);
+	if(!(pTree->iMode & TREE_POOL))
+		free(pNode);
+return;
+}
+
+static void parMake(ParJob *pJob, ParPiece *pPiece) {
+	unsigned long ul;
+	for(ul = pPiece->ulFirst; ul < pPiece->ulFirst + pPiece->ulLen; ul++) {
+		pJob->ppNodes[ul] = makeNode(
+			pJob->pTree, pJob->ppKeys[ul], (pJob->pSizeTkeys == NULL) ? 0 : pJob->pSizeTkeys[ul],
+			(pJob->ppValues == NULL) ? NULL : pJob->ppValues[ul], (pJob->pSizeTvalues == NULL) ? 0 : pJob->pSizeTvalues[ul]
+		);
+		if(pJob->ppNodes[ul] == NULL)
+			pPiece->iFailed = 1;
+	}
+return;
+}
+
+static void parLink(ParJob *pJob, ParPiece *pPiece) {
+	buildShape(pJob->ppNodes, &pPiece->range, pJob->ulRed, ULONG_MAX, NULL);
+return;
+}
+
+static void parKeys(ParJob *pJob, ParPiece *pPiece) {
+	unsigned long ul;
+	for(ul = pPiece->ulFirst; ul < pPiece->ulFirst + pPiece->ulLen; ul++) /* node buffer becomes the sorted array in place */
+		pJob->pTree->ppArraySorted[ul] = pJob->ppNodes[ul]->pKey;
+return;
+}
+
+static void parSet(ParJob *pJob, ParPiece *pPiece) {
+	setRun(pPiece->pSet);
+return;
+}
+
+static int setFits(Tree *pTree, Tree *pOther) {
+	int iNot = TREE_POOL | TREE_BPLUS | TREE_CONCURRENT | TREE_MAPPED | TREE_COMPACT | TREE_PAGED; /* nodes of pools go with their slabs */
+	if((pTree == NULL) || (pTree->iMode & iNot) || (pTree->px != NULL) || (pTree->pe != NULL))
+		return(0);
+	if(pOther == NULL)
+		return(1);
+return((pOther != pTree) && !(pOther->iMode & iNot) && (pOther->px == NULL) && (pOther->pe == NULL)
+	&& (pOther->iKey == pTree->iKey) && (pOther->pfCmp == pTree->pfCmp) && (pOther->sizeTcmp == pTree->sizeTcmp));
+}
+
+static void setStart(SetJob *pJob, Tree *pTree, Tree *pOther, int iOp) {
+	memcpy(&pJob->tree, pTree, sizeof(Tree));
+	pJob->iOp = iOp;
+	pJob->aPart[0].pRoot = pTree->pr;
+	pJob->aPart[0].ulHeight = rbHeight(pTree->pr);
+	pJob->aPart[1].pRoot = pOther->pr;
+	pJob->aPart[1].ulHeight = rbHeight(pOther->pr);
+	pJob->apDrop[0] = pJob->apDrop[1] = NULL;
+return;
+}
+
+static void setFree(Tree *pTree, Tree *pOther, SetJob *pJob) {
+	Node *pNode, *pNext;
+	int i;
+	for(i = 0; i < 2; i++) {
+		for(pNode = pJob->apDrop[i]; pNode != NULL; pNode = pNext) {
+			pNext = pNode->pRight;
+			resetList((i == 0) ? pTree : pOther, pNode);
+			releaseNode((i == 0) ? pTree : pOther, pNode);
+		}
+		pJob->apDrop[i] = NULL;
+	}
+return;
+}
+
+static void setEnd(Tree *pTree, Tree *pOther, SetPart *pResult) {
+	Node *pRoot = pResult->pRoot;
+	if(pRoot != NULL) {
+		pRoot->pParent = NULL;
+		pRoot->color = NODE_BLACK;
+	}
+	if(pOther->ph != NULL) { /* nodes left in other follow tree's in insertion order */
+		if(pTree->ph == NULL)
+			pTree->ph = pOther->ph;
+		else {
+			((Node*)pTree->pt)->pNext = pOther->ph;
+			((Node*)pOther->ph)->pPrev = pTree->pt;
+		}
+		pTree->pt = pOther->pt;
+	}
+	pTree->pr = pRoot;
+	pTree->ulTreeLen = SIZE(pRoot);
+	pTree->iStale = pOther->iStale = STALE_ARRAY | STALE_SORTED;
+	pOther->pr = pOther->ph = pOther->pt = NULL;
+	pOther->ulTreeLen = 0;
+return;
+}
+
+static int setMerge(Tree *pTree, Tree *pOther, int iOp, int iThreads) {
+	SetJob set;
+	SetSlot *pSlots, *pS;
+	ParJob job;
+	unsigned long ul, ulSlots = 1, ulWant, ulPieces = 0;
+	if(!setFits(pTree, pOther))
+		return(0);
+	setStart(&set, pTree, pOther, iOp);
+	iThreads = parThreads(iThreads);
+	ulWant = (pTree->ulTreeLen + pOther->ulTreeLen) / PAR_GRAIN; /* small merges stay on the calling thread */
+	if(ulWant > (unsigned long)iThreads * PAR_PIECES)
+		ulWant = (unsigned long)iThreads * PAR_PIECES;
+	while(ulSlots < ulWant)
+		ulSlots *= 2;
+	if((iThreads < 2) || (ulSlots < 2) || ((pSlots = calloc(2 * ulSlots, sizeof(SetSlot))) == NULL)) {
+		setRun(&set);
+		setFree(pTree, pOther, &set);
+		setEnd(pTree, pOther, &set.aPart[0]);
+		return(1);
+	}
+	memcpy(&pSlots[1].job, &set, sizeof(SetJob));
+	pSlots[1].iUsed = 1;
+	for(ul = 1; ul < 2 * ulSlots; ul++) { /* top levels divided here, halves below the cut or too small are pieces */
+		pS = &pSlots[ul];
+		if(pS->iUsed == 0)
+			continue;
+		if((ul < ulSlots) && (pS->job.aPart[0].pRoot != NULL) && (pS->job.aPart[1].pRoot != NULL)
+		&& (SIZE(pS->job.aPart[0].pRoot) + SIZE(pS->job.aPart[1].pRoot) >= 2 * PAR_GRAIN)
+		&& setStep(&pS->job, &pS->job.aPart[0], &pS->job.aPart[1], &pS->frame)) {
+			pS->iUsed = 2;
+			setStart(&pSlots[2 * ul].job, pTree, pOther, iOp);
+			setStart(&pSlots[(2 * ul) + 1].job, pTree, pOther, iOp);
+			memcpy(pSlots[2 * ul].job.aPart, pS->job.aPart, sizeof(pS->job.aPart));
+			memcpy(pSlots[(2 * ul) + 1].job.aPart, pS->frame.aRight, sizeof(pS->frame.aRight));
+			pSlots[2 * ul].iUsed = pSlots[(2 * ul) + 1].iUsed = 1;
+		} else
+			ulPieces++;
+	}
+	memset(&job, 0, sizeof(ParJob));
+	job.pTree = pTree;
+	job.pfPiece = parSet;
+	job.iThreads = iThreads;
+	if((job.pPieces = calloc(ulPieces, sizeof(ParPiece))) != NULL) {
+		for(ul = 1; ul < 2 * ulSlots; ul++) {
+			if(pSlots[ul].iUsed == 1)
+				job.pPieces[job.ulPieces++].pSet = &pSlots[ul].job;
+		}
+		parRun(&job);
+		free(job.pPieces);
+	} else { /* calling thread does it all */
+		for(ul = 1; ul < 2 * ulSlots; ul++) {
+			if(pSlots[ul].iUsed == 1)
+				setRun(&pSlots[ul].job);
+		}
+	}
+	for(ul = ulSlots - 1; ul > 0; ul--) { /* halves joined back up */
+		if(pSlots[ul].iUsed == 2) {
+			pSlots[ul].frame.left = pSlots[2 * ul].job.aPart[0];
+			pSlots[ul].job.aPart[0] = pSlots[(2 * ul) + 1].job.aPart[0];
+			setJoin(&pSlots[ul].job, &pSlots[ul].frame, &pSlots[ul].job.aPart[0]);
+		}
+	}
+	for(ul = 1; ul < 2 * ulSlots; ul++)
+		setFree(pTree, pOther, &pSlots[ul].job);
+	setEnd(pTree, pOther, &pSlots[1].job.aPart[0]);
+	free(pSlots);
+return(1);
+}
+
+static void setRun(SetJob *pJob) {
+	SetFrame aFrames[SET_DEPTH_MAX], *pFrame;
+	SetPart *pA = &pJob->aPart[0], *pB = &pJob->aPart[1];
+	int iDepth = 0;
+	for(;;) {
+		while(setStep(pJob, pA, pB, &aFrames[iDepth])) /* left halves first, each level one lower in a tree */
+			aFrames[iDepth++].iLeft = 0;
+		for(;;) { /* merged halves in pA go up until a right half is still to do */
+			if(iDepth == 0)
+				return;
+			pFrame = &aFrames[iDepth - 1];
+			if(!pFrame->iLeft)
+				break;
+			setJoin(pJob, pFrame, pA);
+			iDepth--;
+		}
+		pFrame->left = *pA;
+		pFrame->iLeft = 1;
+		*pA = pFrame->aRight[0];
+		*pB = pFrame->aRight[1];
+	}
+}
+
+static int setStep(SetJob *pJob, SetPart *pA, SetPart *pB, SetFrame *pFrame) {
+	SetPart *pPivot, *pCut;
+	Node *pKey, *pFound;
+	int iSide = (pJob->iOp == SET_DIFFERENCE); /* part whose root divides, the other is split at its key */
+	if((pA->pRoot == NULL) || (pB->pRoot == NULL)) { /* one side empty, the other kept whole or dropped */
+		if(pJob->iOp == SET_UNION) {
+			if(pA->pRoot == NULL)
+				*pA = *pB;
+		} else if(pA->pRoot == NULL)
+			setDrop(pJob, 1, pB->pRoot, 1);
+		else if(pJob->iOp == SET_INTERSECT) {
+			setDrop(pJob, 0, pA->pRoot, 1);
+			pA->pRoot = NULL;
+			pA->ulHeight = 0;
+		}
+		return(0);
+	}
+	pPivot = iSide ? pB : pA;
+	pCut = iSide ? pA : pB;
+	pKey = pPivot->pRoot;
+	pFound = rbSplit(&pJob->tree, pCut, pKey->pKey, pKey->ui64Prefix, pCut, &pFrame->aRight[!iSide]);
+	pFrame->aRight[iSide].pRoot = pKey->pRight;
+	pFrame->aRight[iSide].ulHeight = pPivot->ulHeight - (pKey->color == NODE_BLACK);
+	pPivot->pRoot = pKey->pLeft;
+	pPivot->ulHeight = pFrame->aRight[iSide].ulHeight;
+	pFrame->pKey = NULL;
+	if(pFound != NULL) /* other's match of tree's root, or tree's match of other's root for difference */
+		setDrop(pJob, !iSide, pFound, 0);
+	if(iSide || ((pJob->iOp == SET_INTERSECT) && (pFound == NULL)))
+		setDrop(pJob, iSide, pKey, 0);
+	else
+		pFrame->pKey = pKey;
+return(1);
+}
+
+static void setJoin(SetJob *pJob, SetFrame *pFrame, SetPart *pRight) {
+	if(pFrame->pKey != NULL)
+		rbJoin(&pJob->tree, &pFrame->left, pFrame->pKey, pRight, pRight);
+	else
+		rbJoin2(&pJob->tree, &pFrame->left, pRight, pRight);
+return;
+}
+
+static void setDrop(SetJob *pJob, int iOwner, Node *pNode, int iWhole) {
+	Node *pNext;
+	if(!iWhole)
+		pNode->pLeft = pNode->pRight = NULL;
+	while(pNode != NULL) { /* left children rotated up until none, then node onto chain and on to its right */
+		if((pNext = pNode->pLeft) != NULL) {
+			pNode->pLeft = pNext->pRight;
+			pNext->pRight = pNode;
+		} else {
+			pNext = pNode->pRight;
+			pNode->pRight = pJob->apDrop[iOwner];
+			pJob->apDrop[iOwner] = pNode;
+		}
+		pNode = pNext;
+	}
+return;
+}
+
+static unsigned long rbHeight(Node *pNode) {
+	unsigned long ulHeight = 0;
+	for(; pNode != NULL; pNode = pNode->pLeft)
+		ulHeight += (pNode->color == NODE_BLACK);
+return(ulHeight);
+}
+
+static void rbJoin(Tree *pTree, SetPart *pLeft, Node *pKey, SetPart *pRight, SetPart *pOut) {
+	Node *pL = pLeft->pRoot, *pR = pRight->pRoot, *pTall, *pShort, *pNode, *pParent = NULL;
+	unsigned long ulL = pLeft->ulHeight, ulR = pRight->ulHeight, ulHeight;
+	int iRight;
+	if(pL != NULL) { /* roots made black, heights one more where red */
+		pL->pParent = NULL;
+		ulL += (pL->color == NODE_RED);
+		pL->color = NODE_BLACK;
+	}
+	if(pR != NULL) {
+		pR->pParent = NULL;
+		ulR += (pR->color == NODE_RED);
+		pR->color = NODE_BLACK;
+	}
+	if(ulL == ulR) { /* node becomes black root over both */
+		pKey->pParent = NULL;
+		pKey->pLeft = pL;
+		pKey->pRight = pR;
+		if(pL != NULL)
+			pL->pParent = pKey;
+		if(pR != NULL)
+			pR->pParent = pKey;
+		pKey->color = NODE_BLACK;
+		pKey->ulSize = SIZE(pL) + SIZE(pR) + 1;
+		pOut->pRoot = pKey;
+		pOut->ulHeight = ulL + 1;
+		return;
+	}
+	iRight = (ulL > ulR); /* down right edge of taller left, or left edge of taller right */
+	pTall = iRight ? pL : pR;
+	pShort = iRight ? pR : pL;
+	pOut->ulHeight = ulHeight = iRight ? ulL : ulR;
+	for(pNode = pTall; (pNode != NULL) && ((pNode->color == NODE_RED) || (ulHeight > (iRight ? ulR : ulL)));) {
+		ulHeight -= (pNode->color == NODE_BLACK); /* to black node as high as shorter tree */
+		pNode->ulSize += SIZE(pShort) + 1;
+		pParent = pNode;
+		pNode = iRight ? pNode->pRight : pNode->pLeft;
+	}
+	if(iRight)
+		pParent->pRight = pKey;
+	else
+		pParent->pLeft = pKey;
+	pKey->pParent = pParent;
+	pKey->pLeft = iRight ? pNode : pShort;
+	pKey->pRight = iRight ? pShort : pNode;
+	if(pNode != NULL)
+		pNode->pParent = pKey;
+	if(pShort != NULL)
+		pShort->pParent = pKey;
+	pKey->color = NODE_RED;
+	pKey->ulSize = SIZE(pNode) + SIZE(pShort) + 1;
+	pTree->pr = pTall;
+	balanceTree(pTree, pKey); /* red node fixed up as an insert, root left red when recoloring reached it */
+	pOut->pRoot = pTree->pr;
+	pOut->ulHeight += (pOut->pRoot->color == NODE_RED);
+	pOut->pRoot->color = NODE_BLACK;
+return;
+}
+
+static void rbJoin2(Tree *pTree, SetPart *pLeft, SetPart *pRight, SetPart *pOut) {
+	SetPart rest;
+	Node *pKey;
+	if(pRight->pRoot == NULL) {
+		*pOut = *pLeft;
+		return;
+	}
+	if(pLeft->pRoot == NULL) {
+		*pOut = *pRight;
+		return;
+	}
+	pTree->pr = pRight->pRoot;
+	pRight->pRoot->pParent = NULL;
+	pKey = edgeNode(pTree->pr, 0);
+	cutNode(pTree, pKey);
+	rest.pRoot = pTree->pr;
+	rest.ulHeight = rbHeight(rest.pRoot);
+	rbJoin(pTree, pLeft, pKey, &rest, pOut);
+return;
+}
+
+static Node* rbSplit(Tree *pTree, SetPart *pWhole, const void *pKey, uint64_t ui64Prefix, SetPart *pLow, SetPart *pHigh) {
+	Node *apPath[SET_DEPTH_MAX], *pNode = pWhole->pRoot, *pFound = NULL;
+	unsigned long aulHeight[SET_DEPTH_MAX], ulHeight = pWhole->ulHeight;
+	char acRight[SET_DEPTH_MAX];
+	SetPart side;
+	int iCmp, i = 0;
+	while(pNode != NULL) { /* path down to key with black height of each node */
+		if((iCmp = cmpKeyPrefix(pTree, pKey, ui64Prefix, pNode->pKey, pNode->ui64Prefix)) == 0) {
+			pFound = pNode;
+			break;
+		}
+		apPath[i] = pNode;
+		aulHeight[i] = ulHeight;
+		acRight[i++] = (iCmp > 0);
+		ulHeight -= (pNode->color == NODE_BLACK);
+		pNode = (iCmp > 0) ? pNode->pRight : pNode->pLeft;
+	}
+	pLow->pRoot = pHigh->pRoot = NULL;
+	pLow->ulHeight = pHigh->ulHeight = 0;
+	if(pFound != NULL) { /* its subtrees start both sides */
+		pLow->pRoot = pFound->pLeft;
+		pHigh->pRoot = pFound->pRight;
+		pLow->ulHeight = pHigh->ulHeight = ulHeight - (pFound->color == NODE_BLACK);
+		if(pLow->pRoot != NULL)
+			pLow->pRoot->pParent = NULL;
+		if(pHigh->pRoot != NULL)
+			pHigh->pRoot->pParent = NULL;
+	}
+	while(i > 0) { /* back up the path, each node joins its other subtree to the side it belongs to */
+		pNode = apPath[--i];
+		side.pRoot = acRight[i] ? pNode->pLeft : pNode->pRight;
+		side.ulHeight = aulHeight[i] - (pNode->color == NODE_BLACK);
+		if(acRight[i])
+			rbJoin(pTree, &side, pNode, pLow, pLow);
+		else
+			rbJoin(pTree, pHigh, pNode, &side, pHigh);
+	}
+return(pFound);
+}
+
+static size_t cacheBytes(Tree *pTree, Node *pNode) {
+	size_t sizeT = (pTree->iMode & TREE_POOL) ? POOL_NODE_SIZE : sizeof(Node);
+	if((pNode->sizeTkey > 0) && (pNode->pKey != (void*)KEY_INLINE(pTree, pNode)))
+		sizeT += pNode->sizeTkey + 1;
+	if((pNode->sizeTvalue > 0) && (pNode->pValue != NULL) && (pNode->pValue != (void*)VALUE_INLINE(pTree, pNode)))
+		sizeT += pNode->sizeTvalue + 1;
+return(sizeT);
+}
+
+static void cacheTouch(Tree *pTree, Node *pNode) {
+	if((pTree->pe == NULL) || !((Cache*)pTree->pe)->iLRU || (pNode == pTree->pt))
+		return;
+	resetList(pTree, pNode);
+	pNode->pNext = NULL;
+	pNode->pPrev = pTree->pt;
+	((Node*)pTree->pt)->pNext = pNode; /* list still holds others, node was not last */
+	pTree->pt = pNode;
+	pTree->iStale |= STALE_ARRAY;
+return;
+}
+
+static void cacheTrim(Tree *pTree, Node *pKeep) {
+	Cache *pCache = pTree->pe;
+	Node *pNode;
+	while((pCache != NULL)
+	&& (((pCache->ulMaxLen > 0) && (pTree->ulTreeLen > pCache->ulMaxLen)) || ((pCache->sizeTmax > 0) && (pCache->sizeTbytes > pCache->sizeTmax)))) {
+		if(((pNode = pTree->ph) != NULL) && (pNode == pKeep)) /* updated node may be oldest, it stays */
+			pNode = pKeep->pNext;
+		if((pNode == NULL) || !retireRoom(pTree)) /* TREE_CONCURRENT: each eviction retires */
+			break;
+		if(pCache->pfEvict != NULL)
+			pCache->pfEvict(pNode->pKey, pNode->pValue, pCache->pArg);
+		unlinkNode(pTree, pNode);
+	}
+return;
+}
+
+static uint64_t hashOf(Tree *pTree, const void *pKey) {
+	HashIndex *pIndex = pTree->px;
+return((pIndex->pfHash != NULL) ? (uint64_t)pIndex->pfHash(pKey) : hashKey(pTree, pKey));
+}
+
+static Node* hashFind(Tree *pTree, const void *pKey) {
+	HashIndex *pIndex = pTree->px;
+	uint64_t ui64Hash = hashOf(pTree, pKey);
+	unsigned long ul;
+	Node *pNode;
+	for(ul = (unsigned long)((ui64Hash * 0x9E3779B97F4A7C15ULL) >> pIndex->iShift); ; ul = (ul + 1) & pIndex->ulMask) {
+		if((pNode = pIndex->pSlots[ul].pNode) == NULL)
+			break;
+		if((pIndex->pSlots[ul].ui64Hash == ui64Hash) && (cmpKey(pTree, pNode->pKey, pKey) == 0))
+			return(pNode);
+	}
+	if(pIndex->pOld == NULL)
+		return(NULL);
+	for(ul = (unsigned long)((ui64Hash * 0x9E3779B97F4A7C15ULL) >> pIndex->iOldShift); ; ul = (ul + 1) & pIndex->ulOldMask) {
+		if((pNode = pIndex->pOld[ul].pNode) == NULL)
+			break;
+		if((pNode != HASH_GONE) && (pIndex->pOld[ul].ui64Hash == ui64Hash) && (cmpKey(pTree, pNode->pKey, pKey) == 0))
+			return(pNode);
+	}
+return(NULL);
+}
+
+static void hashAdd(Tree *pTree, Node *pNode) {
+	HashIndex *pIndex = pTree->px;
+	HashSlot *pSlots;
+	hashMove(pIndex, HASH_MOVE);
+	if((pIndex->ulUsed + pIndex->ulOldUsed + 1) * 2 > pIndex->ulMask + 1) { /* over half full, grow */
+		hashMove(pIndex, ULONG_MAX); /* still growing from last time, finish first */
+		if((pSlots = calloc(2 * (pIndex->ulMask + 1), sizeof(HashSlot))) != NULL) {
+			pIndex->pOld = pIndex->pSlots;
+			pIndex->ulOldMask = pIndex->ulMask;
+			pIndex->iOldShift = pIndex->iShift;
+			pIndex->ulOldUsed = pIndex->ulUsed;
+			pIndex->ulMoved = 0;
+			pIndex->pSlots = pSlots;
+			pIndex->ulMask = (2 * pIndex->ulMask) + 1;
+			pIndex->iShift--;
+			pIndex->ulUsed = 0;
+		} else if(pIndex->ulUsed + 1 > pIndex->ulMask) { /* a slot stays empty to end probes */
+			hashDrop(pTree);
+			return;
+		}
+	}
+	hashPut(pIndex->pSlots, pIndex->ulMask, pIndex->iShift, pNode, hashOf(pTree, pNode->pKey));
+	pIndex->ulUsed++;
+return;
+}
+
+static void hashRemove(Tree *pTree, Node *pNode) {
+	HashIndex *pIndex = pTree->px;
+	HashSlot *pSlots = pIndex->pSlots;
+	uint64_t ui64Hash = hashOf(pTree, pNode->pKey);
+	unsigned long ul, ulNext, ulHome;
+	for(ul = (unsigned long)((ui64Hash * 0x9E3779B97F4A7C15ULL) >> pIndex->iShift); pSlots[ul].pNode != NULL; ul = (ul + 1) & pIndex->ulMask) {
+		if(pSlots[ul].pNode != pNode)
+			continue;
+		for(ulNext = ul; ; ) { /* later slots of the run move back, no tombstones in the new table */
+			ulNext = (ulNext + 1) & pIndex->ulMask;
+			if(pSlots[ulNext].pNode == NULL)
+				break;
+			ulHome = (unsigned long)((pSlots[ulNext].ui64Hash * 0x9E3779B97F4A7C15ULL) >> pIndex->iShift);
+			if(((ulNext - ulHome) & pIndex->ulMask) >= ((ulNext - ul) & pIndex->ulMask)) { /* home at or before the hole */
+				pSlots[ul] = pSlots[ulNext];
+				ul = ulNext;
+			}
+		}
+		pSlots[ul].pNode = NULL;
+		pIndex->ulUsed--;
+		hashMove(pIndex, HASH_MOVE);
+		return;
+	}
+	if(pIndex->pOld != NULL) { /* old table keeps runs whole for the slots not moved yet */
+		for(ul = (unsigned long)((ui64Hash * 0x9E3779B97F4A7C15ULL) >> pIndex->iOldShift); pIndex->pOld[ul].pNode != NULL; ul = (ul + 1) & pIndex->ulOldMask) {
+			if(pIndex->pOld[ul].pNode == pNode) {
+				pIndex->pOld[ul].pNode = HASH_GONE;
+				pIndex->ulOldUsed--;
+				break;
+			}
+		}
+	}
+	hashMove(pIndex, HASH_MOVE);
+return;
+}
+
+static void hashPut(HashSlot *pSlots, unsigned long ulMask, int iShift, Node *pNode, uint64_t ui64Hash) {
+	unsigned long ul = (unsigned long)((ui64Hash * 0x9E3779B97F4A7C15ULL) >> iShift);
+	while(pSlots[ul].pNode != NULL)
+		ul = (ul + 1) & ulMask;
+	pSlots[ul].pNode = pNode;
+	pSlots[ul].ui64Hash = ui64Hash;
+return;
+}
+
+static void hashMove(HashIndex *pIndex, unsigned long ulSlots) {
+	HashSlot *pSlot;
+	for(; (pIndex->pOld != NULL) && (ulSlots > 0) && (pIndex->ulMoved <= pIndex->ulOldMask); ulSlots--) {
+		pSlot = &pIndex->pOld[pIndex->ulMoved++];
+		if((pSlot->pNode != NULL) && (pSlot->pNode != HASH_GONE)) {
+			hashPut(pIndex->pSlots, pIndex->ulMask, pIndex->iShift, pSlot->pNode, pSlot->ui64Hash);
+			pIndex->ulUsed++;
+			pIndex->ulOldUsed--;
+			pSlot->pNode = HASH_GONE;
+		}
+	}
+	if((pIndex->pOld != NULL) && (pIndex->ulMoved > pIndex->ulOldMask)) {
+		free(pIndex->pOld);
+		pIndex->pOld = NULL;
+	}
+return;
+}
+
+static void hashDrop(Tree *pTree) {
+	HashIndex *pIndex = pTree->px;
+	if(pIndex != NULL) {
+		free(pIndex->pOld);
+		free(pIndex->pSlots);
+		free(pIndex);
+		pTree->px = NULL;
+	}
+return;
 }
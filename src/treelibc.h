@@ -4,8 +4,8 @@
  Author      : David T. Silvers Sr.
  Contact     : davidtsilvers@aol.com
  Created     : 2014-02-03
- Updated     : 2014-02-27
- Version     : 1.101
+ Updated     : 2026-10-16
+ Version     : 4.00
  License     : GNU LGPL
  Description : Associative Balanced Tree Container with no recursive limits.
                Generic implementation requires user supplied compare function.
@@ -39,30 +39,251 @@
 extern "C" {
 #endif
 
+/* modes for treeInitMode(), may be combined with bitwise OR */
+#define TREE_POOL 0x01 /* carve nodes from slabs, small copied keys/values stored inline in node */
+#define TREE_BPLUS 0x02 /* B+tree of cache line aligned nodes, no insertion order, rank or select */
+#define TREE_CONCURRENT 0x04 /* red-black tree shared by threads, link with -pthread, not with TREE_BPLUS */
+#define TREE_MAPPED 0x08 /* set by treeLoad(), read only view of a file until treeFree(), writes fail */
+#define TREE_COMPACT 0x10 /* red-black nodes of 24 bytes in chunks, no insertion order, rank or select, alone only */
+#define TREE_SNAPSHOT 0x20 /* set by treeSnapshot(), read only view of a TREE_COMPACT tree until treeFree(), writes fail */
+#define TREE_PAGED 0x40 /* set by treeOpen(), keys and values in pages of a file behind a bounded buffer pool */
+
+/* built-in key kinds for treeInitKey(), compared inline without calling pfCmp */
+#define TREE_KEY_USER 0 /* user supplied compare function, set by treeInit() and treeInitMode() */
+#define TREE_KEY_INT64 1 /* int64_t */
+#define TREE_KEY_UINT64 2 /* uint64_t */
+#define TREE_KEY_DOUBLE 3 /* double, -0.0 equals 0.0, NaN sorts beyond infinity */
+#define TREE_KEY_STRING 4 /* NUL terminated string, strcmp() order */
+#define TREE_KEY_MEMCMP 5 /* fixed length bytes, memcmp() order */
+
+/* problems reported by treeVerify(), may be combined with bitwise OR */
+#define TREE_BAD_ORDER 0x01 /* keys out of order */
+#define TREE_BAD_LINK 0x02 /* parent and child disagree */
+#define TREE_BAD_RED 0x04 /* red node with red parent */
+#define TREE_BAD_BALANCE 0x08 /* black heights differ, or B+tree node under or over filled */
+#define TREE_BAD_COUNT 0x10 /* subtree sizes or length wrong */
+#define TREE_BAD_LIST 0x20 /* insertion list or leaf chain broken */
+#define TREE_BAD_INDEX 0x40 /* hash index misses a key or holds too many */
+
+/* orders walked by TreeCursor */
+#define TREE_SORTED 0 /* ascending order of user supplied compare function */
+#define TREE_INSERTED 1 /* order of insertion, same as treeArray() */
+
+/* calls counted by treeStats(), rows of TreeStats.aaullLatency */
+#define TREE_STATS_INSERT 0 /* treeInsert(), treeUpsert() and treeGetOrInsert() */
+#define TREE_STATS_LOOKUP 1 /* treeValue() */
+#define TREE_STATS_DELETE 2 /* treeDelete() */
+#define TREE_STATS_BUCKETS 32 /* latency bucket i counts calls of 2^i up to 2^(i + 1) nanoseconds, last one beyond */
+
+/* bytes reserved inline per node in TREE_POOL mode, copies of size below these are not malloced */
+#ifndef TREELIBC_POOL_KEY
+#define TREELIBC_POOL_KEY 16
+#endif
+#ifndef TREELIBC_POOL_VALUE
+#define TREELIBC_POOL_VALUE 16
+#endif
+
 /* user supplied comparison function for keys */
 typedef int (*PFCMP)(const void *, const void *); /* Returns: -1 = LT; 0 = EQ; 1 = GT */
 
+/* user supplied hash function for TreeShards, equal keys must hash equal */
+typedef unsigned long (*PFHASH)(const void *);
+
+/* user supplied callbacks for treeParallel*(), run on several threads at once */
+typedef void (*PFVISIT)(void *pKey, void *pValue, void *pArg);
+typedef void (*PFREDUCE)(void *pAcc, void *pKey, void *pValue, void *pArg); /* fold key into accumulator */
+typedef void (*PFJOIN)(void *pAcc, void *pNext, void *pArg); /* fold accumulator of following keys into pAcc */
+
+/* user supplied callback for treeCacheLimit(), key and value of an evicted node before it goes */
+typedef void (*PFEVICT)(void *pKey, void *pValue, void *pArg);
+
 typedef struct tree { /* convenience structure to allow for multiple trees in process */
-	PFCMP pfCmp; /* points to user supplied comparison function. */
+	PFCMP pfCmp; /* points to user supplied comparison function. built-in for key kinds, NULL for TREE_KEY_MEMCMP */
 	unsigned long ulTreeLen; /* returned by treeLength() */
 	void **ppArray; /* returned by treeArray() */
 	void **ppArraySorted; /* returned by treeArraySorted() */
 	void *pr; /* internal use only */
 	void *ph; /* internal use only */
 	void *pt; /* internal use only */
+	int iMode; /* mode given to treeInitMode() */
+	int iStale; /* internal use only */
+	void *pp; /* internal use only */
+	int iKey; /* key kind given to treeInitKey() */
+	size_t sizeTcmp; /* internal use only */
+	void *pc; /* internal use only */
+	void *ps; /* internal use only */
+	void *pe; /* internal use only */
+	void *px; /* internal use only */
 } Tree;
 
+typedef struct treeCursor { /* position in a tree, allocates nothing. invalid once its key is deleted */
+	Tree *pTree; /* tree walked by cursor */
+	int iOrder; /* TREE_SORTED or TREE_INSERTED */
+	void *pn; /* internal use only */
+	void *pb; /* internal use only */
+	void *pe; /* internal use only */
+	int iIndex; /* internal use only */
+} TreeCursor;
+
+typedef struct treeShards { /* TREE_CONCURRENT trees split by key hash, writers to different shards run in parallel */
+	Tree *pTrees; /* ulShards trees */
+	unsigned long ulShards;
+	PFHASH pfHash; /* NULL = built-in hash of key kind */
+} TreeShards;
+
+typedef struct treeStats { /* filled by treeStats() */
+	unsigned long ulLength; /* keys */
+	unsigned long ulNodes; /* red-black nodes, or B+tree leaves and inner nodes */
+	unsigned long ulHeight; /* nodes on longest path from root, 0 = empty or TREE_MAPPED */
+	double dDepthAvg; /* mean nodes from root to a key, root = 1 */
+	size_t sizeTnodes; /* bytes of nodes, TREE_POOL inline copies included */
+	size_t sizeTkeys; /* bytes of key copies held outside nodes */
+	size_t sizeTvalues; /* bytes of value copies held outside nodes */
+	/* counted only when treelibc.c is built with TREELIBC_STATS, from first call after treeInit*() or treeFree() */
+	unsigned long long ullCompares; /* key compares, pfCmp calls for TREE_KEY_USER */
+	unsigned long long ullRotations; /* red-black rotations */
+	unsigned long long ullAllocs; /* mallocs of nodes, pool slabs and copies */
+	unsigned long long aullCalls[3]; /* calls per TREE_STATS_* */
+	unsigned long long aaullLatency[3][TREE_STATS_BUCKETS]; /* TREELIBC_STATS=2 only, calls per TREE_STATS_* by latency */
+} TreeStats;
+
 /* Global function declarations for external usage. CRUD: Create, Read, Update and Delete */
 Tree* treeInit(Tree *pTree, PFCMP pfCmp); /* Return: NULL = fail */
+Tree* treeInitMode(Tree *pTree, PFCMP pfCmp, int iMode); /* same as treeInit() with TREE_* modes. Return: NULL = fail */
+Tree* treeInitKey(Tree *pTree, int iKey, size_t sizeTkey, int iMode); /* built-in TREE_KEY_* compare, sizeTkey only for TREE_KEY_MEMCMP. Return: NULL = fail */
 int treeInsert(Tree *pTree, void *pKey, size_t sizeTkey, void *pValue, size_t sizeTvalue); /* Return: 0 = fail; 1 = insert */
+int treeBuildSorted( /* fill empty tree from unique ascending keys without compares, sizes as treeInsert(), NULL sizes = 0 */
+	Tree *pTree, void **ppKeys, const size_t *pSizeTkeys, void **ppValues, const size_t *pSizeTvalues,
+	unsigned long ulLen, const unsigned long *pulOrder /* sorted index of each insertion, NULL = sorted */
+); /* Return: 0 = fail; 1 = built */
 unsigned long treeLength(Tree *pTree); /* Return number of unique inserted keys for length of arrays */
-void** const treeArray(Tree *pTree); /* get array of keys in order of insertion. Return: NULL = fail */
-void** const treeArraySorted(Tree *pTree); /* get array of sorted keys. Return: NULL = fail */
+void** const treeArray(Tree *pTree); /* get array of keys in order of insertion, reused until tree changes. Return: NULL = fail, TREE_BPLUS or TREE_COMPACT */
+void** const treeArraySorted(Tree *pTree); /* get array of sorted keys, reused until tree changes. Return: NULL = fail */
 void* treeValue(Tree *pTree, const void *pKey); /* get value from given key. Return: NULL = fail */
+unsigned long treeValueBatch(Tree *pTree, void **ppKeys, unsigned long ulLen, void **ppValues); /* treeValue() of each key into ppValues. Return: values found */
 int treeUpdate(Tree *pTree, const void *pKey, void *pValue, size_t sizeTvalue); /* Return: 0 = fail; 1 = update */
-int treeDelete(Tree *pTree, const void *pKey); /* delete key. Return: 0 = fail; 1 = deleted */
+int treeDelete(Tree *pTree, const void *pKey); /* delete key, copies of other keys and values stay where they are. Return: 0 = fail; 1 = deleted */
 void treeFree(Tree *pTree); /* free internally allocated memory for given tree */
 
+/* Single descent insert or find. Slot holds the value pointer until the tree changes, *piInserted may be NULL.
+   Write through the slot only for address assigned values, copies are changed through *slot. Return: NULL = fail */
+void** treeUpsert(Tree *pTree, void *pKey, size_t sizeTkey, void *pValue, size_t sizeTvalue, int *piInserted); /* insert or update value */
+void** treeGetOrInsert(Tree *pTree, void *pKey, size_t sizeTkey, void *pValue, size_t sizeTvalue, int *piInserted); /* insert or keep value */
+
+/* Batches resolve many keys in one call. Red-black descents of unsorted keys run side by side so their cache misses
+   overlap, ascending keys resume from the path of the key before. treeInsertBatch() inserts in array order, sizes as
+   treeBuildSorted(). TREE_BPLUS, TREE_COMPACT, TREE_CONCURRENT, TREE_MAPPED, TREE_PAGED and hash indexed trees take one
+   key at a time */
+unsigned long treeInsertBatch( /* Return: keys inserted */
+	Tree *pTree, void **ppKeys, const size_t *pSizeTkeys, void **ppValues, const size_t *pSizeTvalues, unsigned long ulLen
+);
+
+/* Cursor functions yield key and value together, ppKey or ppValue may be NULL when not wanted. TREE_BPLUS, TREE_COMPACT
+   and TREE_PAGED walk TREE_SORTED only, a TREE_COMPACT cursor finds each next key from root */
+int treeCursorFirst(Tree *pTree, TreeCursor *pCursor, int iOrder, void **ppKey, void **ppValue); /* Return: 0 = empty; 1 = found */
+int treeCursorLast(Tree *pTree, TreeCursor *pCursor, int iOrder, void **ppKey, void **ppValue); /* Return: 0 = empty; 1 = found */
+int treeCursorSeek(Tree *pTree, TreeCursor *pCursor, const void *pKey, void **ppKey, void **ppValue); /* sorted, at key or next greater. Return: 0 = none; 1 = found */
+int treeCursorNext(TreeCursor *pCursor, void **ppKey, void **ppValue); /* Return: 0 = end; 1 = found */
+int treeCursorPrev(TreeCursor *pCursor, void **ppKey, void **ppValue); /* Return: 0 = end; 1 = found */
+
+/* Ordered queries position a sorted cursor. Return: 0 = none; 1 = found. Select, rank and counts return 0 for TREE_BPLUS,
+   TREE_COMPACT and TREE_PAGED */
+int treeLowerBound(Tree *pTree, TreeCursor *pCursor, const void *pKey, void **ppKey, void **ppValue); /* first key >= pKey */
+int treeUpperBound(Tree *pTree, TreeCursor *pCursor, const void *pKey, void **ppKey, void **ppValue); /* first key > pKey */
+int treeFloor(Tree *pTree, TreeCursor *pCursor, const void *pKey, void **ppKey, void **ppValue); /* last key <= pKey */
+int treeCeiling(Tree *pTree, TreeCursor *pCursor, const void *pKey, void **ppKey, void **ppValue); /* first key >= pKey */
+int treeRange(Tree *pTree, TreeCursor *pCursor, const void *pLow, const void *pHigh, void **ppKey, void **ppValue); /* cursor stays within pLow <= key <= pHigh */
+int treeSelect(Tree *pTree, TreeCursor *pCursor, unsigned long ulIndex, void **ppKey, void **ppValue); /* key at 0 based sorted index */
+unsigned long treeRank(Tree *pTree, const void *pKey); /* Return number of keys less than pKey */
+unsigned long treeRangeCount(Tree *pTree, const void *pLow, const void *pHigh); /* Return number of keys within pLow <= key <= pHigh */
+
+/* TREE_COMPACT: nodes hold two 32 bit child indexes with color and copy flags in their low bits, a key word and a value
+   word, at most 2^30 - 1 keys. Keys of built-in number kinds and TREE_KEY_MEMCMP of up to 8 bytes are always held in
+   the node, value copies of up to 7 bytes too with NUL after as other copies. Node chunks never move, keys and values
+   returned stay put until their key is deleted, or while snapshots are held until the next write copies their node.
+   Slots hold a pointer, a value held in the node moves out to a copy first */
+/* Snapshots share all nodes of a TREE_COMPACT tree when taken, later writes of the tree copy the nodes they change and
+   the path above them. Any number of threads read snapshots without locks while one writes the tree. treeSnapshot()
+   takes turns with writes of the tree, treeFree() of a snapshot may come from any thread, the tree may go first.
+   The first snapshot of a tree adds a reference count per node. A snapshot of a snapshot fails.
+   Limitation: only TREE_COMPACT trees take snapshots. Nodes of every other mode hold a parent link, insertion order
+   links and a subtree size, which one node cannot hold for two trees, so treeSnapshot() of them returns NULL */
+Tree* treeSnapshot(Tree *pTree, Tree *pSnap); /* read only copy of tree in pSnap, treeFree() releases it. Return: NULL = fail */
+/* TREE_CONCURRENT: any number of threads read and write one tree, writers take turns and readers never block them.
+   Keys, values, slots and cursors returned stay valid only between treeReadBegin() and treeReadEnd() of the calling
+   thread, address assigned keys and values must outlive them too. Cursors walk TREE_SORTED, one key at a time from root.
+   treeArray(), treeArraySorted(), treeBuildSorted() and treeFree() need the tree to themselves */
+void treeReadBegin(Tree *pTree); /* pin memory read from tree, may nest. no effect without TREE_CONCURRENT */
+void treeReadEnd(Tree *pTree); /* unpin, retired memory freed by a later writer */
+int treeVerify(Tree *pTree); /* check tree invariants. Return: 0 = valid; else TREE_BAD_* */
+TreeStats* treeStats(Tree *pTree, TreeStats *pStats); /* shape and bytes walked now, counters if built with TREELIBC_STATS. Return: NULL = fail */
+void treeStatsReset(Tree *pTree); /* zero counters */
+TreeShards* treeShardsInit( /* ulShards trees by treeInitMode() or treeInitKey(), TREE_CONCURRENT added */
+	TreeShards *pShards, unsigned long ulShards, PFHASH pfHash, PFCMP pfCmp, int iKey, size_t sizeTkey, int iMode
+); /* TREE_KEY_USER needs pfHash. Return: NULL = fail */
+Tree* treeShard(TreeShards *pShards, const void *pKey); /* tree for key, use with any tree function. Return: NULL = fail */
+unsigned long treeShardsLength(TreeShards *pShards); /* Return sum of treeLength() of shards */
+void treeShardsFree(TreeShards *pShards); /* treeFree() every shard and release them */
+
+/* Hash index maps keys straight to nodes, treeValue(), treeUpdate(), treeDelete() and inserts of a present key skip
+   the descent. Equal keys must hash equal, pfHash NULL = built-in hash of key kind. Inserts and deletes keep it in step,
+   growing moves a few slots per write rather than all at once. Without memory to grow it is dropped, lookups descend
+   again. treeFree() drops it. Red-black trees only, not TREE_CONCURRENT or TREE_COMPACT */
+int treeHashIndex(Tree *pTree, int iIndex, PFHASH pfHash); /* iIndex 1 = build, 0 = drop. TREE_KEY_USER needs pfHash. Return: 0 = fail */
+
+/* Bounded cache: inserts past ulMaxLen keys or sizeTmaxBytes bytes evict from the head of insertion order, bytes as
+   treeStats() sizes count them. iLRU moves keys found by treeValue(), treeValueBatch(), treeUpdate() and inserts of a key
+   present to the tail, so lookups change the tree. pfEvict, may be NULL, sees each evicted key and value before it goes
+   and must not change the tree. Limits of 0 are none, both 0 ends the cache. Trims at once, treeFree() drops it.
+   Red-black trees with insertion order only, TREE_CONCURRENT without iLRU: pinned readers may still hold evicted values */
+int treeCacheLimit( /* Return: 0 = fail */
+	Tree *pTree, unsigned long ulMaxLen, size_t sizeTmaxBytes, int iLRU, PFEVICT pfEvict, void *pArg
+);
+
+/* Whole tree work split into pieces in key order, worker threads steal pieces from each other. iThreads 0 = one per
+   core, 1 = calling thread only, built without threads the calling thread does it all. Callbacks must not change the
+   tree, their order across pieces is not defined. Each piece of treeParallelReduce() starts from a copy of pAcc as
+   identity, pieces then join into pAcc in key order. Parallel functions need the tree to themselves. TREE_POOL,
+   TREE_BPLUS and TREE_COMPACT build and TREE_BPLUS and TREE_COMPACT sorted array fall back to the single thread functions */
+int treeParallelForEach(Tree *pTree, int iThreads, PFVISIT pfVisit, void *pArg); /* Return: 0 = fail */
+int treeParallelReduce( /* Return: 0 = fail */
+	Tree *pTree, int iThreads, void *pAcc, size_t sizeTacc, PFREDUCE pfReduce, PFJOIN pfJoin, void *pArg
+);
+void** const treeParallelArraySorted(Tree *pTree, int iThreads); /* treeArraySorted(). Return: NULL = fail */
+int treeParallelBuildSorted( /* treeBuildSorted() */
+	Tree *pTree, int iThreads, void **ppKeys, const size_t *pSizeTkeys, void **ppValues, const size_t *pSizeTvalues,
+	unsigned long ulLen, const unsigned long *pulOrder
+);
+void treeParallelFree(Tree *pTree, int iThreads); /* treeFree() */
+
+/* Join, split and set operations relink the nodes of two red-black trees of one key order, keys and values are not
+   copied and each node keeps its own copies or assigned addresses. Insertion order of tree comes first, nodes taken
+   from other follow in their order, other is left empty. Not TREE_POOL, TREE_BPLUS, TREE_CONCURRENT, TREE_COMPACT
+   or TREE_MAPPED, nor trees with a hash index or bounded cache. treeJoin() and the tree part of treeSplit() take
+   O(log n), treeSplit() then passes once over insertion order. Set operations take O(m log(n / m + 1)) for m keys of
+   the smaller tree, plus freeing nodes dropped, iThreads as treeParallelForEach() */
+int treeJoin(Tree *pTree, Tree *pOther); /* keys of other, all above or all below those of tree, into tree. Return: 0 = fail */
+int treeSplit(Tree *pTree, const void *pKey, Tree *pOther); /* keys >= pKey into pOther, initialized as tree. Return: 0 = fail */
+int treeUnion(Tree *pTree, Tree *pOther, int iThreads); /* keys of either, tree's node kept where both hold a key. Return: 0 = fail */
+int treeIntersect(Tree *pTree, Tree *pOther, int iThreads); /* keys of both, tree's node kept. Return: 0 = fail */
+int treeDifference(Tree *pTree, Tree *pOther, int iThreads); /* keys of tree not in other. Return: 0 = fail */
+
+/* Snapshot of copied keys and values with sorted and insertion orders, native byte order. Address assigned keys
+   save for built-in key kinds, address assigned values only when NULL. Loaded trees read keys and values in place */
+int treeSave(Tree *pTree, const char *pcFile); /* Return: 0 = fail; 1 = saved */
+Tree* treeLoad(Tree *pTree, const char *pcFile, PFCMP pfCmp); /* map file as TREE_MAPPED tree, pfCmp only for TREE_KEY_USER. Return: NULL = fail or file corrupt */
+
+/* TREE_PAGED: B+tree of TREELIBC_PAGE_SIZE pages, 4096 unless treelibc.c is built with another, kept in a file larger
+   than memory. Pages come in through sizeTmemory bytes of frames, at least 64, least recently used page written back
+   and reused first. Keys and values are copied in, address assigned keys only for built-in kinds, values only NULL.
+   TREE_KEY_USER keys need their size to insert. Key and value together fit about a quarter page, 1016 bytes for 4096.
+   Keys and values returned stay valid until the next call on the tree, cursors until the next write. No journal,
+   a crash between syncs may leave the file torn. treeFree() writes back too, failures show only through treeSync().
+   Rank, select, range counts, treeArray(), treeArraySorted(), treeValueBatch(), slots, treeBuildSorted(), hash index,
+   cache limit, join, split and sets fail. Parallel functions run on the calling thread, treeStats() counts pages */
+Tree* treeOpen(Tree *pTree, const char *pcFile, size_t sizeTmemory); /* empty tree from treeInitKey() or treeInit() onto file, made if new. Return: NULL = fail */
+int treeSync(Tree *pTree); /* pages changed and head to file, synced. Return: 0 = fail */
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,158 @@
+/*
+ =============================================================================
+ Name        : treelibc.hpp
+ Author      : David T. Silvers Sr.
+ Contact     : davidtsilvers@aol.com
+ Created     : 2026-10-16
+ Updated     : 2026-10-16
+ Version     : 2.20
+ License     : GNU LGPL
+ Description : Header only C++ front end for treelibc.
+               Tree<K, V, Compare> owns a C Tree holding copies of keys and
+               values. Integer keys of 8 bytes, double, std::string and
+               const char* with the default std::less use the built-in key
+               kinds, compared inline by treelibc. Any other key or Compare
+               is called through one generated function per Tree type.
+               Values are copied bytewise and must be trivially copyable.
+
+ Copyright   : Copyright 2014 by David T. Silvers Sr.
+
+	This file is part of treelibc.
+
+    treelibc is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    treelibc is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with treelibc. If not, see <http://www.gnu.org/licenses/>.
+  =============================================================================
+ */
+#ifndef _TREELIBC_HPP_
+#define	_TREELIBC_HPP_
+#include <cstring>
+#include <functional>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include "treelibc.h"
+
+namespace treelibc {
+
+template<class K, class Enable = void> struct KeyTraits { /* trivially copyable key stored as its bytes */
+	static_assert(std::is_trivially_copyable<K>::value, "key must be trivially copyable or have KeyTraits");
+	enum { kind = std::is_floating_point<K>::value && (sizeof(K) == 8) ? TREE_KEY_DOUBLE : TREE_KEY_USER };
+	typedef const K &ref; /* what iterators yield */
+	static const void* data(const K &key) { return(&key); }
+	static size_t size(const K &) { return(sizeof(K)); }
+	static ref load(const void *p) { return(*static_cast<const K*>(p)); }
+};
+
+template<class K> struct KeyTraits<K, typename std::enable_if<std::is_integral<K>::value && (sizeof(K) == 8)>::type> {
+	enum { kind = std::is_signed<K>::value ? TREE_KEY_INT64 : TREE_KEY_UINT64 };
+	typedef const K &ref;
+	static const void* data(const K &key) { return(&key); }
+	static size_t size(const K &) { return(sizeof(K)); }
+	static ref load(const void *p) { return(*static_cast<const K*>(p)); }
+};
+
+template<> struct KeyTraits<std::string> { /* stored NUL terminated, iterators yield const char* */
+	enum { kind = TREE_KEY_STRING };
+	typedef const char *ref;
+	static const void* data(const std::string &key) { return(key.c_str()); }
+	static size_t size(const std::string &key) { return(key.length() + 1); } /* never 0, always a copy */
+	static ref load(const void *p) { return(static_cast<const char*>(p)); }
+};
+
+template<> struct KeyTraits<const char*> { /* string copied into tree */
+	enum { kind = TREE_KEY_STRING };
+	typedef const char *ref;
+	static const void* data(const char *key) { return(key); }
+	static size_t size(const char *key) { return(std::strlen(key) + 1); }
+	static ref load(const void *p) { return(static_cast<const char*>(p)); }
+};
+
+template<class K, class V, class Compare = std::less<K> >
+class Tree {
+	static_assert(std::is_trivially_copyable<V>::value, "value must be trivially copyable");
+	typedef KeyTraits<K> Traits;
+	enum { kind = std::is_same<Compare, std::less<K> >::value ? (int)Traits::kind : (int)TREE_KEY_USER };
+public:
+	typedef typename Traits::ref key_ref;
+
+	class iterator { /* TreeCursor in sorted order, same validity rules */
+	public:
+		iterator() : m_bFound(false), m_pKey(NULL), m_pValue(NULL) {}
+		key_ref key() const { return(Traits::load(m_pKey)); }
+		V& value() const { return(*static_cast<V*>(m_pValue)); }
+		iterator& operator++() { m_bFound = treeCursorNext(&m_cursor, &m_pKey, &m_pValue) != 0; return(*this); }
+		iterator& operator--() { m_bFound = treeCursorPrev(&m_cursor, &m_pKey, &m_pValue) != 0; return(*this); }
+		bool operator==(const iterator &it) const { return((m_bFound == it.m_bFound) && (!m_bFound || (m_pKey == it.m_pKey))); }
+		bool operator!=(const iterator &it) const { return(!(*this == it)); }
+	private:
+		friend class Tree;
+		TreeCursor m_cursor;
+		bool m_bFound;
+		void *m_pKey, *m_pValue;
+	};
+
+	explicit Tree(int iMode = 0) { /* TREE_* modes, throws std::bad_alloc when refused */
+		if(((kind == TREE_KEY_USER) ? treeInitMode(&m_tree, compare, iMode) : treeInitKey(&m_tree, kind, 0, iMode)) == NULL)
+			throw std::bad_alloc();
+	}
+	~Tree() { treeFree(&m_tree); }
+	Tree(const Tree &) = delete;
+	Tree& operator=(const Tree &) = delete;
+
+	size_t size() const { return(m_tree.ulTreeLen); }
+	bool empty() const { return(m_tree.ulTreeLen == 0); }
+	void clear() { treeFree(&m_tree); }
+	::Tree* c_tree() { return(&m_tree); } /* for C functions not wrapped here */
+
+	bool insert(const K &key, const V &value) { /* false when key exists */
+		return(treeInsert(&m_tree, const_cast<void*>(Traits::data(key)), Traits::size(key), const_cast<V*>(&value), sizeof(V)) != 0);
+	}
+	std::pair<V*, bool> insert_or_assign(const K &key, const V &value) { /* one descent, second is true when inserted */
+		int iInserted;
+		void **ppSlot = treeUpsert(
+			&m_tree, const_cast<void*>(Traits::data(key)), Traits::size(key), const_cast<V*>(&value), sizeof(V), &iInserted
+		);
+		if(ppSlot == NULL)
+			throw std::bad_alloc();
+		return(std::pair<V*, bool>(static_cast<V*>(*ppSlot), iInserted != 0));
+	}
+	V& operator[](const K &key) { /* one descent, inserts V() when missing */
+		V value = V();
+		void **ppSlot = treeGetOrInsert(
+			&m_tree, const_cast<void*>(Traits::data(key)), Traits::size(key), &value, sizeof(V), NULL
+		);
+		if(ppSlot == NULL)
+			throw std::bad_alloc();
+		return(*static_cast<V*>(*ppSlot));
+	}
+	V* find(const K &key) { return(static_cast<V*>(treeValue(&m_tree, Traits::data(key)))); } /* NULL = not found */
+	bool erase(const K &key) { return(treeDelete(&m_tree, Traits::data(key)) != 0); }
+
+	iterator begin() { iterator it; it.m_bFound = treeCursorFirst(&m_tree, &it.m_cursor, TREE_SORTED, &it.m_pKey, &it.m_pValue) != 0; return(it); }
+	iterator end() { return(iterator()); }
+	iterator lower_bound(const K &key) { iterator it; it.m_bFound = treeLowerBound(&m_tree, &it.m_cursor, Traits::data(key), &it.m_pKey, &it.m_pValue) != 0; return(it); }
+	iterator upper_bound(const K &key) { iterator it; it.m_bFound = treeUpperBound(&m_tree, &it.m_cursor, Traits::data(key), &it.m_pKey, &it.m_pValue) != 0; return(it); }
+
+private:
+	static int compare(const void *pKeyOld, const void *pKeyNew) { /* Compare as PFCMP, one per Tree type */
+		Compare cmp;
+		const K keyOld(Traits::load(pKeyOld)), keyNew(Traits::load(pKeyNew));
+		return(cmp(keyOld, keyNew) ? -1 : (cmp(keyNew, keyOld) ? 1 : 0));
+	}
+
+	::Tree m_tree;
+};
+
+} /* namespace treelibc */
+#endif